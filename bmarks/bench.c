@@ -0,0 +1,709 @@
+/*
+ *   File: bench.c
+ *   Description:
+ *   clht_bench, the benchmark driver of CLHT: one binary per variant (make
+ *   bench), any workload of bench_workloads.c (-W). VM 0 creates the table
+ *   and preloads it. The threads then run until the throughput is steady,
+ *   i.e., the coefficient of variation of the last BENCH_STEADY_WINDOWS
+ *   windows of BENCH_WINDOW_MS is at most -s percent, or for at most -x
+ *   ms. Then -r runs of -d ms are measured back to back: the throughput,
+ *   and the p50/p99/p99.9 latency of every operation outcome (-L). The
+ *   report gives the mean and the 95% confidence interval of each metric,
+ *   and -o writes all runs as JSON.
+ *
+ *   -c compares the runs with those of a baseline file (Welch's t-test):
+ *   a metric regressed if it got worse by more than -T percent, and the
+ *   difference is significant at 95%. Latencies must also have moved by
+ *   more than one histogram bucket (clht_hist.h). The exit code is 2 if
+ *   any metric regressed. -C compares two files without running.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <malloc.h>
+
+#include "clht_bench.h"
+
+#define BENCH_WINDOW_MS      100
+#define BENCH_STEADY_WINDOWS 10
+#define BENCH_MAX_RUNS       64
+#define BENCH_NUM_PCTS       3
+/* relative width of a histogram bucket, in percent */
+#define BENCH_LAT_RESOLUTION 12.5
+
+static const double bench_pcts[BENCH_NUM_PCTS] = { 50, 99, 99.9 };
+static const char * bench_pct_names[BENCH_NUM_PCTS] = { "p50", "p99", "p999" };
+static const char * bench_dist_names[] = { "uniform", "zipfian", "latest", "hotspot" };
+
+typedef struct bench_series {
+    int n;
+    double v[BENCH_MAX_RUNS];
+} bench_series_t;
+
+typedef struct bench_result {
+    bench_series_t tput;                             // ops/s
+    bench_series_t lat[LAT_NUM_OPS][BENCH_NUM_PCTS]; // ns
+} bench_result_t;
+
+// Default mix is 30% puts / 69% gets / 1% removes over uniform keys, as
+// for randuration; -u splits the update percentage between puts and removes
+static bench_params_t params = {
+    .num_keys = 1 << 20,
+    .num_threads = 1,
+    .num_vms = 1,
+    .ycsb = {
+        .mix = { [YCSB_READ] = 69, [YCSB_INSERT] = 30, [YCSB_REMOVE] = 1 },
+        .dist = YCSB_UNIFORM,
+    },
+};
+
+static const bench_workload_t * workload;
+static bench_thread_t * threads;
+static pthread_barrier_t barrier;
+static int start_run, stop_run;
+static int setup;
+
+void usage() {
+    puts("Usage: ./clht_bench_VARIANT -W WORKLOAD[:ARG] (-W list) -t [NUM_THREADS] -k [NUM_KEYS] -l [PRELOAD_PERC of the keys]\n"
+         "             -b [NUM_BUCKETS] -w [YCSB_PRESET A-F] -m [READ:UPDATE:INSERT:REMOVE:SCAN:RMW] -u [UPDATE_PERC]\n"
+         "             -z [uniform|zipfian|latest|hotspot] -a [ZIPF_THETA] -d [RUN_MS] -r [RUNS] -x [MAX_WARMUP_MS]\n"
+         "             -s [STEADY_CV_PERC] -L [LATENCY_SAMPLE_PERIOD, 0 for none] -o [JSON_OUT] -n [LABEL]\n"
+         "             -c [BASELINE_JSON] -C [CURRENT_JSON, compares without running] -T [REGRESSION_PERC]\n"
+         "             -i [NODE_ID] -v [NUM_VMS]");
+}
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t bench_ops() {
+    uint64_t ops = 0;
+    int i;
+    for(i = 0; i < params.num_threads; i++)
+        ops += __atomic_load_n(&threads[i].ops, __ATOMIC_RELAXED);
+    return ops;
+}
+
+// ops/s over the next ms milliseconds
+static double bench_window(uint64_t ms) {
+    double s = now_s();
+    uint64_t o = bench_ops();
+    usleep(ms * 1000);
+    return (bench_ops() - o) / (now_s() - s);
+}
+
+static void bench_lat_snapshot(clht_lat_t * cur) {
+    int i;
+    memset(cur, 0, sizeof(*cur));
+    for(i = 0; i < params.num_threads; i++)
+        clht_lat_merge(cur, threads[i].lat);
+}
+
+static void * bench_worker(void * arg) {
+    bench_thread_t * t = (bench_thread_t *) arg;
+
+    ycsb_gen_init(&t->gen, &params.ycsb);
+    clht_gc_thread_init(t->ht, t->id);
+
+    if(workload->thread_init != NULL)
+        workload->thread_init(t, &params);
+
+    // Only the VM that created the table loads it, every thread a slice
+    if(setup)
+        workload->load(t, &params);
+
+    pthread_barrier_wait(&barrier);
+
+    while(!__atomic_load_n(&start_run, __ATOMIC_ACQUIRE))
+        _mm_pause();
+
+    while(!__atomic_load_n(&stop_run, __ATOMIC_RELAXED)) {
+        workload->op(t, &params);
+        __atomic_store_n(&t->ops, t->ops + 1, __ATOMIC_RELAXED);
+    }
+
+    if(workload->thread_term != NULL)
+        workload->thread_term(t, &params);
+
+    free(t->gen.seeds);
+    return NULL;
+}
+
+/* statistics */
+
+static double series_mean(const bench_series_t * s) {
+    double sum = 0;
+    int i;
+    for(i = 0; i < s->n; i++)
+        sum += s->v[i];
+    return s->n > 0 ? sum / s->n : 0;
+}
+
+// sample standard deviation
+static double series_sd(const bench_series_t * s) {
+    double m = series_mean(s), sum = 0;
+    int i;
+    if(s->n < 2)
+        return 0;
+    for(i = 0; i < s->n; i++)
+        sum += (s->v[i] - m) * (s->v[i] - m);
+    return sqrt(sum / (s->n - 1));
+}
+
+// two-sided 95% quantile of Student's t with df degrees of freedom
+static double t95(int df) {
+    static const double t[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if(df < 1)
+        df = 1;
+    return df <= 30 ? t[df - 1] : 1.96;
+}
+
+// half width of the 95% confidence interval of the mean
+static double series_ci95(const bench_series_t * s) {
+    return s->n < 2 ? 0 : t95(s->n - 1) * series_sd(s) / sqrt(s->n);
+}
+
+static double cv_perc(const double * v, int n) {
+    bench_series_t s;
+    s.n = n;
+    memcpy(s.v, v, n * sizeof(double));
+    double m = series_mean(&s);
+    return m > 0 ? 100 * series_sd(&s) / m : 100;
+}
+
+static void series_push(bench_series_t * s, double v) {
+    if(s->n < BENCH_MAX_RUNS)
+        s->v[s->n++] = v;
+}
+
+/* JSON */
+
+static void json_str(FILE * f, const char * str) {
+    fputc('"', f);
+    for(; str != NULL && *str; str++) {
+        if(*str == '"' || *str == '\\')
+            fputc('\\', f);
+        if((unsigned char) *str >= 0x20)
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+static void json_series(FILE * f, const char * indent, const char * name, const bench_series_t * s, const char * sep) {
+    int i;
+    fprintf(f, "%s\"%s\": { \"runs\": [", indent, name);
+    for(i = 0; i < s->n; i++)
+        fprintf(f, "%s%.1f", i ? ", " : "", s->v[i]);
+    fprintf(f, "], \"mean\": %.1f, \"stddev\": %.1f, \"ci95\": %.1f }%s\n",
+            series_mean(s), series_sd(s), series_ci95(s), sep);
+}
+
+static void bench_write_json(FILE * f, const bench_result_t * r, const char * label, uint64_t num_buckets,
+                             uint64_t run_ms, uint32_t lat_period, double warmup_ms, int steady,
+                             double warmup_cv, uint64_t errors) {
+    char host[256] = "";
+    char date[32];
+    time_t now = time(NULL);
+    int o, p, i;
+
+    gethostname(host, sizeof(host) - 1);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    fprintf(f, "{\n  \"bench\": \"clht_bench\",\n  \"variant\": ");
+    json_str(f, clht_type_desc());
+    fprintf(f, ",\n  \"workload\": ");
+    json_str(f, workload->name);
+    fprintf(f, ",\n  \"label\": ");
+    json_str(f, label);
+    fprintf(f, ",\n  \"host\": ");
+    json_str(f, host);
+    fprintf(f, ",\n  \"date\": \"%s\",\n", date);
+
+    fprintf(f, "  \"params\": { \"threads\": %d, \"vm_id\": %d, \"num_vms\": %d, \"keys\": %lu, \"preload\": %lu, "
+            "\"buckets\": %lu,\n              \"mix\": {",
+            params.num_threads, params.vm_id, params.num_vms, params.num_keys, params.num_preload, num_buckets);
+    for(i = 0; i < YCSB_NUM_OPS; i++)
+        fprintf(f, "%s\"%s\": %u", i ? ", " : " ", ycsb_op_names[i], params.ycsb.mix[i]);
+    fprintf(f, " }, \"dist\": \"%s\", \"theta\": %.3f, \"arg\": ",
+            bench_dist_names[params.ycsb.dist], params.ycsb.theta);
+    if(params.arg != NULL)
+        json_str(f, params.arg);
+    else
+        fputs("null", f);
+    fprintf(f, ", \"run_ms\": %lu, \"lat_sample\": %u },\n", run_ms, lat_period);
+
+    fprintf(f, "  \"warmup\": { \"ms\": %.0f, \"steady\": %s, \"cv\": %.2f },\n",
+            warmup_ms, steady ? "true" : "false", warmup_cv);
+    fprintf(f, "  \"errors\": %lu,\n", errors);
+    json_series(f, "  ", "throughput", &r->tput, ",");
+
+    fprintf(f, "  \"latency_ns\": {");
+    const char * sep = "\n";
+    for(o = 0; o < LAT_NUM_OPS; o++) {
+        if(r->lat[o][0].n == 0)
+            continue;
+        fprintf(f, "%s    \"%s\": {\n", sep, clht_lat_op_names[o]);
+        for(p = 0; p < BENCH_NUM_PCTS; p++)
+            json_series(f, "      ", bench_pct_names[p], &r->lat[o][p], p + 1 < BENCH_NUM_PCTS ? "," : "");
+        fprintf(f, "    }");
+        sep = ",\n";
+    }
+    fprintf(f, "\n  }\n}\n");
+}
+
+// the value of the first "key" after p, NULL if there is none
+static const char * json_key(const char * p, const char * key) {
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\"", key);
+    if(p == NULL || (p = strstr(p, pat)) == NULL)
+        return NULL;
+    p += strlen(pat);
+    while(isspace((unsigned char) *p))
+        p++;
+    return *p == ':' ? p + 1 : NULL;
+}
+
+static void json_get_str(const char * doc, const char * key, char * out, size_t len) {
+    const char * p = json_key(doc, key);
+    size_t i = 0;
+    out[0] = '\0';
+    if(p == NULL || (p = strchr(p, '"')) == NULL)
+        return;
+    for(p++; *p && *p != '"' && i + 1 < len; p++) {
+        if(*p == '\\' && p[1])
+            p++;
+        out[i++] = *p;
+    }
+    out[i] = '\0';
+}
+
+// the "runs" of the series that starts at p
+static void json_get_series(const char * p, bench_series_t * s) {
+    s->n = 0;
+    if((p = json_key(p, "runs")) == NULL || (p = strchr(p, '[')) == NULL)
+        return;
+    for(p++; s->n < BENCH_MAX_RUNS;) {
+        char * end;
+        double v = strtod(p, &end);
+        if(end == p)
+            break;
+        s->v[s->n++] = v;
+        for(p = end; isspace((unsigned char) *p) || *p == ','; p++)
+            ;
+    }
+}
+
+// reads back a file of bench_write_json; the whole file in *doc
+static int bench_read_json(const char * path, bench_result_t * r, char ** doc) {
+    FILE * f = fopen(path, "r");
+    int o, p;
+
+    if(f == NULL) {
+        perror(path);
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    rewind(f);
+    *doc = (char *) malloc(len + 1);
+    len = fread(*doc, 1, len, f);
+    (*doc)[len] = '\0';
+    fclose(f);
+
+    memset(r, 0, sizeof(*r));
+    const char * tput = json_key(*doc, "throughput");
+    if(tput == NULL) {
+        printf("** %s: no throughput, not a clht_bench result\n", path);
+        return 0;
+    }
+    json_get_series(tput, &r->tput);
+
+    const char * lat = json_key(*doc, "latency_ns");
+    for(o = 0; lat != NULL && o < LAT_NUM_OPS; o++) {
+        const char * op = json_key(lat, clht_lat_op_names[o]);
+        for(p = 0; op != NULL && p < BENCH_NUM_PCTS; p++)
+            json_get_series(json_key(op, bench_pct_names[p]), &r->lat[o][p]);
+    }
+    return 1;
+}
+
+/* comparison */
+
+// prints one metric; returns 1 if it regressed
+static int compare_one(const char * name, const bench_series_t * base, const bench_series_t * cur,
+                       int higher_better, double thr) {
+    if(base->n == 0 || cur->n == 0)
+        return 0;
+
+    double mb = series_mean(base), mc = series_mean(cur);
+    double delta = mb != 0 ? 100 * (mc - mb) / mb : 0;
+    const char * verdict;
+
+    if(base->n < 2 || cur->n < 2) {
+        verdict = "too few runs";
+    } else {
+        // Welch's t-test
+        double vb = series_sd(base) * series_sd(base) / base->n;
+        double vc = series_sd(cur) * series_sd(cur) / cur->n;
+        double se = sqrt(vb + vc);
+        int sig;
+        if(se == 0) {
+            sig = mc != mb;
+        } else {
+            double df = (vb + vc) * (vb + vc) / (vb * vb / (base->n - 1) + vc * vc / (cur->n - 1));
+            sig = fabs(mc - mb) / se > t95((int) df);
+        }
+
+        int worse = higher_better ? delta < -thr : delta > thr;
+        int better = higher_better ? delta > thr : delta < -thr;
+        verdict = sig && worse ? "REGRESSION" : sig && better ? "improved" : "~";
+    }
+
+    printf("%-22s %14.1f -> %14.1f  %+7.2f%%  %s\n", name, mb, mc, delta, verdict);
+    return !strcmp(verdict, "REGRESSION");
+}
+
+static int bench_compare(const bench_result_t * base, const char * base_doc,
+                         const bench_result_t * cur, const char * cur_doc, double thr) {
+    char bv[128], cv[128], bw[64], cw[64];
+    char name[64];
+    int o, p, regressed = 0;
+
+    json_get_str(base_doc, "variant", bv, sizeof(bv));
+    json_get_str(base_doc, "workload", bw, sizeof(bw));
+    if(cur_doc != NULL) {
+        json_get_str(cur_doc, "variant", cv, sizeof(cv));
+        json_get_str(cur_doc, "workload", cw, sizeof(cw));
+    } else {
+        snprintf(cv, sizeof(cv), "%s", clht_type_desc());
+        snprintf(cw, sizeof(cw), "%s", workload->name);
+    }
+    if(strcmp(bv, cv) || strcmp(bw, cw))
+        printf("** comparing %s on %s with a baseline of %s on %s\n", cw, cv, bw, bv);
+
+    printf("%-22s %14s    %14s  %8s\n", "metric", "baseline", "current", "change");
+    regressed += compare_one("throughput (ops/s)", &base->tput, &cur->tput, 1, thr);
+    for(o = 0; o < LAT_NUM_OPS; o++) {
+        for(p = 0; p < BENCH_NUM_PCTS; p++) {
+            snprintf(name, sizeof(name), "%s %s (ns)", clht_lat_op_names[o], bench_pct_names[p]);
+            regressed += compare_one(name, &base->lat[o][p], &cur->lat[o][p], 0,
+                                     thr > BENCH_LAT_RESOLUTION ? thr : BENCH_LAT_RESOLUTION);
+        }
+    }
+
+    if(regressed)
+        printf("** %d metrics regressed by more than %.1f%%\n", regressed, thr);
+    return regressed;
+}
+
+int main(int argc, char **argv) {
+    uint64_t num_buckets = 0;
+    uint64_t preload_perc = 50;
+    int64_t update_perc = -1;
+    bool mix_set = false;
+    uint64_t run_ms = 1000;
+    int num_runs = 5;
+    uint64_t max_warmup_ms = 10000;
+    double steady_cv = 2;
+    uint32_t lat_period = 16;
+    double thr = 5;
+    const char * out_path = NULL;
+    const char * base_path = NULL;
+    const char * cur_path = NULL;
+    const char * label = "";
+    char wl_name[64] = "ycsb";
+    int i, o, p;
+    char c;
+
+    while ((c = getopt (argc, argv, "W:t:b:k:l:w:m:u:z:a:d:r:x:s:L:o:n:c:C:T:i:v:")) != -1)
+    switch (c)
+      {
+      case 'W': {
+        const char * colon = strchr(optarg, ':');
+        snprintf(wl_name, sizeof(wl_name), "%.*s", colon ? (int) (colon - optarg) : (int) strlen(optarg), optarg);
+        params.arg = colon ? colon + 1 : NULL;
+        break;
+      }
+      case 't':
+        params.num_threads = atoi(optarg);
+        break;
+      case 'b':
+        num_buckets = atoll(optarg);
+        break;
+      case 'k':
+        params.num_keys = atoll(optarg);
+        break;
+      case 'l':
+        preload_perc = atoll(optarg);
+        break;
+      case 'w':
+        if(!ycsb_workload_preset(&params.ycsb, optarg[0])) {
+            printf("Unknown YCSB workload %s\n", optarg);
+            return 1;
+        }
+        mix_set = true;
+        break;
+      case 'm':
+        if(!ycsb_workload_parse_mix(&params.ycsb, optarg)) {
+            printf("Operation mix %s does not add up to 100\n", optarg);
+            return 1;
+        }
+        mix_set = true;
+        break;
+      case 'u':
+        update_perc = atoll(optarg);
+        break;
+      case 'z':
+        if(!ycsb_workload_parse_dist(&params.ycsb, optarg)) {
+            printf("Unknown key distribution %s\n", optarg);
+            return 1;
+        }
+        break;
+      case 'a':
+        params.ycsb.theta = atof(optarg);
+        break;
+      case 'd':
+        run_ms = atoll(optarg);
+        break;
+      case 'r':
+        num_runs = atoi(optarg);
+        break;
+      case 'x':
+        max_warmup_ms = atoll(optarg);
+        break;
+      case 's':
+        steady_cv = atof(optarg);
+        break;
+      case 'L':
+        lat_period = atoi(optarg);
+        break;
+      case 'o':
+        out_path = optarg;
+        break;
+      case 'n':
+        label = optarg;
+        break;
+      case 'c':
+        base_path = optarg;
+        break;
+      case 'C':
+        cur_path = optarg;
+        break;
+      case 'T':
+        thr = atof(optarg);
+        break;
+      case 'i':
+        params.vm_id = atoi(optarg);
+        break;
+      case 'v':
+        params.num_vms = atoi(optarg);
+        break;
+      default:
+        printf("Invalid option %c\n", c);
+        usage();
+        return 1;
+      }
+
+    // comparison of two result files only
+    if(cur_path != NULL) {
+        bench_result_t * base = (bench_result_t *) calloc(1, sizeof(bench_result_t));
+        bench_result_t * cur = (bench_result_t *) calloc(1, sizeof(bench_result_t));
+        char * base_doc = NULL, * cur_doc = NULL;
+        if(base_path == NULL) {
+            puts("** -C needs a baseline (-c)");
+            return 1;
+        }
+        if(!bench_read_json(base_path, base, &base_doc) || !bench_read_json(cur_path, cur, &cur_doc))
+            return 1;
+        return bench_compare(base, base_doc, cur, cur_doc, thr) ? 2 : 0;
+    }
+
+    for(i = 0; bench_workloads[i] != NULL; i++) {
+        if(!strcmp(bench_workloads[i]->name, wl_name))
+            workload = bench_workloads[i];
+    }
+    if(workload == NULL) {
+        if(strcmp(wl_name, "list"))
+            printf("Unknown workload %s\n", wl_name);
+        for(i = 0; bench_workloads[i] != NULL; i++)
+            printf("  %-8s %s\n", bench_workloads[i]->name, bench_workloads[i]->desc);
+        return strcmp(wl_name, "list") != 0;
+    }
+
+    if(params.num_threads < 1 || params.num_threads >= CLHT_STATS_MAX_THREADS || params.num_keys == 0
+       || params.num_vms < 1 || params.vm_id < 0 || params.vm_id >= params.num_vms || update_perc > 100
+       || num_runs < 1 || num_runs > BENCH_MAX_RUNS || run_ms == 0 || preload_perc > 100
+       || (lat_period & (lat_period - 1)) != 0) {
+        usage();
+        return 1;
+    }
+
+    if(update_perc >= 0 && mix_set) {
+        puts("** -u cannot be combined with -w or -m");
+        return 1;
+    }
+
+    if(update_perc >= 0) {
+        memset(params.ycsb.mix, 0, sizeof(params.ycsb.mix));
+        params.ycsb.mix[YCSB_REMOVE] = update_perc / 2;
+        params.ycsb.mix[YCSB_INSERT] = update_perc - params.ycsb.mix[YCSB_REMOVE];
+        params.ycsb.mix[YCSB_READ] = 100 - update_perc;
+    }
+
+    params.num_preload = params.num_keys * preload_perc / 100;
+    if(workload->setup != NULL && !workload->setup(&params))
+        return 1;
+
+    if(num_buckets == 0)
+        num_buckets = (params.num_keys + ENTRIES_PER_BUCKET - 1) / ENTRIES_PER_BUCKET;
+
+    setup = params.vm_id == 0;
+    clht_t * ht = (clht_t *) clht_shm_init(params.vm_id, setup, num_buckets, params.num_vms);
+    if(ht == NULL) {
+        perror("clht_shm_init");
+        return 1;
+    }
+
+    ycsb_workload_init(&params.ycsb, params.num_keys, params.num_preload, params.vm_id, params.num_vms);
+
+    printf("[%d] %s %s t:%d b:%lu k:%lu l:%lu mix:", params.vm_id, clht_type_desc(), workload->name,
+           params.num_threads, num_buckets, params.num_keys, params.num_preload);
+    for(i = 0; i < YCSB_NUM_OPS; i++)
+        printf(" %s=%u", ycsb_op_names[i], params.ycsb.mix[i]);
+    printf(" dist:%s\n", bench_dist_names[params.ycsb.dist]);
+
+    threads = (bench_thread_t *) memalign(64, params.num_threads * sizeof(bench_thread_t));
+    memset(threads, 0, params.num_threads * sizeof(bench_thread_t));
+    for(i = 0; i < params.num_threads; i++) {
+        threads[i].id = i;
+        threads[i].ht = ht;
+        if(lat_period > 0) {
+            threads[i].lat = (clht_lat_t *) memalign(64, sizeof(clht_lat_t));
+            memset(threads[i].lat, 0, sizeof(clht_lat_t));
+            threads[i].lat_mask = lat_period - 1;
+        }
+    }
+    double ticks_per_ns = lat_period > 0 ? clht_ticks_per_ns() : 0;
+
+#if defined(CLHT_DELEGATE) && defined(LOCKFREE_RES)
+    // this VM applies the updates to its bucket range, including the preload
+    if(!clht_deleg_start(ht, params.num_threads))
+        return 1;
+#endif
+
+    // workers + main thread, which releases them once every VM is ready
+    pthread_barrier_init(&barrier, NULL, params.num_threads + 1);
+    pthread_t tids[params.num_threads];
+    for(i = 0; i < params.num_threads; i++) {
+        if(pthread_create(&tids[i], NULL, bench_worker, &threads[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    pthread_barrier_wait(&barrier);
+    clht_shm_barrier(params.num_vms);
+    __atomic_store_n(&start_run, 1, __ATOMIC_RELEASE);
+
+    // warm-up, until the last windows agree
+    double win[BENCH_STEADY_WINDOWS];
+    double warmup_start = now_s(), cv = 100;
+    int n_win = 0, steady = 0;
+    while(!steady && (now_s() - warmup_start) * 1000 < max_warmup_ms) {
+        win[n_win++ % BENCH_STEADY_WINDOWS] = bench_window(BENCH_WINDOW_MS);
+        cv = cv_perc(win, n_win < BENCH_STEADY_WINDOWS ? n_win : BENCH_STEADY_WINDOWS);
+        steady = n_win >= BENCH_STEADY_WINDOWS && cv <= steady_cv;
+    }
+    double warmup_ms = (now_s() - warmup_start) * 1000;
+    if(!steady)
+        printf("** not steady after %.0f ms (cv %.2f%%), measuring anyway\n", warmup_ms, cv);
+
+    // every VM measures the same interval
+    clht_shm_barrier(params.num_vms);
+
+    bench_result_t * res = (bench_result_t *) calloc(1, sizeof(bench_result_t));
+    clht_lat_t * lat_prev = (clht_lat_t *) calloc(2, sizeof(clht_lat_t));
+    clht_lat_t * lat_cur = lat_prev + 1;
+    clht_lat_t run_lat;
+    if(lat_period > 0)
+        bench_lat_snapshot(lat_prev);
+
+    for(i = 0; i < num_runs; i++) {
+        series_push(&res->tput, bench_window(run_ms));
+        if(lat_period == 0)
+            continue;
+
+        bench_lat_snapshot(lat_cur);
+        clht_lat_diff(&run_lat, lat_cur, lat_prev);
+        memcpy(lat_prev, lat_cur, sizeof(clht_lat_t));
+        for(o = 0; o < LAT_NUM_OPS; o++) {
+            uint64_t n = clht_hist_total(&run_lat.op[o]);
+            for(p = 0; n > 0 && p < BENCH_NUM_PCTS; p++)
+                series_push(&res->lat[o][p], clht_hist_percentile(&run_lat.op[o], n, bench_pcts[p]) / ticks_per_ns);
+        }
+    }
+
+    __atomic_store_n(&stop_run, 1, __ATOMIC_RELAXED);
+    uint64_t errors = 0;
+    for(i = 0; i < params.num_threads; i++) {
+        pthread_join(tids[i], NULL);
+        errors += threads[i].errors;
+    }
+
+    printf("warm-up %.0f ms (%s, cv %.2f%%), %d runs of %lu ms\n", warmup_ms, steady ? "steady" : "not steady",
+           cv, num_runs, run_ms);
+    printf("%-22s %14.1f +- %.1f (95%% CI)\n", "throughput (ops/s)", series_mean(&res->tput), series_ci95(&res->tput));
+    for(o = 0; o < LAT_NUM_OPS; o++) {
+        if(res->lat[o][0].n == 0)
+            continue;
+        printf("%-8s", clht_lat_op_names[o]);
+        for(p = 0; p < BENCH_NUM_PCTS; p++)
+            printf(" | %s: %8.0f +- %-6.0f", bench_pct_names[p], series_mean(&res->lat[o][p]), series_ci95(&res->lat[o][p]));
+        printf(" ns\n");
+    }
+    if(errors > 0)
+        printf("** %lu wrong values read\n", errors);
+
+    if(out_path != NULL) {
+        FILE * f = strcmp(out_path, "-") ? fopen(out_path, "w") : stdout;
+        if(f == NULL) {
+            perror(out_path);
+        } else {
+            bench_write_json(f, res, label, num_buckets, run_ms, lat_period, warmup_ms, steady, cv, errors);
+            if(f != stdout)
+                fclose(f);
+        }
+    }
+
+    int regressed = 0;
+    if(base_path != NULL) {
+        bench_result_t * base = (bench_result_t *) calloc(1, sizeof(bench_result_t));
+        char * base_doc = NULL;
+        if(bench_read_json(base_path, base, &base_doc))
+            regressed = bench_compare(base, base_doc, res, NULL, thr);
+    }
+
+    // Nobody tears the table down before every VM has stopped
+    clht_shm_barrier(params.num_vms);
+
+#if defined(CLHT_DELEGATE) && defined(LOCKFREE_RES)
+    clht_deleg_stop();
+#endif
+
+    if(params.vm_id == 0)
+        clht_gc_destroy(ht);
+    clht_shm_term(params.vm_id);
+
+    return errors > 0 ? 1 : regressed ? 2 : 0;
+}
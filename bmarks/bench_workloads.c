@@ -0,0 +1,245 @@
+/*
+ *   File: bench_workloads.c
+ *   Description:
+ *   The workloads of clht_bench (bench.c, clht_bench.h):
+ *    ycsb   the operation mix and key distribution of -w/-m/-u/-z, over
+ *           values equal to their keys (the former test.c, randuration.c;
+ *           with few keys and -u 100 the contention of snap_stress.c)
+ *    ro     gets of preloaded keys only, each value checked (test_ro.c)
+ *    mem    the ycsb mix over values that are shared objects: puts
+ *           allocate them, removes retire them, gets read them in an EBR
+ *           section and check their key (test_mem.c)
+ *    cache  a read-through cache: a miss computes the value and puts it,
+ *           the remove share of the mix evicts (math_cache.c); the
+ *           optional argument is the cost of a computation, in rounds
+ *   A workload is added by defining one more bench_workload_t and listing
+ *   it in bench_workloads[].
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clht_bench.h"
+
+/* CLHT has no in-place update: an update replaces the pair */
+static inline void bench_update(bench_thread_t * t, uint64_t key, uint64_t val) {
+    bench_remove(t, key);
+    bench_put(t, key, val);
+}
+
+static void ycsb_load(bench_thread_t * t, bench_params_t * p) {
+    uint64_t key;
+    for(key = t->id + 1; key <= p->num_preload; key += p->num_threads)
+        clht_put(t->ht, key, key);
+}
+
+static void ycsb_op(bench_thread_t * t, bench_params_t * p) {
+    ycsb_gen_t * g = &t->gen;
+    uint64_t key;
+
+    switch(ycsb_next_op(g)) {
+    case YCSB_READ:
+        bench_get(t, ycsb_next_key(g));
+        break;
+    case YCSB_UPDATE:
+        key = ycsb_next_key(g);
+        bench_update(t, key, key);
+        break;
+    case YCSB_INSERT:
+        key = ycsb_insert_key(g, &p->ycsb);
+        bench_put(t, key, key);
+        break;
+    case YCSB_REMOVE:
+        bench_remove(t, ycsb_next_key(g));
+        break;
+    case YCSB_SCAN: {
+        uint32_t i, len = ycsb_scan_len(g);
+        key = ycsb_next_key(g);
+        for(i = 0; i < len && key + i <= p->num_keys; i++)
+            bench_get(t, key + i);
+        break;
+    }
+    case YCSB_RMW:
+        key = ycsb_next_key(g);
+        bench_get(t, key);
+        bench_update(t, key, key);
+        break;
+    default:
+        break;
+    }
+}
+
+static const bench_workload_t bench_ycsb = {
+    .name = "ycsb",
+    .desc = "operation mix and key distribution of -w/-m/-u/-z, values are the keys",
+    .load = ycsb_load,
+    .op = ycsb_op,
+};
+
+/* every key is preloaded and nothing is removed, so every get must hit */
+static int ro_setup(bench_params_t * p) {
+    memset(p->ycsb.mix, 0, sizeof(p->ycsb.mix));
+    p->ycsb.mix[YCSB_READ] = 100;
+    if(p->ycsb.dist == YCSB_LATEST)
+        p->ycsb.dist = YCSB_ZIPFIAN;
+    p->num_preload = p->num_keys;
+    return 1;
+}
+
+static void ro_op(bench_thread_t * t, bench_params_t * p) {
+    uint64_t key = ycsb_next_key(&t->gen);
+    if(bench_get(t, key) != key)
+        t->errors++;
+}
+
+static const bench_workload_t bench_ro = {
+    .name = "ro",
+    .desc = "gets of preloaded keys only, every value checked",
+    .setup = ro_setup,
+    .load = ycsb_load,
+    .op = ro_op,
+};
+
+/* a 64B object of the slabs (clht_slab.h) */
+typedef struct mem_obj {
+    uint64_t key;
+    uint64_t payload[7];
+} mem_obj_t;
+
+static clht_val_t mem_new(uint64_t key) {
+    SHM_off off = clht_shm_alloc(sizeof(mem_obj_t));
+    mem_obj_t * o = (mem_obj_t *) SHR_OFF_TO_PTR(off);
+    o->key = key;
+    o->payload[0] = key;
+    return (clht_val_t) off;
+}
+
+static void mem_put(bench_thread_t * t, uint64_t key) {
+    clht_val_t v = mem_new(key);
+    if(!bench_put(t, key, v))
+        clht_shm_free((SHM_off) v);	/* never visible */
+}
+
+static void mem_remove(bench_thread_t * t, uint64_t key) {
+    clht_val_t v = bench_remove(t, key);
+    if(v != 0)
+        clht_ebr_retire((shm_offt) v, clht_shm_free);
+}
+
+static void mem_get(bench_thread_t * t, uint64_t key) {
+    clht_ebr_enter();
+    clht_val_t v = bench_get(t, key);
+    if(v != 0 && ((mem_obj_t *) SHR_OFF_TO_PTR(v))->key != key)
+        t->errors++;
+    clht_ebr_exit();
+}
+
+static void mem_load(bench_thread_t * t, bench_params_t * p) {
+    uint64_t key;
+    for(key = t->id + 1; key <= p->num_preload; key += p->num_threads) {
+        clht_val_t v = mem_new(key);
+        if(!clht_put(t->ht, key, v))
+            clht_shm_free((SHM_off) v);
+    }
+}
+
+static void mem_op(bench_thread_t * t, bench_params_t * p) {
+    ycsb_gen_t * g = &t->gen;
+    uint64_t key;
+
+    switch(ycsb_next_op(g)) {
+    case YCSB_READ:
+    case YCSB_SCAN:
+        mem_get(t, ycsb_next_key(g));
+        break;
+    case YCSB_INSERT:
+        mem_put(t, ycsb_insert_key(g, &p->ycsb));
+        break;
+    case YCSB_REMOVE:
+        mem_remove(t, ycsb_next_key(g));
+        break;
+    case YCSB_RMW:
+        key = ycsb_next_key(g);
+        mem_get(t, key);
+        mem_remove(t, key);
+        mem_put(t, key);
+        break;
+    case YCSB_UPDATE:
+        key = ycsb_next_key(g);
+        mem_remove(t, key);
+        mem_put(t, key);
+        break;
+    default:
+        break;
+    }
+}
+
+/* objects still retired are freed before the thread leaves */
+static void mem_thread_term(bench_thread_t * t, bench_params_t * p) {
+    clht_ebr_drain();
+    clht_slab_thread_flush();
+}
+
+static const bench_workload_t bench_mem = {
+    .name = "mem",
+    .desc = "ycsb mix over shared objects, allocated by puts and retired by removes",
+    .thread_term = mem_thread_term,
+    .load = mem_load,
+    .op = mem_op,
+};
+
+/* rounds of one computation of a cached value (-W cache:ROUNDS) */
+static uint32_t cache_rounds = 64;
+
+static inline clht_val_t cache_compute(uint64_t key) {
+    uint64_t x = key;
+    uint32_t i;
+    for(i = 0; i < cache_rounds; i++) {
+        x ^= x >> 31;
+        x *= 0x7FB5D329728EA185ULL;
+        x ^= x >> 27;
+    }
+    return x | 1;		/* 0 is not a value */
+}
+
+static int cache_setup(bench_params_t * p) {
+    if(p->arg != NULL)
+        cache_rounds = atoi(p->arg);
+    return 1;
+}
+
+static void cache_load(bench_thread_t * t, bench_params_t * p) {
+    uint64_t key;
+    for(key = t->id + 1; key <= p->num_preload; key += p->num_threads)
+        clht_put(t->ht, key, cache_compute(key));
+}
+
+static void cache_op(bench_thread_t * t, bench_params_t * p) {
+    ycsb_gen_t * g = &t->gen;
+    uint64_t key = ycsb_next_key(g);
+
+    if(ycsb_rand(g) % 100 < p->ycsb.mix[YCSB_REMOVE]) {
+        bench_remove(t, key);
+        return;
+    }
+
+    if(bench_get(t, key) == 0)
+        bench_put(t, key, cache_compute(key));
+}
+
+static const bench_workload_t bench_cache = {
+    .name = "cache",
+    .desc = "read-through cache, misses compute (ARG rounds) and put, removes evict",
+    .setup = cache_setup,
+    .load = cache_load,
+    .op = cache_op,
+};
+
+const bench_workload_t * bench_workloads[] = {
+    &bench_ycsb,
+    &bench_ro,
+    &bench_mem,
+    &bench_cache,
+    NULL
+};
@@ -0,0 +1,168 @@
+/*
+ *   File: fastpath.c
+ *   Description:
+ *   Single-VM microbenchmark of the CLHT hot path: cycles and ns per
+ *   get (hit / miss) and per put + remove pair on a preloaded table, with
+ *   one thread or several threads on disjoint keys. Built at -O3 with
+ *   inlining (make clht_fastpath), to see what the compiler makes of the
+ *   lookup loop once the accesses are no longer volatile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "clht_shm.h"
+#include "clht_hist.h"
+
+#define NUM_PHASES 3
+
+static const char * phase_names[NUM_PHASES] = { "get-hit", "get-miss", "put+remove" };
+
+struct fp_thread {
+    int id;
+    clht_t * ht;
+    uint64_t num_keys;
+    uint64_t iters;
+    pthread_barrier_t * barrier;
+    ticks ticks[NUM_PHASES];
+    uint64_t ops[NUM_PHASES];
+    uint64_t sink;
+} __attribute__ ((aligned (64)));
+
+static int num_thread = 1;
+
+void usage() {
+    puts("Usage: ./clht_fastpath [-b NUM_BUCKETS] [-k PRELOADED_KEYS] [-n OPS_PER_PHASE] [-t NUM_THREADS]");
+}
+
+// xorshift64*, cheap enough not to show up next to a get
+static inline uint64_t fp_rand(uint64_t * s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+void * fp_worker(void * _arg) {
+    struct fp_thread * t = _arg;
+    clht_t * h = t->ht;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (t->id + 1);
+    uint64_t sink = 0;
+    uint64_t i;
+
+    clht_gc_thread_init(h, t->id);
+
+    // thread i preloads keys i+1, i+1+T, ...; misses and new keys are above num_keys
+    for(i = t->id + 1; i <= t->num_keys; i += num_thread)
+        clht_put(h, i, i);
+
+    pthread_barrier_wait(t->barrier);
+
+    ticks s = getticks();
+    for(i = 0; i < t->iters; i++)
+        sink += clht_get(h->ht, fp_rand(&seed) % t->num_keys + 1);
+    t->ticks[0] = getticks() - s;
+    t->ops[0] = t->iters;
+
+    pthread_barrier_wait(t->barrier);
+
+    s = getticks();
+    for(i = 0; i < t->iters; i++)
+        sink += clht_get(h->ht, t->num_keys + 1 + fp_rand(&seed) % t->num_keys);
+    t->ticks[1] = getticks() - s;
+    t->ops[1] = t->iters;
+
+    pthread_barrier_wait(t->barrier);
+
+    uint64_t base = 2 * t->num_keys + 1 + t->id;
+    s = getticks();
+    for(i = 0; i < t->iters; i++) {
+        uint64_t key = base + (i % 1024) * num_thread;
+        sink += clht_put(h, key, key);
+        sink += clht_remove(h, key);
+    }
+    t->ticks[2] = getticks() - s;
+    t->ops[2] = t->iters;
+
+    t->sink = sink;
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    uint64_t num_buckets = 1 << 16;
+    uint64_t num_keys = 0;
+    uint64_t iters = 10000000;
+    char c;
+
+    while ((c = getopt (argc, argv, "b:k:n:t:")) != -1)
+    switch (c)
+      {
+      case 'b':
+        num_buckets = atoll(optarg);
+        break;
+      case 'k':
+        num_keys = atoll(optarg);
+        break;
+      case 'n':
+        iters = atoll(optarg);
+        break;
+      case 't':
+        num_thread = atoi(optarg);
+        break;
+      default:
+        printf("Invalid option %c\n", c);
+        usage();
+        return 1;
+      }
+
+    if(num_keys == 0)
+        num_keys = num_buckets;	// a third of the slots
+    if(num_thread < 1 || num_buckets == 0) {
+        usage();
+        return 1;
+    }
+
+    clht_t * h = (clht_t *) clht_shm_init(0, 1, num_buckets, 1);
+    if(h == NULL) {
+        perror("clht_shm_init");
+        return 1;
+    }
+
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, num_thread);
+
+    struct fp_thread * tds = (struct fp_thread *) calloc(num_thread, sizeof(struct fp_thread));
+    pthread_t threads[num_thread];
+    int i, p;
+    for(i = 0; i < num_thread; i++) {
+        tds[i].id = i;
+        tds[i].ht = h;
+        tds[i].num_keys = num_keys;
+        tds[i].iters = iters;
+        tds[i].barrier = &barrier;
+        pthread_create(&threads[i], NULL, fp_worker, &tds[i]);
+    }
+    for(i = 0; i < num_thread; i++)
+        pthread_join(threads[i], NULL);
+
+    double ticks_per_ns = clht_ticks_per_ns();
+    printf("%s / #bu: %lu / #keys: %lu / threads: %d\n", clht_type_desc(),
+           ((clht_hashtable_t *) SHR_OFF_TO_PTR(h->ht))->num_buckets, num_keys, num_thread);
+    for(p = 0; p < NUM_PHASES; p++) {
+        ticks t = 0;
+        uint64_t ops = 0;
+        for(i = 0; i < num_thread; i++) {
+            t += tds[i].ticks[p];
+            ops += tds[i].ops[p];
+        }
+        printf("%-12s %8.1f cycles/op %8.1f ns/op\n", phase_names[p],
+               (double) t / ops, ((double) t / ops) / ticks_per_ns);
+    }
+
+    clht_gc_destroy(h);
+    clht_shm_term(0);
+    return 0;
+}
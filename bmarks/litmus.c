@@ -0,0 +1,436 @@
+/*
+ *   File: litmus.c
+ *   Description:
+ *   Litmus-style stress of the memory orders of CLHT-LF (clht_atomic.h).
+ *   Every test runs many short rounds between spinning threads and counts
+ *   the outcomes that a linearizable table forbids:
+ *    mp    message passing: writers churn put/remove of their keys in
+ *          shared buckets, readers must never see a value that belongs
+ *          to another key (a slot reused before its key/value are visible)
+ *    once  all threads put the same keys: exactly one put and one remove
+ *          per key succeed, and the remove returns the winner's value
+ *    sb    store buffering: T0 put(x); get(y) || T1 put(y); get(x) must
+ *          not miss on both sides
+ *    multi writers put and remove groups of keys with clht_multi_put /
+ *          clht_multi_remove (their own groups and one shared by all),
+ *          readers must see each group complete or absent, from one put
+ *    snap  writers put and then remove their keys in order, T1 scans
+ *          snapshots (clht_snapshot_create) twice: each writer's keys
+ *          must be one contiguous run, and the same in both scans
+ *   Exits with 1 if any forbidden outcome was seen. Build at -O3
+ *   (make clht_litmus), where compiler reordering actually happens.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "clht_shm.h"
+#include "clht_atomic.h"
+
+#define LITMUS_MAGIC 0x5a5a000000000000ULL
+#define LITMUS_VAL(key, t) (LITMUS_MAGIC | ((uint64_t) (t) << 32) | (key))
+#define LITMUS_KEY(val) ((val) & 0xffffffffULL)
+
+enum { T_MP, T_ONCE, T_SB, T_MULTI, T_SNAP, T_NUM };
+static const char * test_names[T_NUM] = { "mp", "once", "sb", "multi", "snap" };
+
+struct spin_barrier {
+    uint64_t count;
+    uint64_t round;
+} __attribute__ ((aligned (64)));
+
+static struct spin_barrier sbar;
+static clht_t * ht;
+static int num_thread = 4;
+static uint64_t iters = 100000;
+static int test = T_NUM;
+
+// keys that all hash to the buckets used by mp, KEY_BUCKT per bucket
+static uint64_t * mp_keys;
+static uint64_t mp_num_keys;
+static int mp_stop;
+
+static uint64_t checks[T_NUM];
+static uint64_t violations[T_NUM];
+
+void usage() {
+    puts("Usage: ./clht_litmus [-t NUM_THREADS] [-n ROUNDS] [-T mp|once|sb|multi|snap]");
+}
+
+static int selected(int t) {
+#if defined(CLHT_DELEGATE)
+    // multi-key updates are not available with delegation
+    if(t == T_MULTI)
+        return 0;
+#endif
+    return test == T_NUM || test == t;
+}
+
+static void spin_barrier(struct spin_barrier * b) {
+    uint64_t round = CLHT_LOAD(&b->round, acquire);
+    if(CLHT_FAA(&b->count, 1, acq_rel) == (uint64_t) num_thread - 1) {
+        CLHT_STORE(&b->count, 0, relaxed);
+        CLHT_STORE(&b->round, round + 1, release);
+        return;
+    }
+    while(CLHT_LOAD(&b->round, acquire) == round)
+        _mm_pause();
+}
+
+static void report(int t, uint64_t n, uint64_t bad) {
+    CLHT_FAA(&checks[t], n, relaxed);
+    CLHT_FAA(&violations[t], bad, relaxed);
+}
+
+// even threads write, odd threads read; writer w owns every W-th key
+static void litmus_mp(int id) {
+    int num_writers = (num_thread + 1) / 2;
+    uint64_t n = 0, bad = 0, k, r;
+
+    if(id % 2 == 0) {
+        for(r = 0; r < iters; r++) {
+            for(k = id / 2; k < mp_num_keys; k += num_writers) {
+                clht_put(ht, mp_keys[k], LITMUS_VAL(mp_keys[k], id));
+                clht_remove(ht, mp_keys[k]);
+            }
+        }
+        CLHT_FAA(&mp_stop, 1, release);
+    } else {
+        uint64_t seed = id;
+        while(CLHT_LOAD(&mp_stop, acquire) < num_writers) {
+            seed = seed * 6364136223846793005ULL + 1;
+            uint64_t key = mp_keys[(seed >> 33) % mp_num_keys];
+            clht_val_t val = clht_get(CLHT_LOAD(&ht->ht, acquire), key);
+            n++;
+            if(val != 0 && LITMUS_KEY(val) != key)
+                bad++;
+        }
+    }
+    report(T_MP, n, bad);
+}
+
+static int once_wins[64];
+static clht_val_t once_removed[64];
+
+static void litmus_once(int id) {
+    uint64_t n = 0, bad = 0, r;
+    int k, t;
+
+    for(r = 0; r < iters; r++) {
+        // 64 keys per round, fresh for every round
+        uint64_t base = 1 + r * 64;
+        for(k = 0; k < 64; k++) {
+            int j = (k + id * 7) % 64;	// threads start at different keys
+            if(clht_put(ht, base + j, LITMUS_VAL(base + j, id)))
+                CLHT_FAA(&once_wins[j], 1, relaxed);
+        }
+        spin_barrier(&sbar);
+        for(k = 0; k < 64; k++) {
+            int j = (k + id * 13) % 64;
+            clht_val_t v = clht_remove(ht, base + j);
+            if(v != 0) {
+                CLHT_FAA(&once_wins[j], 1 << 16, relaxed);
+                CLHT_STORE(&once_removed[j], v, relaxed);
+            }
+        }
+        spin_barrier(&sbar);
+        if(id == 0) {
+            for(k = 0; k < 64; k++) {
+                n++;
+                int w = CLHT_LOAD(&once_wins[k], relaxed);
+                clht_val_t v = CLHT_LOAD(&once_removed[k], relaxed);
+                if(w != (1 | 1 << 16) || LITMUS_KEY(v) != base + k)
+                    bad++;
+                CLHT_STORE(&once_wins[k], 0, relaxed);
+                CLHT_STORE(&once_removed[k], 0, relaxed);
+            }
+            // the table must be empty again
+            for(t = 0; t < 64; t++)
+                if(clht_get(CLHT_LOAD(&ht->ht, acquire), base + t) != 0)
+                    bad++;
+        }
+        spin_barrier(&sbar);
+    }
+    report(T_ONCE, n, bad);
+}
+
+static clht_val_t sb_seen[2];
+
+// threads pair up: 2p and 2p+1 share x = key 2p+1 and y = key 2p+2 of each round
+static void litmus_sb(int id) {
+    uint64_t n = 0, bad = 0, r;
+    int pair = id / 2, side = id % 2;
+    uint64_t stride = (uint64_t) num_thread + 2;
+
+    for(r = 0; r < iters; r++) {
+        uint64_t x = 1 + r * stride + 2 * pair;
+        uint64_t mine = side ? x + 1 : x;
+        uint64_t other = side ? x : x + 1;
+
+        spin_barrier(&sbar);
+        if(id < (num_thread & ~1)) {
+            clht_put(ht, mine, LITMUS_VAL(mine, id));
+            clht_val_t v = clht_get(CLHT_LOAD(&ht->ht, acquire), other);
+            if(pair == 0)
+                CLHT_STORE(&sb_seen[side], v, relaxed);
+        }
+        spin_barrier(&sbar);
+        if(id == 0) {
+            n++;
+            if(CLHT_LOAD(&sb_seen[0], relaxed) == 0 && CLHT_LOAD(&sb_seen[1], relaxed) == 0)
+                bad++;
+        }
+        if(id < (num_thread & ~1))
+            clht_remove(ht, mine);
+    }
+    report(T_SB, n, bad);
+}
+
+#if !defined(CLHT_DELEGATE)
+#define MULTI_KEYS 4
+#define MULTI_TAG(val) (((val) >> 32) & 0xffff)
+
+static int multi_stop;
+
+// group g (0 is shared) is keys (g + 1) << 20 | k, tags are id << 8 | round
+static void multi_group(int g, clht_addr_t * keys) {
+    int k;
+    for(k = 0; k < MULTI_KEYS; k++)
+        keys[k] = ((uint64_t) (g + 1) << 20) | (k + 1);
+}
+
+// even threads write, odd threads read
+static void litmus_multi(int id) {
+    int num_writers = (num_thread + 1) / 2;
+    clht_addr_t keys[MULTI_KEYS];
+    clht_val_t vals[MULTI_KEYS], out[MULTI_KEYS];
+    uint64_t n = 0, bad = 0, r;
+    int k;
+
+    if(id % 2 == 0) {
+        for(r = 0; r < iters; r++) {
+            int g;
+            for(g = 0; g <= 1; g++) {
+                multi_group(g ? id / 2 + 1 : 0, keys);
+                for(k = 0; k < MULTI_KEYS; k++)
+                    vals[k] = LITMUS_VAL(keys[k], id << 8 | (r & 0xff));
+                // only the shared group can be taken by another writer
+                if(!clht_multi_put(ht, keys, vals, MULTI_KEYS)) {
+                    n++;
+                    bad += g;
+                    continue;
+                }
+                n += 2;
+                if(!clht_multi_remove(ht, keys, out, MULTI_KEYS)) {
+                    bad++;
+                    continue;
+                }
+                for(k = 0; k < MULTI_KEYS; k++)
+                    bad += out[k] != vals[k];
+            }
+        }
+        CLHT_FAA(&multi_stop, 1, release);
+    } else {
+        uint64_t seed = id;
+        while(CLHT_LOAD(&multi_stop, acquire) < num_writers) {
+            seed = seed * 6364136223846793005ULL + 1;
+            multi_group((seed >> 33) % (num_writers + 1), keys);
+            size_t found = clht_multi_get(ht, keys, out, MULTI_KEYS);
+            n++;
+            if(found != 0 && found != MULTI_KEYS) {
+                bad++;
+                continue;
+            }
+            for(k = 0; k < (int) found; k++)
+                if(LITMUS_KEY(out[k]) != keys[k] || MULTI_TAG(out[k]) != MULTI_TAG(out[0]))
+                    bad++;
+        }
+    }
+    report(T_MULTI, n, bad);
+}
+#endif
+
+#define SNAP_KEYS 32
+#define SNAP_WRITER(key) ((key) >> 20)
+
+static int snap_stop;
+static uint64_t snap_rounds;
+
+struct snap_seen {
+    uint64_t mask[64];		// [id]: bit j is key j of writer id
+    uint64_t bad;
+};
+
+static struct snap_seen snap_scans[2];
+
+static void snap_collect(clht_addr_t key, clht_val_t val, void * arg) {
+    struct snap_seen * seen = (struct snap_seen *) arg;
+    uint64_t w = SNAP_WRITER(key), j = key & (SNAP_KEYS - 1);
+    if(w == 0 || w > 64 || LITMUS_KEY(val) != key) {
+        seen->bad++;
+        return;
+    }
+    seen->mask[w - 1] |= 1ULL << j;
+}
+
+// all threads but T1 write, keys of writer id are (id + 1) << 20 | j, j < SNAP_KEYS
+static void litmus_snap(int id) {
+    int num_writers = num_thread - 1;
+    uint64_t n = 0, bad = 0, r, j;
+
+    if(id != 1) {
+        for(r = 0; r < iters; r++) {
+            for(j = 0; j < SNAP_KEYS; j++) {
+                clht_addr_t key = ((uint64_t) (id + 1) << 20) | j;
+                clht_put(ht, key, LITMUS_VAL(key, id));
+            }
+            for(j = 0; j < SNAP_KEYS; j++)
+                clht_remove(ht, ((uint64_t) (id + 1) << 20) | j);
+            CLHT_FAA(&snap_rounds, 1, relaxed);
+        }
+        CLHT_FAA(&snap_stop, 1, release);
+    } else {
+        uint64_t last = 0;
+        while(CLHT_LOAD(&snap_stop, acquire) < num_writers) {
+            // back to back, the resize lock of the creates starves the writers
+            uint64_t rounds = CLHT_LOAD(&snap_rounds, relaxed);
+            if(rounds == last) {
+                _mm_pause();
+                continue;
+            }
+            last = rounds;
+            clht_snap_t * snap = clht_snapshot_create(ht);
+            if(snap == NULL)
+                break;
+            int s, w;
+            memset(snap_scans, 0, sizeof(snap_scans));
+            for(s = 0; s < 2; s++)
+                clht_snapshot_scan(snap, snap_collect, &snap_scans[s]);
+            // a snapshot that ran out of side buckets checks nothing
+            if(clht_snapshot_valid(snap)) {
+                n++;
+                bad += snap_scans[0].bad + snap_scans[1].bad;
+                for(w = 0; w < num_thread; w++) {
+                    uint64_t m = snap_scans[0].mask[w];
+                    // a put or remove is visible only with all earlier ones
+                    if(m != 0) {
+                        m >>= __builtin_ctzll(m);
+                        bad += (m & (m + 1)) != 0;
+                    }
+                    bad += snap_scans[0].mask[w] != snap_scans[1].mask[w];
+                }
+            }
+            clht_snapshot_release(snap);
+        }
+    }
+    report(T_SNAP, n, bad);
+}
+
+void * litmus_worker(void * arg) {
+    int id = (int) (uintptr_t) arg;
+    int t;
+
+    clht_gc_thread_init(ht, id);
+
+    for(t = 0; t < T_NUM; t++) {
+        if(!selected(t))
+            continue;
+        spin_barrier(&sbar);
+        switch(t) {
+        case T_MP:    litmus_mp(id);    break;
+        case T_ONCE:  litmus_once(id);  break;
+        case T_SB:    litmus_sb(id);    break;
+#if !defined(CLHT_DELEGATE)
+        case T_MULTI: litmus_multi(id); break;
+#endif
+        case T_SNAP:  litmus_snap(id);  break;
+        }
+        spin_barrier(&sbar);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    uint64_t num_buckets = 1024;
+    char c;
+    int t;
+
+    while ((c = getopt (argc, argv, "t:n:T:")) != -1)
+    switch (c)
+      {
+      case 't':
+        num_thread = atoi(optarg);
+        break;
+      case 'n':
+        iters = atoll(optarg);
+        break;
+      case 'T':
+        for(t = 0; t < T_NUM; t++)
+            if(strcmp(optarg, test_names[t]) == 0)
+                test = t;
+        if(test == T_NUM) {
+            printf("Unknown test %s\n", optarg);
+            return 1;
+        }
+        break;
+      default:
+        printf("Invalid option %c\n", c);
+        usage();
+        return 1;
+      }
+
+    if(num_thread < 2 || num_thread > 64) {
+        usage();
+        return 1;
+    }
+
+    ht = (clht_t *) clht_shm_init(0, 1, num_buckets, 1);
+    if(ht == NULL) {
+        perror("clht_shm_init");
+        return 1;
+    }
+
+    // mp: fill 4 buckets with exactly KEY_BUCKT keys each, so slots are
+    // reused by different keys but puts never run out of room
+    clht_hashtable_t * table = (clht_hashtable_t *) SHR_OFF_TO_PTR(ht->ht);
+    uint64_t per_bin[4] = { 0 }, key;
+    mp_keys = (uint64_t *) calloc(4 * KEY_BUCKT, sizeof(uint64_t));
+    for(key = 1ULL << 31; mp_num_keys < 4 * KEY_BUCKT; key++) {
+        uint64_t bin = clht_hash(table, key);
+        if(bin < 4 && per_bin[bin] < KEY_BUCKT) {
+            per_bin[bin]++;
+            mp_keys[mp_num_keys++] = key;
+        }
+    }
+
+#if defined(CLHT_DELEGATE)
+    // the updates of all threads are applied by this VM's server
+    if(!clht_deleg_start(ht, num_thread))
+        return 1;
+#endif
+
+    pthread_t threads[num_thread];
+    for(t = 0; t < num_thread; t++)
+        pthread_create(&threads[t], NULL, litmus_worker, (void *) (uintptr_t) t);
+    for(t = 0; t < num_thread; t++)
+        pthread_join(threads[t], NULL);
+
+    int failed = 0;
+    for(t = 0; t < T_NUM; t++) {
+        if(!selected(t))
+            continue;
+        printf("%-5s %12lu checks %8lu forbidden outcomes\n", test_names[t], checks[t], violations[t]);
+        if(violations[t] > 0)
+            failed = 1;
+    }
+
+#if defined(CLHT_DELEGATE)
+    clht_deleg_stop();
+#endif
+    clht_gc_destroy(ht);
+    clht_shm_term(0);
+    return failed;
+}
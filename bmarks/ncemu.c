@@ -0,0 +1,189 @@
+/*
+ *   File: ncemu.c
+ *   Description:
+ *   Stale-cache stress of the software coherence of CLHT-LF (clht_nc.h),
+ *   on a coherent machine: built with -DCLHT_NONCOHERENT -DCLHT_NC_EMULATE
+ *   (make clht_ncemu), every thread reads the tables through an emulated
+ *   private cache that only the invalidations of the table refresh.
+ *   Writers replace the values of their own keys with a counter and
+ *   publish each new value in a coherent array once the replace returned;
+ *   readers check that a get never returns less than the value published
+ *   before it started (a stale line), nor goes back in time. With -s the
+ *   readers ignore their invalidations, which must show up as stale reads.
+ *   Exits with 1 if a stale read was seen (without -s), or if none was
+ *   seen with -s.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "clht_shm.h"
+#include "clht_atomic.h"
+
+#if !defined(CLHT_NONCOHERENT) || !defined(CLHT_NC_EMULATE)
+#  error "build with -DCLHT_NONCOHERENT -DCLHT_NC_EMULATE (make clht_ncemu)"
+#endif
+
+static clht_t * ht;
+static int num_writers = 2;
+static int num_readers = 2;
+static uint64_t num_keys = 64;
+static uint64_t iters = 100000;
+static int skip_inval = 0;
+
+// last value of each key whose replace returned; keys are 1..num_keys
+static uint64_t * published;
+static int writers_left;
+
+static uint64_t checks, stale, backwards, wstale;
+
+void usage() {
+    puts("Usage: ./clht_ncemu [-w WRITERS] [-r READERS] [-k KEYS] [-n REPLACES_PER_WRITER] [-s]");
+}
+
+// xorshift64*
+static inline uint64_t nc_rand(uint64_t * s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+void * nc_writer(void * arg) {
+    int id = (int) (uintptr_t) arg;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (id + 1);
+    uint64_t i;
+
+    clht_gc_thread_init(ht, id);
+
+    // writer id owns the keys k with k % num_writers == id
+    uint64_t own = (num_keys - id + num_writers - 1) / num_writers;
+    for(i = 0; i < iters && own > 0; i++) {
+        uint64_t key = id + 1 + (nc_rand(&seed) % own) * num_writers;
+        uint64_t version;
+        clht_val_t v;
+        do {
+            v = clht_get_versioned(ht, key, &version);
+        } while(!clht_replace_if_version(ht, key, v + 1, version));
+
+        // only this writer changes key: anything else is a stale read
+        if(v != __atomic_load_n(&published[key], __ATOMIC_RELAXED))
+            __atomic_fetch_add(&wstale, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&published[key], v + 1, __ATOMIC_RELEASE);
+
+        // on few cores, the readers must run between the replaces
+        if((i & 63) == 63)
+            sched_yield();
+    }
+
+    __atomic_fetch_sub(&writers_left, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void * nc_reader(void * arg) {
+    int id = (int) (uintptr_t) arg;
+    uint64_t seed = 0xD1B54A32D192ED03ULL * (id + 1);
+    uint64_t * last = (uint64_t *) calloc(num_keys + 1, sizeof(uint64_t));
+    uint64_t n_checks = 0, n_stale = 0, n_back = 0;
+
+    clht_gc_thread_init(ht, id);
+    clht_nc_emu_skip = skip_inval;
+
+    while(__atomic_load_n(&writers_left, __ATOMIC_ACQUIRE) > 0) {
+        uint64_t key = 1 + nc_rand(&seed) % num_keys;
+        uint64_t before = __atomic_load_n(&published[key], __ATOMIC_ACQUIRE);
+        clht_val_t v = clht_get(CLHT_LOAD(&ht->ht, acquire), key);
+        // a get that sees its slot reused while it reads misses, as on
+        // coherent memory
+        if(v == 0)
+            continue;
+
+        n_checks++;
+        if(v < before)
+            n_stale++;
+        if(v < last[key])
+            n_back++;
+        last[key] = v;
+    }
+
+    free(last);
+    __atomic_fetch_add(&checks, n_checks, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stale, n_stale, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&backwards, n_back, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    char c;
+    int t;
+
+    while ((c = getopt (argc, argv, "w:r:k:n:s")) != -1)
+    switch (c)
+      {
+      case 'w':
+        num_writers = atoi(optarg);
+        break;
+      case 'r':
+        num_readers = atoi(optarg);
+        break;
+      case 'k':
+        num_keys = atoll(optarg);
+        break;
+      case 'n':
+        iters = atoll(optarg);
+        break;
+      case 's':
+        skip_inval = 1;
+        break;
+      default:
+        printf("Invalid option %c\n", c);
+        usage();
+        return 1;
+      }
+
+    if(num_writers < 1 || num_readers < 1 || num_keys < (uint64_t) num_writers
+       || num_writers + num_readers > CLHT_STATS_MAX_THREADS) {
+        usage();
+        return 1;
+    }
+
+    ht = (clht_t *) clht_shm_init(0, 1, num_keys, 1);
+    if(ht == NULL) {
+        perror("clht_shm_init");
+        return 1;
+    }
+
+    clht_gc_thread_init(ht, num_writers + num_readers);
+    // room for every key from the start: a resize would refresh all lines
+    clht_reserve(ht, 8 * num_keys);
+    published = (uint64_t *) calloc(num_keys + 1, sizeof(uint64_t));
+    uint64_t key;
+    for(key = 1; key <= num_keys; key++) {
+        clht_put(ht, key, 1);
+        published[key] = 1;
+    }
+    writers_left = num_writers;
+
+    pthread_t threads[num_writers + num_readers];
+    for(t = 0; t < num_writers; t++)
+        pthread_create(&threads[t], NULL, nc_writer, (void *) (uintptr_t) t);
+    for(t = 0; t < num_readers; t++)
+        pthread_create(&threads[num_writers + t], NULL, nc_reader, (void *) (uintptr_t) (num_writers + t));
+    for(t = 0; t < num_writers + num_readers; t++)
+        pthread_join(threads[t], NULL);
+
+    printf("%s%s: %lu gets, %lu stale, %lu backwards, %lu stale in writers\n", clht_type_desc(),
+           skip_inval ? " (readers skip invalidations)" : "", checks, stale, backwards, wstale);
+
+    int failed = skip_inval ? stale == 0 : (stale > 0 || backwards > 0 || wstale > 0);
+    if(failed)
+        printf("** %s\n", skip_inval ? "no stale read detected" : "stale reads");
+
+    clht_gc_destroy(ht);
+    clht_shm_term(0);
+    return failed;
+}
@@ -1,11 +1,14 @@
 //#include "tbb/tbb.h"
 
-#include "clht_lf_res.h"
 #include "clht_shm.h"
 #include "ssmem.h"
 #include "stdio.h"
+#include "ycsb.h"
+#include "clht_hist.h"
+#include "clht_phase.h"
 
-#define KEY_LIMIT(K) (K >> 11)
+// Same key space as the former KEY_LIMIT(rand()) keys
+#define DEFAULT_NUM_KEYS (1 << 20)
 
 typedef struct thread_data {
     uint32_t id;
@@ -42,57 +45,207 @@ void barrier_cross(barrier_t *b) {
 barrier_t barrier;
 
 void usage() {
-    puts("Usage: ./yscb -i [NODE_ID] -b [NUM_BUCKETS] -t [NUM_THREADS] -d [DURATION] -v [NUM_VMS]");
+    puts("Usage: ./yscb -i [NODE_ID] -b [NUM_BUCKETS] -t [NUM_THREADS] -d [DURATION] -v [NUM_VMS] -u [UPDATE_PERC]\n"
+         "              -w [YCSB_PRESET A-F] -m [READ:UPDATE:INSERT:REMOVE:SCAN:RMW] -z [uniform|zipfian|latest|hotspot]\n"
+         "              -a [ZIPF_THETA] -k [NUM_KEYS] -l [PRELOAD_PERC of the table slots] -L (latency histograms)\n"
+         "              -r [EXPECTED_ELEMS to reserve room for] -B (bulk preload)");
 }
 
 struct op_counters {
     int valid;
-    uint64_t put_count;
-    uint64_t get_count;
-    uint64_t rem_count;
+    uint64_t ops[YCSB_NUM_OPS];
 } __attribute__ ((aligned (64)));
 
 
 struct op_counters counters[128] = {0};
 
+// Default mix is 30% puts / 69% gets / 1% removes over uniform keys, -u
+// splits the given update percentage evenly between puts and removes
+ycsb_workload_t workload = {
+    .mix = { [YCSB_READ] = 69, [YCSB_INSERT] = 30, [YCSB_REMOVE] = 1 },
+    .dist = YCSB_UNIFORM,
+};
 
-void do_clht_op(clht_t * hashtable, uint64_t rand1, uint64_t rand2, struct op_counters * c) {
-    uint64_t op = rand2 % 100;
+uint64_t num_preload = 0;
+// elements to reserve room for before the preload (-r, LF only)
+uint64_t num_reserve = 0;
+// preload through clht_bulk_load instead of clht_put (-B, LF only)
+bool bulk_preload = false;
+
+// Per-thread latency histograms, only allocated with -L
+bool measure_latency = false;
+clht_lat_t * thread_lat[128] = {0};
+__thread clht_lat_t * lat = NULL;
+
+static inline clht_val_t bench_get(clht_t * hashtable, uint64_t key) {
+    if(lat == NULL)
+        return clht_get(hashtable->ht, key);
+
+    ticks s = getticks();
+    clht_val_t val = clht_get(hashtable->ht, key);
+    ticks e = getticks();
+    clht_hist_add(&lat->op[val ? LAT_GET_HIT : LAT_GET_MISS], e - s);
+    return val;
+}
 
-    if(op < 30) {
-        clht_put(hashtable, rand1, rand2);
-        c->put_count++;
-    } else if(op < 99) {
-        clht_get(hashtable->ht, rand1);
-        c->get_count++;
-    } else {
-        clht_remove(hashtable, rand1);
-        c->rem_count++;
+static inline int bench_put(clht_t * hashtable, uint64_t key, uint64_t val) {
+    if(lat == NULL)
+        return clht_put(hashtable, key, val);
+
+    ticks s = getticks();
+    int res = clht_put(hashtable, key, val);
+    ticks e = getticks();
+    clht_hist_add(&lat->op[res ? LAT_PUT_SUC : LAT_PUT_FAIL], e - s);
+    return res;
+}
+
+static inline clht_val_t bench_remove(clht_t * hashtable, uint64_t key) {
+    if(lat == NULL)
+        return clht_remove(hashtable, key);
+
+    ticks s = getticks();
+    clht_val_t val = clht_remove(hashtable, key);
+    ticks e = getticks();
+    clht_hist_add(&lat->op[LAT_REMOVE], e - s);
+    return val;
+}
+
+// CLHT has no in-place update: an update replaces the pair
+static inline void clht_update(clht_t * hashtable, uint64_t key, uint64_t val) {
+    bench_remove(hashtable, key);
+    bench_put(hashtable, key, val);
+}
+
+void do_clht_op(clht_t * hashtable, ycsb_gen_t * g, struct op_counters * c) {
+    enum ycsb_op op = ycsb_next_op(g);
+    uint64_t key;
+
+    switch(op) {
+    case YCSB_READ:
+        bench_get(hashtable, ycsb_next_key(g));
+        break;
+    case YCSB_UPDATE:
+        key = ycsb_next_key(g);
+        clht_update(hashtable, key, key);
+        break;
+    case YCSB_INSERT:
+        key = ycsb_insert_key(g, &workload);
+        bench_put(hashtable, key, key);
+        break;
+    case YCSB_REMOVE:
+        bench_remove(hashtable, ycsb_next_key(g));
+        break;
+    case YCSB_SCAN: {
+        key = ycsb_next_key(g);
+        uint32_t len = ycsb_scan_len(g);
+        for(uint32_t i = 0; i < len && key + i <= workload.num_keys; i++)
+            bench_get(hashtable, key + i);
+        break;
+    }
+    case YCSB_RMW:
+        key = ycsb_next_key(g);
+        bench_get(hashtable, key);
+        clht_update(hashtable, key, key);
+        break;
+    default:
+        break;
     }
+
+    c->ops[op]++;
+}
+
+// Sum this VM's threads into its slot of the comm region
+void publish_latency(int id, uint64_t num_thread) {
+    clht_lat_t * shared = clht_shm_lat(id);
+    if(shared == NULL)
+        return;
+
+    clht_lat_t sum;
+    memset(&sum, 0, sizeof(sum));
+    for(uint64_t i = 0; i < num_thread; i++) {
+        if(thread_lat[i] != NULL)
+            clht_lat_merge(&sum, thread_lat[i]);
+    }
+
+    clht_lat_publish(shared, &sum);
+}
+
+// Merge the slots of all VMs, print the percentiles since the last report
+void report_latency(const char * prefix, uint64_t num_vms, clht_lat_t * prev, double ticks_per_ns) {
+    clht_lat_t cur, interval;
+    memset(&cur, 0, sizeof(cur));
+    for(uint64_t vm = 0; vm < num_vms && vm < CLHT_SHM_MAX_VMS; vm++)
+        clht_lat_merge(&cur, clht_shm_lat(vm));
+
+    clht_lat_diff(&interval, &cur, prev);
+    clht_lat_print(prefix, &interval, ticks_per_ns);
+    memcpy(prev, &cur, sizeof(cur));
 }
 
 struct worker_struct {
     int id;
     int setup;
+    int num_thread;
     clht_t * ht;
+    volatile _Atomic int * start_workload;
     volatile _Atomic int * run_workload; 
 };
 
 void * worker_func(void * _arg) {
     struct worker_struct * arg = _arg;
+    ycsb_gen_t gen;
 
     counters[arg->id].valid = 1;
 
-    srand(time(0));
+    ycsb_gen_init(&gen, &workload);
 
     clht_gc_thread_init(arg->ht, arg->id);
 
+#if defined(LOCKFREE_RES)
+    if(arg->setup && arg->id == 0 && num_reserve > 0)
+        clht_reserve(arg->ht, num_reserve);
+
+    if(arg->setup && arg->id == 0 && bulk_preload && num_preload > 0) {
+        clht_addr_t * keys = (clht_addr_t *) malloc(num_preload * sizeof(clht_addr_t));
+        clht_val_t * vals = (clht_val_t *) malloc(num_preload * sizeof(clht_val_t));
+        for(uint64_t i = 0; i < num_preload; i++)
+            keys[i] = vals[i] = i + 1;
+
+        struct timespec s, e;
+        clock_gettime(CLOCK_MONOTONIC, &s);
+        size_t loaded = clht_bulk_load(arg->ht, keys, vals, num_preload, arg->num_thread);
+        clock_gettime(CLOCK_MONOTONIC, &e);
+        printf("bulk loaded %zu keys in %.3f s\n", loaded,
+               (e.tv_sec - s.tv_sec) + (e.tv_nsec - s.tv_nsec) / 1e9);
+
+        free(keys);
+        free((void *) vals);
+    }
+#endif
+
+    // Only the VM that created the table loads it, every thread a slice
+    if(arg->setup && !bulk_preload) {
+        for(uint64_t key = arg->id + 1; key <= num_preload; key += arg->num_thread)
+            clht_put(arg->ht, key, key);
+    }
+
+    if(measure_latency) {
+        lat = (clht_lat_t *) memalign(64, sizeof(clht_lat_t));
+        memset(lat, 0, sizeof(clht_lat_t));
+        thread_lat[arg->id] = lat;
+    }
+
     barrier_cross(&barrier);
+
+    while(!*arg->start_workload)
+        _mm_pause();
     
     while(*arg->run_workload) {
-        do_clht_op(arg->ht, KEY_LIMIT(rand()), rand(), &counters[arg->id]);
+        do_clht_op(arg->ht, &gen, &counters[arg->id]);
     }
 
+    free(gen.seeds);
+
     printf("Worker %d finished\n", arg->id);
 
     return NULL;
@@ -105,10 +258,14 @@ int main(int argc, char **argv) {
     uint64_t duration = 0;
     uint64_t step = 0;
     uint64_t num_vms = 0;
+    int64_t update_perc = -1;
+    bool mix_set = false;
+    uint64_t num_keys = DEFAULT_NUM_KEYS;
+    uint64_t preload_perc = 0;
     bool setup = false;
     char c;
 
-    while ((c = getopt (argc, argv, "i:b:t:d:s:v:")) != -1)
+    while ((c = getopt (argc, argv, "i:b:t:d:s:v:u:w:m:z:a:k:l:Lr:B")) != -1)
     switch (c)
       {
       case 'i':
@@ -130,18 +287,76 @@ int main(int argc, char **argv) {
       case 'v':
         num_vms = atoll(optarg);
         break;
+      case 'u':
+        update_perc = atoll(optarg);
+        break;
+      case 'w':
+        if(!ycsb_workload_preset(&workload, optarg[0])) {
+            printf("Unknown YCSB workload %s\n", optarg);
+            return 1;
+        }
+        mix_set = true;
+        break;
+      case 'm':
+        if(!ycsb_workload_parse_mix(&workload, optarg)) {
+            printf("Operation mix %s does not add up to 100\n", optarg);
+            return 1;
+        }
+        mix_set = true;
+        break;
+      case 'z':
+        if(!ycsb_workload_parse_dist(&workload, optarg)) {
+            printf("Unknown key distribution %s\n", optarg);
+            return 1;
+        }
+        break;
+      case 'a':
+        workload.theta = atof(optarg);
+        break;
+      case 'k':
+        num_keys = atoll(optarg);
+        break;
+      case 'l':
+        preload_perc = atoll(optarg);
+        break;
+      case 'L':
+        measure_latency = true;
+        break;
+      case 'r':
+        num_reserve = atoll(optarg);
+        break;
+      case 'B':
+        bulk_preload = true;
+        break;
       default:
         printf("Invalid option %c\n", c);
         usage();
         return 1;
       }
 
-    if(id == -1 || num_thread == 0 || duration == 0 || num_vms == 0) {
+    if(id == -1 || num_thread == 0 || duration == 0 || num_vms == 0 || update_perc > 100 || num_keys == 0) {
         usage();
         return 1;
     }
 
-    printf("[%d] b:%ld t:%ld d:%ld s:%ld v:%ld\n", id, num_buckets, num_thread, duration, step, num_vms);
+    if(update_perc >= 0 && mix_set) {
+        puts("** -u cannot be combined with -w or -m");
+        return 1;
+    }
+
+#if !defined(LOCKFREE_RES)
+    if(bulk_preload || num_reserve > 0) {
+        puts("** -B and -r are only supported by clht_lf_res and clht_lf_2c");
+        bulk_preload = false;
+    }
+#endif
+
+    if(update_perc >= 0) {
+        memset(workload.mix, 0, sizeof(workload.mix));
+        workload.mix[YCSB_REMOVE] = update_perc / 2;
+        workload.mix[YCSB_INSERT] = update_perc - workload.mix[YCSB_REMOVE];
+        workload.mix[YCSB_READ] = 100 - update_perc;
+    }
 
     clht_t *hashtable = (clht_t*) clht_shm_init(id, setup, num_buckets, num_vms);
 
@@ -150,8 +365,33 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    barrier_init(&barrier, num_thread);
+    // Every VM derives the preloaded key range from the table it attached to
+    clht_hashtable_t *table = (clht_hashtable_t*) SHR_OFF_TO_PTR(hashtable->ht);
+    num_preload = (table->num_buckets * ENTRIES_PER_BUCKET * preload_perc) / 100;
+    if(num_preload > num_keys)
+        num_preload = num_keys;
+
+    ycsb_workload_init(&workload, num_keys, num_preload, id, num_vms);
+
+    printf("[%d] b:%ld t:%ld d:%ld s:%ld v:%ld k:%ld l:%ld mix:", id, table->num_buckets, num_thread, duration, step, num_vms, num_keys, num_preload);
+    for(int i = 0; i < YCSB_NUM_OPS; i++)
+        printf(" %s=%u", ycsb_op_names[i], workload.mix[i]);
+    printf(" dist:%d\n", workload.dist);
+
+    double ticks_per_ns = 0;
+    clht_lat_t * lat_prev = NULL;
+    if(measure_latency) {
+        if(num_vms > CLHT_SHM_MAX_VMS)
+            printf("** only the first %d VMs report latencies\n", CLHT_SHM_MAX_VMS);
+
+        ticks_per_ns = clht_ticks_per_ns();
+        lat_prev = (clht_lat_t *) calloc(1, sizeof(clht_lat_t));
+    }
+
+    // workers + main thread, which releases them once every VM is ready
+    barrier_init(&barrier, num_thread + 1);
     
+    _Atomic int start_workload = 0;
     _Atomic int run_workload = 1;
 
     struct worker_struct *tds = (struct worker_struct *) calloc(num_thread, sizeof(struct worker_struct));
@@ -159,10 +399,18 @@ int main(int argc, char **argv) {
     for (uint64_t i = 0; i < num_thread; i++) {
         tds[i].id = i;
         tds[i].ht = hashtable;
-        tds[i].setup = (i == 0) && setup;
+        tds[i].setup = setup;
+        tds[i].num_thread = num_thread;
+        tds[i].start_workload = &start_workload;
         tds[i].run_workload = &run_workload;
     }
 
+#if defined(CLHT_DELEGATE) && defined(LOCKFREE_RES)
+    // this VM applies the updates to its bucket range, including the preload
+    if(!clht_deleg_start(hashtable, num_thread))
+        return 1;
+#endif
+
     // Workload
     pthread_t thread_group[num_thread];
 
@@ -174,6 +422,13 @@ int main(int argc, char **argv) {
 
     puts("Threads created");
 
+    barrier_cross(&barrier);
+    clht_shm_barrier(num_vms);
+
+    struct timespec start_ts, stop_ts;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    start_workload = 1;
+
     if(step != 0) {
         int elapsed = 0;
 
@@ -184,20 +439,31 @@ int main(int argc, char **argv) {
 
             sleep(sleep_dur);
 
-            uint64_t put_c = 0, rem_c = 0, get_c = 0;
+            uint64_t op_c[YCSB_NUM_OPS] = {0};
 
             for(int i = 0; i < 128; i++) {
                 if(!counters[i].valid)
                     break;
 
-                put_c += counters[i].put_count;
-                rem_c += counters[i].rem_count;
-                get_c += counters[i].get_count;
+                for(int o = 0; o < YCSB_NUM_OPS; o++)
+                    op_c[o] += counters[i].ops[o];
             }
 
-            printf("Inserts:%ld - Removes:%ld - Searches:%ld\n", put_c, rem_c, get_c);
+            for(int o = 0; o < YCSB_NUM_OPS; o++)
+                printf("%s:%ld ", ycsb_op_names[o], op_c[o]);
+            printf("\n");
 
             elapsed += sleep_dur;
+
+            // VM 0 reports the cluster-wide tail of the last interval
+            if(measure_latency) {
+                publish_latency(id, num_thread);
+                if(id == 0) {
+                    char prefix[32];
+                    snprintf(prefix, sizeof(prefix), "[LAT %4ds]", elapsed);
+                    report_latency(prefix, num_vms, lat_prev, ticks_per_ns);
+                }
+            }
         }
 
     } else {
@@ -211,6 +477,35 @@ int main(int argc, char **argv) {
         pthread_join(thread_group[i], NULL);
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &stop_ts);
+
+    uint64_t total_ops = 0;
+    for(int i = 0; i < num_thread; i++) {
+        for(int o = 0; o < YCSB_NUM_OPS; o++)
+            total_ops += counters[i].ops[o];
+    }
+
+    double elapsed_s = (stop_ts.tv_sec - start_ts.tv_sec) + (stop_ts.tv_nsec - start_ts.tv_nsec) / 1e9;
+    printf("#vm %d throughput: %.0f ops/s\n", id, total_ops / elapsed_s);
+
+    // Per-phase breakdown of this VM's threads (make PHASES=1 only)
+    clht_phase_print();
+
+    if(measure_latency)
+        publish_latency(id, num_thread);
+
+    // Nobody tears the table down before every VM has stopped
+    clht_shm_barrier(num_vms);
+
+    if(measure_latency && id == 0) {
+        memset(lat_prev, 0, sizeof(clht_lat_t));
+        report_latency("[LAT total]", num_vms, lat_prev, ticks_per_ns);
+    }
+
+
+#if defined(CLHT_DELEGATE) && defined(LOCKFREE_RES)
+    clht_deleg_stop();
+#endif
 
     if(id == 0) {
         clht_gc_destroy(hashtable);    
@@ -0,0 +1,176 @@
+/*
+ *   File: retire.c
+ *   Description:
+ *   Use-after-free stress of the epoch-based reclamation of values
+ *   (clht_ebr.h). Values are offsets of shared objects that hold their key
+ *   and a live mark. Every thread reads random keys in clht_ebr_enter
+ *   sections and checks the object it got, while replacing others: it
+ *   removes the key with clht_remove_and_retire, whose free function
+ *   marks the object dead before it gives it back, and puts a new object.
+ *   Reports the objects that were seen dead or reused while read, and the
+ *   objects neither in the table nor freed at the end (leaked).
+ *   Exits with 1 if there were any of either.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "clht_shm.h"
+#include "clht_atomic.h"
+
+#define RETIRE_LIVE 0x4c495645ULL
+#define RETIRE_DEAD 0x44454144ULL
+
+typedef struct retire_obj {
+    uint64_t key;
+    uint64_t mark;
+    uint64_t payload[6];
+} retire_obj_t;
+
+static clht_t * ht;
+static int num_threads = 4;
+static uint64_t num_keys = 256;
+static uint64_t iters = 200000;
+static int update_pct = 20;
+
+static uint64_t allocated, freed, bad_reads, reads;
+
+void usage() {
+    puts("Usage: ./clht_retire [-t THREADS] [-k KEYS] [-n OPS_PER_THREAD] [-u UPDATE_PCT]");
+}
+
+// xorshift64*
+static inline uint64_t rt_rand(uint64_t * s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+static void retire_free(shm_offt off) {
+    retire_obj_t * o = (retire_obj_t *) SHR_OFF_TO_PTR(off);
+    __atomic_store_n(&o->mark, RETIRE_DEAD, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&freed, 1, __ATOMIC_RELAXED);
+    clht_shm_free(off);
+}
+
+static clht_val_t retire_new(uint64_t key) {
+    SHM_off off = clht_shm_alloc(sizeof(retire_obj_t));
+    retire_obj_t * o = (retire_obj_t *) SHR_OFF_TO_PTR(off);
+    o->key = key;
+    o->mark = RETIRE_LIVE;
+    __atomic_fetch_add(&allocated, 1, __ATOMIC_RELAXED);
+    return (clht_val_t) off;
+}
+
+void * rt_thread(void * arg) {
+    int id = (int) (uintptr_t) arg;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (id + 1);
+    uint64_t i, n_reads = 0, n_bad = 0;
+
+    clht_gc_thread_init(ht, id);
+
+    for(i = 0; i < iters; i++) {
+        uint64_t r = rt_rand(&seed);
+        uint64_t key = 1 + r % num_keys;
+
+        if((r >> 32) % 100 < (uint64_t) update_pct) {
+            clht_remove_and_retire(ht, key, retire_free);
+            clht_val_t v = retire_new(key);
+            if(!clht_put(ht, key, v)) {
+                // another thread put it first: v was never visible
+                __atomic_fetch_add(&freed, 1, __ATOMIC_RELAXED);
+                clht_shm_free((SHM_off) v);
+            }
+            continue;
+        }
+
+        clht_ebr_enter();
+        clht_val_t v = clht_get(CLHT_LOAD(&ht->ht, acquire), key);
+        if(v != 0) {
+            retire_obj_t * o = (retire_obj_t *) SHR_OFF_TO_PTR(v);
+            int k;
+            // keep the object a while, so that removes and frees overlap
+            for(k = 0; k < 8; k++) {
+                if(__atomic_load_n(&o->mark, __ATOMIC_RELAXED) != RETIRE_LIVE
+                   || __atomic_load_n(&o->key, __ATOMIC_RELAXED) != key) {
+                    n_bad++;
+                    break;
+                }
+                _mm_pause();
+            }
+            n_reads++;
+        }
+        clht_ebr_exit();
+
+        if((i & 1023) == 1023)
+            sched_yield();
+    }
+
+    clht_ebr_drain();
+
+    __atomic_fetch_add(&reads, n_reads, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&bad_reads, n_bad, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    char c;
+    int t;
+
+    while ((c = getopt (argc, argv, "t:k:n:u:")) != -1)
+    switch (c)
+      {
+      case 't':
+        num_threads = atoi(optarg);
+        break;
+      case 'k':
+        num_keys = atoll(optarg);
+        break;
+      case 'n':
+        iters = atoll(optarg);
+        break;
+      case 'u':
+        update_pct = atoi(optarg);
+        break;
+      default:
+        printf("Invalid option %c\n", c);
+        usage();
+        return 1;
+      }
+
+    if(num_threads < 1 || num_threads >= CLHT_STATS_MAX_THREADS || num_keys < 1) {
+        usage();
+        return 1;
+    }
+
+    ht = (clht_t *) clht_shm_init(0, 1, num_keys, 1);
+    if(ht == NULL) {
+        perror("clht_shm_init");
+        return 1;
+    }
+    clht_gc_thread_init(ht, num_threads);
+
+    pthread_t threads[num_threads];
+    for(t = 0; t < num_threads; t++)
+        pthread_create(&threads[t], NULL, rt_thread, (void *) (uintptr_t) t);
+    for(t = 0; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+
+    size_t in_table = clht_size(SHR_OFF_TO_PTR(ht->ht));
+    uint64_t leaked = allocated - freed - in_table;
+    printf("%s: %lu reads, %lu of a freed object, %lu allocated, %lu freed, %zu in the table, %lu leaked\n",
+           clht_type_desc(), reads, bad_reads, allocated, freed, in_table, leaked);
+
+    int failed = bad_reads > 0 || leaked > 0;
+    if(failed)
+        printf("** %s\n", bad_reads > 0 ? "freed objects were read" : "retired objects were not freed");
+
+    clht_gc_destroy(ht);
+    clht_shm_term(0);
+    return failed;
+}
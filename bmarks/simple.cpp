@@ -47,7 +47,7 @@ void barrier_cross(barrier_t *b) {
 barrier_t barrier;
 
 void usage() {
-    puts("Usage: ./yscb -i [NODE_ID] -b [NUM_BUCKETS] -k [NUM_KEYS] -t [NUM_THREADS] -s");
+    puts("Usage: ./yscb -i [NODE_ID] -b [NUM_BUCKETS] -k [NUM_KEYS] -t [NUM_THREADS] -v [NUM_VMS] -s");
 }
 
 
@@ -56,10 +56,11 @@ int main(int argc, char **argv) {
     uint64_t num_keys = 0;
     uint64_t num_buckets = 0;
     uint64_t num_thread = 0;
+    uint64_t num_vms = 1;
     bool setup = false;
     char c;
 
-    while ((c = getopt (argc, argv, "i:b:k:t:s")) != -1)
+    while ((c = getopt (argc, argv, "i:b:k:t:v:s")) != -1)
     switch (c)
       {
       case 'i':
@@ -74,6 +75,9 @@ int main(int argc, char **argv) {
       case 't':
         num_thread = atoll(optarg);
         break;
+      case 'v':
+        num_vms = atoll(optarg);
+        break;
       case 's':
         setup = true;
         break;
@@ -83,7 +87,7 @@ int main(int argc, char **argv) {
         return 1;
       }
 
-    if(id == -1 || num_keys == 0 || num_buckets == 0 || num_thread == 0) {
+    if(id == -1 || num_keys == 0 || num_buckets == 0 || num_thread == 0 || num_vms == 0) {
         usage();
         return 1;
     }
@@ -97,7 +101,7 @@ int main(int argc, char **argv) {
         keys[i] = i + ((id+1) * num_keys) + 1;
     }
 
-    clht_t *hashtable = (clht*) clht_shm_init(id, setup, num_buckets);
+    clht_t *hashtable = (clht*) clht_shm_init(id, setup, num_buckets, num_vms);
     if(hashtable == NULL) {
         return 1;
     }
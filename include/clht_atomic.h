@@ -0,0 +1,146 @@
+/*
+ *   File: clht_atomic.h
+ *   Description:
+ *   C11 <stdatomic.h> accessors with explicit memory orders for the
+ *   structures that several VMs share: the CLHT-LF table and the comm
+ *   region. The shared fields stay plain (non-volatile) integers, because
+ *   their layout is the cross-VM ABI, and every concurrent access goes
+ *   through an accessor that names its order. Everything else is left to
+ *   the compiler to keep in registers, merge, and reorder.
+ *
+ *   Orders used by CLHT-LF:
+ *    - CAS that publishes or invalidates an entry, and the map load a
+ *      lookup decides on: seq_cst, so that operations on different keys
+ *      stay linearizable (on x86 still a plain mov / lock cmpxchg);
+ *    - CAS that only reserves a slot, bucket snapshot loads: acquire;
+ *    - keys and values: relaxed, published by the seq_cst CAS;
+ *    - table pointer and resize lock: acquire / release.
+ *
+ *   With -DCLHT_NONCOHERENT, the accessors also do the cache maintenance
+ *   that memory without hardware coherence needs, see clht_nc.h.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_ATOMIC_H_
+#define _CLHT_ATOMIC_H_
+
+/* C only: the C++ benchmarks include the table headers but never expand these */
+#if !defined(__cplusplus)
+
+#include <stdatomic.h>
+#include "clht_nc.h"
+
+/* a plain shared field viewed as an atomic object of the same type */
+#define CLHT_ATOMIC(p) ((_Atomic __typeof__ (*(p)) *) (p))
+
+#if !defined(CLHT_NONCOHERENT)
+
+#define CLHT_LOAD(p, mo)						\
+  atomic_load_explicit (CLHT_ATOMIC (p), memory_order_##mo)
+#define CLHT_STORE(p, v, mo)						\
+  atomic_store_explicit (CLHT_ATOMIC (p), (v), memory_order_##mo)
+#define CLHT_SWAP(p, v, mo)						\
+  atomic_exchange_explicit (CLHT_ATOMIC (p), (v), memory_order_##mo)
+#define CLHT_FAA(p, v, mo)						\
+  atomic_fetch_add_explicit (CLHT_ATOMIC (p), (v), memory_order_##mo)
+#define CLHT_OR(p, v, mo)						\
+  atomic_fetch_or_explicit (CLHT_ATOMIC (p), (v), memory_order_##mo)
+#define CLHT_AND(p, v, mo)						\
+  atomic_fetch_and_explicit (CLHT_ATOMIC (p), (v), memory_order_##mo)
+#define CLHT_FENCE(mo)							\
+  atomic_thread_fence (memory_order_##mo)
+
+/* returns the value found, like CAS_U64; a failed CAS is an acquire */
+#define CLHT_CAS(p, e, d, mo)						\
+  ({									\
+    __typeof__ ((void) 0, *(p)) _clht_e = (e);			\
+    atomic_compare_exchange_strong_explicit (CLHT_ATOMIC (p), &_clht_e, (d), \
+					     memory_order_##mo,		\
+					     memory_order_acquire);	\
+    _clht_e;								\
+  })
+
+#else  /* CLHT_NONCOHERENT, see clht_nc.h */
+
+/* loads that synchronize read memory, relaxed ones the cached line */
+#define CLHT_NC_FRESH_relaxed 0
+#define CLHT_NC_FRESH_acquire 1
+#define CLHT_NC_FRESH_seq_cst 1
+
+#if defined(CLHT_NC_EMULATE)
+#define CLHT_LOAD(p, mo)						\
+  ({									\
+    __typeof__ ((void) 0, *(p)) _clht_v;				\
+    CLHT_FENCE (mo);							\
+    clht_nc_emu_load ((p), &_clht_v, sizeof (_clht_v), CLHT_NC_FRESH_##mo); \
+    CLHT_FENCE (mo);							\
+    _clht_v;								\
+  })
+#else
+#define CLHT_LOAD(p, mo)						\
+  ({									\
+    if (CLHT_NC_FRESH_##mo)						\
+      clht_nc_inval (p);						\
+    atomic_load_explicit (CLHT_ATOMIC (p), memory_order_##mo);		\
+  })
+#endif
+
+/* updates go to memory through the uncached view, and the stale line
+   of the write-back mapping is dropped */
+#define CLHT_NC_RMW(p, op)						\
+  ({									\
+    __auto_type _clht_r = (op);						\
+    clht_nc_inval (p);							\
+    _clht_r;								\
+  })
+
+#define CLHT_STORE(p, v, mo)						\
+  ({									\
+    atomic_store_explicit (CLHT_ATOMIC (CLHT_NC_UC (p)), (v), memory_order_##mo); \
+    clht_nc_inval (p);							\
+  })
+#define CLHT_SWAP(p, v, mo)						\
+  CLHT_NC_RMW (p, atomic_exchange_explicit (CLHT_ATOMIC (CLHT_NC_UC (p)), (v), memory_order_##mo))
+#define CLHT_FAA(p, v, mo)						\
+  CLHT_NC_RMW (p, atomic_fetch_add_explicit (CLHT_ATOMIC (CLHT_NC_UC (p)), (v), memory_order_##mo))
+#define CLHT_OR(p, v, mo)						\
+  CLHT_NC_RMW (p, atomic_fetch_or_explicit (CLHT_ATOMIC (CLHT_NC_UC (p)), (v), memory_order_##mo))
+#define CLHT_AND(p, v, mo)						\
+  CLHT_NC_RMW (p, atomic_fetch_and_explicit (CLHT_ATOMIC (CLHT_NC_UC (p)), (v), memory_order_##mo))
+#define CLHT_FENCE(mo)							\
+  atomic_thread_fence (memory_order_##mo)
+
+#define CLHT_CAS(p, e, d, mo)						\
+  ({									\
+    __typeof__ ((void) 0, *(p)) _clht_e = (e);			\
+    atomic_compare_exchange_strong_explicit (CLHT_ATOMIC (CLHT_NC_UC (p)), &_clht_e, (d), \
+					     memory_order_##mo,		\
+					     memory_order_acquire);	\
+    clht_nc_inval (p);							\
+    _clht_e;								\
+  })
+
+#endif	/* CLHT_NONCOHERENT */
+
+#endif	/* !__cplusplus */
+
+#endif	/* _CLHT_ATOMIC_H_ */
@@ -0,0 +1,142 @@
+/*
+ *   File: clht_bench.h
+ *   Description:
+ *   Interface between the benchmark driver (bmarks/bench.c) and its
+ *   workloads (bmarks/bench_workloads.c). The driver owns the table, the
+ *   threads, the warm-up, the measurement runs and the report. A workload
+ *   preloads its slice of the keys in every thread and then runs one
+ *   operation per call, through the bench_get/put/remove wrappers, which
+ *   sample latencies into the thread's histograms (clht_hist.h).
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_BENCH_H_
+#define _CLHT_BENCH_H_
+
+#include <stdint.h>
+#include "clht_shm.h"
+#include "clht_hist.h"
+#include "ycsb.h"
+
+/* not defined by the CLHT_LB and CLHT_LB_PACKED headers */
+#ifndef likely
+#  define likely(x)       __builtin_expect((x), 1)
+#endif
+
+typedef struct bench_params
+{
+  /* keys are 1..num_keys, and 1..num_preload are loaded before the runs */
+  uint64_t num_keys;
+  uint64_t num_preload;
+  int num_threads;
+  int vm_id;
+  int num_vms;
+  /* operation mix and key distribution (-w, -m, -u, -z, -a) */
+  ycsb_workload_t ycsb;
+  /* what follows the ':' of -W NAME:ARG, NULL without */
+  const char* arg;
+} bench_params_t;
+
+typedef struct ALIGNED(64) bench_thread
+{
+  int id;			/* GC id of the thread in its VM */
+  clht_t* ht;
+  ycsb_gen_t gen;
+  clht_lat_t* lat;		/* NULL if latencies are not sampled */
+  uint32_t lat_mask;		/* one op in lat_mask + 1 is timed */
+  uint32_t lat_n;
+  uint64_t ops;			/* completed operations, read by the driver */
+  uint64_t errors;		/* wrong values seen by checking workloads */
+  void* priv;			/* workload state */
+} bench_thread_t;
+
+typedef struct bench_workload
+{
+  const char* name;
+  const char* desc;
+  /* the following three may be NULL */
+  /* adjusts and checks the parameters before the table is created; 0 refuses */
+  int (*setup)(bench_params_t* p);
+  /* per thread, before the preload and after the runs */
+  void (*thread_init)(bench_thread_t* t, bench_params_t* p);
+  void (*thread_term)(bench_thread_t* t, bench_params_t* p);
+  /* puts the keys of thread t among 1..num_preload (VM 0 only) */
+  void (*load)(bench_thread_t* t, bench_params_t* p);
+  /* one operation */
+  void (*op)(bench_thread_t* t, bench_params_t* p);
+} bench_workload_t;
+
+/* NULL-terminated, see bench_workloads.c */
+extern const bench_workload_t* bench_workloads[];
+
+static inline int
+bench_timed(bench_thread_t* t)
+{
+  return t->lat != NULL && (++t->lat_n & t->lat_mask) == 0;
+}
+
+static inline clht_val_t
+bench_get(bench_thread_t* t, clht_addr_t key)
+{
+  if (likely(!bench_timed(t)))
+    {
+      return clht_get(t->ht->ht, key);
+    }
+
+  ticks s = getticks();
+  clht_val_t val = clht_get(t->ht->ht, key);
+  ticks e = getticks();
+  clht_hist_add(&t->lat->op[val ? LAT_GET_HIT : LAT_GET_MISS], e - s);
+  return val;
+}
+
+static inline int
+bench_put(bench_thread_t* t, clht_addr_t key, clht_val_t val)
+{
+  if (likely(!bench_timed(t)))
+    {
+      return clht_put(t->ht, key, val);
+    }
+
+  ticks s = getticks();
+  int res = clht_put(t->ht, key, val);
+  ticks e = getticks();
+  clht_hist_add(&t->lat->op[res ? LAT_PUT_SUC : LAT_PUT_FAIL], e - s);
+  return res;
+}
+
+static inline clht_val_t
+bench_remove(bench_thread_t* t, clht_addr_t key)
+{
+  if (likely(!bench_timed(t)))
+    {
+      return clht_remove(t->ht, key);
+    }
+
+  ticks s = getticks();
+  clht_val_t val = clht_remove(t->ht, key);
+  ticks e = getticks();
+  clht_hist_add(&t->lat->op[LAT_REMOVE], e - s);
+  return val;
+}
+
+#endif	/* _CLHT_BENCH_H_ */
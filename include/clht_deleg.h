@@ -0,0 +1,73 @@
+/*
+ *   File: clht_deleg.h
+ *   Description:
+ *   Delegation of CLHT-LF updates to the VM that owns the bucket (build
+ *   with -DCLHT_DELEGATE, e.g. make DELEG=1). The buckets of a table are
+ *   split into num_vms contiguous ranges, one per VM. A put or remove is
+ *   written into the ring from the calling VM to the owner of its bucket,
+ *   and the owner's server thread (clht_deleg_start) applies it with plain
+ *   stores, so the snapshot lines of a range are only written by one host.
+ *   Gets still read the table directly.
+ *
+ *   There is one ring per pair of VMs (from, to), including from == to for
+ *   the owner's own updates. The threads of a VM share the producer side
+ *   of its rings under a VM-local lock, which makes every ring single
+ *   producer / single consumer across hosts. A slot goes FREE -> request
+ *   (client) -> DONE or MOVED (server) -> FREE (client): the client waits
+ *   for the answer in the slot it filled in.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_DELEG_H_
+#define _CLHT_DELEG_H_
+
+#include <stdint.h>
+
+#define CLHT_DELEG_RING_SIZE 64	/* requests in flight per pair of VMs */
+#define CLHT_DELEG_RING_MASK (CLHT_DELEG_RING_SIZE - 1)
+
+#define CLHT_DELEG_FREE   0
+#define CLHT_DELEG_PUT    1
+#define CLHT_DELEG_REMOVE 2
+#define CLHT_DELEG_DONE   3
+#define CLHT_DELEG_MOVED  4	/* not the owner any more after a resize: route again */
+#define CLHT_DELEG_PUT_IF     5	/* clht_put_if_version, the version is passed in res */
+#define CLHT_DELEG_REPLACE_IF 6	/* clht_replace_if_version, likewise */
+
+#define CLHT_DELEG_IS_REQ(s)						\
+  ((s) == CLHT_DELEG_PUT || (s) == CLHT_DELEG_REMOVE			\
+   || (s) == CLHT_DELEG_PUT_IF || (s) == CLHT_DELEG_REPLACE_IF)
+
+typedef struct clht_deleg_req
+{
+  uint64_t state;
+  uint64_t key;
+  uint64_t val;
+  uint64_t res;			/* put: 1 if inserted, remove: the value removed */
+} clht_deleg_req_t;
+
+typedef struct __attribute__ ((aligned (64))) clht_deleg_ring
+{
+  clht_deleg_req_t req[CLHT_DELEG_RING_SIZE];
+} clht_deleg_ring_t;
+
+#endif	/* _CLHT_DELEG_H_ */
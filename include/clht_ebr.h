@@ -0,0 +1,89 @@
+/*
+ *   File: clht_ebr.h
+ *   Description:
+ *   Epoch-based reclamation across VMs, for values that are offsets of
+ *   shared objects. A thread reads such a value, and the object behind
+ *   it, between clht_ebr_enter() and clht_ebr_exit(). A thread that
+ *   removes the value retires it (clht_remove_and_retire, clht_ebr_retire)
+ *   instead of freeing it. The object is freed once every thread of every
+ *   VM has left the sections it was in at that point.
+ *
+ *   The cluster epoch and one announcement line per thread live in the
+ *   comm region, indexed by VM id and GC id like the statistics page. A
+ *   thread in a section announces the epoch it entered in. Retired objects
+ *   wait in a private list of the retiring thread, tagged with the epoch.
+ *   Every CLHT_EBR_BATCH retires, the thread tries to advance the epoch,
+ *   which it can do only if every active thread announced the current
+ *   one. It then frees the objects retired two epochs ago, in one batch,
+ *   with the free function given for each of them (e.g. clht_shm_free,
+ *   which returns them to the slabs of this VM, see clht_slab.h).
+ *
+ *   Threads without a line (GC id >= CLHT_STATS_MAX_THREADS, or a VM
+ *   without an id) are not protected by their sections: they must not
+ *   dereference values that are retired.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_EBR_H_
+#define _CLHT_EBR_H_
+
+#include <stdint.h>
+#include "shm_alloc.h"
+#include "clht_stats.h"
+
+/* VMs with announcement lines; at least CLHT_SHM_MAX_VMS */
+#define CLHT_EBR_MAX_VMS 16
+
+/* retires of a thread between two attempts to advance the epoch */
+#define CLHT_EBR_BATCH 64
+
+typedef struct __attribute__ ((aligned (64))) clht_ebr_slot
+{
+  uint64_t state;		/* epoch << 1 | 1 in a section, 0 outside */
+} clht_ebr_slot_t;
+
+typedef struct __attribute__ ((aligned (64))) clht_ebr_region
+{
+  uint64_t epoch;
+  /* lines ever used per VM, the scan of an advance stops there */
+  uint32_t __attribute__ ((aligned (64))) num_threads[CLHT_EBR_MAX_VMS];
+  clht_ebr_slot_t slot[CLHT_EBR_MAX_VMS][CLHT_STATS_MAX_THREADS];
+} clht_ebr_region_t;
+
+/* frees one retired object */
+typedef void (*clht_ebr_free_fn)(shm_offt off);
+
+/* takes the line of GC id id of this VM; done by clht_gc_thread_init */
+void clht_ebr_thread_init(int id);
+
+/* a section, in which retired values stay valid; sections nest */
+void clht_ebr_enter();
+void clht_ebr_exit();
+
+/* free_fn(off) once no section that may have seen off is left */
+void clht_ebr_retire(shm_offt off, clht_ebr_free_fn free_fn);
+
+/* waits until the objects retired by this thread are freed; it must not
+   be in a section, and the other threads must leave theirs */
+void clht_ebr_drain();
+
+#endif	/* _CLHT_EBR_H_ */
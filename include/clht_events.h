@@ -0,0 +1,85 @@
+/*
+ *   File: clht_events.h
+ *   Description:
+ *   Event log of the rare, slow table operations (resize, status checks,
+ *   version GC) in the comm region. Writers of all VMs claim a slot with a
+ *   single fetch-and-increment and never block; the ring overwrites its
+ *   oldest records. Read with clht_events.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_EVENTS_H_
+#define _CLHT_EVENTS_H_
+
+#include <stdint.h>
+
+#define CLHT_EV_RING_SIZE 4096	/* power of two */
+#define CLHT_EV_RING_MASK (CLHT_EV_RING_SIZE - 1)
+#define CLHT_EV_NUM_ARGS  5
+
+/*
+ * Arguments per type (durations in ns, converted with the calibrated
+ * ticks_per_ns of the logging VM):
+ *  STATUS       #buckets, #elems, full% x 100, expands, max expands
+ *  RESIZE_START #buckets old, #buckets new, version old
+ *  RESIZE_END   #buckets old, #buckets new, took, stall, participants
+ *  GC           versions freed, oldest version kept, took
+ *  NO_SPACE     bin, #buckets (clht_put_seq found a full bucket)
+ */
+enum clht_ev_type
+  {
+    CLHT_EV_STATUS,
+    CLHT_EV_RESIZE_START,
+    CLHT_EV_RESIZE_END,
+    CLHT_EV_GC,
+    CLHT_EV_NO_SPACE,
+    CLHT_EV_NUM_TYPES
+  };
+
+static const char* const clht_ev_names[CLHT_EV_NUM_TYPES] =
+  {
+    "STATUS", "RESIZE-START", "RESIZE-END", "GC", "NO-SPACE"
+  };
+
+typedef struct __attribute__ ((aligned (64))) clht_event
+{
+  uint64_t seq;	/* position + 1 once complete, 0 while being written */
+  uint32_t type;
+  uint16_t vm;
+  uint16_t thread;
+  uint64_t ts_ns;		/* CLOCK_REALTIME, comparable across VMs */
+  uint64_t arg[CLHT_EV_NUM_ARGS];
+} clht_event_t;
+
+typedef struct __attribute__ ((aligned (64))) clht_event_ring
+{
+  uint64_t head;	/* next position to be claimed */
+  uint8_t padding[64 - sizeof(uint64_t)];
+  clht_event_t ev[CLHT_EV_RING_SIZE];
+} clht_event_ring_t;
+
+/* no-op before clht_shm_init */
+void clht_event_log(uint32_t type, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4);
+/* ticks of the calling VM to ns */
+uint64_t clht_ticks_to_ns(uint64_t t);
+
+#endif	/* _CLHT_EVENTS_H_ */
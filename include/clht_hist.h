@@ -0,0 +1,226 @@
+/*
+ *   File: clht_hist.h
+ *   Description:
+ *   Log-bucketed latency histograms, recorded per thread with getticks()
+ *   and merged across threads and VMs (through the comm region).
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_HIST_H_
+#define _CLHT_HIST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "utils.h"
+#include "clht_atomic.h"
+
+/*
+ * Buckets: values < 8 are exact, then every power of two is split in
+ * 2^HIST_SUB_BITS linear sub-buckets (<= 12.5% relative error).
+ */
+#define HIST_SUB_BITS    3
+#define HIST_SUB         (1 << HIST_SUB_BITS)
+#define HIST_NUM_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+enum clht_lat_op
+  {
+    LAT_GET_HIT,
+    LAT_GET_MISS,
+    LAT_PUT_SUC,
+    LAT_PUT_FAIL,
+    LAT_REMOVE,
+    LAT_NUM_OPS
+  };
+
+static const char* const clht_lat_op_names[LAT_NUM_OPS] =
+  {
+    "get-hit", "get-miss", "put-suc", "put-fail", "remove"
+  };
+
+/* written by one thread, read by the reporters with relaxed loads */
+typedef struct clht_hist
+{
+  uint64_t count[HIST_NUM_BUCKETS];
+} clht_hist_t;
+
+/* one histogram per operation outcome */
+typedef struct ALIGNED(64) clht_lat
+{
+  clht_hist_t op[LAT_NUM_OPS];
+} clht_lat_t;
+
+static inline uint32_t
+clht_hist_idx(uint64_t v)
+{
+  if (v < HIST_SUB)
+    {
+      return v;
+    }
+  uint32_t msb = 63 - __builtin_clzll(v);
+  uint32_t sub = (v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1);
+  return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) | sub;
+}
+
+/* largest value that falls in bucket idx */
+static inline uint64_t
+clht_hist_upper(uint32_t idx)
+{
+  if (idx < HIST_SUB)
+    {
+      return idx;
+    }
+  uint32_t msb = (idx >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+  uint64_t sub = idx & (HIST_SUB - 1);
+  return (((HIST_SUB | sub) + 1) << (msb - HIST_SUB_BITS)) - 1;
+}
+
+static inline void
+clht_hist_add(clht_hist_t* h, uint64_t ticks)
+{
+  uint32_t i = clht_hist_idx(ticks);
+  CLHT_STORE(&h->count[i], h->count[i] + 1, relaxed);
+}
+
+/* dst += src (cumulative merge) */
+static inline void
+clht_lat_merge(clht_lat_t* dst, const clht_lat_t* src)
+{
+  int o, i;
+  for (o = 0; o < LAT_NUM_OPS; o++)
+    {
+      for (i = 0; i < HIST_NUM_BUCKETS; i++)
+	{
+	  dst->op[o].count[i] += CLHT_LOAD(&src->op[o].count[i], relaxed);
+	}
+    }
+}
+
+/* dst = src, for a dst that others merge concurrently */
+static inline void
+clht_lat_publish(clht_lat_t* dst, const clht_lat_t* src)
+{
+  int o, i;
+  for (o = 0; o < LAT_NUM_OPS; o++)
+    {
+      for (i = 0; i < HIST_NUM_BUCKETS; i++)
+	{
+	  CLHT_STORE(&dst->op[o].count[i], src->op[o].count[i], relaxed);
+	}
+    }
+}
+
+/* dst = cur - prev, i.e., the samples of one interval */
+static inline void
+clht_lat_diff(clht_lat_t* dst, const clht_lat_t* cur, const clht_lat_t* prev)
+{
+  int o, i;
+  for (o = 0; o < LAT_NUM_OPS; o++)
+    {
+      for (i = 0; i < HIST_NUM_BUCKETS; i++)
+	{
+	  dst->op[o].count[i] = cur->op[o].count[i] - prev->op[o].count[i];
+	}
+    }
+}
+
+static inline uint64_t
+clht_hist_total(const clht_hist_t* h)
+{
+  uint64_t n = 0;
+  int i;
+  for (i = 0; i < HIST_NUM_BUCKETS; i++)
+    {
+      n += h->count[i];
+    }
+  return n;
+}
+
+/* upper bound (in ticks) of the bucket holding percentile perc of the samples */
+static inline uint64_t
+clht_hist_percentile(const clht_hist_t* h, uint64_t total, double perc)
+{
+  if (total == 0)
+    {
+      return 0;
+    }
+
+  uint64_t rank = (uint64_t) (total * perc / 100.0);
+  if (rank >= total)
+    {
+      rank = total - 1;
+    }
+
+  uint64_t seen = 0;
+  int i;
+  for (i = 0; i < HIST_NUM_BUCKETS; i++)
+    {
+      seen += h->count[i];
+      if (seen > rank)
+	{
+	  return clht_hist_upper(i);
+	}
+    }
+  return clht_hist_upper(HIST_NUM_BUCKETS - 1);
+}
+
+/* getticks() ticks per ns, measured against CLOCK_MONOTONIC */
+static inline double
+clht_ticks_per_ns()
+{
+  struct timespec s, e;
+  clock_gettime(CLOCK_MONOTONIC, &s);
+  ticks ts = getticks();
+  do
+    {
+      clock_gettime(CLOCK_MONOTONIC, &e);
+    }
+  while ((e.tv_sec - s.tv_sec) * 1000000000LL + (e.tv_nsec - s.tv_nsec) < 50000000LL);
+  ticks te = getticks();
+
+  double ns = (e.tv_sec - s.tv_sec) * 1e9 + (e.tv_nsec - s.tv_nsec);
+  return (te - ts) / ns;
+}
+
+static inline void
+clht_lat_print(const char* prefix, const clht_lat_t* l, double ticks_per_ns)
+{
+  int o;
+  for (o = 0; o < LAT_NUM_OPS; o++)
+    {
+      const clht_hist_t* h = &l->op[o];
+      uint64_t n = clht_hist_total(h);
+      if (n == 0)
+	{
+	  continue;
+	}
+      printf("%s %-8s n: %-10llu | p50: %8.0f | p99: %8.0f | p99.9: %8.0f | max: %8.0f ns\n",
+	     prefix, clht_lat_op_names[o], (unsigned long long) n,
+	     clht_hist_percentile(h, n, 50.0) / ticks_per_ns,
+	     clht_hist_percentile(h, n, 99.0) / ticks_per_ns,
+	     clht_hist_percentile(h, n, 99.9) / ticks_per_ns,
+	     clht_hist_percentile(h, n, 100.0) / ticks_per_ns);
+    }
+}
+
+#endif	/* _CLHT_HIST_H_ */
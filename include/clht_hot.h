@@ -0,0 +1,136 @@
+/*
+ *   File: clht_hot.h
+ *   Description:
+ *   Sampling profiler of contended buckets and keys (build with
+ *   -DCLHT_HOT, e.g. make HOT=1). Every CLHT_HOT_PERIOD-th snapshot CAS
+ *   retry or slow operation of a thread is recorded in two small top-K
+ *   sketches (Space-Saving: buckets and keys) in the per-VM part of the
+ *   comm region. Each thread owns its sketches, so sampling never
+ *   synchronizes; clht_stat -H merges them across threads and VMs.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_HOT_H_
+#define _CLHT_HOT_H_
+
+#include <stdint.h>
+#include "clht_atomic.h"
+
+#define CLHT_HOT_K       16	/* entries per sketch */
+#define CLHT_HOT_PERIOD  4	/* record one in every CLHT_HOT_PERIOD events */
+#define CLHT_HOT_SLOW_NS 2000	/* an operation slower than this is sampled */
+
+enum clht_hot_cause
+  {
+    CLHT_HOT_CAS,		/* failed snapshot CAS */
+    CLHT_HOT_SLOW,		/* operation took > CLHT_HOT_SLOW_NS */
+    CLHT_HOT_NUM_CAUSES
+  };
+
+typedef struct clht_hot_entry
+{
+  uint64_t id;		/* bucket index or key */
+  uint64_t count;	/* estimated events (over-estimate, Space-Saving) */
+} clht_hot_entry_t;
+
+typedef struct __attribute__ ((aligned (64))) clht_hot_thread
+{
+  uint64_t num_buckets;		/* table the bucket indices refer to */
+  uint64_t samples[CLHT_HOT_NUM_CAUSES];
+  uint64_t countdown;
+  uint64_t slow_ticks;
+  clht_hot_entry_t bucket[CLHT_HOT_K];
+  clht_hot_entry_t key[CLHT_HOT_K];
+} clht_hot_thread_t;
+
+/* NULL unless the thread has a slot in the comm region */
+extern __thread clht_hot_thread_t* clht_hot_thr;
+
+#if !defined(__cplusplus)
+/*
+ * Space-Saving: a miss replaces the smallest entry and inherits its count.
+ * Only the owning thread writes its sketch; clht_stat reads it from other
+ * processes, so the stores are relaxed atomics.
+ */
+static inline void
+clht_hot_sketch_add(clht_hot_entry_t* top, uint64_t id, uint64_t w)
+{
+  int i, min = 0;
+  for (i = 0; i < CLHT_HOT_K; i++)
+    {
+      if (top[i].count > 0 && top[i].id == id)
+	{
+	  CLHT_STORE(&top[i].count, top[i].count + w, relaxed);
+	  return;
+	}
+      if (top[i].count < top[min].count)
+	{
+	  min = i;
+	}
+    }
+  CLHT_STORE(&top[min].id, id, relaxed);
+  CLHT_STORE(&top[min].count, top[min].count + w, relaxed);
+}
+
+static inline void
+clht_hot_sample(clht_hot_thread_t* t, enum clht_hot_cause cause,
+		uint64_t num_buckets, uint64_t bin, uint64_t key)
+{
+  if (t->countdown-- > 0)
+    {
+      return;
+    }
+  t->countdown = CLHT_HOT_PERIOD - 1;
+
+  /* bucket indices of an older table size are meaningless after a resize */
+  if (t->num_buckets != num_buckets)
+    {
+      int i;
+      for (i = 0; i < CLHT_HOT_K; i++)
+	{
+	  CLHT_STORE(&t->bucket[i].count, 0, relaxed);
+	}
+      CLHT_STORE(&t->num_buckets, num_buckets, relaxed);
+    }
+
+  CLHT_STORE(&t->samples[cause], t->samples[cause] + 1, relaxed);
+  clht_hot_sketch_add(t->bucket, bin, CLHT_HOT_PERIOD);
+  clht_hot_sketch_add(t->key, key, CLHT_HOT_PERIOD);
+}
+#endif
+
+#if defined(CLHT_HOT)
+#  define CLHT_HOT_BEGIN()						\
+  ticks _hot_s = getticks()
+#  define CLHT_HOT_CAS(ht, bin, key)					\
+  if (clht_hot_thr != NULL)						\
+    clht_hot_sample(clht_hot_thr, CLHT_HOT_CAS, (ht)->num_buckets, bin, key)
+#  define CLHT_HOT_END(ht, bin, key)					\
+  if (clht_hot_thr != NULL && getticks() - _hot_s > clht_hot_thr->slow_ticks) \
+    clht_hot_sample(clht_hot_thr, CLHT_HOT_SLOW, (ht)->num_buckets, bin, key)
+#else
+#  define CLHT_HOT_BEGIN()
+#  define CLHT_HOT_CAS(ht, bin, key)
+#  define CLHT_HOT_END(ht, bin, key)
+#endif
+
+#endif	/* _CLHT_HOT_H_ */
@@ -39,6 +39,8 @@
 
 #include "ssmem.h"
 
+#include "clht_shm.h"
+
 #define true 1
 #define false 0
 
@@ -85,7 +87,7 @@
 #endif
 
 #define CAS_U64_BOOL(a, b, c) (CAS_U64(a, b, c) == b)
-inline int is_power_of_two(unsigned int x);
+extern int is_power_of_two(unsigned int x);
 
 typedef uintptr_t clht_addr_t;
 typedef volatile uintptr_t clht_val_t;
@@ -97,7 +99,7 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) bucket_s
   clht_lock_t lock;
   clht_addr_t key[ENTRIES_PER_BUCKET];
   clht_val_t  val[ENTRIES_PER_BUCKET];
-  struct bucket_s* next;
+  volatile SHM_off next; // struct bucket_s*
 } bucket_t;
 
 typedef struct ALIGNED(CACHE_LINE_SIZE) clht
@@ -106,7 +108,7 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) clht
   {
     struct
     {
-      struct clht_hashtable_s* ht;
+      SHM_off ht; // struct clht_hashtable_s*
       uint8_t next_cache_line[CACHE_LINE_SIZE - (sizeof(void*))];
     };
     uint8_t padding[2 * CACHE_LINE_SIZE];
@@ -120,7 +122,7 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) clht_hashtable_s
     struct
     {
       size_t num_buckets;
-      bucket_t* table;
+      SHM_off table; // bucket_t *
     };
     uint8_t padding[1 * CACHE_LINE_SIZE];
   };
@@ -174,8 +176,8 @@ _mm_pause_rep(uint64_t w)
   *lock = 0;	  
 
 /* Create a new hashtable. */
-clht_hashtable_t* clht_hashtable_create(uint64_t num_buckets );
-clht_t* clht_create(uint64_t num_buckets);
+SHM_off clht_hashtable_create(uint64_t num_buckets); // clht_hashtable_t*
+SHM_off clht_create(uint64_t num_buckets);
 
 /* Hash a key for a particular hashtable. */
 uint64_t clht_hash(clht_hashtable_t* hashtable, clht_addr_t key );
@@ -184,7 +186,7 @@ uint64_t clht_hash(clht_hashtable_t* hashtable, clht_addr_t key );
 int clht_put(clht_t* h, clht_addr_t key, clht_val_t val);
 
 /* Retrieve a key-value pair from a hashtable. */
-clht_val_t clht_get(clht_hashtable_t* hashtable, clht_addr_t key);
+clht_val_t clht_get(SHM_off hashtable, clht_addr_t key);
 
 /* Remove a key-value pair from a hashtable. */
 clht_val_t clht_remove(clht_t* hashtable, clht_addr_t key);
@@ -192,6 +194,10 @@ clht_val_t clht_remove(clht_t* hashtable, clht_addr_t key);
 /* Dealloc the hashtable */
 void clht_destroy(clht_hashtable_t* hashtable);
 
+/* No resizing, thus nothing to collect: kept for interface compatibility */
+void clht_gc_thread_init(clht_t* hashtable, int id);
+void clht_gc_destroy(clht_t* hashtable);
+
 size_t clht_size(clht_hashtable_t* hashtable);
 
 void clht_print(clht_hashtable_t* hashtable);
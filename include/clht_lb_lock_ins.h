@@ -40,6 +40,10 @@
 
 #include "ssmem.h"
 
+#include "clht_shm.h"
+
+extern __thread ssmem_allocator_t* clht_alloc;
+
 #define true 1
 #define false 0
 
@@ -128,7 +132,7 @@
 #endif
 
 #define CAS_U64_BOOL(a, b, c) (CAS_U64(a, b, c) == b)
-inline int is_power_of_two(unsigned int x);
+extern int is_power_of_two(unsigned int x);
 
 typedef uintptr_t clht_addr_t;
 typedef volatile uintptr_t clht_val_t;
@@ -144,7 +148,7 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) bucket_s
   clht_lock_t lock;
   clht_addr_t key[ENTRIES_PER_BUCKET];
   clht_val_t  val[ENTRIES_PER_BUCKET];
-  volatile struct bucket_s* next;
+  volatile SHM_off next; // struct bucket_s*
 } bucket_t;
 
 
@@ -154,10 +158,10 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) clht
   {
     struct
     {
-      struct clht_hashtable_s* ht;
+      SHM_off ht; // struct clht_hashtable_s*
       uint8_t next_cache_line[CACHE_LINE_SIZE - (sizeof(void*))];
-      struct clht_hashtable_s* ht_oldest;
-      struct ht_ts* version_list;
+      SHM_off ht_oldest; // struct clht_hashtable_s*
+      SHM_off version_list; // struct ht_ts*
       size_t version_min;
       volatile clht_lock_t resize_lock;
       volatile clht_lock_t gc_lock;
@@ -174,13 +178,13 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) clht_hashtable_s
     struct
     {
       size_t num_buckets;
-      bucket_t* table;
+      SHM_off table; // bucket_t *
       size_t hash;
       size_t version;
       uint8_t next_cache_line[CACHE_LINE_SIZE - (3 * sizeof(size_t)) - (sizeof(void*))];
-      struct clht_hashtable_s* table_tmp;
-      struct clht_hashtable_s* table_prev;
-      struct clht_hashtable_s* table_new;
+      SHM_off table_tmp; // struct clht_hashtable_s*
+      SHM_off table_prev; // struct clht_hashtable_s*
+      SHM_off table_new; // struct clht_hashtable_s*
       volatile uint32_t num_expands;
       volatile uint32_t num_expands_threshold;
       volatile int32_t is_helper;
@@ -200,14 +204,14 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) ht_ts
       size_t version;
       clht_hashtable_t* versionp;
       int id;
-      volatile struct ht_ts* next;
+      SHM_off next;
     };
     uint8_t padding[CACHE_LINE_SIZE];
   };
 } ht_ts_t;
 
 
-inline uint64_t __ac_Jenkins_hash_64(uint64_t key);
+extern uint64_t __ac_Jenkins_hash_64(uint64_t key);
 
 /* Hash a key for a particular hashtable. */
 uint64_t clht_hash(clht_hashtable_t* hashtable, clht_addr_t key );
@@ -338,7 +342,7 @@ lock_acq_rtm_chk_resize(clht_lock_t* lock, clht_hashtable_t* h)
 	      ht_resize_help(h);
 #  endif
 
-	      while (h->table_new == NULL)
+	      while (h->table_new == SHM_NULL)
 		{
 		  _mm_mfence();
 		}
@@ -361,14 +365,14 @@ lock_acq_rtm_chk_resize(clht_lock_t* lock, clht_hashtable_t* h)
 /* ******************************************************************************** */
 
 /* Create a new hashtable. */
-clht_hashtable_t* clht_hashtable_create(uint64_t num_buckets);
-clht_t* clht_create(uint64_t num_buckets);
+SHM_off clht_hashtable_create(uint64_t num_buckets); // clht_hashtable_t*
+SHM_off clht_create(uint64_t num_buckets);
 
 /* Insert a key-value pair into a hashtable. */
 int clht_put(clht_t* hashtable, clht_addr_t key, clht_val_t val);
 
 /* Retrieve a key-value pair from a hashtable. */
-clht_val_t clht_get(clht_hashtable_t* hashtable, clht_addr_t key);
+clht_val_t clht_get(SHM_off hashtable, clht_addr_t key);
 
 /* Remove a key-value pair from a hashtable. */
 clht_val_t clht_remove(clht_t* hashtable, clht_addr_t key);
@@ -378,8 +382,8 @@ size_t clht_size_mem(clht_hashtable_t* hashtable);
 size_t clht_size_mem_garbage(clht_hashtable_t* hashtable);
 
 void clht_gc_thread_init(clht_t* hashtable, int id);
-inline void clht_gc_thread_version(clht_hashtable_t* h);
-inline int clht_gc_get_id();
+extern void clht_gc_thread_version(clht_hashtable_t* h);
+extern int clht_gc_get_id();
 int clht_gc_collect(clht_t* h);
 int clht_gc_collect_all(clht_t* h);
 int clht_gc_free(clht_hashtable_t* hashtable);
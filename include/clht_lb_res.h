@@ -39,6 +39,8 @@
 
 #include "ssmem.h"
 
+#include "clht_shm.h"
+
 extern __thread ssmem_allocator_t* clht_alloc;
 
 #define true 1
@@ -57,7 +59,7 @@ extern __thread ssmem_allocator_t* clht_alloc;
 #define CLHT_RATIO_HALVE      8		  
 #define CLHT_MIN_CLHT_SIZE    8
 #define CLHT_DO_CHECK_STATUS  0
-#define CLHT_DO_GC            0
+#define CLHT_DO_GC            1	   /* old tables are shared: free them once no VM uses them */
 #define CLHT_STATUS_INVOK     500000
 #define CLHT_STATUS_INVOK_IN  500000
 #define LOAD_FACTOR           2
@@ -156,7 +158,7 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) bucket_s
   volatile uint32_t hops;
   clht_addr_t key[ENTRIES_PER_BUCKET];
   clht_val_t val[ENTRIES_PER_BUCKET];
-  volatile struct bucket_s* next;
+  volatile SHM_off next; // struct bucket_s*
 } bucket_t;
 
 #if __GNUC__ > 4 && __GNUC_MINOR__ > 4
@@ -169,10 +171,10 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) clht
   {
     struct
     {
-      struct clht_hashtable_s* ht;
+      SHM_off ht; // struct clht_hashtable_s*
       uint8_t next_cache_line[CACHE_LINE_SIZE - (sizeof(void*))];
-      struct clht_hashtable_s* ht_oldest;
-      struct ht_ts* version_list;
+      SHM_off ht_oldest; // struct clht_hashtable_s*
+      SHM_off version_list; // struct ht_ts*
       size_t version_min;
       volatile clht_lock_t resize_lock;
       volatile clht_lock_t gc_lock;
@@ -189,13 +191,13 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) clht_hashtable_s
     struct
     {
       size_t num_buckets;
-      bucket_t* table;
+      SHM_off table; // bucket_t *
       size_t hash;
       size_t version;
       uint8_t next_cache_line[CACHE_LINE_SIZE - (3 * sizeof(size_t)) - (sizeof(void*))];
-      struct clht_hashtable_s* table_tmp;
-      struct clht_hashtable_s* table_prev;
-      struct clht_hashtable_s* table_new;
+      SHM_off table_tmp; // struct clht_hashtable_s*
+      SHM_off table_prev; // struct clht_hashtable_s*
+      SHM_off table_new; // struct clht_hashtable_s*
       volatile uint32_t num_expands;
       union
       {
@@ -219,7 +221,7 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) ht_ts
       size_t version;
       clht_hashtable_t* versionp;
       int id;
-      volatile struct ht_ts* next;
+      SHM_off next;
     };
     uint8_t padding[CACHE_LINE_SIZE];
   };
@@ -314,7 +316,7 @@ lock_acq_chk_resize(clht_lock_t* lock, clht_hashtable_t* h)
       ht_resize_help(h);
 #endif
 
-      while (h->table_new == NULL)
+      while (h->table_new == SHM_NULL)
 	{
 	  _mm_pause();
 	  _mm_mfence();
@@ -376,7 +378,7 @@ lock_acq_rtm_chk_resize(clht_lock_t* lock, clht_hashtable_t* h)
 	      ht_resize_help(h);
 #  endif
 
-	      while (h->table_new == NULL)
+	      while (h->table_new == SHM_NULL)
 		{
 		  _mm_mfence();
 		}
@@ -399,17 +401,19 @@ lock_acq_rtm_chk_resize(clht_lock_t* lock, clht_hashtable_t* h)
 /* ******************************************************************************** */
 
 /* Create a new hashtable. */
-clht_hashtable_t* clht_hashtable_create(uint64_t num_buckets);
-clht_t* clht_create(uint64_t num_buckets);
+SHM_off clht_hashtable_create(uint64_t num_buckets); // clht_hashtable_t*
+SHM_off clht_create(uint64_t num_buckets);
 
 /* Insert a key-value pair into a hashtable. */
 int clht_put(clht_t* hashtable, clht_addr_t key, clht_val_t val);
 
 /* Retrieve a key-value pair from a hashtable. */
-clht_val_t clht_get(clht_hashtable_t* hashtable, clht_addr_t key);
+clht_val_t clht_get(SHM_off hashtable, clht_addr_t key);
 
 /* Remove a key-value pair from a hashtable. */
 clht_val_t clht_remove(clht_t* hashtable, clht_addr_t key);
+/* Remove key and retire its value, see clht_ebr.h. */
+clht_val_t clht_remove_and_retire(clht_t* hashtable, clht_addr_t key, clht_ebr_free_fn free_fn);
 
 size_t clht_size(clht_hashtable_t* hashtable);
 size_t clht_size_mem(clht_hashtable_t* hashtable);
@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include "atomic_ops.h"
+#include "clht_atomic.h"
 #include "utils.h"
 
 #include "ssmem.h"
@@ -63,16 +64,49 @@ extern __thread ssmem_allocator_t* clht_alloc;
 #define MAP_INVLD 0
 #define MAP_VALID 1
 #define MAP_INSRT 2
+#define MAP_MULTI 3 /* owned by a clht_multi_put / clht_multi_remove */
 
-#define KEY_BUCKT 3
+#if defined(CLHT_KEY128)
+/* two 16-byte keys, their values and the next offset fill the line */
+#  define KEY_BUCKT 2
+#else
+#  define KEY_BUCKT 3
+#endif
 #define ENTRIES_PER_BUCKET KEY_BUCKT
 
 #define CLHT_DO_GC                  1
 #define CLHT_PERC_FULL_HALVE        2
 #define CLHT_PERC_FULL_DOUBLE       15
-#define CLHT_OCCUP_AFTER_RES        40
+#if defined(CLHT_TWO_CHOICE)
+/* with two candidate buckets per key, tables run much fuller */
+#  define CLHT_OCCUP_AFTER_RES      60
+#else
+#  define CLHT_OCCUP_AFTER_RES      40
+#endif
 #define CLHT_INC_EMERGENCY          2
+/* tables have arbitrary sizes; a resize grows by at least this much */
+#define CLHT_GROWTH_PERC            150
 #define CLHT_NO_EMPTY_SLOT_TRIES    16
+/* predictive resize: every thread publishes its element count delta every
+   CLHT_POLICY_BATCH updates; above CLHT_POLICY_GROW_PERC% occupancy the next
+   table is sized for the inserts expected within CLHT_POLICY_HORIZON_MS */
+#define CLHT_POLICY_BATCH           1024
+#if defined(CLHT_TWO_CHOICE)
+#  define CLHT_POLICY_GROW_PERC     80
+#else
+#  define CLHT_POLICY_GROW_PERC     50
+#endif
+#define CLHT_POLICY_HORIZON_MS      1000
+#define CLHT_MULTI_MAX              16 /* keys per multi-key operation */
+#define CLHT_MULTI_MAX_BACKOFF      4096
+/* CLHT_TTL: the sweeper keeps the earliest expiry of every region of
+   CLHT_TTL_REGION buckets and only scans the regions that are due */
+#define CLHT_TTL_REGION             256
+#define CLHT_TTL_SWEEP_REGIONS      4096 /* per sweeper pass */
+#define CLHT_WATCH_MAX_KEYS         63 /* per clht_watch_many, one bit each */
+#define CLHT_WATCH_EINVAL           ((uint64_t) -1) /* too many keys, never a mask */
+#define CLHT_DELEG_YIELD_SPINS      1024 /* CLHT_DELEGATE: ring spins between yields */
+#define CLHT_COW_SIDE_DIV           8 /* snapshots: one side bucket per 8 of the table */
 #define CLHT_GC_HT_VERSION_USED(ht) clht_gc_thread_version(ht)
 #define CLHT_NO_UPDATE()            clht_gc_thread_version_max();
 #define LOAD_FACTOR                 1
@@ -88,38 +122,21 @@ extern __thread ssmem_allocator_t* clht_alloc;
 #define likely(x)       __builtin_expect((x), 1)
 #define unlikely(x)     __builtin_expect((x), 0)
 
-#if defined(__sparc__)
-#  define PREFETCHW(x) 
-#  define PREFETCH(x) 
-#  define PREFETCHNTA(x) 
-#  define PREFETCHT0(x) 
-#  define PREFETCHT1(x) 
-#  define PREFETCHT2(x) 
-
-#  define PAUSE    asm volatile("rd    %%ccr, %%g0\n\t" \
-				::: "memory")
-#  define _mm_pause() PAUSE
-#  define _mm_mfence() __asm__ __volatile__("membar #LoadLoad | #LoadStore | #StoreLoad | #StoreStore");
-#  define _mm_lfence() __asm__ __volatile__("membar #LoadLoad | #LoadStore");
-#  define _mm_sfence() __asm__ __volatile__("membar #StoreLoad | #StoreStore");
-
-
-#elif defined(__tile__)
-#  define _mm_lfence() arch_atomic_read_barrier()
-#  define _mm_sfence() arch_atomic_write_barrier()
-#  define _mm_mfence() arch_atomic_full_barrier()
-#  define _mm_pause() cycle_relax()
-#endif
 
 #define CAS_U64_BOOL(a, b, c) (CAS_U64(a, b, c) == b)
 
+#if defined(CLHT_KEY128)
+/* UUIDs, 128-bit content hashes; 8-byte aligned, like the rest of the bucket */
+typedef unsigned __int128 clht_addr_t __attribute__ ((aligned (8)));
+#else
 typedef uintptr_t clht_addr_t;
-typedef volatile uintptr_t clht_val_t;
+#endif
+typedef uintptr_t clht_val_t;
 typedef uint64_t clht_snapshot_all_t;
 
 typedef union
 {
-  volatile uint64_t snapshot;
+  uint64_t snapshot;
   struct
   {
 #if KEY_BUCKT == 4
@@ -130,18 +147,37 @@ typedef union
     uint32_t version;
 #endif
     uint8_t map[KEY_BUCKT];
+#if KEY_BUCKT == 3
+    uint8_t clock; /* CLHT_CACHE: reference bits and hand, see snap_clock_victim */
+#endif
   };
 } clht_snapshot_t;
 
+#if defined(CLHT_CACHE) && KEY_BUCKT != 3
+#  error "CLHT_CACHE keeps its CLOCK state in the spare snapshot byte (KEY_BUCKT 3)"
+#endif
+
+#if defined(CLHT_DELEGATE) && (defined(CLHT_TWO_CHOICE) || defined(CLHT_CACHE) || defined(CLHT_TTL))
+#  error "CLHT_DELEGATE supports the one-choice table without CLHT_CACHE and CLHT_TTL"
+#endif
+
+#if defined(CLHT_KEY128) && defined(CLHT_DELEGATE)
+#  error "CLHT_KEY128 does not support CLHT_DELEGATE"
+#endif
+
 #if __GNUC__ > 4 && __GNUC_MINOR__ > 4
 _Static_assert (sizeof(clht_snapshot_t) == 8, "sizeof(clht_snapshot_t) == 8");
 #endif
 
-typedef volatile struct ALIGNED(CACHE_LINE_SIZE) bucket_s
+/*
+ * Shared by all VMs: concurrent accesses go through the clht_atomic.h
+ * accessors, so the fields are not volatile.
+ */
+typedef struct ALIGNED(CACHE_LINE_SIZE) bucket_s
 {
   union
   {
-    volatile uint64_t snapshot;
+    uint64_t snapshot;
     struct
     {
 #if KEY_BUCKT == 4
@@ -153,11 +189,14 @@ typedef volatile struct ALIGNED(CACHE_LINE_SIZE) bucket_s
 /* #  error "KEY_BUCKT should be either 4 or 6" */
 #endif
       uint8_t map[KEY_BUCKT];
+#if KEY_BUCKT == 3
+      uint8_t clock;
+#endif
     };
   };
   clht_addr_t key[KEY_BUCKT];
   clht_val_t  val[KEY_BUCKT];
-  volatile SHM_off next; // struct bucket_s *
+  SHM_off next; // struct bucket_s *
 } bucket_t;
 
 
@@ -165,33 +204,75 @@ typedef volatile struct ALIGNED(CACHE_LINE_SIZE) bucket_s
 _Static_assert (sizeof(bucket_t) % 64 == 0, "sizeof(bucket_t) == 64");
 #endif
 
-#if defined(__tile__)
-typedef volatile uint32_t clht_lock_t;
+#if defined(CLHT_KEY128)
+#  if !defined(__cplusplus)
+_Static_assert (sizeof(bucket_t) == CACHE_LINE_SIZE, "two 128-bit slots per bucket");
+#  endif
+
+/*
+ * A 128-bit key is read and written as two 64-bit words, each atomic on
+ * its own: a reader can see half of a key that is being written to a
+ * reserved slot. The slot went INVLD -> INSRT before, and goes to VALID
+ * after, with the snapshot changing both times, so a match counts only if
+ * the snapshot is still the one read before the key (CLHT_KEY_TORN).
+ */
+typedef uint64_t __attribute__ ((may_alias)) clht_key_word_t;
+
+#  define CLHT_KEY_LOAD(p)						\
+  ({									\
+    clht_key_word_t *_clht_w = (clht_key_word_t *) (p);		\
+    clht_addr_t _clht_lo = CLHT_LOAD (&_clht_w[0], relaxed);		\
+    ((clht_addr_t) CLHT_LOAD (&_clht_w[1], relaxed) << 64) | _clht_lo;	\
+  })
+#  define CLHT_KEY_STORE(p, k)						\
+  ({									\
+    clht_key_word_t *_clht_w = (clht_key_word_t *) (p);		\
+    clht_addr_t _clht_k = (k);						\
+    CLHT_STORE (&_clht_w[0], (uint64_t) _clht_k, relaxed);		\
+    CLHT_STORE (&_clht_w[1], (uint64_t) (_clht_k >> 64), relaxed);	\
+  })
+#  define CLHT_KEY_TORN(bucket, s)					\
+  (CLHT_FENCE (acquire), CLHT_LOAD (&(bucket)->snapshot, relaxed) != (s))
 #else
-typedef volatile uint8_t clht_lock_t;
+#  define CLHT_KEY_LOAD(p)          CLHT_LOAD (p, relaxed)
+#  define CLHT_KEY_STORE(p, k)      CLHT_STORE (p, k, relaxed)
+#  define CLHT_KEY_TORN(bucket, s)  ((void) (s), 0)
 #endif
+
+typedef uint8_t clht_lock_t;
 /* typedef volatile uint64_t clht_lock_t; */
 #define CLHT_LOCK_FREE 0
 #define CLHT_LOCK_ACQR 1
 
-#define CLHT_CHECK_RESIZE(w)				\
-  while (unlikely(w->resize_lock == CLHT_LOCK_ACQR))	\
-    {							\
-      _mm_pause();					\
-      CLHT_GC_HT_VERSION_USED(SHR_OFF_TO_PTR(w->ht));			\
+#define CLHT_CHECK_RESIZE(w)						\
+  while (unlikely(CLHT_LOAD(&w->resize_lock, acquire) == CLHT_LOCK_ACQR)) \
+    {									\
+      _mm_pause();							\
+      CLHT_GC_HT_VERSION_USED(SHR_OFF_TO_PTR(CLHT_LOAD(&w->ht, acquire))); \
     }
 
+#if !defined(CLHT_NONCOHERENT)
+#define CLHT_LOCK_RESIZE(w)						\
+  (CLHT_CAS(&w->resize_lock, CLHT_LOCK_FREE, CLHT_LOCK_ACQR, acquire) == CLHT_LOCK_FREE)
+#else
+/* the holder reads the clht_t with plain loads */
 #define CLHT_LOCK_RESIZE(w)						\
-  (CAS_U8(&w->resize_lock, CLHT_LOCK_FREE, CLHT_LOCK_ACQR) == CLHT_LOCK_FREE)
+  ({									\
+    int _clht_l = CLHT_CAS(&w->resize_lock, CLHT_LOCK_FREE, CLHT_LOCK_ACQR, acquire) == CLHT_LOCK_FREE; \
+    if (_clht_l)							\
+      CLHT_NC_INVAL_RANGE(w, sizeof(clht_t));				\
+    _clht_l;								\
+  })
+#endif
 
 #define CLHT_RLS_RESIZE(w)			\
-  w->resize_lock = CLHT_LOCK_FREE
+  CLHT_STORE(&w->resize_lock, CLHT_LOCK_FREE, release)
 
 #define TRYLOCK_ACQ(lock)			\
-  TAS_U8(lock)
+  CLHT_SWAP(lock, CLHT_LOCK_ACQR, acquire)
 
 #define TRYLOCK_RLS(lock)			\
-  lock = CLHT_LOCK_FREE
+  CLHT_STORE(&(lock), CLHT_LOCK_FREE, release)
 
 
 typedef struct ALIGNED(CACHE_LINE_SIZE) clht
@@ -205,9 +286,10 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) clht
       SHM_off ht_oldest; // struct clht_hashtable_s*
       SHM_off version_list; // struct ht_ts*
       size_t version_min;
-      volatile clht_lock_t resize_lock;
-      volatile clht_lock_t gc_lock;
-      volatile clht_lock_t status_lock;
+      int64_t num_elems; /* approximate, see CLHT_POLICY_BATCH */
+      clht_lock_t resize_lock;
+      clht_lock_t gc_lock;
+      clht_lock_t status_lock;
     };
     uint8_t padding[2 * CACHE_LINE_SIZE];
   };
@@ -221,23 +303,33 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) clht_hashtable_s
     {
       size_t num_buckets;
       SHM_off table; // bucket_t *
-      size_t hash;
       size_t version;
-      uint8_t next_cache_line[CACHE_LINE_SIZE - (3 * sizeof(size_t)) - (sizeof(void*))];
+      SHM_off expiry; // uint32_t * per slot, then the CLHT_TTL sweep state
+      uint32_t cow_epoch;	/* of the live snapshot, 0: none */
+      uint32_t cow_now;		/* CLHT_TTL: cluster time of the snapshot */
+      uint8_t next_cache_line[CACHE_LINE_SIZE - (2 * sizeof(size_t)) - (2 * sizeof(void*)) - (2 * sizeof(uint32_t))];
       SHM_off table_tmp; // struct clht_hashtable_s* 
       SHM_off table_prev; // struct clht_hashtable_s* 
       SHM_off table_new; // struct clht_hashtable_s* 
-      volatile uint32_t num_expands;
+      uint32_t num_expands;
       union
       {
-	volatile uint32_t num_expands_threshold;
+	uint32_t num_expands_threshold;
 	uint32_t num_buckets_prev;
       };
-      volatile int32_t is_helper;
-      volatile int32_t helper_done;
+      int32_t is_helper;
+      int32_t helper_done;
       size_t version_min;
+      uint64_t created_ns;	/* CLOCK_REALTIME, for the insert rate */
+      int64_t elems_at_create;
+      SHM_off cow_map; // uint64_t * per bucket: epoch << 32 | side bucket + 1
+      SHM_off cow_side; // bucket_t * the saved buckets of the snapshot
+      uint64_t cow_cap;		/* side buckets */
+      uint64_t cow_used;
+      uint32_t cow_last;	/* last epoch given out */
+      uint32_t cow_full;	/* epoch that ran out of side buckets */
     };
-    uint8_t padding[2*CACHE_LINE_SIZE];
+    uint8_t padding[3*CACHE_LINE_SIZE];
   };
 } clht_hashtable_t;
 
@@ -259,6 +351,30 @@ typedef struct ALIGNED(CACHE_LINE_SIZE) ht_ts
 /* Hash a key for a particular hashtable. */
 uint64_t clht_hash(clht_hashtable_t* hashtable, clht_addr_t key );
 
+#define CLHT_HASH_MULT 0x9E3779B97F4A7C15ULL /* 2^64 / golden ratio */
+#define CLHT_HASH_MULT2 0xE7037ED1A0B428DBULL
+
+/* the 64-bit hash of a key, before clht_fastrange */
+static inline uint64_t
+clht_key_mix(clht_addr_t key)
+{
+#if defined(CLHT_KEY128)
+  /* both halves, folded by one 64x64->128 multiply (wyhash's mix) */
+  __uint128_t m = (__uint128_t) ((uint64_t) key ^ CLHT_HASH_MULT)
+    * ((uint64_t) (key >> 64) ^ CLHT_HASH_MULT2);
+  return (uint64_t) m ^ (uint64_t) (m >> 64);
+#else
+  return key * CLHT_HASH_MULT;
+#endif
+}
+
+/* maps a 64-bit hash to [0, n) with a multiply-high (Lemire's fastrange) */
+static inline uint64_t
+clht_fastrange(uint64_t hash, uint64_t n)
+{
+  return (uint64_t) (((__uint128_t) hash * n) >> 64);
+}
+
 
 static inline int
 snap_get_empty_index(uint64_t snap)
@@ -340,6 +456,68 @@ snap_set_map_and_inc_version(uint64_t s, int index, int val)
   return s1.snapshot;
 }
 
+static inline uint64_t
+snap_inc_version(uint64_t s)
+{
+  clht_snapshot_t s1 = { .snapshot = s };
+  s1.version++;
+  return s1.snapshot;
+}
+
+static inline int
+snap_num_empty(uint64_t snap)
+{
+  clht_snapshot_t s = { .snapshot = snap };
+  int i, n = 0;
+  for (i = 0; i < KEY_BUCKT; i++)
+    {
+      if (s.map[i] == MAP_INVLD)
+	{
+	  n++;
+	}
+    }
+  return n;
+}
+
+#if KEY_BUCKT == 3
+#define CLHT_CLOCK_REFS       ((1 << KEY_BUCKT) - 1) /* one reference bit per slot */
+#define CLHT_CLOCK_HAND_SHIFT 4
+
+/*
+ * CLHT_CACHE: runs CLOCK over the MAP_VALID slots of a full bucket, from
+ * the hand kept in the snapshot. A referenced slot loses its bit and is
+ * passed over, and the first unreferenced one is the victim. Returns the
+ * victim's index and in *snap_new the snapshot with its slot set to map
+ * and the hand past it, or -1 if no slot is MAP_VALID.
+ */
+static inline int
+snap_clock_victim(uint64_t snap, int map, uint64_t* snap_new)
+{
+  clht_snapshot_t s = { .snapshot = snap };
+  int hand = s.clock >> CLHT_CLOCK_HAND_SHIFT;
+  int n;
+  for (n = 0; n < 2 * KEY_BUCKT; n++)
+    {
+      int i = (hand + n) % KEY_BUCKT;
+      if (s.map[i] != MAP_VALID)
+	{
+	  continue;
+	}
+      if (s.clock & (1 << i))
+	{
+	  s.clock &= ~(1 << i);
+	  continue;
+	}
+      s.map[i] = map;
+      s.clock = (s.clock & CLHT_CLOCK_REFS)
+	| (((i + 1) % KEY_BUCKT) << CLHT_CLOCK_HAND_SHIFT);
+      *snap_new = s.snapshot;
+      return i;
+    }
+  return -1;
+}
+#endif
+
 static inline void
 _mm_pause_rep(uint64_t w)
 {
@@ -359,7 +537,20 @@ _mm_pause_rep(uint64_t w)
 SHM_off clht_hashtable_create(uint64_t num_buckets); // clht_hashtable_t*
 SHM_off clht_create(uint64_t num_buckets);
 
-/* Insert a key-value pair into a hashtable. */
+/* Grow the table (at most one resize) to hold expected_elems elements at
+   CLHT_OCCUP_AFTER_RES% occupancy. Returns 1 if it resized. */
+int clht_reserve(clht_t* hashtable, size_t expected_elems);
+
+/* Load n pairs before traffic starts: nthreads threads partition the input
+   by bucket and fill a private table with plain stores, which is published
+   like a resize. Concurrent updates are not allowed meanwhile. The caller
+   must have called clht_gc_thread_init. Returns the number of keys inserted
+   (for duplicate keys, one of the values is kept). */
+size_t clht_bulk_load(clht_t* hashtable, clht_addr_t* keys, clht_val_t* vals, size_t n, int nthreads);
+
+/* Insert a key-value pair into a hashtable. In a CLHT_CACHE build the
+   table never grows: a put into a full bucket evicts an entry chosen by
+   CLOCK over the reference bits that gets set. */
 int clht_put(clht_t* hashtable, clht_addr_t key, clht_val_t val);
 
 /* Retrieve a key-value pair from a hashtable. */
@@ -368,6 +559,115 @@ clht_val_t clht_get(SHM_off hashtable, clht_addr_t key);
 /* Remove a key-value pair from a hashtable. */
 clht_val_t clht_remove(clht_t* hashtable, clht_addr_t key);
 
+/* Remove key and retire its value, an offset of a shared object: free_fn
+   frees it once no clht_ebr_enter section can reach it (clht_ebr.h). */
+clht_val_t clht_remove_and_retire(clht_t* hashtable, clht_addr_t key, clht_ebr_free_fn free_fn);
+
+#if !defined(CLHT_TWO_CHOICE)
+/* Optimistic concurrency: the value of key (0 if missing) and its
+   version, which changes with every put into its bucket and with every
+   resize. Not declared with CLHT_TWO_CHOICE, where a commit would also
+   need the primary snapshot of keys in their secondary bucket. */
+clht_val_t clht_get_versioned(clht_t* hashtable, clht_addr_t key, uint64_t* version);
+
+/* Insert key, if it is missing and its version is still version. */
+int clht_put_if_version(clht_t* hashtable, clht_addr_t key, clht_val_t val, uint64_t version);
+
+/* Replace the value of key, if it is present and its version is still
+   version. With CLHT_TTL the entry keeps its expiry. Both conditional
+   writes reserve a free slot with one snapshot CAS and publish it with a
+   second one, which also checks the version; they fail spuriously if
+   another key of the bucket was put in the meantime. */
+int clht_replace_if_version(clht_t* hashtable, clht_addr_t key, clht_val_t val, uint64_t version);
+#endif
+
+#if defined(CLHT_TTL)
+/* Insert a key-value pair that expires after ttl_ms (rounded up to the
+   next CLHT_TTL_TICK_MS of the cluster clock). An expired entry is absent
+   for every operation until it is reclaimed. */
+int clht_put_ttl(clht_t* hashtable, clht_addr_t key, clht_val_t val, uint32_t ttl_ms);
+
+/* Reclaim the expired entries of up to max_regions regions that are due,
+   continuing where the previous pass of any VM stopped. Returns the
+   number of entries reclaimed. */
+size_t clht_ttl_sweep(clht_t* hashtable, size_t max_regions);
+
+/* Run clht_ttl_sweep and advance the cluster clock every CLHT_TTL_TICK_MS
+   in a background thread, which uses the GC id id. */
+int clht_ttl_sweeper_start(clht_t* hashtable, int id);
+void clht_ttl_sweeper_stop();
+#endif
+
+#if defined(CLHT_DELEGATE)
+/* Serve the puts and removes that the VMs send to the bucket range of
+   this VM, in a background thread that uses the GC id id. Every VM must
+   run it before its first update, since clht_put and clht_remove wait for
+   the owner of the bucket to apply them. */
+int clht_deleg_start(clht_t* hashtable, int id);
+void clht_deleg_stop();
+#endif
+
+/* Multi-key operations on up to CLHT_MULTI_MAX distinct keys. A key that
+   is being written by one of them cannot be read half-way by a get. */
+
+/* Read the values of n keys as of one instant (0 for a missing key).
+   Returns the number of keys found. */
+size_t clht_multi_get(clht_t* hashtable, clht_addr_t* keys, clht_val_t* vals, size_t n);
+
+#if !defined(CLHT_DELEGATE)
+/* Insert all n pairs, or none of them if one of the keys is present.
+   Not declared with CLHT_DELEGATE, like clht_multi_remove. */
+int clht_multi_put(clht_t* hashtable, clht_addr_t* keys, clht_val_t* vals, size_t n);
+
+/* Remove all n keys, or none of them if one is missing. The removed values
+   are stored in vals, unless it is NULL. */
+int clht_multi_remove(clht_t* hashtable, clht_addr_t* keys, clht_val_t* vals, size_t n);
+#endif
+
+/* Watches: a stamp that changes with every update of the bucket(s) of a
+   key, and with every resize. It can also change without an update of
+   the key itself, and an entry that expires changes it only once it is
+   reclaimed. Waiting costs the writers nothing while nobody watches. */
+
+/* The current stamp of key. */
+uint64_t clht_watch_version(clht_t* hashtable, clht_addr_t key);
+
+/* Block until the stamp of key differs from last_version, spinning and
+   then sleeping on a notification word of this VM. Returns the new stamp. */
+uint64_t clht_watch(clht_t* hashtable, clht_addr_t key, uint64_t last_version);
+
+/* Block until the stamp of one of n keys (at most CLHT_WATCH_MAX_KEYS)
+   differs from versions[i], or for at most timeout_ms (0: no timeout).
+   The stamps that changed are updated in versions. Returns the bitmask of
+   the keys that changed, 0 after the timeout, or CLHT_WATCH_EINVAL if n
+   is larger than CLHT_WATCH_MAX_KEYS. */
+uint64_t clht_watch_many(clht_t* hashtable, clht_addr_t* keys, uint64_t* versions, size_t n, uint64_t timeout_ms);
+
+/* Copy-on-write snapshots: a frozen view of the table for long readers,
+   while the others keep writing. A write saves a bucket into a side area
+   of the table the first time it changes it after the snapshot; writes
+   pay one load of the epoch while there is no snapshot. One snapshot per
+   table at a time. */
+typedef struct clht_snap clht_snap_t;
+
+/* Freeze the current table, after the operations in flight on it, like a
+   resize does. Bumps the version of every bucket, which conditional writes
+   and watches see as a change. Returns NULL if the table already has a
+   snapshot. */
+clht_snap_t* clht_snapshot_create(clht_t* hashtable);
+
+/* The value of key when the snapshot was taken, 0 if it had none. */
+clht_val_t clht_snapshot_get(clht_snap_t* snap, clht_addr_t key);
+
+/* Call fn for every entry of the snapshot. Returns the number of entries. */
+size_t clht_snapshot_scan(clht_snap_t* snap, void (*fn)(clht_addr_t key, clht_val_t val, void* arg), void* arg);
+
+/* 0 if the writers ran out of side buckets, and the reads since the
+   snapshot was taken may have seen later updates. */
+int clht_snapshot_valid(clht_snap_t* snap);
+
+void clht_snapshot_release(clht_snap_t* snap);
+
 size_t clht_size(clht_hashtable_t* hashtable);
 size_t clht_size_mem(clht_hashtable_t* hashtable);
 size_t clht_size_mem_garbage(clht_hashtable_t* hashtable);
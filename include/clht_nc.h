@@ -0,0 +1,141 @@
+/*
+ *   File: clht_nc.h
+ *   Description:
+ *   Software coherence for CXL memory that several hosts share without
+ *   hardware coherence (build with -DCLHT_NONCOHERENT, e.g. make NC=1).
+ *   The device is mapped twice: the usual write-back mapping, through
+ *   which buckets are read, and an uncached view of the same memory
+ *   (CLHT_NC_UC_PATH), through which every atomic of clht_atomic.h
+ *   updates it. A load that synchronizes (acquire, seq_cst) first drops
+ *   its line from the cache, so it reads memory; relaxed loads read the
+ *   cached line and are only fresh after such a load or a CLHT_NC_INVAL.
+ *   Plain stores (new tables, headers) are written back with CLHT_NC_WB
+ *   before they are published.
+ *
+ *   With -DCLHT_NC_EMULATE (make NC=1 NC_EMU=1), the caches are emulated
+ *   in software on a coherent machine: every thread reads the table area
+ *   through a private direct-mapped cache that is only refilled when a
+ *   line is invalidated or evicted, so missing invalidations show up as
+ *   stale reads (see bmarks/ncemu.c).
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_NC_H_
+#define _CLHT_NC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* uncached (e.g. write-combining disabled, UC PAT) view of /dev/mewsi */
+#ifndef CLHT_NC_UC_PATH
+#  define CLHT_NC_UC_PATH "/dev/mewsi_uc"
+#endif
+
+#define CLHT_NC_LINE 64
+
+#if defined(CLHT_NONCOHERENT) && !defined(__cplusplus)
+
+/* the range of the write-back mapping, and where its uncached view is;
+   the delta is 0 without an uncached view, or when emulating */
+extern uintptr_t clht_nc_lo;
+extern uintptr_t clht_nc_span;
+extern intptr_t clht_nc_uc_delta;
+
+/* the uncached alias of p, or p if it is not in the write-back mapping */
+static inline void *
+clht_nc_uc(const volatile void *p)
+{
+  uintptr_t a = (uintptr_t) p;
+  return (void *) (a - clht_nc_lo < clht_nc_span ? a + clht_nc_uc_delta : a);
+}
+#  define CLHT_NC_UC(p) ((__typeof__ (p)) clht_nc_uc (p))
+
+#  if defined(CLHT_NC_EMULATE)
+/* reads n (1, 2, 4, 8) bytes at p through the cache of the thread;
+   fresh: drop the line first */
+void clht_nc_emu_load(const volatile void *p, void *out, size_t n, int fresh);
+void clht_nc_emu_inval(const volatile void *p);
+void clht_nc_emu_wb(const volatile void *p, size_t n);
+/* set by a thread to ignore its invalidations, to show that they matter */
+extern __thread int clht_nc_emu_skip;
+
+static inline void
+clht_nc_inval(const volatile void *p)
+{
+  clht_nc_emu_inval(p);
+}
+
+/* plain stores go to memory, past the emulated cache of the thread,
+   which only has to forget its copies */
+static inline void
+clht_nc_wb(const volatile void *p, size_t n)
+{
+  clht_nc_emu_wb(p, n);
+}
+#  else
+/* drops the line of p from the cache; the next load of it reads memory */
+static inline void
+clht_nc_inval(const volatile void *p)
+{
+  __asm__ __volatile__ ("clflushopt %0\n\tmfence" : "+m" (*(volatile char *) p) : : "memory");
+}
+
+/* writes [p, p + n) back to memory and drops it from the cache */
+static inline void
+clht_nc_wb(const volatile void *p, size_t n)
+{
+  uintptr_t a = (uintptr_t) p & ~(uintptr_t) (CLHT_NC_LINE - 1);
+  uintptr_t end = (uintptr_t) p + n;
+  for (; a < end; a += CLHT_NC_LINE)
+    {
+      __asm__ __volatile__ ("clflushopt %0" : "+m" (*(volatile char *) a));
+    }
+  __asm__ __volatile__ ("sfence" : : : "memory");
+}
+#  endif
+
+#  define CLHT_NC_INVAL(p)  clht_nc_inval (p)
+#  define CLHT_NC_WB(p, n)  clht_nc_wb ((p), (n))
+
+/* invalidates [p, p + n), e.g. a header written by another host */
+static inline void
+clht_nc_inval_range(const volatile void *p, size_t n)
+{
+  uintptr_t a = (uintptr_t) p & ~(uintptr_t) (CLHT_NC_LINE - 1);
+  uintptr_t end = (uintptr_t) p + n;
+  for (; a < end; a += CLHT_NC_LINE)
+    {
+      clht_nc_inval ((const volatile void *) a);
+    }
+}
+#  define CLHT_NC_INVAL_RANGE(p, n) clht_nc_inval_range ((p), (n))
+
+#else  /* coherent memory */
+
+#  define CLHT_NC_UC(p)              (p)
+#  define CLHT_NC_INVAL(p)           do { } while (0)
+#  define CLHT_NC_INVAL_RANGE(p, n)  do { } while (0)
+#  define CLHT_NC_WB(p, n)           do { } while (0)
+
+#endif
+
+#endif	/* _CLHT_NC_H_ */
@@ -0,0 +1,163 @@
+/*
+ *   File: clht_phase.h
+ *   Description:
+ *   Phase-level cycle and hardware-counter breakdown of the CLHT hot path
+ *   (build with -DCLHT_PHASES, e.g. make PHASES=1). Every CLHT_PH(phase)
+ *   mark charges the ticks and perf counter deltas since the previous
+ *   mark to the given phase. Counters are read in user space with rdpmc
+ *   through the perf_event mmap page, falling back to read(2).
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_PHASE_H_
+#define _CLHT_PHASE_H_
+
+#if defined(CLHT_PHASES)
+
+#include <stdint.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include "utils.h"
+
+enum clht_phase
+  {
+    PH_TABLE,			/* clht_t / hashtable pointer loads */
+    PH_HASH,
+    PH_BUCKET,			/* first load of the bucket line */
+    PH_SEARCH,
+    PH_CAS_INS,			/* put: reserve the empty slot */
+    PH_CAS_VAL,			/* put: publish the slot */
+    PH_CAS_REM,			/* remove: invalidate the slot */
+    PH_NUM
+  };
+
+enum clht_phase_event
+  {
+    PH_EV_LLC_MISS,
+    PH_EV_REMOTE_LOAD,		/* loads served by another NUMA node (CXL) */
+    PH_EV_STALLED,		/* backend stalled cycles */
+    PH_EV_NUM
+  };
+
+typedef struct clht_phase_thread
+{
+  ticks last_ticks;
+  uint64_t last_ev[PH_EV_NUM];
+  uint64_t samples[PH_NUM];
+  ticks ticks[PH_NUM];
+  uint64_t ev[PH_NUM][PH_EV_NUM];
+  int fd[PH_EV_NUM];
+  struct perf_event_mmap_page* pg[PH_EV_NUM];
+} clht_phase_thread_t;
+
+extern __thread clht_phase_thread_t* clht_ph;
+
+void clht_phase_thread_init();
+void clht_phase_print();
+
+static inline uint64_t
+clht_phase_rdpmc(uint32_t idx)
+{
+  uint32_t lo, hi;
+  __asm__ __volatile__ ("rdpmc" : "=a" (lo), "=d" (hi) : "c" (idx));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+static inline uint64_t
+clht_phase_read_ev(clht_phase_thread_t* t, int e)
+{
+  struct perf_event_mmap_page* pg = t->pg[e];
+  if (pg == NULL)
+    {
+      return 0;
+    }
+
+  uint64_t count;
+  uint32_t seq;
+  do
+    {
+      seq = pg->lock;
+      __asm__ __volatile__ ("" ::: "memory");
+      uint32_t idx = pg->index;
+      count = pg->offset;
+      if (pg->cap_user_rdpmc && idx)
+	{
+	  uint64_t pmc = clht_phase_rdpmc(idx - 1);
+	  pmc <<= 64 - pg->pmc_width;
+	  pmc >>= 64 - pg->pmc_width;
+	  count += pmc;
+	}
+      else
+	{
+	  if (read(t->fd[e], &count, sizeof(count)) != sizeof(count))
+	    {
+	      count = 0;
+	    }
+	}
+      __asm__ __volatile__ ("" ::: "memory");
+    }
+  while (pg->lock != seq);
+
+  return count;
+}
+
+static inline void
+clht_phase_begin(clht_phase_thread_t* t)
+{
+  int e;
+  for (e = 0; e < PH_EV_NUM; e++)
+    {
+      t->last_ev[e] = clht_phase_read_ev(t, e);
+    }
+  t->last_ticks = getticks();
+}
+
+static inline void
+clht_phase_mark(clht_phase_thread_t* t, enum clht_phase p)
+{
+  ticks now = getticks();
+  t->ticks[p] += now - t->last_ticks;
+  t->samples[p]++;
+
+  int e;
+  for (e = 0; e < PH_EV_NUM; e++)
+    {
+      uint64_t v = clht_phase_read_ev(t, e);
+      t->ev[p][e] += v - t->last_ev[e];
+      t->last_ev[e] = v;
+    }
+  /* do not charge the counter reads to the next phase */
+  t->last_ticks = getticks();
+}
+
+#  define CLHT_PH_BEGIN()  if (clht_ph != NULL) clht_phase_begin(clht_ph)
+#  define CLHT_PH(p)       if (clht_ph != NULL) clht_phase_mark(clht_ph, p)
+#  define CLHT_PH_LOAD(x)  (void) *(volatile __typeof__(x)*) &(x)
+#else  /* !CLHT_PHASES */
+#  define CLHT_PH_BEGIN()
+#  define CLHT_PH(p)
+#  define CLHT_PH_LOAD(x)
+#  define clht_phase_thread_init()
+#  define clht_phase_print()
+#endif	/* CLHT_PHASES */
+
+#endif	/* _CLHT_PHASE_H_ */
@@ -2,19 +2,55 @@
 #define CLHT_SHM_H	
 
 #include "shm_alloc.h"
+#include "clht_stats.h"
+#include "clht_events.h"
+#include "clht_hot.h"
+#include "clht_ttl.h"
+#include "clht_deleg.h"
+#include "clht_watch.h"
+#include "clht_slab.h"
+#include "clht_ebr.h"
 
 typedef shm_offt SHM_off;
 
-#include "clht_lf_res.h"
+/* The variant is selected at compile time by the Makefile target */
+#if defined(CLHT_LB_RES)
+#  include "clht_lb_res.h"
+#elif defined(CLHT_LB)
+#  include "clht_lb.h"
+#elif defined(CLHT_LB_LINKED)
+#  include "clht_lb_linked.h"
+#elif defined(CLHT_LB_PACKED)
+#  include "clht_lb_packed.h"
+#elif defined(CLHT_LB_LOCK_INS)
+#  include "clht_lb_lock_ins.h"
+#else
+#  include "clht_lf_res.h"
+#endif
+
+// VMs that can publish per-VM data in the comm region
+#define CLHT_SHM_MAX_VMS 16
+
+struct clht_lat;
 
 void * clht_shm_init(int node, int force_init, int num_buckets, int num_vms);
 void clht_shm_term(int node);
+void clht_shm_barrier(uint64_t num_vms);
+struct clht_lat * clht_shm_lat(int node);
+int clht_shm_attach_stats();
+const clht_stats_vm_t * clht_shm_stats(int node);
+const clht_event_ring_t * clht_shm_events();
+const clht_hot_thread_t * clht_shm_hot(int node, int thread);
+int clht_shm_node_id();
+int clht_shm_num_vms();
+clht_deleg_ring_t * clht_shm_deleg_ring(int from, int to);
 
 SHM_off clht_shm_alloc(uint64_t size);
 void clht_shm_free(SHM_off off);
 uint64_t clht_get_shm_base_addr();
 
 SHM_off clht_table_alloc(uint64_t num_buckets);
+SHM_off clht_table_alloc_size(uint64_t size);
 void clht_table_free(uint64_t num_buckets);
 
 #define GET_SHM_BASE_ADDR() clht_get_shm_base_addr()
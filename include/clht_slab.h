@@ -0,0 +1,69 @@
+/*
+ *   File: clht_slab.h
+ *   Description:
+ *   Size-class slabs for the shared allocations of CLHT (clht_shm_alloc):
+ *   the clht_t, GC thread descriptors, overflow buckets, table headers and
+ *   any other out-of-line object of up to CLHT_SLAB_MAX bytes. A slab is
+ *   CLHT_SLAB_SIZE bytes of the table area, aligned to its size, and holds
+ *   objects of one power-of-two class. Slabs are carved by one VM, which
+ *   hands their objects to its threads; every thread caches up to
+ *   CLHT_SLAB_CACHE free objects per class and exchanges batches of them
+ *   with its VM under a process-local lock. A free keeps the object in the
+ *   VM that frees it, whichever VM carved it. The only cross-host
+ *   synchronization is the CAS on the end of the table area that claims a
+ *   new slab. Larger objects still go to shm_malloc.
+ *
+ *   Slabs are never given back: the objects of a VM that leaves stay in
+ *   its slabs until the region is initialized again. The class of every
+ *   slab is kept in a byte map of the table area (the only shared state),
+ *   from which clht_shm_free finds the class of an object.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_SLAB_H_
+#define _CLHT_SLAB_H_
+
+#include <stdint.h>
+
+/* 256KB; divides the 2MB alignment of the table area */
+#define CLHT_SLAB_SIZE      (1ULL << 18)
+/* classes of 64B (one bucket) up to 4KB */
+#define CLHT_SLAB_MIN_SHIFT 6
+#define CLHT_SLAB_CLASSES   7
+#define CLHT_SLAB_MAX       (1ULL << (CLHT_SLAB_MIN_SHIFT + CLHT_SLAB_CLASSES - 1))
+
+/* free objects a thread keeps per class; it gets and returns half at once */
+#define CLHT_SLAB_CACHE     64
+#define CLHT_SLAB_BATCH     (CLHT_SLAB_CACHE / 2)
+
+/* the class of a size of at most CLHT_SLAB_MAX */
+static inline int
+clht_slab_class(uint64_t size)
+{
+  return size <= (1ULL << CLHT_SLAB_MIN_SHIFT) ? 0 : 64 - __builtin_clzll(size - 1) - CLHT_SLAB_MIN_SHIFT;
+}
+
+/* returns the free objects cached by the calling thread to its VM; done
+   at thread exit for the threads that allocated */
+void clht_slab_thread_flush();
+
+#endif	/* _CLHT_SLAB_H_ */
@@ -0,0 +1,84 @@
+/*
+ *   File: clht_stats.h
+ *   Description:
+ *   Per-VM statistics page in the comm region. Every thread owns one
+ *   cache line of counters (single writer, plain increments); resize and
+ *   GC counters are only written under the global resize/gc locks. The
+ *   page is read by clht_stat without synchronization.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_STATS_H_
+#define _CLHT_STATS_H_
+
+#include <stdint.h>
+
+#ifndef CLHT_DO_STATS
+#  define CLHT_DO_STATS 1
+#endif
+
+#define CLHT_STATS_MAX_THREADS 64
+
+typedef struct __attribute__ ((aligned (64))) clht_stats_thread
+{
+  volatile uint64_t get;
+  volatile uint64_t get_hit;
+  volatile uint64_t put;
+  volatile uint64_t put_suc;
+  volatile uint64_t remove;
+  volatile uint64_t remove_suc;
+  volatile uint64_t cas_retries;
+  volatile uint64_t empty_retries;
+  volatile uint64_t evictions;	/* CLHT_CACHE */
+  volatile uint64_t cow_saves;	/* buckets saved for snapshots */
+} clht_stats_thread_t;
+
+typedef struct __attribute__ ((aligned (64))) clht_stats_vm
+{
+  volatile uint64_t active;	/* VM attached to the table */
+  volatile uint64_t num_threads;
+  volatile double ticks_per_ns;
+  volatile uint64_t num_buckets; /* of the table in use, as last seen by this VM */
+  volatile uint64_t resizes;
+  volatile uint64_t resize_ticks;
+  volatile uint64_t gc_runs;
+  volatile uint64_t gc_collected;
+  volatile uint64_t gc_ticks;
+  clht_stats_thread_t thread[CLHT_STATS_MAX_THREADS];
+} clht_stats_vm_t;
+
+extern __thread clht_stats_thread_t* clht_stats_thr;
+extern clht_stats_vm_t* clht_stats_vm;
+
+void clht_stats_thread_init(int id);
+
+#if CLHT_DO_STATS == 1
+#  define CLHT_STAT_INC(field)       clht_stats_thr->field++
+#  define CLHT_STAT_VM_ADD(field, v) clht_stats_vm->field += (v)
+#  define CLHT_STAT_VM_SET(field, v) clht_stats_vm->field = (v)
+#else
+#  define CLHT_STAT_INC(field)
+#  define CLHT_STAT_VM_ADD(field, v)
+#  define CLHT_STAT_VM_SET(field, v)
+#endif
+
+#endif	/* _CLHT_STATS_H_ */
@@ -0,0 +1,62 @@
+/*
+ *   File: clht_ttl.h
+ *   Description:
+ *   Cluster clock for the expiry of CLHT-LF entries (build with -DCLHT_TTL,
+ *   e.g. make TTL=1). The clock lives in the comm region and counts ticks
+ *   of CLHT_TTL_TICK_MS since the epoch set by the VM that initialized the
+ *   region. Every VM advances it from its own CLOCK_REALTIME, and it only
+ *   moves forward, so all VMs read the same time: the latest clock in the
+ *   cluster.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_TTL_H_
+#define _CLHT_TTL_H_
+
+#include <stdint.h>
+#include "clht_atomic.h"
+
+#define CLHT_TTL_TICK_MS 100	/* clock and TTL resolution; 32-bit ticks last 13 years */
+#define CLHT_TTL_NEVER   0	/* expiry of an entry without TTL */
+
+typedef struct __attribute__ ((aligned (64))) clht_clock
+{
+  uint64_t epoch_ns;		/* CLOCK_REALTIME of tick 0 */
+  uint32_t now;			/* ticks since epoch_ns, max of the VMs' clocks */
+} clht_clock_t;
+
+/* the clock of the comm region, NULL before clht_shm_init */
+extern clht_clock_t* clht_clock;
+
+#if !defined(__cplusplus)
+/* the current cluster time, as last advanced by any VM */
+static inline uint32_t
+clht_clock_now()
+{
+  return CLHT_LOAD(&clht_clock->now, relaxed);
+}
+#endif
+
+/* moves the cluster time up to the local clock; returns the new time */
+uint32_t clht_clock_advance();
+
+#endif	/* _CLHT_TTL_H_ */
@@ -0,0 +1,92 @@
+/*
+ *   File: clht_watch.h
+ *   Description:
+ *   Change notification for clht_watch. A VM that watches a bucket sets
+ *   its bit in the filter slot of the bucket and counts itself in
+ *   watchers. A writer that changed a bucket checks watchers, which stays
+ *   0 and in its cache while nobody watches, and only then the filter, to
+ *   bump the notification word of every VM with a watch on that slot.
+ *   Watchers wait on the word of their own VM: it is read from the local
+ *   cache until a writer bumps it. A resize bumps the words of all VMs.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CLHT_WATCH_H_
+#define _CLHT_WATCH_H_
+
+#include <stdint.h>
+#include "clht_atomic.h"
+
+#define CLHT_WATCH_SLOTS        4096	/* filter slots, bucket bin & (CLHT_WATCH_SLOTS - 1) */
+#define CLHT_WATCH_MAX_VMS      16	/* bits of a filter slot */
+#define CLHT_WATCH_SPINS        4096	/* polls of the notification word before sleeping */
+#define CLHT_WATCH_SLEEP_MAX_US 1000	/* the sleeps double up to this */
+
+typedef struct __attribute__ ((aligned (64))) clht_watch_word
+{
+  uint64_t seq;			/* bumped for every change a VM may wait for */
+} clht_watch_word_t;
+
+typedef struct __attribute__ ((aligned (64))) clht_watch_region
+{
+  uint64_t watchers;		/* filter bits set, in all VMs */
+  uint8_t padding[56];
+  uint16_t filter[CLHT_WATCH_SLOTS];	/* bit v: VM v watches a bucket of the slot */
+  clht_watch_word_t notify[CLHT_WATCH_MAX_VMS];
+} clht_watch_region_t;
+
+/* the watch region of the comm region, NULL before clht_shm_init */
+extern clht_watch_region_t* clht_watches;
+
+#if !defined(__cplusplus)
+/* after an update of bucket bin, ordered before by a seq_cst CAS or fence */
+#  define CLHT_WATCH_NOTIFY(bin)					\
+  do									\
+    {									\
+      if (__builtin_expect (CLHT_LOAD (&clht_watches->watchers, seq_cst) != 0, 0)) \
+        clht_watch_notify (bin);					\
+    }									\
+  while (0)
+
+#  define CLHT_WATCH_NOTIFY_ALL()					\
+  do									\
+    {									\
+      if (__builtin_expect (CLHT_LOAD (&clht_watches->watchers, seq_cst) != 0, 0)) \
+        clht_watch_notify_all ();					\
+    }									\
+  while (0)
+#endif
+
+void clht_watch_notify(uint64_t bin);
+void clht_watch_notify_all();
+
+/* filter registration of this VM, counted per slot */
+void clht_watch_register(uint64_t bin);
+void clht_watch_unregister(uint64_t bin);
+
+/* the notification word of this VM */
+uint64_t clht_watch_seq();
+/* waits until the word is no longer seq, spinning first and then
+   sleeping; returns 0 if deadline_ns (CLOCK_REALTIME, 0: none) passed */
+int clht_watch_wait(uint64_t seq, uint64_t deadline_ns);
+
+#endif	/* _CLHT_WATCH_H_ */
@@ -0,0 +1,341 @@
+/*
+ *   File: ycsb.h
+ *   Description:
+ *   YCSB-style operation mixes and key distributions (uniform, zipfian,
+ *   latest, hotspot) for the CLHT benchmarks. Every thread owns its
+ *   generator state, so drawing keys never synchronizes.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _YCSB_H_
+#define _YCSB_H_
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "prand.h"
+#include "clht_atomic.h"
+
+enum ycsb_op
+  {
+    YCSB_READ,
+    YCSB_UPDATE,
+    YCSB_INSERT,
+    YCSB_REMOVE,
+    YCSB_SCAN,
+    YCSB_RMW,
+    YCSB_NUM_OPS
+  };
+
+enum ycsb_dist
+  {
+    YCSB_UNIFORM,
+    YCSB_ZIPFIAN,
+    YCSB_LATEST,
+    YCSB_HOTSPOT
+  };
+
+#define YCSB_ZIPF_THETA_DEFAULT 0.99
+#define YCSB_HOT_SET_PERC       20 /* % of the key space that is hot */
+#define YCSB_HOT_OPS_PERC       80 /* % of the operations that hit the hot set */
+#define YCSB_SCAN_LEN_MAX       100
+
+typedef struct ycsb_workload
+{
+  /* percentage per enum ycsb_op, sums up to 100 */
+  uint32_t mix[YCSB_NUM_OPS];
+  enum ycsb_dist dist;
+  /* keys are 1..num_keys (0 is the empty key in CLHT) */
+  uint64_t num_keys;
+  double theta;
+  /* zipfian constants, computed once by ycsb_workload_init */
+  double zetan;
+  double zeta2;
+  double alpha;
+  double eta;
+  /* next fresh key for inserts under YCSB_LATEST */
+  uint64_t insert_next;
+  uint32_t insert_stride;
+} ycsb_workload_t;
+
+typedef struct ycsb_gen
+{
+  unsigned long* seeds;
+  const ycsb_workload_t* w;
+} ycsb_gen_t;
+
+static const char* const ycsb_op_names[YCSB_NUM_OPS] =
+  {
+    "read", "update", "insert", "remove", "scan", "rmw"
+  };
+
+static inline double
+ycsb_zeta(uint64_t n, double theta)
+{
+  double sum = 0;
+  uint64_t i;
+  for (i = 1; i <= n; i++)
+    {
+      sum += 1.0 / pow((double) i, theta);
+    }
+  return sum;
+}
+
+/*
+ * Set the mix of a YCSB core workload (A-F). Scans (E) are emulated as runs
+ * of consecutive gets, since CLHT has no ordered iteration. Returns 0 on an
+ * unknown preset.
+ */
+static inline int
+ycsb_workload_preset(ycsb_workload_t* w, char preset)
+{
+  memset(w->mix, 0, sizeof(w->mix));
+  w->dist = YCSB_ZIPFIAN;
+
+  switch (preset)
+    {
+    case 'A': case 'a':
+      w->mix[YCSB_READ] = 50; w->mix[YCSB_UPDATE] = 50;
+      break;
+    case 'B': case 'b':
+      w->mix[YCSB_READ] = 95; w->mix[YCSB_UPDATE] = 5;
+      break;
+    case 'C': case 'c':
+      w->mix[YCSB_READ] = 100;
+      break;
+    case 'D': case 'd':
+      w->mix[YCSB_READ] = 95; w->mix[YCSB_INSERT] = 5;
+      w->dist = YCSB_LATEST;
+      break;
+    case 'E': case 'e':
+      w->mix[YCSB_SCAN] = 95; w->mix[YCSB_INSERT] = 5;
+      break;
+    case 'F': case 'f':
+      w->mix[YCSB_READ] = 50; w->mix[YCSB_RMW] = 50;
+      break;
+    default:
+      return 0;
+    }
+  return 1;
+}
+
+/*
+ * Parse a custom mix "read:update:insert:remove:scan:rmw" (trailing fields
+ * may be omitted). Returns 0 if the percentages do not add up to 100.
+ */
+static inline int
+ycsb_workload_parse_mix(ycsb_workload_t* w, const char* str)
+{
+  memset(w->mix, 0, sizeof(w->mix));
+  sscanf(str, "%u:%u:%u:%u:%u:%u", &w->mix[YCSB_READ], &w->mix[YCSB_UPDATE], &w->mix[YCSB_INSERT],
+	 &w->mix[YCSB_REMOVE], &w->mix[YCSB_SCAN], &w->mix[YCSB_RMW]);
+
+  uint32_t i, sum = 0;
+  for (i = 0; i < YCSB_NUM_OPS; i++)
+    {
+      sum += w->mix[i];
+    }
+  return sum == 100;
+}
+
+static inline int
+ycsb_workload_parse_dist(ycsb_workload_t* w, const char* str)
+{
+  if (!strcmp(str, "uniform"))
+    {
+      w->dist = YCSB_UNIFORM;
+    }
+  else if (!strcmp(str, "zipfian"))
+    {
+      w->dist = YCSB_ZIPFIAN;
+    }
+  else if (!strcmp(str, "latest"))
+    {
+      w->dist = YCSB_LATEST;
+    }
+  else if (!strcmp(str, "hotspot"))
+    {
+      w->dist = YCSB_HOTSPOT;
+    }
+  else
+    {
+      return 0;
+    }
+  return 1;
+}
+
+/*
+ * Compute the distribution constants. The first num_preloaded keys are the
+ * ones present after the preload; fresh inserts (YCSB_LATEST) of VM vm_id
+ * continue after them, interleaved across the num_vms VMs.
+ */
+static inline void
+ycsb_workload_init(ycsb_workload_t* w, uint64_t num_keys, uint64_t num_preloaded, int vm_id, int num_vms)
+{
+  w->num_keys = num_keys;
+  if (w->theta == 0)
+    {
+      w->theta = YCSB_ZIPF_THETA_DEFAULT;
+    }
+
+  if (w->dist == YCSB_ZIPFIAN || w->dist == YCSB_LATEST)
+    {
+      w->zetan = ycsb_zeta(num_keys, w->theta);
+      w->zeta2 = ycsb_zeta(2, w->theta);
+      w->alpha = 1.0 / (1.0 - w->theta);
+      w->eta = (1 - pow(2.0 / num_keys, 1 - w->theta)) / (1 - w->zeta2 / w->zetan);
+    }
+
+  w->insert_stride = num_vms;
+  w->insert_next = num_preloaded + 1 + vm_id;
+}
+
+static inline void
+ycsb_gen_init(ycsb_gen_t* g, const ycsb_workload_t* w)
+{
+  g->seeds = seed_rand();
+  g->w = w;
+}
+
+static inline uint64_t
+ycsb_rand(ycsb_gen_t* g)
+{
+  return xorshf96(&g->seeds[0], &g->seeds[1], &g->seeds[2]);
+}
+
+/* uniform in [0, 1) */
+static inline double
+ycsb_rand_double(ycsb_gen_t* g)
+{
+  return (ycsb_rand(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Gray et al., "Quickly generating billion-record synthetic databases" */
+static inline uint64_t
+ycsb_zipf_rank(ycsb_gen_t* g)
+{
+  const ycsb_workload_t* w = g->w;
+  double u = ycsb_rand_double(g);
+  double uz = u * w->zetan;
+
+  if (uz < 1.0)
+    {
+      return 0;
+    }
+  if (uz < 1.0 + pow(0.5, w->theta))
+    {
+      return 1;
+    }
+  uint64_t r = (uint64_t) (w->num_keys * pow(w->eta * u - w->eta + 1, w->alpha));
+  return r < w->num_keys ? r : w->num_keys - 1;
+}
+
+/* FNV-1a, spreads the zipfian popular ranks over the key space */
+static inline uint64_t
+ycsb_scramble(uint64_t rank)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  int i;
+  for (i = 0; i < 8; i++)
+    {
+      h ^= rank & 0xff;
+      h *= 0x100000001b3ULL;
+      rank >>= 8;
+    }
+  return h;
+}
+
+static inline uint64_t
+ycsb_next_key(ycsb_gen_t* g)
+{
+  const ycsb_workload_t* w = g->w;
+  uint64_t n = w->num_keys;
+
+  switch (w->dist)
+    {
+    case YCSB_ZIPFIAN:
+      return (ycsb_scramble(ycsb_zipf_rank(g)) % n) + 1;
+    case YCSB_LATEST:
+      {
+	/* the most recently inserted keys are the most popular ones */
+	uint64_t next = CLHT_LOAD(&w->insert_next, relaxed);
+	uint64_t newest = next > w->insert_stride ? next - w->insert_stride : 1;
+	uint64_t rank = ycsb_zipf_rank(g) % newest;
+	return newest - rank;
+      }
+    case YCSB_HOTSPOT:
+      {
+	uint64_t hot = (n * YCSB_HOT_SET_PERC) / 100;
+	if (hot == 0)
+	  {
+	    hot = 1;
+	  }
+	if ((ycsb_rand(g) % 100) < YCSB_HOT_OPS_PERC || hot == n)
+	  {
+	    return (ycsb_rand(g) % hot) + 1;
+	  }
+	return hot + (ycsb_rand(g) % (n - hot)) + 1;
+      }
+    case YCSB_UNIFORM:
+    default:
+      return (ycsb_rand(g) % n) + 1;
+    }
+}
+
+/*
+ * Key for an insert: a fresh key under YCSB_LATEST (the newest key then
+ * becomes the hottest one), otherwise a key drawn from the distribution.
+ */
+static inline uint64_t
+ycsb_insert_key(ycsb_gen_t* g, ycsb_workload_t* w)
+{
+  if (w->dist == YCSB_LATEST)
+    {
+      return CLHT_FAA(&w->insert_next, w->insert_stride, relaxed);
+    }
+  return ycsb_next_key(g);
+}
+
+static inline enum ycsb_op
+ycsb_next_op(ycsb_gen_t* g)
+{
+  uint32_t r = ycsb_rand(g) % 100;
+  uint32_t i, acc = 0;
+  for (i = 0; i < YCSB_NUM_OPS - 1; i++)
+    {
+      acc += g->w->mix[i];
+      if (r < acc)
+	{
+	  break;
+	}
+    }
+  return (enum ycsb_op) i;
+}
+
+static inline uint32_t
+ycsb_scan_len(ycsb_gen_t* g)
+{
+  return (ycsb_rand(g) % YCSB_SCAN_LEN_MAX) + 1;
+}
+
+#endif	/* _YCSB_H_ */
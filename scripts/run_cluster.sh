@@ -0,0 +1,124 @@
+#!/bin/bash
+
+# Scalability sweep over the shared CXL backend: for every
+# (#vms, #threads, update%) point, start one benchmark process per "VM",
+# let them meet on the shm barrier, and sum the per-VM throughput.
+#
+# Usage: ./scripts/run_cluster.sh [-p PROG] [-b BUCKETS] [-d DURATION]
+#            [-v "VMS"] [-t "THREADS"] [-u "UPDATES"] [-H "HOSTS"] [-o OUT]
+#            [-a "BENCH_ARGS"]
+#
+# BENCH_ARGS are passed to every VM, e.g. -a "-z zipfian -k 1000000 -l 50".
+# With -H, VM i is started over ssh on host (i mod #hosts), from the same
+# directory; otherwise all VMs are local processes.
+
+prog=./clht_lf_res;
+buckets=4096;
+duration=5;
+vms_all="1 2 4";
+threads_all="1 2 4 8";
+updates_all="0 10 50";
+hosts="";
+out="./data/cluster";
+bench_args="";
+
+while getopts "p:b:d:v:t:u:H:o:a:" opt;
+do
+    case $opt in
+	p) prog=$OPTARG;;
+	b) buckets=$OPTARG;;
+	d) duration=$OPTARG;;
+	v) vms_all=$OPTARG;;
+	t) threads_all=$OPTARG;;
+	u) updates_all=$OPTARG;;
+	H) hosts=($OPTARG);;
+	o) out=$OPTARG;;
+	a) bench_args=$OPTARG;;
+	*) echo "Usage: $0 [-p PROG] [-b BUCKETS] [-d DURATION] [-v VMS] [-t THREADS] [-u UPDATES] [-H HOSTS] [-o OUT] [-a BENCH_ARGS]"; exit 1;;
+    esac;
+done;
+
+mkdir -p $out/logs;
+csv=$out/cluster.csv;
+echo "vms,threads,update,throughput,vm_min,vm_max" > $csv;
+
+start_vm()
+{
+    local vm=$1; shift;
+    local log=$1; shift;
+    if [ -n "$hosts" ];
+    then
+	local host=${hosts[$((vm % ${#hosts[@]}))]};
+	ssh $host "cd $(pwd) && $prog $@" > $log 2>&1 &
+    else
+	$prog "$@" > $log 2>&1 &
+    fi;
+}
+
+for vms in $vms_all
+do
+    for threads in $threads_all
+    do
+	for update in $updates_all
+	do
+	    tag="v$vms.t$threads.u$update";
+	    printf "* %-16s : " $tag;
+
+	    # VM 0 (re)initializes the table, the others only attach to it
+	    start_vm 0 $out/logs/$tag.0.log -i0 -b$buckets -t$threads -d$duration -v$vms -u$update $bench_args;
+	    leader=$!;
+	    until grep -q "Initializing CLHT" $out/logs/$tag.0.log 2> /dev/null;
+	    do
+		if ! kill -0 $leader 2> /dev/null;
+		then
+		    break;
+		fi;
+		sleep 0.1;
+	    done;
+
+	    for vm in $(seq 1 1 $((vms - 1)));
+	    do
+		start_vm $vm $out/logs/$tag.$vm.log -i$vm -t$threads -d$duration -v$vms -u$update $bench_args;
+	    done;
+	    wait;
+
+	    line=$(cat $out/logs/$tag.*.log | grep "^#vm" | \
+		gawk -v n=$vms '{ t=$4; sum+=t; if (min=="" || t<min) min=t; if (t>max) max=t; i++ }
+                  END { if (i != n) print "FAILED"; else printf "%.0f,%.0f,%.0f", sum, min, max }');
+	    echo $line;
+	    if [ "$line" != "FAILED" ];
+	    then
+		echo "$vms,$threads,$update,$line" >> $csv;
+	    fi;
+	done;
+    done;
+done;
+
+if ! which gnuplot > /dev/null 2>&1;
+then
+    exit 0;
+fi;
+
+# one plot per update ratio: throughput over threads/VM, one line per #vms
+for update in $updates_all
+do
+    gp=$out/cluster.u$update.gp;
+    eps=$out/cluster.u$update.eps;
+    cp ./scripts/lock-free.gp $gp;
+    cat << EOF >> $gp
+set datafile separator ",";
+set xlabel "Threads per VM";
+set xtics 1;
+set title "CLHT over CXL / Update: $update%";
+set output "$eps";
+plot \\
+EOF
+    ls_i=1;
+    for vms in $vms_all
+    do
+	echo "\"< gawk -F, '\$1==$vms && \$3==$update' $csv\" using 2:4 title \"$vms VMs\" ls $ls_i with linespoints, \\" >> $gp;
+	ls_i=$((ls_i + 1));
+    done;
+    sed -i '$ s/, \\$//' $gp;
+    gnuplot $gp;
+done;
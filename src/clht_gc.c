@@ -28,7 +28,8 @@
  *
  */
 
-#include "clht_lf_res.h"
+#include "clht_shm.h"
+#include "clht_phase.h"
 #include <assert.h>
 #include <malloc.h>
 
@@ -44,38 +45,52 @@ static __thread ht_ts_t* clht_ts_thread = NULL;
 void
 clht_gc_thread_init(clht_t* h, int id)
 {
-
-
+  /* CLHT-LF allocates only through clht_shm_alloc (clht_slab.h), not ssmem */
+#if !defined(_CLHT_LF_RES_H_)
   clht_alloc = (ssmem_allocator_t*) malloc(sizeof(ssmem_allocator_t));
   assert(clht_alloc != NULL);
   ssmem_alloc_init_fs_size(clht_alloc, SSMEM_DEFAULT_MEM_SIZE, SSMEM_GC_FREE_SET_SIZE, id);
+#endif
 
   SHM_off ts_off = clht_shm_alloc(sizeof(ht_ts_t));
   assert(ts_off != SHM_NULL);
 
   ht_ts_t* ts = (ht_ts_t*) SHR_OFF_TO_PTR(ts_off);
 
-  ts->version = ((clht_hashtable_t*) SHR_OFF_TO_PTR(h->ht))->version;
+  /* no operation in progress until the first CLHT_GC_HT_VERSION_USED */
+  ts->version = (size_t) -1;
   ts->id = id;
 
-  SHM_off ts_next_off; 
-  do
+  SHM_off ts_next_off = CLHT_LOAD(&h->version_list, acquire);
+  SHM_off found;
+  while (1)
     {
-      ts_next_off = h->version_list;
+      ts->next = ts_next_off;
+      /* the list is linked through the uncached view, see clht_nc.h */
+      CLHT_NC_WB(ts, sizeof(ht_ts_t));
+      found = CLHT_CAS(&h->version_list, ts_next_off, ts_off, seq_cst);
+      if (found == ts_next_off)
+	{
+	  break;
+	}
+      ts_next_off = found;
     }
-  while (CAS_U64((volatile size_t*) &h->version_list, (size_t) ts_next_off, (size_t) ts_off) != (size_t) ts_next_off);
 
 
   clht_ts_thread = ts;
+
+  clht_stats_thread_init(id);
+  clht_ebr_thread_init(id);
+  clht_phase_thread_init();
 }
 
 /* 
  * set the ht version currently used by the current thread
  */
-inline void
+void
 clht_gc_thread_version(clht_hashtable_t* h)
 {
-  clht_ts_thread->version = h->version;
+  CLHT_STORE(&clht_ts_thread->version, CLHT_LOAD(&h->version, acquire), relaxed);
 }
 
 /* 
@@ -86,14 +101,14 @@ clht_gc_thread_version(clht_hashtable_t* h)
 void
 clht_gc_thread_version_max()
 {
-  clht_ts_thread->version = -1;
+  CLHT_STORE(&clht_ts_thread->version, (size_t) -1, relaxed);
 }
 
 
 /* 
  * get the GC id of the current thread
  */
-inline int 
+int
 clht_gc_get_id()
 {
   return clht_ts_thread->id;
@@ -101,6 +116,13 @@ clht_gc_get_id()
 
 static int clht_gc_collect_cond(clht_t* hashtable, int collect_not_referenced_only);
 
+#if defined(_CLHT_LF_RES_H_)
+/* a CLHT-LF table with a snapshot stays, and so do the later ones */
+#  define CLHT_GC_PINNED(ht) (CLHT_LOAD(&(ht)->cow_epoch, acquire) != 0)
+#else
+#  define CLHT_GC_PINNED(ht) 0
+#endif
+
 /* 
  * perform a GC of the versions of the ht that are not currently used by any
  * of the participating threads
@@ -136,19 +158,21 @@ clht_gc_collect_all(clht_t* hashtable)
 size_t
 clht_gc_min_version_used(clht_t* h)
 {
-  SHM_off           cur_off = h->version_list;
-  volatile ht_ts_t* cur = (volatile ht_ts_t*) SHR_OFF_TO_PTR(cur_off);
+  SHM_off  cur_off = CLHT_LOAD(&h->version_list, acquire);
+  ht_ts_t* cur = (ht_ts_t*) SHR_OFF_TO_PTR(cur_off);
 
-  size_t min = ((clht_hashtable_t*) SHR_OFF_TO_PTR(h->ht))->version;
+  clht_hashtable_t* ht = (clht_hashtable_t*) SHR_OFF_TO_PTR(CLHT_LOAD(&h->ht, acquire));
+  size_t min = CLHT_LOAD(&ht->version, acquire);
   while (cur != NULL)
     {
-      if (cur->version < min)
+      size_t version = CLHT_LOAD(&cur->version, acquire);
+      if (version < min)
     	{
-    	  min = cur->version;
+    	  min = version;
     	}
       
-      cur_off = cur->next;
-      cur = (volatile ht_ts_t*) SHR_OFF_TO_PTR(cur_off);
+      cur_off = CLHT_LOAD(&cur->next, relaxed);
+      cur = (ht_ts_t*) SHR_OFF_TO_PTR(cur_off);
     }
 
   return min;
@@ -162,6 +186,8 @@ clht_gc_min_version_used(clht_t* h)
 static int
 clht_gc_collect_cond(clht_t* hashtable, int collect_not_referenced_only)
 {
+  /* the checks and the lock holder read the clht_t with plain loads */
+  CLHT_NC_INVAL_RANGE(hashtable, sizeof(clht_t));
   /* if version_min >= current version there is nothing to collect! */
   if ((hashtable->version_min >= ((clht_hashtable_t*) SHR_OFF_TO_PTR(hashtable->ht))->version) || TRYLOCK_ACQ(&hashtable->gc_lock))
     {
@@ -170,6 +196,7 @@ clht_gc_collect_cond(clht_t* hashtable, int collect_not_referenced_only)
     }
 
   ticks s = getticks();
+  CLHT_NC_INVAL_RANGE(hashtable, sizeof(clht_t));
 
   /* printf("[GCOLLE-%02d] LOCK  : %zu\n", GET_ID(collect_not_referenced_only), hashtable->version); */
 
@@ -195,29 +222,37 @@ clht_gc_collect_cond(clht_t* hashtable, int collect_not_referenced_only)
 
       clht_hashtable_t* cur = (clht_hashtable_t*) SHR_OFF_TO_PTR(hashtable->ht_oldest);
       SHM_off cur_off = hashtable->ht_oldest;
-      while (cur != NULL && cur->version < version_min)
+      CLHT_NC_INVAL_RANGE(cur, sizeof(clht_hashtable_t));
+      while (cur != NULL && cur->version < version_min && !CLHT_GC_PINNED(cur))
     	{
     	  gced_num++;
     	  clht_hashtable_t* nxt = (clht_hashtable_t*) SHR_OFF_TO_PTR(cur->table_new);
         SHM_off nxt_off = cur->table_new;
+        CLHT_NC_INVAL_RANGE(nxt, sizeof(clht_hashtable_t));
     	  /* printf("[GCOLLE-%02d] gc_free version: %6zu | current version: %6zu\n", GET_ID(collect_not_referenced_only), */
     	  /* 	 cur->version, hashtable->ht->version); */
-    	  nxt->table_prev = SHM_NULL;
+    	  CLHT_STORE(&nxt->table_prev, SHM_NULL, relaxed);
     	  clht_gc_free(cur);
     	  cur = nxt;
         cur_off = nxt_off;
     	}
 
-      hashtable->version_min = cur->version;
-      hashtable->ht_oldest = cur_off;
+      /* the line is shared with the locks and the version list */
+      CLHT_STORE(&hashtable->version_min, cur->version, relaxed);
+      CLHT_STORE(&hashtable->ht_oldest, cur_off, relaxed);
 
       TRYLOCK_RLS(hashtable->gc_lock);
       /* printf("[GCOLLE-%02d] UNLOCK: %zu\n", GET_ID(collect_not_referenced_only), cur->version); */
     }
 
   ticks e = getticks() - s;
-  printf("[GCOLLE-%02d] collected: %-3d | took: %13llu ti = %8.6f s\n", 
-	 GET_ID(collect_not_referenced_only), gced_num, (unsigned long long) e, e / 2.1e9);
+  CLHT_STAT_VM_ADD(gc_runs, 1);
+  CLHT_STAT_VM_ADD(gc_collected, gced_num);
+  CLHT_STAT_VM_ADD(gc_ticks, e);
+  if (gced_num > 0)
+    {
+      clht_event_log(CLHT_EV_GC, gced_num, hashtable->version_min, clht_ticks_to_ns(e), 0, 0);
+    }
 
 
   return gced_num;
@@ -239,19 +274,23 @@ clht_gc_free(clht_hashtable_t* hashtable)
   for (bin = 0; bin < num_buckets; bin++)
     {
       bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
-      bucket = (bucket_t*) SHR_OFF_TO_PTR(bucket->next);
-      bucket_off = SHR_PTR_TO_OFF(bucket);
+      bucket_off = bucket->next;
       
-      while (bucket != NULL)
+      while (bucket_off != SHM_NULL)
       	{
-      	  bucket = SHR_OFF_TO_PTR(bucket->next);
+      	  bucket = (bucket_t*) SHR_OFF_TO_PTR(bucket_off);
+      	  SHM_off next_off = bucket->next;
       	  clht_shm_free(bucket_off);
+      	  bucket_off = next_off;
       	}
     }
 #endif
 
   clht_table_free(hashtable->table);
+  /* with CLHT_NONCOHERENT, the header is in the table area, never freed */
+#if !defined(CLHT_NONCOHERENT)
   clht_shm_free(SHR_PTR_TO_OFF(hashtable));
+#endif
 
   return 1;
 }
@@ -273,9 +312,9 @@ clht_gc_destroy(clht_t* hashtable)
 }
 
 /* 
- * uses the ssmem_release function to return some memory
- * to the OS (free), when it is safe (nobody is using it
- * anymore)
+ * retires an old table: its header and overflow buckets are freed once
+ * no clht_ebr_enter section can use them anymore (clht_ebr.h); the
+ * table itself is in the table area
  */
 inline int
 clht_gc_release(clht_hashtable_t* hashtable)
@@ -289,19 +328,28 @@ clht_gc_release(clht_hashtable_t* hashtable)
   for (bin = 0; bin < num_buckets; bin++)
     {
       bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
-      bucket = SHR_OFF_TO_PTR(bucket->next);
-      while (bucket != NULL)
+      SHM_off bucket_off = bucket->next;
+      while (bucket_off != SHM_NULL)
   	{
-  	  volatile bucket_t* cur = bucket;
-  	  bucket = SHR_OFF_TO_PTR(bucket->next);
-  	  ssmem_release(clht_alloc, (void*) cur);
+  	  bucket = (bucket_t*) SHR_OFF_TO_PTR(bucket_off);
+  	  SHM_off next_off = bucket->next;
+  	  clht_ebr_retire(bucket_off, clht_shm_free);
+  	  bucket_off = next_off;
   	}
     }
 #endif
 
-  ssmem_release(clht_alloc, SHR_OFF_TO_PTR(hashtable->table));
-  ssmem_release(clht_alloc, hashtable);
+  clht_ebr_retire(SHR_PTR_TO_OFF(hashtable), clht_shm_free);
   return 1;
 }
 
-
+clht_val_t
+clht_remove_and_retire(clht_t* hashtable, clht_addr_t key, clht_ebr_free_fn free_fn)
+{
+  clht_val_t val = clht_remove(hashtable, key);
+  if (val != 0)
+    {
+      clht_ebr_retire((SHM_off) val, free_fn);
+    }
+  return val;
+}
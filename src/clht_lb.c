@@ -35,8 +35,6 @@
 
 #include "clht_lb.h"
 
-#include "shm_alloc.h"
-
 __thread ssmem_allocator_t* clht_alloc;
 
 #ifdef DEBUG
@@ -86,15 +84,15 @@ __ac_Jenkins_hash_64(uint64_t key)
 bucket_t*
 clht_bucket_create() 
 {
-  shm_offt bucket_off = SHM_NULL;
-  bucket_off = shm_malloc(sizeof(bucket_t));
+  SHM_off bucket_off = SHM_NULL;
+  bucket_off = clht_shm_alloc(sizeof(bucket_t));
   if (bucket_off == SHM_NULL)
     {
-      printf("** shm_malloc @ clht_bucket_create\n");
+      printf("** clht_shm_alloc @ clht_bucket_create\n");
       return NULL;
     }
 
-  bucket_t* bucket = SHM_OFFT_TO_ADDR(bucket_off);
+  bucket_t* bucket = SHR_OFF_TO_PTR(bucket_off);
 
   bucket->lock = 0;
 
@@ -108,30 +106,30 @@ clht_bucket_create()
   return bucket;
 }
 
-clht_t* 
+SHM_off
 clht_create(uint64_t num_buckets)
 {
-  shm_offt w_off = SHM_NULL;
-  w_off = shm_malloc(sizeof(clht_t));
+  SHM_off w_off = SHM_NULL;
+  w_off = clht_shm_alloc(sizeof(clht_t));
   if (w_off == SHM_NULL)
     {
-      printf("** shm_malloc @ clht_create\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_create\n");
+      return SHM_NULL;
     }
 
-  clht_t* w = (clht_t*) SHM_OFFT_TO_ADDR(w_off);
+  clht_t* w = (clht_t*) SHR_OFF_TO_PTR(w_off);
   
   w->ht = clht_hashtable_create(num_buckets);
   if (w->ht == SHM_NULL)
     {
-      shm_free(w_off);
-      return NULL;
+      clht_shm_free(w_off);
+      return SHM_NULL;
     }
 
-  return w;
+  return w_off;
 }
 
-shm_offt
+SHM_off
 clht_hashtable_create(uint64_t num_buckets) 
 {
   clht_hashtable_t* hashtable = NULL;
@@ -142,28 +140,25 @@ clht_hashtable_create(uint64_t num_buckets)
     }
     
   /* Allocate the table itself. */
-  shm_offt hashtable_off = SHM_NULL;
-  hashtable_off = shm_malloc(sizeof(clht_hashtable_t));
+  SHM_off hashtable_off = SHM_NULL;
+  hashtable_off = clht_shm_alloc(sizeof(clht_hashtable_t));
   if (hashtable_off == SHM_NULL) 
     {
-      printf("** shm_malloc @ clht_hashtable_create hashtable\n");
+      printf("** clht_shm_alloc @ clht_hashtable_create hashtable\n");
       return SHM_NULL;
     }
 
-  hashtable = (clht_hashtable_t*) SHM_OFFT_TO_ADDR(hashtable_off);
-
+  hashtable = (clht_hashtable_t*) SHR_OFF_TO_PTR(hashtable_off);
 
-  hashtable->table =  shm_malloc(num_buckets * (sizeof(bucket_t)));
+  hashtable->table = clht_table_alloc(num_buckets);
   if (hashtable->table == SHM_NULL) 
     {
-      printf("** shm_malloc: clht_hashtable_create table\n"); 
-      shm_free(hashtable->table);
+      printf("** clht_table_alloc: clht_hashtable_create table\n"); 
+      clht_shm_free(hashtable_off);
       return SHM_NULL;
     }
 
-  bucket_t * table = SHM_OFFT_TO_ADDR(hashtable->table);
-  
-  memset(table, 0, num_buckets * (sizeof(bucket_t)));
+  bucket_t * table = SHR_OFF_TO_PTR(hashtable->table);
     
   uint64_t i;
   for (i = 0; i < num_buckets; i++)
@@ -195,10 +190,11 @@ clht_hash(clht_hashtable_t* hashtable, clht_addr_t key)
 
   /* Retrieve a key-value entry from a hash table. */
 clht_val_t
-clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
+clht_get(SHM_off hashtable_off, clht_addr_t key)
 {
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(hashtable_off);
   size_t bin = clht_hash(hashtable, key);
-  volatile bucket_t* bucket = SHM_OFFT_TO_ADDR(hashtable->table) + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
     
   uint32_t j;
   do 
@@ -222,7 +218,7 @@ clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
 	    }
 	}
 
-      bucket = SHM_OFFT_TO_ADDR(bucket->next);
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (bucket != NULL);
   return 0;
@@ -242,7 +238,7 @@ bucket_exists(bucket_t* bucket, clht_addr_t key)
 	    }
 	}
 
-      bucket = SHM_OFFT_TO_ADDR(bucket->next);
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (bucket != NULL);
   return false;
 }
@@ -252,9 +248,9 @@ bucket_exists(bucket_t* bucket, clht_addr_t key)
 int
 clht_put(clht_t* h, clht_addr_t key, clht_val_t val) 
 {
-  clht_hashtable_t* hashtable = SHM_OFFT_TO_ADDR(h->ht);
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash(hashtable, key);
-  bucket_t* bucket = ((bucket_t*) SHM_OFFT_TO_ADDR(hashtable->table)) + bin;
+  bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
 #if defined(READ_ONLY_FAIL)
   if (bucket_exists(bucket, key))
@@ -292,7 +288,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	    {
 	      DPP(put_num_failed_expand);
         bucket_t* next_ptr = clht_bucket_create();
-	      bucket->next = SHM_ADDR_TO_OFFT(next_ptr);
+	      bucket->next = SHR_PTR_TO_OFF(next_ptr);
 	      next_ptr->key[0] = key;
 #ifdef __tile__
 	      _mm_sfence();
@@ -312,7 +308,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	  return true;
 	}
 
-      bucket = SHM_OFFT_TO_ADDR(bucket->next);
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (true);
 }
 
@@ -322,9 +318,9 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 clht_val_t
 clht_remove(clht_t* h, clht_addr_t key)
 {
-  clht_hashtable_t* hashtable = SHM_OFFT_TO_ADDR(h->ht);
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash(hashtable, key);
-  bucket_t* bucket = ((bucket_t *) SHM_OFFT_TO_ADDR(hashtable->table)) + bin;
+  bucket_t* bucket = ((bucket_t *) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
 #if defined(READ_ONLY_FAIL)
   if (!bucket_exists(bucket, key))
@@ -349,7 +345,7 @@ clht_remove(clht_t* h, clht_addr_t key)
 	      return val;
 	    }
 	}
-      bucket = SHM_OFFT_TO_ADDR(bucket->next);
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (bucket != NULL);
   LOCK_RLS(lock);
   return false;
@@ -358,7 +354,7 @@ clht_remove(clht_t* h, clht_addr_t key)
 static uint32_t
 clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint64_t bin) 
 {
-  bucket_t* bucket = ((bucket_t*) SHM_OFFT_TO_ADDR(hashtable->table)) + bin;
+  bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
   clht_addr_t* empty = NULL;
   clht_val_t* empty_v = NULL;
   uint32_t j;
@@ -384,7 +380,7 @@ clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint6
 	    {
 	      DPP(put_num_failed_expand);
         bucket_t* next_ptr = clht_bucket_create();
-	      bucket->next = SHM_ADDR_TO_OFFT(next_ptr);
+	      bucket->next = SHR_PTR_TO_OFF(next_ptr);
 	      next_ptr->key[0] = key;
 	      next_ptr->val[0] = val;
 	    }
@@ -396,7 +392,7 @@ clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint6
 	  return true;
 	}
 
-      bucket = SHM_OFFT_TO_ADDR(bucket->next);
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (true);
 }
 
@@ -418,7 +414,7 @@ bucket_cpy(bucket_t* bucket, clht_hashtable_t* ht_new)
 	      clht_put_seq(ht_new, key, val, bin);
 	    }
 	}
-      bucket = SHM_OFFT_TO_ADDR(bucket->next);
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (bucket != NULL);
 
 }
@@ -426,8 +422,34 @@ bucket_cpy(bucket_t* bucket, clht_hashtable_t* ht_new)
 void
 clht_destroy(clht_hashtable_t* hashtable)
 {
-  shm_free(hashtable->table);
-  shm_free(SHM_ADDR_TO_OFFT(hashtable));
+  uint64_t bin;
+  for (bin = 0; bin < hashtable->num_buckets; bin++)
+    {
+      bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
+      SHM_off next = bucket->next;
+      while (next != SHM_NULL)
+	{
+	  bucket = SHR_OFF_TO_PTR(next);
+	  next = bucket->next;
+	  clht_shm_free(SHR_PTR_TO_OFF(bucket));
+	}
+    }
+
+  clht_table_free(hashtable->num_buckets);
+  clht_shm_free(SHR_PTR_TO_OFF(hashtable));
+}
+
+void
+clht_gc_thread_init(clht_t* h, int id)
+{
+  clht_stats_thread_init(id);
+}
+
+void
+clht_gc_destroy(clht_t* h)
+{
+  clht_destroy(SHR_OFF_TO_PTR(h->ht));
+  clht_shm_free(SHR_PTR_TO_OFF(h));
 }
 
 
@@ -442,7 +464,7 @@ clht_size(clht_hashtable_t* hashtable)
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = ((bucket_t*) SHM_OFFT_TO_ADDR(hashtable->table)) + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
        
       uint32_t j;
       do
@@ -455,7 +477,7 @@ clht_size(clht_hashtable_t* hashtable)
 		}
 	    }
 
-	  bucket = SHM_OFFT_TO_ADDR(bucket->next);
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	}
       while (bucket != NULL);
     }
@@ -468,14 +490,14 @@ clht_print(clht_hashtable_t* hashtable)
   uint64_t num_buckets = hashtable->num_buckets;
   bucket_t* bucket;
 
-  printf("Number of buckets: %u\n", num_buckets);
+  printf("Number of buckets: %zu\n", num_buckets);
 
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = ((bucket_t*) SHM_OFFT_TO_ADDR(hashtable->table)) + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
       
-      printf("[[%05d]] ", bin);
+      printf("[[%05zu]] ", bin);
 
       uint32_t j;
       do
@@ -488,7 +510,7 @@ clht_print(clht_hashtable_t* hashtable)
 		}
 	    }
 
-	  bucket = SHM_OFFT_TO_ADDR(bucket->next);
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	  printf(" ** -> ");
 	}
       while (bucket != NULL);
@@ -86,9 +86,9 @@ __ac_Jenkins_hash_64(uint64_t key)
 }
 
 /* Create a new bucket. */
-clht_hashtable_t* clht_hashtable_create(uint64_t num_buckets);
+SHM_off clht_hashtable_create(uint64_t num_buckets);
 
-clht_t* 
+SHM_off
 clht_create(uint64_t num_buckets)
 {
   if (unlikely(num_buckets == 1))
@@ -96,81 +96,85 @@ clht_create(uint64_t num_buckets)
       num_buckets++;
     }
 
-  clht_t* w = (clht_t*) memalign(CACHE_LINE_SIZE, sizeof(clht_t));
-  if (w == NULL)
+  SHM_off w_off = clht_shm_alloc(sizeof(clht_t));
+  if (w_off == SHM_NULL)
     {
-      printf("** malloc @ hatshtalbe\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_create\n");
+      return SHM_NULL;
     }
 
+  clht_t* w = (clht_t*) SHR_OFF_TO_PTR(w_off);
+
   w->ht = clht_hashtable_create(num_buckets);
-  if (w->ht == NULL)
+  if (w->ht == SHM_NULL)
     {
-      free(w);
-      return NULL;
+      clht_shm_free(w_off);
+      return SHM_NULL;
     }
   w->resize_lock = LOCK_FREE;
   w->gc_lock = LOCK_FREE;
   w->status_lock = LOCK_FREE;
-  w->version_list = NULL;
+  w->version_list = SHM_NULL;
   w->version_min = 0;
   w->ht_oldest = w->ht;
 
-  return w;
+  return w_off;
 }
 
-clht_hashtable_t* 
+SHM_off
 clht_hashtable_create(uint64_t num_buckets) 
 {
   clht_hashtable_t* hashtable = NULL;
     
   if (num_buckets == 0)
     {
-      return NULL;
+      return SHM_NULL;
     }
     
   /* Allocate the table itself. */
-  hashtable = (clht_hashtable_t*) memalign(CACHE_LINE_SIZE, sizeof(clht_hashtable_t));
-  if (hashtable == NULL) 
+  SHM_off hashtable_off = clht_shm_alloc(sizeof(clht_hashtable_t));
+  if (hashtable_off == SHM_NULL) 
     {
-      printf("** malloc @ hatshtalbe\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_hashtable_create hashtable\n");
+      return SHM_NULL;
     }
+
+  hashtable = (clht_hashtable_t*) SHR_OFF_TO_PTR(hashtable_off);
     
   size_t num_buckets_linked = num_buckets + CLHT_LINKED_MAX_EXPANSIONS_HARD;
 
-  hashtable->table = (bucket_t*) memalign(CACHE_LINE_SIZE,  num_buckets_linked * sizeof(bucket_t));
-  if (hashtable->table == NULL) 
+  hashtable->table = clht_table_alloc(num_buckets_linked);
+  if (hashtable->table == SHM_NULL) 
     {
-      printf("** alloc: hashtable->table\n"); fflush(stdout);
-      free(hashtable);
-      return NULL;
+      printf("** clht_table_alloc: clht_hashtable_create table\n"); fflush(stdout);
+      clht_shm_free(hashtable_off);
+      return SHM_NULL;
     }
 
-  memset(hashtable->table, 0, num_buckets * (sizeof(bucket_t)));
+  bucket_t* table = SHR_OFF_TO_PTR(hashtable->table);
     
   uint64_t i;
   for (i = 0; i < num_buckets_linked; i++)
     {
-      hashtable->table[i].lock = LOCK_FREE;
-      hashtable->table[i].hops = 0;
+      table[i].lock = LOCK_FREE;
+      table[i].hops = 0;
       uint32_t j;
       for (j = 0; j < ENTRIES_PER_BUCKET; j++)
 	{
-	  hashtable->table[i].key[j] = 0;
+	  table[i].key[j] = 0;
 	}
 
       /* link buckets to their next bucket (and last bucket with the first)*/
-      hashtable->table[i].next = &hashtable->table[(i+1) % num_buckets_linked]; 
+      table[i].next = SHR_PTR_TO_OFF(&table[(i+1) % num_buckets_linked]); 
     }
-  hashtable->table[num_buckets_linked - 1].next = NULL; /* avoid the cycle from n-1 to 0 */
+  table[num_buckets_linked - 1].next = SHM_NULL; /* avoid the cycle from n-1 to 0 */
 
   hashtable->num_buckets = num_buckets;
   hashtable->hash = num_buckets - 1;
   hashtable->version = 0;
-  hashtable->table_tmp = NULL;
-  hashtable->table_new = NULL;
-  hashtable->table_prev = NULL;
+  hashtable->table_tmp = SHM_NULL;
+  hashtable->table_new = SHM_NULL;
+  hashtable->table_prev = SHM_NULL;
   hashtable->num_expands = 0;
   hashtable->num_expands_threshold = (CLHT_PERC_EXPANSIONS * num_buckets);
   if (hashtable->num_expands_threshold == 0)
@@ -180,7 +184,7 @@ clht_hashtable_create(uint64_t num_buckets)
   hashtable->is_helper = 1;
   hashtable->helper_done = 0;
  
-  return hashtable;
+  return hashtable_off;
 }
 
 
@@ -199,11 +203,12 @@ clht_hash(clht_hashtable_t* hashtable, clht_addr_t key)
 
 /* Retrieve a key-value entry from a hash table. */
 clht_val_t
-clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
+clht_get(SHM_off hashtable_off, clht_addr_t key)
 {
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(hashtable_off);
   size_t bin = clht_hash(hashtable, key);
   CLHT_GC_HT_VERSION_USED(hashtable);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
   uint32_t j, h, hops = bucket->hops;
   for (h = 0; h <= hops; h++, bucket++)
@@ -254,7 +259,7 @@ lock_release_n(volatile bucket_t* b, int n)
   for (i = 0; i < n; i++)
     {
       LOCK_RLS(&b->lock);
-      b = b->next;
+      b = SHR_OFF_TO_PTR(b->next);
     }
 }
 
@@ -265,9 +270,9 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
   volatile clht_hashtable_t* hashtable;
 
  again:
-  hashtable = h->ht;
+  hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash((clht_hashtable_t*)hashtable, key);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
   volatile bucket_t* bucket_first = bucket;
 
 #if CLHT_READ_ONLY_FAIL == 1
@@ -293,7 +298,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
       if (!LOCK_ACQ(&bucket->lock, (clht_hashtable_t*) hashtable))
 	{
 	  lock_release_n(bucket_first, l);
-	  while (hashtable->table_new == NULL)
+	  while (hashtable->table_new == SHM_NULL)
 	    {
 	      _mm_pause();
 	    }
@@ -329,7 +334,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	      lock_release_n(bucket_first, l);
 
 	      ht_status(h, 0, CLHT_LINKED_EMERGENCY_RESIZE, 0);
-	      while (hashtable->table_new == NULL)
+	      while (hashtable->table_new == SHM_NULL)
 		{
 		  _mm_pause();
 		}
@@ -339,7 +344,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	  if (!LOCK_ACQ(&bucket->lock, (clht_hashtable_t*) hashtable))
 	    {
 	      lock_release_n(bucket_first, l);
-	      while (hashtable->table_new == NULL)
+	      while (hashtable->table_new == SHM_NULL)
 		{
 		  _mm_pause();
 		}
@@ -387,9 +392,9 @@ clht_remove(clht_t* h, clht_addr_t key)
 {
   volatile clht_hashtable_t* hashtable;
  again:
-  hashtable = h->ht;
+  hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash((clht_hashtable_t*) hashtable, key);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
   volatile bucket_t* bucket_first = bucket;
 
 #if CLHT_READ_ONLY_FAIL == 1
@@ -433,7 +438,7 @@ clht_remove(clht_t* h, clht_addr_t key)
 static uint32_t
 clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint64_t bin) 
 {
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
   volatile bucket_t* bucket_first = bucket;
   uint32_t j;
 
@@ -457,7 +462,7 @@ clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint6
 	}
         
       tr++;
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (true);
 }
@@ -495,8 +500,8 @@ ht_resize_help(clht_hashtable_t* h)
   int32_t b;
   for (b = (h->hash + CLHT_LINKED_MAX_EXPANSIONS_HARD); b >= 0; b--)
     {
-      bucket_t* bu_cur = h->table + b;
-      if (!bucket_cpy(bu_cur, h->table_tmp))
+      bucket_t* bu_cur = ((bucket_t*) SHR_OFF_TO_PTR(h->table)) + b;
+      if (!bucket_cpy(bu_cur, SHR_OFF_TO_PTR(h->table_tmp)))
 	{	    /* reached a point where the resizer is handling */
 	  /* printf("[GC-%02d] helped  #buckets: %10zu = %5.1f%%\n",  */
 	  /* 	 clht_gc_get_id(), h->num_buckets - b, 100.0 * (h->num_buckets - b) / h->num_buckets); */
@@ -514,7 +519,8 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
 
   check_ht_status_steps = CLHT_STATUS_INVOK;
 
-  clht_hashtable_t* ht_old = h->ht;
+  SHM_off ht_old_off = h->ht;
+  clht_hashtable_t* ht_old = SHR_OFF_TO_PTR(ht_old_off);
 
   if (TRYLOCK_ACQ(&h->resize_lock))
     {
@@ -535,17 +541,22 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
       num_buckets_new = ht_old->num_buckets / CLHT_RATIO_HALVE;
     }
 
-  clht_hashtable_t* ht_new = clht_hashtable_create(num_buckets_new);
+  clht_event_log(CLHT_EV_RESIZE_START, ht_old->num_buckets, num_buckets_new, ht_old->version, 0, 0);
+
+  SHM_off ht_new_off = clht_hashtable_create(num_buckets_new);
+  clht_hashtable_t* ht_new = SHR_OFF_TO_PTR(ht_new_off);
   ht_new->version = ht_old->version + 1;
   ht_new->num_buckets_prev = ht_old->num_buckets;
 
+  ticks stall = 0;
+  uint64_t participants = 1;
 #if CLHT_HELP_RESIZE == 1
-  ht_old->table_tmp = ht_new; 
+  ht_old->table_tmp = ht_new_off; 
 
   int32_t b;
   for (b = 0; b < (ht_old->num_buckets + CLHT_LINKED_MAX_EXPANSIONS_HARD); b++)
     {
-      bucket_t* bu_cur = ht_old->table + b;
+      bucket_t* bu_cur = ((bucket_t*) SHR_OFF_TO_PTR(ht_old->table)) + b;
       if (!bucket_cpy(bu_cur, ht_new)) /* reached a point where the helper is handling */
 	{
 	  break;
@@ -554,17 +565,20 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
 
   if (is_increase && ht_old->is_helper != 1)	/* there exist a helper */
     {
+      participants++;
+      stall = getticks();
       while (ht_old->helper_done != 1)
 	{
 	  _mm_pause();
 	}
+      stall = getticks() - stall;
     }
 
 #else
   int32_t b;
   for (b = 0; b < (ht_old->num_buckets + CLHT_LINKED_MAX_EXPANSIONS_HARD); b++)
     {
-      bucket_t* bu_cur = ht_old->table + b;
+      bucket_t* bu_cur = ((bucket_t*) SHR_OFF_TO_PTR(ht_old->table)) + b;
       bucket_cpy(bu_cur, ht_new);
     }
 #endif
@@ -576,7 +590,7 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
   /*   } */
 #endif
 
-  ht_new->table_prev = ht_old;
+  ht_new->table_prev = ht_old_off;
 
   double avg_expands = ht_new->num_expands / (double) ht_new->num_buckets;
   int ht_resize_again = 0;
@@ -587,14 +601,13 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
     }
 
   
-  SWAP_U64((uint64_t*) h, (uint64_t) ht_new);
-  ht_old->table_new = ht_new;
+  SWAP_U64((uint64_t*) &h->ht, (uint64_t) ht_new_off);
+  ht_old->table_new = ht_new_off;
   TRYLOCK_RLS(h->resize_lock);
 
   ticks e = getticks() - s;
-  double mba = (ht_new->num_buckets * 64) / (1024.0 * 1024);
-  printf("[RESIZE-%02d] to #bu %7zu = MB: %7.2f    | took: %13llu ti = %8.6f s\n", 
-	 clht_gc_get_id(), ht_new->num_buckets, mba, (unsigned long long) e, e / 2.1e9);
+  clht_event_log(CLHT_EV_RESIZE_END, ht_old->num_buckets, ht_new->num_buckets,
+		 clht_ticks_to_ns(e), clht_ticks_to_ns(stall), participants);
 
   clht_gc_collect(h);
 
@@ -616,7 +629,7 @@ clht_size(clht_hashtable_t* hashtable)
   uint64_t bin;
   for (bin = 0; bin < (num_buckets + CLHT_LINKED_MAX_EXPANSIONS_HARD); bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
        
       uint32_t j;
       for (j = 0; j < ENTRIES_PER_BUCKET; j++)
@@ -638,7 +651,7 @@ ht_status(clht_t* h, int resize_increase, int emergency_increase, int just_print
       return 0;
     }
 
-  clht_hashtable_t* hashtable = h->ht;
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   uint64_t num_buckets = hashtable->num_buckets;
   volatile bucket_t* bucket = NULL;
   size_t size = 0;
@@ -648,8 +661,8 @@ ht_status(clht_t* h, int resize_increase, int emergency_increase, int just_print
   if (emergency_increase)
     {
       int inc_by_pow2 = pow2roundup(emergency_increase);
-      printf("[STATUS-%02d] #bu: %7zu / #elems: emrgncy / full%%: ???????? / expands: ???? /avg expands: ???? / max expands: ??\n",
-	     clht_gc_get_id(), hashtable->num_buckets);
+      /* emergency: no scan, #elems unknown */
+      clht_event_log(CLHT_EV_STATUS, hashtable->num_buckets, 0, 0, 0, 0);
       ht_resize_pes(h, 1, inc_by_pow2);
       
     }
@@ -658,7 +671,7 @@ ht_status(clht_t* h, int resize_increase, int emergency_increase, int just_print
       uint64_t bin;
       for (bin = 0; bin < num_buckets + CLHT_LINKED_MAX_EXPANSIONS_HARD; bin++)
 	{
-	  bucket = hashtable->table + bin;
+	  bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
 	  expands += bucket->hops;
 	  if (bucket->hops > expands_max)
@@ -687,8 +700,8 @@ ht_status(clht_t* h, int resize_increase, int emergency_increase, int just_print
 	{
 	  if (full_ratio > 0 && full_ratio < CLHT_PERC_FULL_HALVE)
 	    {
-	      printf("[STATUS-%02d] #bu: %7zu / #elems: %7zu / full%%: %8.4f%% / expands: %4d / max expands: %2d\n",
-		     clht_gc_get_id(), hashtable->num_buckets, size, full_ratio, expands, expands_max);
+	      clht_event_log(CLHT_EV_STATUS, hashtable->num_buckets, size, (uint64_t) (full_ratio * 100),
+			     expands, expands_max);
 	      ht_resize_pes(h, 0, 33);
 	    }
 	  else if ((full_ratio > 0 && full_ratio > CLHT_LINKED_PERC_FULL_DOUBLE) || expands_max > CLHT_LINKED_MAX_EXPANSIONS ||
@@ -697,9 +710,8 @@ ht_status(clht_t* h, int resize_increase, int emergency_increase, int just_print
 	      int inc_by = (full_ratio / 30) + resize_increase + (hashtable->num_buckets == hashtable->num_buckets_prev);
 	      int inc_by_pow2 = pow2roundup(inc_by);
 
-	      printf("[STATUS-%02d] #bu: %7zu / #elems: %7zu / full%%: %8.4f%% / expands: %4d /avg expands: %.1f / max expands: %2d\n",
-		     clht_gc_get_id(), hashtable->num_buckets, size, full_ratio, 
-		     expands, (double) expands / hashtable->num_buckets, expands_max);
+	      clht_event_log(CLHT_EV_STATUS, hashtable->num_buckets, size, (uint64_t) (full_ratio * 100),
+			     expands, expands_max);
 	      ht_resize_pes(h, 1, inc_by_pow2);
 	    }
 	}
@@ -737,11 +749,11 @@ clht_size_mem_garbage(clht_hashtable_t* h) /* in bytes */
     }
 
   size_t size_tot = 0;
-  clht_hashtable_t* cur = h->table_prev;
+  clht_hashtable_t* cur = SHR_OFF_TO_PTR(h->table_prev);
   while (cur != NULL)
     {
       size_tot += clht_size_mem(cur);
-      cur = cur->table_prev;
+      cur = SHR_OFF_TO_PTR(cur->table_prev);
     }
 
   return size_tot;
@@ -754,14 +766,14 @@ clht_print(clht_hashtable_t* hashtable)
   uint64_t num_buckets = hashtable->num_buckets;
   volatile bucket_t* bucket;
 
-  printf("Number of buckets: %u\n", num_buckets);
+  printf("Number of buckets: %zu\n", num_buckets);
 
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
       
-      printf("[[%05d]] ", bin);
+      printf("[[%05zu]] ", bin);
 
       uint32_t j;
       do
@@ -774,7 +786,7 @@ clht_print(clht_hashtable_t* hashtable)
 		}
 	    }
 
-	  bucket = bucket->next;
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	  printf(" ** -> ");
 	}
       while (bucket != NULL);
@@ -86,13 +86,15 @@ __ac_Jenkins_hash_64(uint64_t key)
 bucket_t*
 clht_bucket_create() 
 {
-  bucket_t* bucket = NULL;
-  bucket = memalign(CACHE_LINE_SIZE, sizeof(bucket_t));
-  if (bucket == NULL)
+  SHM_off bucket_off = clht_shm_alloc(sizeof(bucket_t));
+  if (bucket_off == SHM_NULL)
     {
+      printf("** clht_shm_alloc @ clht_bucket_create\n");
       return NULL;
     }
 
+  bucket_t* bucket = SHR_OFF_TO_PTR(bucket_off);
+
   bucket->lock = 0;
 
   uint32_t j;
@@ -100,76 +102,90 @@ clht_bucket_create()
     {
       bucket->key[j] = 0;
     }
-  bucket->next = NULL;
+  bucket->next = SHM_NULL;
 
   return bucket;
 }
 
 
-clht_hashtable_t* clht_hashtable_create(uint64_t num_buckets);
+SHM_off clht_hashtable_create(uint64_t num_buckets);
 
-clht_t* 
+SHM_off
 clht_create(uint64_t num_buckets)
 {
-  clht_t* w = (clht_t*) memalign(CACHE_LINE_SIZE, sizeof(clht_t));
-  if (w == NULL)
+  SHM_off w_off = clht_shm_alloc(sizeof(clht_t));
+  if (w_off == SHM_NULL)
     {
-      printf("** malloc @ hatshtalbe\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_create\n");
+      return SHM_NULL;
     }
 
+  clht_t* w = (clht_t*) SHR_OFF_TO_PTR(w_off);
+
   w->ht = clht_hashtable_create(num_buckets);
-  if (w->ht == NULL)
+  if (w->ht == SHM_NULL)
     {
-      free(w);
-      return NULL;
+      clht_shm_free(w_off);
+      return SHM_NULL;
     }
-  return w;
+  w->resize_lock = LOCK_FREE;
+  w->gc_lock = LOCK_FREE;
+  w->status_lock = LOCK_FREE;
+  w->version_list = SHM_NULL;
+  w->version_min = 0;
+  w->ht_oldest = w->ht;
+
+  return w_off;
 }
 
-clht_hashtable_t* 
+SHM_off
 clht_hashtable_create(uint64_t num_buckets) 
 {
   clht_hashtable_t* hashtable = NULL;
     
   if (num_buckets == 0)
     {
-      return NULL;
+      return SHM_NULL;
     }
     
   /* Allocate the table itself. */
-  hashtable = (clht_hashtable_t*) memalign(CACHE_LINE_SIZE, sizeof(clht_hashtable_t));
-  if (hashtable == NULL) 
+  SHM_off hashtable_off = clht_shm_alloc(sizeof(clht_hashtable_t));
+  if (hashtable_off == SHM_NULL) 
     {
-      printf("** malloc @ hatshtalbe\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_hashtable_create hashtable\n");
+      return SHM_NULL;
     }
+
+  hashtable = (clht_hashtable_t*) SHR_OFF_TO_PTR(hashtable_off);
     
-  /* hashtable->table = calloc(num_buckets, (sizeof(bucket_t))); */
-  hashtable->table = (bucket_t*) memalign(CACHE_LINE_SIZE, num_buckets * (sizeof(bucket_t)));
-  if (hashtable->table == NULL) 
+  hashtable->table = clht_table_alloc(num_buckets);
+  if (hashtable->table == SHM_NULL) 
     {
-      printf("** alloc: hashtable->table\n"); fflush(stdout);
-      free(hashtable);
-      return NULL;
+      printf("** clht_table_alloc: clht_hashtable_create table\n"); fflush(stdout);
+      clht_shm_free(hashtable_off);
+      return SHM_NULL;
     }
 
-  memset(hashtable->table, 0, num_buckets * (sizeof(bucket_t)));
+  bucket_t* table = SHR_OFF_TO_PTR(hashtable->table);
     
   uint64_t i;
   for (i = 0; i < num_buckets; i++)
     {
-      hashtable->table[i].lock = LOCK_FREE;
+      table[i].lock = LOCK_FREE;
       uint32_t j;
       for (j = 0; j < ENTRIES_PER_BUCKET; j++)
 	{
-	  hashtable->table[i].key[j] = 0;
+	  table[i].key[j] = 0;
 	}
     }
 
   hashtable->num_buckets = num_buckets;
   hashtable->hash = num_buckets - 1;
-  return hashtable;
+  hashtable->version = 0;
+  hashtable->table_tmp = SHM_NULL;
+  hashtable->table_new = SHM_NULL;
+  hashtable->table_prev = SHM_NULL;
+  return hashtable_off;
 }
 
 
@@ -188,10 +204,11 @@ clht_hash(clht_hashtable_t* hashtable, clht_addr_t key)
 
 /* Retrieve a key-value entry from a hash table. */
 clht_val_t
-clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
+clht_get(SHM_off hashtable_off, clht_addr_t key)
 {
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(hashtable_off);
   size_t bin = clht_hash(hashtable, key);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
   uint32_t j;
   do 
@@ -215,7 +232,7 @@ clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
 	    }
 	}
 
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (bucket != NULL);
   return 0;
 }
@@ -233,7 +250,7 @@ bucket_exists(volatile bucket_t* bucket, clht_addr_t key)
       	      return true;
       	    }
       	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (bucket != NULL);
   return false;
 }
@@ -242,9 +259,9 @@ bucket_exists(volatile bucket_t* bucket, clht_addr_t key)
 int
 clht_put(clht_t* h, clht_addr_t key, clht_val_t val) 
 {
-  clht_hashtable_t* hashtable = h->ht;
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash(hashtable, key);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
 #if CLHT_READ_ONLY_FAIL == 1
   if (bucket_exists(bucket, key))
@@ -276,18 +293,19 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	    }
 	}
         
-      if (bucket->next == NULL)
+      if (bucket->next == SHM_NULL)
 	{
 	  if (empty == NULL)
 	    {
 	      DPP(put_num_failed_expand);
-	      bucket->next = clht_bucket_create(hashtable);
-	      bucket->next->val[0] = val;
+	      bucket_t* b = clht_bucket_create();
+	      b->val[0] = val;
+	      b->key[0] = key;
 #ifdef __tile__
 	      /* keep the writes in order */
 	      _mm_sfence();
 #endif
-	      bucket->next->key[0] = key;
+	      bucket->next = SHR_PTR_TO_OFF(b);
 	    }
 	  else 
 	    {
@@ -302,7 +320,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	  LOCK_RLS(lock);
 	  return true;
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     }
   while (true);
 }
@@ -312,9 +330,9 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 clht_val_t
 clht_remove(clht_t* h, clht_addr_t key)
 {
-  clht_hashtable_t* hashtable = h->ht;
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash(hashtable, key);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
   uint32_t j;
   do 
@@ -338,7 +356,7 @@ clht_remove(clht_t* h, clht_addr_t key)
 		}
 	    }
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (bucket != NULL);
   return false;
@@ -347,7 +365,7 @@ clht_remove(clht_t* h, clht_addr_t key)
 static uint32_t
 clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint64_t bin) 
 {
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
   uint32_t j;
 
   do 
@@ -362,16 +380,17 @@ clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint6
 	    }
 	}
         
-      if (bucket->next == NULL)
+      if (bucket->next == SHM_NULL)
 	{
 	  DPP(put_num_failed_expand);
-	  bucket->next = clht_bucket_create(hashtable);
-	  bucket->next->val[0] = val;
-	  bucket->next->key[0] = key;
+	  bucket_t* b = clht_bucket_create();
+	  b->val[0] = val;
+	  b->key[0] = key;
+	  bucket->next = SHR_PTR_TO_OFF(b);
 	  return true;
 	}
 
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (true);
 }
@@ -396,7 +415,7 @@ bucket_cpy(volatile bucket_t* bucket, clht_hashtable_t* ht_new)
 	      clht_put_seq(ht_new, key, bucket->val[j], bin);
 	    }
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (bucket != NULL);
 
@@ -416,8 +435,8 @@ ht_resize_help(clht_hashtable_t* h)
   /* hash = num_buckets - 1 */
   for (b = h->hash; b >= 0; b--)
     {
-      bucket_t* bu_cur = h->table + b;
-      if (!bucket_cpy(bu_cur, h->table_tmp))
+      bucket_t* bu_cur = ((bucket_t*) SHR_OFF_TO_PTR(h->table)) + b;
+      if (!bucket_cpy(bu_cur, SHR_OFF_TO_PTR(h->table_tmp)))
 	{	    /* reached a point where the resizer is handling */
 	  /* printf("[GC-%02d] helped  #buckets: %10zu = %5.1f%%\n",  */
 	  /* 	 clht_gc_get_id(), h->num_buckets - b, 100.0 * (h->num_buckets - b) / h->num_buckets); */
@@ -438,7 +457,7 @@ clht_size(clht_hashtable_t* hashtable)
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
        
       uint32_t j;
       do
@@ -451,7 +470,7 @@ clht_size(clht_hashtable_t* hashtable)
 		}
 	    }
 
-	  bucket = bucket->next;
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	}
       while (bucket != NULL);
     }
@@ -480,11 +499,11 @@ clht_size_mem_garbage(clht_hashtable_t* h) /* in bytes */
     }
 
   size_t size_tot = 0;
-  clht_hashtable_t* cur = h->table_prev;
+  clht_hashtable_t* cur = SHR_OFF_TO_PTR(h->table_prev);
   while (cur != NULL)
     {
       size_tot += clht_size_mem(cur);
-      cur = cur->table_prev;
+      cur = SHR_OFF_TO_PTR(cur->table_prev);
     }
 
   return size_tot;
@@ -497,14 +516,14 @@ clht_print(clht_hashtable_t* hashtable)
   uint64_t num_buckets = hashtable->num_buckets;
   volatile bucket_t* bucket;
 
-  printf("Number of buckets: %u\n", num_buckets);
+  printf("Number of buckets: %zu\n", num_buckets);
 
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
       
-      printf("[[%05d]] ", bin);
+      printf("[[%05zu]] ", bin);
 
       uint32_t j;
       do
@@ -517,7 +536,7 @@ clht_print(clht_hashtable_t* hashtable)
 		}
 	    }
 
-	  bucket = bucket->next;
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	  printf(" ** -> ");
 	}
       while (bucket != NULL);
@@ -85,13 +85,15 @@ __ac_Jenkins_hash_64(uint64_t key)
 bucket_t*
 clht_bucket_create() 
 {
-  bucket_t* bucket = NULL;
-  bucket = memalign(CACHE_LINE_SIZE, sizeof(bucket_t ));
-  if(bucket == NULL)
+  SHM_off bucket_off = clht_shm_alloc(sizeof(bucket_t));
+  if (bucket_off == SHM_NULL)
     {
+      printf("** clht_shm_alloc @ clht_bucket_create\n");
       return NULL;
     }
 
+  bucket_t* bucket = SHR_OFF_TO_PTR(bucket_off);
+
   bucket->lock = 0;
   bucket->last = 0;
 
@@ -100,75 +102,78 @@ clht_bucket_create()
     {
       bucket->key[j] = 0;
     }
-  bucket->next = NULL;
+  bucket->next = SHM_NULL;
     
   return bucket;
 }
 
-clht_t* 
+SHM_off
 clht_create(uint64_t num_buckets)
 {
-  clht_t* w = (clht_t*) memalign(CACHE_LINE_SIZE, sizeof(clht_t));
-  if (w == NULL)
+  SHM_off w_off = clht_shm_alloc(sizeof(clht_t));
+  if (w_off == SHM_NULL)
     {
-      printf("** malloc @ hatshtalbe\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_create\n");
+      return SHM_NULL;
     }
 
+  clht_t* w = (clht_t*) SHR_OFF_TO_PTR(w_off);
+
   w->ht = clht_hashtable_create(num_buckets);
-  if (w->ht == NULL)
+  if (w->ht == SHM_NULL)
     {
-      free(w);
-      return NULL;
+      clht_shm_free(w_off);
+      return SHM_NULL;
     }
 
-  return w;
+  return w_off;
 }
 
-clht_hashtable_t* 
+SHM_off
 clht_hashtable_create(uint64_t num_buckets) 
 {
   clht_hashtable_t* hashtable = NULL;
     
   if(num_buckets == 0)
     {
-      return NULL;
+      return SHM_NULL;
     }
     
   /* Allocate the table itself. */
-  hashtable = (clht_hashtable_t*) memalign(CACHE_LINE_SIZE, sizeof(clht_hashtable_t));
-  if(hashtable == NULL ) 
+  SHM_off hashtable_off = clht_shm_alloc(sizeof(clht_hashtable_t));
+  if(hashtable_off == SHM_NULL) 
     {
-      printf("** malloc @ hatshtalbe\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_hashtable_create hashtable\n");
+      return SHM_NULL;
     }
+
+  hashtable = (clht_hashtable_t*) SHR_OFF_TO_PTR(hashtable_off);
     
-  /* hashtable->table = calloc(num_buckets, (sizeof(bucket_t))); */
-  hashtable->table = (bucket_t*) memalign(CACHE_LINE_SIZE, num_buckets * (sizeof(bucket_t)));
-  if(hashtable->table == NULL ) 
+  hashtable->table = clht_table_alloc(num_buckets);
+  if(hashtable->table == SHM_NULL) 
     {
-      printf("** alloc: hashtable->table\n"); fflush(stdout);
-      free(hashtable);
-      return NULL;
+      printf("** clht_table_alloc: clht_hashtable_create table\n"); fflush(stdout);
+      clht_shm_free(hashtable_off);
+      return SHM_NULL;
     }
 
-  memset(hashtable->table, 0, num_buckets * (sizeof(bucket_t)));
+  bucket_t* table = SHR_OFF_TO_PTR(hashtable->table);
     
   uint64_t i;
   for(i = 0; i < num_buckets; i++)
     {
-      hashtable->table[i].lock = 0;
-      hashtable->table[i].last = 0;
+      table[i].lock = 0;
+      table[i].last = 0;
       uint32_t j;
       for (j = 0; j < ENTRIES_PER_BUCKET; j++)
 	{
-	  hashtable->table[i].key[j] = 0;
+	  table[i].key[j] = 0;
 	}
     }
 
   hashtable->num_buckets = num_buckets;
     
-  return hashtable;
+  return hashtable_off;
 }
 
 /* Hash a key for a particular hash table. */
@@ -185,10 +190,11 @@ clht_hash(clht_hashtable_t* hashtable, clht_addr_t key)
 
   /* Retrieve a key-value entry from a hash table. */
 clht_val_t
-clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
+clht_get(SHM_off hashtable_off, clht_addr_t key)
 {
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(hashtable_off);
   size_t bin = clht_hash(hashtable, key);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
     
   int32_t j;
   do 
@@ -217,7 +223,7 @@ clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
 	{
 	  break;
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (bucket != NULL);
   return 0;
 }
@@ -241,7 +247,7 @@ bucket_exists(bucket_t* bucket, clht_addr_t key)
 	{
 	  break;
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (bucket != NULL);
   return false;
 }
@@ -251,9 +257,9 @@ bucket_exists(bucket_t* bucket, clht_addr_t key)
 int
 clht_put(clht_t* h, clht_addr_t key, clht_val_t val) 
 {
-  clht_hashtable_t* hashtable = h->ht;
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash(hashtable, key);
-  bucket_t* bucket = hashtable->table + bin;
+  bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 #if defined(READ_ONLY_FAIL)
   if (bucket_exists(bucket, key))
     {
@@ -287,24 +293,25 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	  LOCK_RLS(lock);
 	  return true;
 	}
-      else if (bucket->next == NULL)
+      else if (bucket->next == SHM_NULL)
 	{
 	  DPP(put_num_failed_expand);
-	  bucket->next = clht_bucket_create();
-	  bucket->next->key[0] = key;
+	  bucket_t* next_ptr = clht_bucket_create();
+	  next_ptr->key[0] = key;
 #ifdef __tile__
 	      _mm_sfence();
 #endif	 
-	      bucket->next->val[0] = val;
+	      next_ptr->val[0] = val;
 #ifdef __tile__
 	      _mm_sfence();
 #endif
-	  bucket->next->last++;
+	  next_ptr->last++;
+	  bucket->next = SHR_PTR_TO_OFF(next_ptr);
 	  LOCK_RLS(lock);
 	  return true;
 	}
 
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (true);
 }
 
@@ -314,9 +321,9 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 clht_val_t
 clht_remove(clht_t* h, clht_addr_t key)
 {
-  clht_hashtable_t* hashtable = h->ht;
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash(hashtable, key);
-  bucket_t* bucket = hashtable->table + bin;
+  bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 #if defined(READ_ONLY_FAIL)
   if (!bucket_exists(bucket, key))
     {
@@ -337,9 +344,9 @@ clht_remove(clht_t* h, clht_addr_t key)
 	    {
 	      clht_val_t val = bucket->val[j];
 	      bucket_t* blast = bucket;
-	      while (blast->next != NULL && blast->next->last)
+	      while (blast->next != SHM_NULL && ((bucket_t*) SHR_OFF_TO_PTR(blast->next))->last)
 		{
-		  blast = blast->next;
+		  blast = SHR_OFF_TO_PTR(blast->next);
 		}
 
 	      bucket->key[j] = 0;
@@ -363,7 +370,7 @@ clht_remove(clht_t* h, clht_addr_t key)
 	{
 	  break;
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } while (bucket != NULL);
   LOCK_RLS(lock);
   return false;
@@ -401,9 +408,35 @@ clht_destroy( clht_hashtable_t *hashtable)
     /*   } while (bucket_c != NULL); */
     /* } */
     
-    free(hashtable->table);
-    free(hashtable);
-  }
+  uint64_t bin;
+  for (bin = 0; bin < hashtable->num_buckets; bin++)
+    {
+      bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
+      SHM_off next = bucket->next;
+      while (next != SHM_NULL)
+	{
+	  bucket = SHR_OFF_TO_PTR(next);
+	  next = bucket->next;
+	  clht_shm_free(SHR_PTR_TO_OFF(bucket));
+	}
+    }
+
+  clht_table_free(hashtable->num_buckets);
+  clht_shm_free(SHR_PTR_TO_OFF(hashtable));
+}
+
+void
+clht_gc_thread_init(clht_t* h, int id)
+{
+  clht_stats_thread_init(id);
+}
+
+void
+clht_gc_destroy(clht_t* h)
+{
+  clht_destroy(SHR_OFF_TO_PTR(h->ht));
+  clht_shm_free(SHR_PTR_TO_OFF(h));
+}
 
 
 
@@ -416,7 +449,7 @@ clht_size(clht_hashtable_t *hashtable)
   uint64_t bin;
   for (bin = 0; bin < hashtable->num_buckets; bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
        
       uint32_t j;
       do
@@ -431,7 +464,7 @@ clht_size(clht_hashtable_t *hashtable)
 	    {
 	      break;
 	    }
-	  bucket = bucket->next;
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	}
       while (bucket != NULL);
     }
@@ -443,14 +476,14 @@ clht_print(clht_hashtable_t *hashtable, uint64_t num_buckets)
 {
   bucket_t *bucket;
 
-  printf("Number of buckets: %u\n", num_buckets);
+  printf("Number of buckets: %zu\n", num_buckets);
 
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
       
-      printf("[[%05d]] ", bin);
+      printf("[[%05zu]] ", bin);
 
       uint32_t j;
       do
@@ -463,7 +496,7 @@ clht_print(clht_hashtable_t *hashtable, uint64_t num_buckets)
 		}
 	    }
 
-	  bucket = bucket->next;
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	  printf(" ** -> ");
 	}
       while (bucket != NULL);
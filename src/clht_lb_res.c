@@ -85,13 +85,15 @@ __ac_Jenkins_hash_64(uint64_t key)
 bucket_t*
 clht_bucket_create() 
 {
-  bucket_t* bucket = NULL;
-  bucket = memalign(CACHE_LINE_SIZE, sizeof(bucket_t));
-  if (bucket == NULL)
+  SHM_off bucket_off = clht_shm_alloc(sizeof(bucket_t));
+  if (bucket_off == SHM_NULL)
     {
+      printf("** clht_shm_alloc @ clht_bucket_create\n");
       return NULL;
     }
 
+  bucket_t* bucket = SHR_OFF_TO_PTR(bucket_off);
+
   bucket->lock = 0;
 
   uint32_t j;
@@ -99,7 +101,7 @@ clht_bucket_create()
     {
       bucket->key[j] = 0;
     }
-  bucket->next = NULL;
+  bucket->next = SHM_NULL;
 
   return bucket;
 }
@@ -116,80 +118,83 @@ clht_bucket_create_stats(clht_hashtable_t* h, int* resize)
   return b;
 }
 
-clht_hashtable_t* clht_hashtable_create(uint64_t num_buckets);
+SHM_off clht_hashtable_create(uint64_t num_buckets);
 
-clht_t* 
+SHM_off
 clht_create(uint64_t num_buckets)
 {
-  clht_t* w = (clht_t*) memalign(CACHE_LINE_SIZE, sizeof(clht_t));
-  if (w == NULL)
+  SHM_off w_off = clht_shm_alloc(sizeof(clht_t));
+  if (w_off == SHM_NULL)
     {
-      printf("** malloc @ hatshtalbe\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_create\n");
+      return SHM_NULL;
     }
 
+  clht_t* w = (clht_t*) SHR_OFF_TO_PTR(w_off);
+
   w->ht = clht_hashtable_create(num_buckets);
-  if (w->ht == NULL)
+  if (w->ht == SHM_NULL)
     {
-      free(w);
-      return NULL;
+      clht_shm_free(w_off);
+      return SHM_NULL;
     }
   w->resize_lock = LOCK_FREE;
   w->gc_lock = LOCK_FREE;
   w->status_lock = LOCK_FREE;
-  w->version_list = NULL;
+  w->version_list = SHM_NULL;
   w->version_min = 0;
   w->ht_oldest = w->ht;
 
-  return w;
+  return w_off;
 }
 
-clht_hashtable_t* 
+SHM_off
 clht_hashtable_create(uint64_t num_buckets) 
 {
   clht_hashtable_t* hashtable = NULL;
     
   if (num_buckets == 0)
     {
-      return NULL;
+      return SHM_NULL;
     }
     
   /* Allocate the table itself. */
-  hashtable = (clht_hashtable_t*) memalign(CACHE_LINE_SIZE, sizeof(clht_hashtable_t));
-  if (hashtable == NULL) 
+  SHM_off hashtable_off = clht_shm_alloc(sizeof(clht_hashtable_t));
+  if (hashtable_off == SHM_NULL) 
     {
-      printf("** malloc @ hatshtalbe\n");
-      return NULL;
+      printf("** clht_shm_alloc @ clht_hashtable_create hashtable\n");
+      return SHM_NULL;
     }
+
+  hashtable = (clht_hashtable_t*) SHR_OFF_TO_PTR(hashtable_off);
     
-  /* hashtable->table = calloc(num_buckets, (sizeof(bucket_t))); */
-  hashtable->table = (bucket_t*) memalign(CACHE_LINE_SIZE, num_buckets * (sizeof(bucket_t)));
-  if (hashtable->table == NULL) 
+  hashtable->table = clht_table_alloc(num_buckets);
+  if (hashtable->table == SHM_NULL) 
     {
-      printf("** alloc: hashtable->table\n"); fflush(stdout);
-      free(hashtable);
-      return NULL;
+      printf("** clht_table_alloc: clht_hashtable_create table\n"); fflush(stdout);
+      clht_shm_free(hashtable_off);
+      return SHM_NULL;
     }
 
-  memset(hashtable->table, 0, num_buckets * (sizeof(bucket_t)));
+  bucket_t* table = SHR_OFF_TO_PTR(hashtable->table);
     
   uint64_t i;
   for (i = 0; i < num_buckets; i++)
     {
-      hashtable->table[i].lock = LOCK_FREE;
+      table[i].lock = LOCK_FREE;
       uint32_t j;
       for (j = 0; j < ENTRIES_PER_BUCKET; j++)
 	{
-	  hashtable->table[i].key[j] = 0;
+	  table[i].key[j] = 0;
 	}
     }
 
   hashtable->num_buckets = num_buckets;
   hashtable->hash = num_buckets - 1;
   hashtable->version = 0;
-  hashtable->table_tmp = NULL;
-  hashtable->table_new = NULL;
-  hashtable->table_prev = NULL;
+  hashtable->table_tmp = SHM_NULL;
+  hashtable->table_new = SHM_NULL;
+  hashtable->table_prev = SHM_NULL;
   hashtable->num_expands = 0;
   hashtable->num_expands_threshold = (CLHT_PERC_EXPANSIONS * num_buckets);
   if (hashtable->num_expands_threshold == 0)
@@ -199,7 +204,7 @@ clht_hashtable_create(uint64_t num_buckets)
   hashtable->is_helper = 1;
   hashtable->helper_done = 0;
  
-  return hashtable;
+  return hashtable_off;
 }
 
 
@@ -218,11 +223,12 @@ clht_hash(clht_hashtable_t* hashtable, clht_addr_t key)
 
 /* Retrieve a key-value entry from a hash table. */
 clht_val_t
-clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
+clht_get(SHM_off hashtable_off, clht_addr_t key)
 {
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(hashtable_off);
   size_t bin = clht_hash(hashtable, key);
   CLHT_GC_HT_VERSION_USED(hashtable);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
   uint32_t j;
   do 
@@ -246,7 +252,7 @@ clht_get(clht_hashtable_t* hashtable, clht_addr_t key)
 	    }
 	}
 
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (unlikely(bucket != NULL));
   return 0;
@@ -265,7 +271,7 @@ bucket_exists(volatile bucket_t* bucket, clht_addr_t key)
       	      return true;
       	    }
       	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (unlikely(bucket != NULL));
   return false;
@@ -275,9 +281,9 @@ bucket_exists(volatile bucket_t* bucket, clht_addr_t key)
 int
 clht_put(clht_t* h, clht_addr_t key, clht_val_t val) 
 {
-  clht_hashtable_t* hashtable = h->ht;
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash(hashtable, key);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
 #if CLHT_READ_ONLY_FAIL == 1
   if (bucket_exists(bucket, key))
@@ -289,10 +295,10 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
   clht_lock_t* lock = &bucket->lock;
   while (!LOCK_ACQ(lock, hashtable))
     {
-      hashtable = h->ht;
+      hashtable = SHR_OFF_TO_PTR(h->ht);
       size_t bin = clht_hash(hashtable, key);
 
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
       lock = &bucket->lock;
     }
 
@@ -319,7 +325,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	}
         
       int resize = 0;
-      if (likely(bucket->next == NULL))
+      if (likely(bucket->next == SHM_NULL))
 	{
 	  if (unlikely(empty == NULL))
 	    {
@@ -336,7 +342,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	      /* make sure they are visible */
 	      _mm_sfence();
 #endif
-	      bucket->next = b;
+	      bucket->next = SHR_PTR_TO_OFF(b);
 	    }
 	  else 
 	    {
@@ -356,7 +362,7 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 	    }
 	  return true;
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     }
   while (true);
 }
@@ -366,9 +372,9 @@ clht_put(clht_t* h, clht_addr_t key, clht_val_t val)
 clht_val_t
 clht_remove(clht_t* h, clht_addr_t key)
 {
-  clht_hashtable_t* hashtable = h->ht;
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   size_t bin = clht_hash(hashtable, key);
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
 #if CLHT_READ_ONLY_FAIL == 1
   if (!bucket_exists(bucket, key))
@@ -380,10 +386,10 @@ clht_remove(clht_t* h, clht_addr_t key)
   clht_lock_t* lock = &bucket->lock;
   while (!LOCK_ACQ(lock, hashtable))
     {
-      hashtable = h->ht;
+      hashtable = SHR_OFF_TO_PTR(h->ht);
       size_t bin = clht_hash(hashtable, key);
 
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
       lock = &bucket->lock;
     }
 
@@ -403,7 +409,7 @@ clht_remove(clht_t* h, clht_addr_t key)
 	      return val;
 	    }
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (unlikely(bucket != NULL));
   LOCK_RLS(lock);
@@ -413,7 +419,7 @@ clht_remove(clht_t* h, clht_addr_t key)
 static uint32_t
 clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint64_t bin) 
 {
-  volatile bucket_t* bucket = hashtable->table + bin;
+  volatile bucket_t* bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
   uint32_t j;
 
   do 
@@ -428,17 +434,18 @@ clht_put_seq(clht_hashtable_t* hashtable, clht_addr_t key, clht_val_t val, uint6
 	    }
 	}
         
-      if (bucket->next == NULL)
+      if (bucket->next == SHM_NULL)
 	{
 	  DPP(put_num_failed_expand);
 	  int null;
-	  bucket->next = clht_bucket_create_stats(hashtable, &null);
-	  bucket->next->val[0] = val;
-	  bucket->next->key[0] = key;
+	  bucket_t* b = clht_bucket_create_stats(hashtable, &null);
+	  b->val[0] = val;
+	  b->key[0] = key;
+	  bucket->next = SHR_PTR_TO_OFF(b);
 	  return true;
 	}
 
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (true);
 }
@@ -463,7 +470,7 @@ bucket_cpy(volatile bucket_t* bucket, clht_hashtable_t* ht_new)
 	      clht_put_seq(ht_new, key, bucket->val[j], bin);
 	    }
 	}
-      bucket = bucket->next;
+      bucket = SHR_OFF_TO_PTR(bucket->next);
     } 
   while (bucket != NULL);
 
@@ -483,8 +490,8 @@ ht_resize_help(clht_hashtable_t* h)
   /* hash = num_buckets - 1 */
   for (b = h->hash; b >= 0; b--)
     {
-      bucket_t* bu_cur = h->table + b;
-      if (!bucket_cpy(bu_cur, h->table_tmp))
+      bucket_t* bu_cur = ((bucket_t*) SHR_OFF_TO_PTR(h->table)) + b;
+      if (!bucket_cpy(bu_cur, SHR_OFF_TO_PTR(h->table_tmp)))
 	{	    /* reached a point where the resizer is handling */
 	  /* printf("[GC-%02d] helped  #buckets: %10zu = %5.1f%%\n",  */
 	  /* 	 clht_gc_get_id(), h->num_buckets - b, 100.0 * (h->num_buckets - b) / h->num_buckets); */
@@ -502,7 +509,8 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
 
   check_ht_status_steps = CLHT_STATUS_INVOK;
 
-  clht_hashtable_t* ht_old = h->ht;
+  SHM_off ht_old_off = h->ht;
+  clht_hashtable_t* ht_old = SHR_OFF_TO_PTR(ht_old_off);
 
   if (TRYLOCK_ACQ(&h->resize_lock))
     {
@@ -525,16 +533,21 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
 
   /* printf("// resizing: from %8zu to %8zu buckets\n", ht_old->num_buckets, num_buckets_new); */
 
-  clht_hashtable_t* ht_new = clht_hashtable_create(num_buckets_new);
+  clht_event_log(CLHT_EV_RESIZE_START, ht_old->num_buckets, num_buckets_new, ht_old->version, 0, 0);
+
+  SHM_off ht_new_off = clht_hashtable_create(num_buckets_new);
+  clht_hashtable_t* ht_new = SHR_OFF_TO_PTR(ht_new_off);
   ht_new->version = ht_old->version + 1;
 
+  ticks stall = 0;
+  uint64_t participants = 1;
 #if CLHT_HELP_RESIZE == 1
-  ht_old->table_tmp = ht_new; 
+  ht_old->table_tmp = ht_new_off; 
 
   int32_t b;
   for (b = 0; b < ht_old->num_buckets; b++)
     {
-      bucket_t* bu_cur = ht_old->table + b;
+      bucket_t* bu_cur = ((bucket_t*) SHR_OFF_TO_PTR(ht_old->table)) + b;
       if (!bucket_cpy(bu_cur, ht_new)) /* reached a point where the helper is handling */
 	{
 	  break;
@@ -543,10 +556,13 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
 
   if (is_increase && ht_old->is_helper != 1)	/* there exist a helper */
     {
+      participants++;
+      stall = getticks();
       while (ht_old->helper_done != 1)
 	{
 	  _mm_pause();
 	}
+      stall = getticks() - stall;
     }
 
 #else
@@ -554,7 +570,7 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
   int32_t b;
   for (b = 0; b < ht_old->num_buckets; b++)
     {
-      bucket_t* bu_cur = ht_old->table + b;
+      bucket_t* bu_cur = ((bucket_t*) SHR_OFF_TO_PTR(ht_old->table)) + b;
       bucket_cpy(bu_cur, ht_new);
     }
 #endif
@@ -566,7 +582,7 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
   /*   } */
 #endif
 
-  ht_new->table_prev = ht_old;
+  ht_new->table_prev = ht_old_off;
 
   int ht_resize_again = 0;
   if (ht_new->num_expands >= ht_new->num_expands_threshold)
@@ -577,14 +593,13 @@ ht_resize_pes(clht_t* h, int is_increase, int by)
     }
 
   
-  SWAP_U64((uint64_t*) h, (uint64_t) ht_new);
-  ht_old->table_new = ht_new;
+  SWAP_U64((uint64_t*) &h->ht, (uint64_t) ht_new_off);
+  ht_old->table_new = ht_new_off;
   TRYLOCK_RLS(h->resize_lock);
 
   ticks e = getticks() - s;
-  double mba = (ht_new->num_buckets * 64) / (1024.0 * 1024);
-  printf("[RESIZE-%02d] to #bu %7zu = MB: %7.2f    | took: %13llu ti = %8.6f s\n", 
-	 clht_gc_get_id(), ht_new->num_buckets, mba, (unsigned long long) e, e / 2.1e9);
+  clht_event_log(CLHT_EV_RESIZE_END, ht_old->num_buckets, ht_new->num_buckets,
+		 clht_ticks_to_ns(e), clht_ticks_to_ns(stall), participants);
 
 
 #if CLHT_DO_GC == 1
@@ -611,7 +626,7 @@ clht_size(clht_hashtable_t* hashtable)
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
        
       uint32_t j;
       do
@@ -624,7 +639,7 @@ clht_size(clht_hashtable_t* hashtable)
 		}
 	    }
 
-	  bucket = bucket->next;
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	}
       while (bucket != NULL);
     }
@@ -639,7 +654,7 @@ ht_status(clht_t* h, int resize_increase, int just_print)
       return 0;
     }
 
-  clht_hashtable_t* hashtable = h->ht;
+  clht_hashtable_t* hashtable = SHR_OFF_TO_PTR(h->ht);
   uint64_t num_buckets = hashtable->num_buckets;
   volatile bucket_t* bucket = NULL;
   size_t size = 0;
@@ -649,7 +664,7 @@ ht_status(clht_t* h, int resize_increase, int just_print)
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
 
       int expands_cont = -1;
       expands--;
@@ -666,7 +681,7 @@ ht_status(clht_t* h, int resize_increase, int just_print)
 		}
 	    }
 
-	  bucket = bucket->next;
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	}
       while (bucket != NULL);
 
@@ -687,8 +702,8 @@ ht_status(clht_t* h, int resize_increase, int just_print)
     {
       if (full_ratio > 0 && full_ratio < CLHT_PERC_FULL_HALVE)
 	{
-	  printf("[STATUS-%02d] #bu: %7zu / #elems: %7zu / full%%: %8.4f%% / expands: %4d / max expands: %2d\n",
-		 clht_gc_get_id(), hashtable->num_buckets, size, full_ratio, expands, expands_max);
+	  clht_event_log(CLHT_EV_STATUS, hashtable->num_buckets, size, (uint64_t) (full_ratio * 100),
+			 expands, expands_max);
 	  ht_resize_pes(h, 0, 33);
 	}
       else if ((full_ratio > 0 && full_ratio > CLHT_PERC_FULL_DOUBLE) || expands_max > CLHT_MAX_EXPANSIONS ||
@@ -697,8 +712,8 @@ ht_status(clht_t* h, int resize_increase, int just_print)
 	  int inc_by = (full_ratio / CLHT_OCCUP_AFTER_RES);
 	  int inc_by_pow2 = pow2roundup(inc_by);
 
-	  printf("[STATUS-%02d] #bu: %7zu / #elems: %7zu / full%%: %8.4f%% / expands: %4d / max expands: %2d\n",
-		 clht_gc_get_id(), hashtable->num_buckets, size, full_ratio, expands, expands_max);
+	  clht_event_log(CLHT_EV_STATUS, hashtable->num_buckets, size, (uint64_t) (full_ratio * 100),
+			 expands, expands_max);
 	  if (inc_by_pow2 == 1)
 	    {
 	      inc_by_pow2 = 2;
@@ -739,11 +754,11 @@ clht_size_mem_garbage(clht_hashtable_t* h) /* in bytes */
     }
 
   size_t size_tot = 0;
-  clht_hashtable_t* cur = h->table_prev;
+  clht_hashtable_t* cur = SHR_OFF_TO_PTR(h->table_prev);
   while (cur != NULL)
     {
       size_tot += clht_size_mem(cur);
-      cur = cur->table_prev;
+      cur = SHR_OFF_TO_PTR(cur->table_prev);
     }
 
   return size_tot;
@@ -761,7 +776,7 @@ clht_print(clht_hashtable_t* hashtable)
   uint64_t bin;
   for (bin = 0; bin < num_buckets; bin++)
     {
-      bucket = hashtable->table + bin;
+      bucket = ((bucket_t*) SHR_OFF_TO_PTR(hashtable->table)) + bin;
       
       printf("[[%05zu]] ", bin);
 
@@ -776,7 +791,7 @@ clht_print(clht_hashtable_t* hashtable)
 		}
 	    }
 
-	  bucket = bucket->next;
+	  bucket = SHR_OFF_TO_PTR(bucket->next);
 	  printf(" ** -> ");
 	}
       while (bucket != NULL);
@@ -33,8 +33,14 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "clht_lf_res.h"
+#include "clht_phase.h"
+#include "clht_hot.h"
 
 __thread ssmem_allocator_t *clht_alloc;
 
@@ -47,10 +53,39 @@ __thread uint32_t put_num_failed_on_new = 0;
 #include "assert.h"
 #include "stdlib.h"
 
+#if defined(CLHT_NONCOHERENT)
+/* the table whose header the thread last read from memory: the header
+   lines that the operations read are written before the table is
+   published and never again, and a header address is never reused */
+static __thread clht_hashtable_t *clht_nc_ht_seen = NULL;
+#  define CLHT_NC_SEEN(ht)						\
+  do									\
+    {									\
+      if (unlikely ((ht) != clht_nc_ht_seen))				\
+        {								\
+          CLHT_NC_INVAL (ht);						\
+          clht_nc_ht_seen = (ht);					\
+        }								\
+    }									\
+  while (0)
+#else
+#  define CLHT_NC_SEEN(ht) do { } while (0)
+#endif
+
 const char *
 clht_type_desc ()
 {
+#if defined(CLHT_CACHE) && defined(CLHT_TWO_CHOICE)
+  return "CLHT-LF-CACHE-2C";
+#elif defined(CLHT_CACHE)
+  return "CLHT-LF-CACHE";
+#elif defined(CLHT_TWO_CHOICE)
+  return "CLHT-LF-RESIZE-2C";
+#elif defined(CLHT_DELEGATE)
+  return "CLHT-LF-DELEGATE";
+#else
   return "CLHT-LF-RESIZE";
+#endif
 }
 
 inline int
@@ -94,11 +129,6 @@ clht_bucket_create ()
 
   bucket_t *bucket = SHR_OFF_TO_PTR (bucket_off);
 
-
-  SHM_off bucket_off2 = SHR_PTR_TO_OFF(bucket);
-
-  printf("clht_bucket_create %ld %ld\n", bucket_off, bucket_off2);
-
   uint32_t j;
   for (j = 0; j < KEY_BUCKT; j++)
     {
@@ -110,6 +140,41 @@ clht_bucket_create ()
 }
 
 SHM_off clht_hashtable_create (uint64_t num_buckets);
+static int ht_grow_to (clht_t *h, size_t num_buckets_new);
+typedef struct clht_bulk clht_bulk_t;
+static int ht_resize_locked (clht_t *h, size_t num_buckets_new, clht_bulk_t *bulk);
+static int clht_bulk_fill (clht_bulk_t *b, clht_hashtable_t *ht);
+static clht_hashtable_t *clht_table_enter (clht_t *h);
+#if defined(CLHT_TTL)
+static SHM_off clht_ttl_alloc (uint64_t num_buckets);
+#endif
+static void clht_cow_save (clht_hashtable_t *hashtable, uint64_t bin,
+                           uint32_t epoch);
+#if defined(CLHT_NONCOHERENT)
+static void clht_nc_wb_table (clht_hashtable_t *ht);
+#endif
+
+/* before a write changes bucket bin: saves it for the snapshot, if any.
+   Goes between the load of the snapshot the CAS expects and the CAS: a
+   snapshot created after that load bumps the bucket and fails the CAS.
+   Writes that publish a slot later without a CAS on a loaded snapshot
+   are registered on the table instead (clht_table_enter). */
+#define CLHT_COW_SAVE(ht, bin)						\
+  do									\
+    {									\
+      uint32_t _clht_epoch = CLHT_LOAD (&(ht)->cow_epoch, acquire);	\
+      if (unlikely (_clht_epoch != 0))					\
+        clht_cow_save (ht, bin, _clht_epoch);				\
+    }									\
+  while (0)
+
+static uint64_t
+clht_now_ns ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 SHM_off
 clht_create (uint64_t num_buckets)
@@ -136,7 +201,12 @@ clht_create (uint64_t num_buckets)
   w->status_lock = 0;
   w->version_list = SHM_NULL;
   w->version_min = 0;
+  w->num_elems = 0;
   w->ht_oldest = w->ht;
+#if defined(CLHT_NONCOHERENT)
+  clht_nc_wb_table (SHR_OFF_TO_PTR (w->ht));
+  CLHT_NC_WB (w, sizeof (clht_t));
+#endif
 
   return w_off;
 }
@@ -153,7 +223,12 @@ clht_hashtable_create (uint64_t num_buckets)
 
   /* Allocate the table itself. */
   SHM_off hashtable_off = SHM_NULL;
+#if defined(CLHT_NONCOHERENT)
+  /* never reused, see CLHT_NC_SEEN */
+  hashtable_off = clht_table_alloc_size (sizeof (clht_hashtable_t));
+#else
   hashtable_off = clht_shm_alloc (sizeof (clht_hashtable_t));
+#endif
   if (hashtable_off == SHM_NULL)
     {
       printf ("** clht_shm_alloc @ clht_hashtable_create hashtable\n");
@@ -163,7 +238,7 @@ clht_hashtable_create (uint64_t num_buckets)
   hashtable = (clht_hashtable_t *)SHR_OFF_TO_PTR (hashtable_off);
 
 
-  hashtable->table = clht_table_alloc (num_buckets * (sizeof (bucket_t)));
+  hashtable->table = clht_table_alloc (num_buckets);
   if (hashtable->table == SHM_NULL)
     {
       printf ("** clht_table_alloc: clht_hashtable_create table\n");
@@ -171,6 +246,11 @@ clht_hashtable_create (uint64_t num_buckets)
       return SHM_NULL;
     }
 
+  hashtable->expiry = SHM_NULL;
+#if defined(CLHT_TTL)
+  hashtable->expiry = clht_ttl_alloc (num_buckets);
+#endif
+
   bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
   
   uint64_t i;
@@ -185,15 +265,25 @@ clht_hashtable_create (uint64_t num_buckets)
     }
 
   hashtable->num_buckets = num_buckets;
-  hashtable->hash = num_buckets - 1;
 
   hashtable->table_new = SHM_NULL;
   hashtable->table_prev = SHM_NULL;
+  /* the snapshot area is allocated by the first snapshot */
+  hashtable->cow_epoch = 0;
+  hashtable->cow_map = SHM_NULL;
+  hashtable->cow_side = SHM_NULL;
+  hashtable->cow_last = 0;
+  hashtable->created_ns = clht_now_ns ();
+  hashtable->elems_at_create = 0;
 
   return hashtable_off;
 }
 
-/* Hash a key for a particular hash table. */
+/*
+ * Hash a key for a particular hash table. Tables have any number of
+ * buckets: the key is mixed (clht_key_mix) and the high bits of the hash
+ * are mapped to [0, num_buckets) with clht_fastrange instead of a mask.
+ */
 uint64_t
 clht_hash (clht_hashtable_t *hashtable, clht_addr_t key)
 {
@@ -202,235 +292,2882 @@ clht_hash (clht_hashtable_t *hashtable, clht_addr_t key)
   /* return hashval % hashtable->num_buckets; */
   /* return key % hashtable->num_buckets; */
   /* return key & (hashtable->num_buckets - 1); */
-  return key & (hashtable->hash);
+  return clht_fastrange (clht_key_mix (key), hashtable->num_buckets);
 }
 
-static inline clht_val_t
-clht_bucket_search (bucket_t *bucket, clht_addr_t key)
-{
-  int i;
-  for (i = 0; i < KEY_BUCKT; i++)
-    {
-      clht_val_t val = bucket->val[i];
-#ifdef __tile__
-      _mm_lfence ();
-#endif
-      if (bucket->map[i] == MAP_VALID)
-        {
-          if (bucket->key[i] == key)
-            {
-              if (likely (bucket->val[i] == val))
-                {
-                  return val;
-                }
-              else
-                {
-                  return 0;
-                }
-            }
-        }
-    }
-  return 0;
-}
+/* ******************************************************************************** */
+/* entry expiry (CLHT_TTL) */
+/* ******************************************************************************** */
 
-/* Retrieve a key-value entry from a hash table. */
-clht_val_t
-clht_get (SHM_off hashtable_off, clht_addr_t key)
+#if defined(CLHT_TTL)
+/*
+ * Every table has a parallel array with the expiry tick of each slot
+ * (CLHT_TTL_NEVER for entries without TTL), written before the slot is
+ * published. It is followed by the sweep state: a cursor and the earliest
+ * expiry of every region of CLHT_TTL_REGION buckets. A put with TTL lowers
+ * the minimum of its region after publishing, and the sweeper resets it
+ * before scanning the region, so the minimum of a region is never later
+ * than the expiry of one of its live entries.
+ */
+#define CLHT_TTL_NONE UINT32_MAX
+
+typedef struct clht_ttl_state
 {
-  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (hashtable_off);
-  CLHT_GC_HT_VERSION_USED (hashtable);
-  size_t bin = clht_hash (hashtable, key);
-  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  uint64_t cursor;		/* next region to sweep, shared by all sweepers */
+  uint32_t region_min[];
+} clht_ttl_state_t;
 
-  return clht_bucket_search (bucket, key);
+static inline size_t
+clht_ttl_slots_size (uint64_t num_buckets)
+{
+  size_t size = num_buckets * KEY_BUCKT * sizeof (uint32_t);
+  return (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
 }
 
-__thread size_t num_retry_cas1 = 0, num_retry_cas2 = 0, num_retry_cas3 = 0,
-                num_retry_cas4 = 0, num_retry_cas5 = 0;
-
-void
-clht_print_retry_stats ()
+static inline size_t
+clht_ttl_num_regions (uint64_t num_buckets)
 {
-  printf ("#cas1: %-8zu / #cas2: %-8zu / #cas3: %-8zu / #cas4: %-8zu\n",
-          num_retry_cas1, num_retry_cas2, num_retry_cas3, num_retry_cas4);
+  return (num_buckets + CLHT_TTL_REGION - 1) / CLHT_TTL_REGION;
 }
 
-#define DO_LF_STATS 0
+static inline uint32_t *
+clht_ttl_slot (clht_hashtable_t *hashtable, bucket_t *bucket, int i)
+{
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  return (uint32_t *)SHR_OFF_TO_PTR (hashtable->expiry)
+         + (bucket - table) * KEY_BUCKT + i;
+}
 
-#if DO_LF_STATS == 1
-#define INC(x) x++
-#else
-#define INC(x) ;
-#endif
+static inline clht_ttl_state_t *
+clht_ttl_state (clht_hashtable_t *hashtable)
+{
+  return (clht_ttl_state_t *)((char *)SHR_OFF_TO_PTR (hashtable->expiry)
+                              + clht_ttl_slots_size (hashtable->num_buckets));
+}
 
-/* Insert a key-value entry into a hash table. */
-int
-clht_put (clht_t *h, clht_addr_t key, clht_val_t val)
+static inline uint32_t *
+clht_ttl_region (clht_hashtable_t *hashtable, uint64_t bin)
 {
-  int empty_retries = 0;
-retry_all:
-  CLHT_CHECK_RESIZE (h);
-  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (h->ht);
-  size_t bin = clht_hash (hashtable, key);
-  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  return &clht_ttl_state (hashtable)->region_min[bin / CLHT_TTL_REGION];
+}
 
-  int empty_index = -2;
-  clht_snapshot_all_t s, s1;
+static SHM_off
+clht_ttl_alloc (uint64_t num_buckets)
+{
+  size_t num_regions = clht_ttl_num_regions (num_buckets);
+  SHM_off off = clht_table_alloc_size (clht_ttl_slots_size (num_buckets)
+                                       + sizeof (clht_ttl_state_t)
+                                       + num_regions * sizeof (uint32_t));
+  clht_ttl_state_t *st = (clht_ttl_state_t *)((char *)SHR_OFF_TO_PTR (off)
+                                              + clht_ttl_slots_size (num_buckets));
+  size_t r;
+  for (r = 0; r < num_regions; r++)
+    {
+      st->region_min[r] = CLHT_TTL_NONE;
+    }
+  CLHT_NC_WB (st->region_min, num_regions * sizeof (uint32_t));
+  return off;
+}
 
-retry:
-  s = bucket->snapshot;
-#ifdef __tile__
-  _mm_lfence ();
-#endif
+/* a MAP_VALID slot whose entry expired is absent for every operation */
+static inline int
+clht_ttl_expired (clht_hashtable_t *hashtable, bucket_t *bucket, int i)
+{
+  uint32_t *slot = clht_ttl_slot (hashtable, bucket, i);
+  /* written before the slot was published, maybe by another host */
+  CLHT_NC_INVAL (slot);
+  uint32_t e = CLHT_LOAD (slot, relaxed);
+  return unlikely (e != CLHT_TTL_NEVER) && e <= clht_clock_now ();
+}
 
-  if (clht_bucket_search (bucket, key) != 0)
+static inline void
+clht_ttl_lower (uint32_t *min, uint32_t expiry)
+{
+  uint32_t m = CLHT_LOAD (min, relaxed);
+  while (expiry < m)
     {
-      if (unlikely (empty_index >= 0))
+      uint32_t found = CLHT_CAS (min, m, expiry, seq_cst);
+      if (found == m)
         {
-          bucket->map[empty_index] = MAP_INVLD;
+          break;
         }
-      CLHT_NO_UPDATE ();
-      return false;
+      m = found;
     }
+}
 
-  if (likely (empty_index < 0))
+/*
+ * Invalidates the expired entries of bucket bin, like a remove, and lowers
+ * *live to the expiry of the others (if live is not NULL). Returns the
+ * number of entries reclaimed.
+ */
+static int
+clht_ttl_reclaim (clht_hashtable_t *hashtable, uint64_t bin, uint32_t now,
+                  uint32_t *live)
+{
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  uint32_t *exp = clht_ttl_slot (hashtable, bucket, 0);
+  clht_snapshot_t s;
+  int i, reclaimed = 0;
+
+retry:
+  s.snapshot = CLHT_LOAD (&bucket->snapshot, acquire);
+  CLHT_NC_INVAL_RANGE (exp, KEY_BUCKT * sizeof (uint32_t));
+  for (i = 0; i < KEY_BUCKT; i++)
     {
-      empty_index = snap_get_empty_index (s);
-      if (empty_index < 0)
+      if (s.map[i] != MAP_VALID)
         {
-          if (empty_retries++ >= CLHT_NO_EMPTY_SLOT_TRIES)
+          continue;
+        }
+      uint32_t e = CLHT_LOAD (&exp[i], relaxed);
+      if (e == CLHT_TTL_NEVER)
+        {
+          continue;
+        }
+      if (e > now)
+        {
+          if (live != NULL && e < *live)
             {
-
-              empty_retries = 0;
-              ht_status (h, 0, 2, 0);
+              *live = e;
             }
-          goto retry_all;
+          continue;
         }
-      s1 = snap_set_map (s, empty_index, MAP_INSRT);
-      if (CAS_U64 (&bucket->snapshot, s, s1) != s)
+
+      CLHT_COW_SAVE (hashtable, bin);
+      clht_snapshot_all_t s1 = snap_set_map (s.snapshot, i, MAP_INVLD);
+      if (CLHT_CAS (&bucket->snapshot, s.snapshot, s1, seq_cst) != s.snapshot)
         {
-          empty_index = -2;
-          INC (num_retry_cas1);
+          CLHT_STAT_INC (cas_retries);
           goto retry;
         }
+      s.snapshot = s1;
+      reclaimed++;
+    }
+  if (reclaimed > 0)
+    {
+      CLHT_WATCH_NOTIFY (bin);
+    }
+  return reclaimed;
+}
+
+#  define CLHT_TTL_EXPIRED(ht, b, i)   clht_ttl_expired (ht, b, i)
+#  define CLHT_TTL_GET(ht, b, i)       CLHT_LOAD (clht_ttl_slot (ht, b, i), relaxed)
+#  define CLHT_TTL_SET(ht, b, i, e)    CLHT_STORE (clht_ttl_slot (ht, b, i), e, relaxed)
+/* after the slot is published */
+#  define CLHT_TTL_NOTE(ht, bin, e)					\
+  if ((e) != CLHT_TTL_NEVER)						\
+    clht_ttl_lower (clht_ttl_region (ht, bin), e)
+#  define CLHT_TTL_RECLAIM(h, ht, bin) clht_ttl_reclaim_full (h, ht, bin)
+#else
+#  define CLHT_TTL_EXPIRED(ht, b, i)   0
+#  define CLHT_TTL_GET(ht, b, i)       CLHT_TTL_NEVER
+#  define CLHT_TTL_SET(ht, b, i, e)    ((void) (e))
+#  define CLHT_TTL_NOTE(ht, bin, e)
+#  define CLHT_TTL_RECLAIM(h, ht, bin) 0
+#endif  /* CLHT_TTL */
+
+#if defined(CLHT_NONCOHERENT)
+/* writes back a private table before it is published: its header and
+   whatever was filled in with plain stores */
+static void
+clht_nc_wb_table (clht_hashtable_t *ht)
+{
+  CLHT_NC_WB (SHR_OFF_TO_PTR (ht->table), ht->num_buckets * sizeof (bucket_t));
+#  if defined(CLHT_TTL)
+  CLHT_NC_WB (SHR_OFF_TO_PTR (ht->expiry),
+              clht_ttl_slots_size (ht->num_buckets) + sizeof (clht_ttl_state_t)
+              + clht_ttl_num_regions (ht->num_buckets) * sizeof (uint32_t));
+#  endif
+  CLHT_NC_WB (ht, sizeof (clht_hashtable_t));
+}
+#endif
 
-      bucket->val[empty_index] = val;
-#ifdef __tile__
-      _mm_sfence ();
+/*
+ * Cache mode (CLHT_CACHE): the table keeps its size and a put into a full
+ * bucket evicts one of its entries instead (snap_clock_victim). A get that
+ * finds its key sets the reference bit of the slot in the spare snapshot
+ * byte, with a plain load first so that hot entries cost no write; the
+ * victim search clears the bits it passes.
+ */
+#if defined(CLHT_CACHE)
+#  define CLHT_CACHE_REF(b, i)						\
+  do									\
+    {									\
+      if (!(CLHT_LOAD (&(b)->clock, relaxed) & (1 << (i))))		\
+        CLHT_OR (&(b)->clock, 1 << (i), relaxed);			\
+    }									\
+  while (0)
+#else
+#  define CLHT_CACHE_REF(b, i)
 #endif
-      bucket->key[empty_index] = key;
-#ifdef __tile__
-      _mm_sfence ();
+
+/* ******************************************************************************** */
+/* copy-on-write snapshots */
+/* ******************************************************************************** */
+
+/*
+ * A snapshot gives the table an epoch. The first write to a bucket after
+ * the snapshot copies it to the next side bucket and publishes the copy in
+ * the bucket's word of cow_map, (epoch << 32) | (side bucket + 1), before
+ * it changes the bucket. Writers that race on the copy keep the first one
+ * published, which was made before any of them changed the bucket. A
+ * reader of the snapshot takes the side bucket if the word has its epoch,
+ * else the table bucket, which it keeps if the word did not change while
+ * it read it.
+ */
+static inline int
+clht_cow_hidden (clht_hashtable_t *hashtable, bucket_t *bucket, int i)
+{
+#if defined(CLHT_TTL)
+  uint32_t e = CLHT_LOAD (clht_ttl_slot (hashtable, bucket, i), relaxed);
+  return e != CLHT_TTL_NEVER && e <= hashtable->cow_now;
+#else
+  return 0;
 #endif
-    }
-  else
+}
+
+/* the valid entries of bucket into copy, as of one version of the bucket */
+static void
+clht_cow_copy (clht_hashtable_t *hashtable, bucket_t *bucket, bucket_t *copy)
+{
+  clht_snapshot_t s, s1, c;
+  clht_addr_t keys[KEY_BUCKT];
+  clht_val_t vals[KEY_BUCKT];
+  int i;
+
+  do
     {
-      s1 = snap_set_map (s, empty_index, MAP_INSRT);
+      s.snapshot = CLHT_LOAD (&bucket->snapshot, acquire);
+      for (i = 0; i < KEY_BUCKT; i++)
+        {
+          keys[i] = CLHT_KEY_LOAD (&bucket->key[i]);
+          vals[i] = CLHT_LOAD (&bucket->val[i], relaxed);
+        }
+      CLHT_FENCE (acquire);
+      CLHT_NC_INVAL (bucket);
+      s1.snapshot = CLHT_LOAD (&bucket->snapshot, relaxed);
+#if KEY_BUCKT == 3
+      /* gets set the reference bits */
+      s.clock = 0;
+      s1.clock = 0;
+#endif
     }
+  while (s.snapshot != s1.snapshot);
 
-  clht_snapshot_all_t s2
-      = snap_set_map_and_inc_version (s1, empty_index, MAP_VALID);
-  if (CAS_U64 (&bucket->snapshot, s1, s2) != s1)
+  c.snapshot = 0;
+  c.version = s.version;
+  for (i = 0; i < KEY_BUCKT; i++)
     {
-      INC (num_retry_cas2);
-      goto retry;
+      if (s.map[i] == MAP_VALID && !clht_cow_hidden (hashtable, bucket, i))
+        {
+          c.map[i] = MAP_VALID;
+        }
+      CLHT_KEY_STORE (&copy->key[i], keys[i]);
+      CLHT_STORE (&copy->val[i], vals[i], relaxed);
     }
-
-  CLHT_NO_UPDATE ();
-  return true;
+  CLHT_STORE (&copy->snapshot, c.snapshot, relaxed);
 }
 
-/* Remove a key-value entry from a hash table. */
-clht_val_t
-clht_remove (clht_t *h, clht_addr_t key)
+static void
+clht_cow_save (clht_hashtable_t *hashtable, uint64_t bin, uint32_t epoch)
 {
-  CLHT_CHECK_RESIZE (h);
-  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (h->ht);
-  size_t bin = clht_hash (hashtable, key);
-  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  uint64_t *map = SHR_OFF_TO_PTR (hashtable->cow_map);
+  uint64_t m = CLHT_LOAD (&map[bin], acquire);
+  if (likely ((uint32_t)(m >> 32) == epoch))
+    {
+      return;
+    }
 
-  clht_snapshot_t s;
+  uint64_t idx = CLHT_FAA (&hashtable->cow_used, 1, relaxed);
+  if (unlikely (idx >= hashtable->cow_cap))
+    {
+      /* before the change, so that a reader that sees it sees this too */
+      CLHT_STORE (&hashtable->cow_full, epoch, seq_cst);
+      return;
+    }
+
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  bucket_t *copy = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->cow_side)) + idx;
+  clht_cow_copy (hashtable, bucket, copy);
+  /* fails if another writer published its copy first */
+  CLHT_CAS (&map[bin], m, ((uint64_t)epoch << 32) | (idx + 1), seq_cst);
+  CLHT_STAT_INC (cow_saves);
+}
 
+/* waits while a multi-key operation owns the key (MAP_MULTI) */
+static inline clht_val_t
+clht_bucket_search (clht_hashtable_t *hashtable, bucket_t *bucket,
+                    clht_addr_t key)
+{
   int i;
 retry:
-  s.snapshot = bucket->snapshot;
-#ifdef __tile__
-  _mm_lfence ();
+  /* the first value read must not be older than the map */
+  CLHT_NC_INVAL (bucket);
+#if defined(CLHT_KEY128)
+  clht_snapshot_all_t s = CLHT_LOAD (&bucket->snapshot, acquire);
 #endif
-
   for (i = 0; i < KEY_BUCKT; i++)
     {
-      if (bucket->key[i] == key && s.map[i] == MAP_VALID)
+      clht_val_t val = CLHT_LOAD (&bucket->val[i], relaxed);
+      uint8_t map = CLHT_LOAD (&bucket->map[i], seq_cst);
+      if (map == MAP_VALID)
         {
-          clht_val_t removed = bucket->val[i];
-#ifdef __tile__
-          _mm_mfence ();
-#endif
-          clht_snapshot_all_t s1 = snap_set_map (s.snapshot, i, MAP_INVLD);
-          if (CAS_U64 (&bucket->snapshot, s.snapshot, s1) == s.snapshot)
-            {
-              CLHT_NO_UPDATE ();
-              return removed;
-            }
-          else
+          if (CLHT_KEY_LOAD (&bucket->key[i]) == key)
             {
-              INC (num_retry_cas3);
-              goto retry;
+#if defined(CLHT_KEY128)
+              if (unlikely (CLHT_KEY_TORN (bucket, s)))
+                {
+                  goto retry;
+                }
+#endif
+              if (CLHT_TTL_EXPIRED (hashtable, bucket, i))
+                {
+                  continue;
+                }
+              if (likely (CLHT_LOAD (&bucket->val[i], relaxed) == val))
+                {
+                  CLHT_CACHE_REF (bucket, i);
+                  return val;
+                }
+              else
+                {
+                  return 0;
+                }
             }
         }
+      else if (unlikely (map == MAP_MULTI)
+               && CLHT_KEY_LOAD (&bucket->key[i]) == key)
+        {
+          _mm_pause ();
+          goto retry;
+        }
     }
-
-  CLHT_NO_UPDATE ();
-  return false;
+  return 0;
 }
 
-static uint32_t
-clht_put_seq (clht_hashtable_t *hashtable, clht_addr_t key, clht_val_t val,
-              uint64_t bin)
+#if !defined(CLHT_TWO_CHOICE)
+/* Retrieve a key-value entry from a hash table. */
+clht_val_t
+clht_get (SHM_off hashtable_off, clht_addr_t key)
 {
-  volatile bucket_t *bucket
-      = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
-  uint32_t j;
-  for (j = 0; j < KEY_BUCKT; j++)
+  CLHT_HOT_BEGIN ();
+  CLHT_PH_BEGIN ();
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (hashtable_off);
+  CLHT_NC_SEEN (hashtable);
+  CLHT_GC_HT_VERSION_USED (hashtable);
+  CLHT_PH_LOAD (hashtable->table);
+  CLHT_PH (PH_TABLE);
+  size_t bin = clht_hash (hashtable, key);
+  CLHT_PH (PH_HASH);
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  CLHT_PH_LOAD (bucket->snapshot);
+  CLHT_PH (PH_BUCKET);
+
+  clht_val_t val = clht_bucket_search (hashtable, bucket, key);
+  CLHT_PH (PH_SEARCH);
+  CLHT_STAT_INC (get);
+  if (val != 0)
     {
-      if (bucket->key[j] == 0)
-        {
-          bucket->val[j] = val;
-          bucket->key[j] = key;
-          bucket->map[j] = MAP_VALID;
-          return true;
-        }
+      CLHT_STAT_INC (get_hit);
     }
-
-  printf ("[CLHT] even the new ht does not have space (bucket %zu) \n", bin);
-  return false;
+  CLHT_HOT_END (hashtable, bin, key);
+  return val;
 }
+#else  /* CLHT_TWO_CHOICE */
 
-static int
-bucket_cpy (volatile bucket_t *bucket, clht_hashtable_t *ht_new)
+/*
+ * Two-choice placement: a key lives either in its primary bucket
+ * (clht_hash) or in its secondary one (clht_hash2), and a put takes the
+ * emptier of the two. Every insertion of a key ends with a CAS on the
+ * snapshot of its primary bucket (publish or version bump), so two puts
+ * of the same key are serialized there. Keys are written while their
+ * slot is MAP_INSRT; an operation that finds its key in a MAP_INSRT or
+ * MAP_MULTI slot waits for the slot to be resolved. This also covers a
+ * key that is being moved to its other bucket to make room.
+ */
+#define CLHT_2C_MISS    0
+#define CLHT_2C_FOUND   1
+#define CLHT_2C_PENDING 2
+
+/* the secondary bucket, never the primary one (unless there is one bucket) */
+static inline uint64_t
+clht_hash2 (clht_hashtable_t *hashtable, clht_addr_t key, uint64_t bin)
 {
-  uint32_t j;
-  for (j = 0; j < KEY_BUCKT; j++)
+#if defined(CLHT_KEY128)
+  uint64_t h2 = __ac_Jenkins_hash_64 ((uint64_t) key
+                                      ^ __ac_Jenkins_hash_64 ((uint64_t) (key >> 64)));
+#else
+  uint64_t h2 = __ac_Jenkins_hash_64 (key);
+#endif
+  uint64_t bin2 = clht_fastrange (h2, hashtable->num_buckets);
+  if (unlikely (bin2 == bin))
     {
-      if (bucket->map[j] == MAP_VALID)
-        {
-          clht_addr_t key = bucket->key[j];
-          uint64_t bin = clht_hash (ht_new, key);
-          clht_put_seq (ht_new, key, bucket->val[j], bin);
-        }
+      bin2 = (bin + 1 < hashtable->num_buckets) ? bin + 1 : 0;
     }
+  return bin2;
+}
 
-  return 1;
+/* the other candidate bucket of a key that is stored in bin */
+static inline uint64_t
+clht_hash_alt (clht_hashtable_t *hashtable, clht_addr_t key, uint64_t bin)
+{
+  uint64_t bin1 = clht_hash (hashtable, key);
+  if (bin1 != bin)
+    {
+      return bin1;
+    }
+  return clht_hash2 (hashtable, key, bin1);
 }
 
-/* resizing */
-int
-ht_resize_pes (clht_t *h, int is_increase, int by)
+/* snap: the snapshot of bucket read before, see CLHT_KEY_TORN */
+static inline int
+clht_2c_search (clht_hashtable_t *hashtable, bucket_t *bucket, clht_addr_t key,
+                clht_snapshot_all_t snap, clht_val_t *val, int *idx)
 {
-  /* if (!is_increase) */
-  /*   { */
-  /*     return 0; */
-  /*   } */
+  int i, res = CLHT_2C_MISS;
+  for (i = 0; i < KEY_BUCKT; i++)
+    {
+      clht_val_t v = CLHT_LOAD (&bucket->val[i], relaxed);
+      uint8_t map = CLHT_LOAD (&bucket->map[i], seq_cst);
+      if (CLHT_KEY_LOAD (&bucket->key[i]) != key)
+        {
+          continue;
+        }
+
+      if (map == MAP_VALID && CLHT_TTL_EXPIRED (hashtable, bucket, i))
+        {
+          continue;
+        }
+      if (map == MAP_VALID && likely (CLHT_LOAD (&bucket->val[i], relaxed) == v))
+        {
+          if (unlikely (CLHT_KEY_TORN (bucket, snap)))
+            {
+              return CLHT_2C_PENDING;
+            }
+          *val = v;
+          *idx = i;
+          return CLHT_2C_FOUND;
+        }
+      if (map == MAP_INSRT || map == MAP_MULTI)
+        {
+          res = CLHT_2C_PENDING;
+        }
+    }
+  return res;
+}
+
+/*
+ * Looks for key in both its buckets. A miss is only reported if neither
+ * snapshot changed during the search, as a key moving from the bucket
+ * searched second to the one searched first could otherwise be missed.
+ * s1/s2 are the snapshots read before the search.
+ */
+static inline int
+clht_2c_lookup (clht_hashtable_t *hashtable, bucket_t *b1, bucket_t *b2,
+                clht_addr_t key,
+                clht_snapshot_all_t *s1, clht_snapshot_all_t *s2,
+                bucket_t **found, int *idx, clht_val_t *val)
+{
+  *s1 = CLHT_LOAD (&b1->snapshot, acquire);
+  *s2 = CLHT_LOAD (&b2->snapshot, acquire);
+
+  int r1 = clht_2c_search (hashtable, b1, key, *s1, val, idx);
+  if (r1 == CLHT_2C_FOUND)
+    {
+      *found = b1;
+      return CLHT_2C_FOUND;
+    }
+  int r2 = clht_2c_search (hashtable, b2, key, *s2, val, idx);
+  if (r2 == CLHT_2C_FOUND)
+    {
+      *found = b2;
+      return CLHT_2C_FOUND;
+    }
+
+  /* the searches must be complete before the snapshots are read again */
+  CLHT_FENCE (acquire);
+  CLHT_NC_INVAL (b1);
+  CLHT_NC_INVAL (b2);
+  if (r1 == CLHT_2C_PENDING || r2 == CLHT_2C_PENDING
+      || CLHT_LOAD (&b1->snapshot, relaxed) != *s1
+      || CLHT_LOAD (&b2->snapshot, relaxed) != *s2)
+    {
+      return CLHT_2C_PENDING;
+    }
+  return CLHT_2C_MISS;
+}
+
+/* Retrieve a key-value entry from a hash table. */
+clht_val_t
+clht_get (SHM_off hashtable_off, clht_addr_t key)
+{
+  CLHT_HOT_BEGIN ();
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (hashtable_off);
+  CLHT_NC_SEEN (hashtable);
+  CLHT_GC_HT_VERSION_USED (hashtable);
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  size_t bin = clht_hash (hashtable, key);
+  size_t bin2 = clht_hash2 (hashtable, key, bin);
+  /* a miss searches both lines: fetch the second one in parallel */
+  __builtin_prefetch ((void *)(table + bin2), 0, 3);
+
+  clht_snapshot_all_t s1, s2;
+  bucket_t *found;
+  clht_val_t val;
+  int idx, r;
+  while ((r = clht_2c_lookup (hashtable, table + bin, table + bin2, key,
+                              &s1, &s2, &found, &idx, &val)) == CLHT_2C_PENDING)
+    {
+      _mm_pause ();
+    }
+
+  CLHT_STAT_INC (get);
+  if (r != CLHT_2C_FOUND)
+    {
+      val = 0;
+    }
+  else
+    {
+      CLHT_CACHE_REF (found, idx);
+      CLHT_STAT_INC (get_hit);
+    }
+  CLHT_HOT_END (hashtable, bin, key);
+  return val;
+}
+#endif  /* CLHT_TWO_CHOICE */
+
+__thread size_t num_retry_cas1 = 0, num_retry_cas2 = 0, num_retry_cas3 = 0,
+                num_retry_cas4 = 0, num_retry_cas5 = 0;
+
+void
+clht_print_retry_stats ()
+{
+  printf ("#cas1: %-8zu / #cas2: %-8zu / #cas3: %-8zu / #cas4: %-8zu\n",
+          num_retry_cas1, num_retry_cas2, num_retry_cas3, num_retry_cas4);
+}
+
+#define DO_LF_STATS 0
+
+#if DO_LF_STATS == 1
+#define INC(x) x++
+#else
+#define INC(x) ;
+#endif
+
+/* number of buckets that hold num_elems at CLHT_OCCUP_AFTER_RES% occupancy */
+static size_t
+clht_buckets_for (size_t num_elems)
+{
+  return (100 * num_elems) / (CLHT_OCCUP_AFTER_RES * ENTRIES_PER_BUCKET) + 1;
+}
+
+/* the smallest table a resize grows to: CLHT_GROWTH_PERC% of the current one */
+static size_t
+clht_buckets_grown (size_t num_buckets)
+{
+  size_t n = (num_buckets * CLHT_GROWTH_PERC) / 100;
+  return (n > num_buckets) ? n : num_buckets + 1;
+}
+
+/*
+ * Predictive resize: once the table is CLHT_POLICY_GROW_PERC% full, size
+ * the next one for the current elements plus the inserts expected within
+ * CLHT_POLICY_HORIZON_MS at the insert rate observed since the current
+ * table was created, instead of waiting for a bucket to overflow.
+ */
+static void
+clht_policy_check (clht_t *h, int64_t num_elems)
+{
+#if defined(CLHT_CACHE)
+  /* the size is fixed, puts evict */
+  (void) h;
+  (void) num_elems;
+#else
+  clht_hashtable_t *ht = SHR_OFF_TO_PTR (h->ht);
+  uint64_t slots = ht->num_buckets * ENTRIES_PER_BUCKET;
+  if (num_elems <= 0 || 100 * (uint64_t)num_elems < CLHT_POLICY_GROW_PERC * slots
+      || CLHT_LOAD (&h->resize_lock, relaxed) == CLHT_LOCK_ACQR)
+    {
+      return;
+    }
+
+  size_t expected = num_elems;
+  int64_t grown = num_elems - ht->elems_at_create;
+  uint64_t elapsed_ns = clht_now_ns () - ht->created_ns;
+  if (grown > 0 && elapsed_ns > 0)
+    {
+      expected += (size_t)((double)grown * CLHT_POLICY_HORIZON_MS * 1e6 / elapsed_ns);
+    }
+
+  size_t num_buckets_new = clht_buckets_for (expected);
+  if (num_buckets_new < clht_buckets_grown (ht->num_buckets))
+    {
+      num_buckets_new = clht_buckets_grown (ht->num_buckets);
+    }
+  clht_event_log (CLHT_EV_STATUS, ht->num_buckets, num_elems,
+                  (100 * 100 * num_elems) / slots, 0, 0);
+  ht_grow_to (h, num_buckets_new);
+#endif
+}
+
+/* threads publish their element count delta in batches */
+static __thread int64_t clht_elems_delta = 0;
+
+static inline void
+clht_elems_add (clht_t *h, int64_t d)
+{
+  clht_elems_delta += d;
+  if (likely (clht_elems_delta < CLHT_POLICY_BATCH
+              && clht_elems_delta > -CLHT_POLICY_BATCH))
+    {
+      return;
+    }
+
+  int64_t delta = clht_elems_delta;
+  clht_elems_delta = 0;
+  int64_t num_elems = CLHT_FAA (&h->num_elems, delta, relaxed) + delta;
+  if (delta > 0)
+    {
+      clht_policy_check (h, num_elems);
+    }
+}
+
+#if defined(CLHT_TTL)
+/* lazy expiry: a put that finds bucket bin full reclaims its expired entries */
+static int
+clht_ttl_reclaim_full (clht_t *h, clht_hashtable_t *hashtable, uint64_t bin)
+{
+  int n = clht_ttl_reclaim (hashtable, bin, clht_clock_now (), NULL);
+  if (n > 0)
+    {
+      clht_elems_add (h, -n);
+    }
+  return n;
+}
+#endif
+
+int
+clht_reserve (clht_t *h, size_t expected_elems)
+{
+  size_t num_buckets = clht_buckets_for (expected_elems);
+  while (1)
+    {
+      clht_hashtable_t *ht = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+      CLHT_NC_SEEN (ht);
+      if (ht->num_buckets >= num_buckets)
+        {
+          return 0;
+        }
+      if (ht_grow_to (h, num_buckets))
+        {
+          return 1;
+        }
+      /* somebody else is resizing: wait and check its new size */
+      CLHT_CHECK_RESIZE (h);
+    }
+}
+
+/* change the map of an own MAP_INSRT/MAP_MULTI slot while others update the bucket */
+static inline void
+clht_slot_set (bucket_t *bucket, int idx, int map, int inc_version)
+{
+  clht_snapshot_all_t s, s1;
+  if (inc_version)
+    {
+      /* publishes the slot */
+      do
+        {
+          s = CLHT_LOAD (&bucket->snapshot, relaxed);
+          s1 = snap_set_map_and_inc_version (s, idx, map);
+        }
+      while (CLHT_CAS (&bucket->snapshot, s, s1, seq_cst) != s);
+      return;
+    }
+
+  do
+    {
+      s = CLHT_LOAD (&bucket->snapshot, relaxed);
+      s1 = snap_set_map (s, idx, map);
+    }
+  while (CLHT_CAS (&bucket->snapshot, s, s1, acq_rel) != s);
+}
+
+#if defined(CLHT_TWO_CHOICE)
+/* publishes an own MAP_INSRT slot of bucket bin from a write that is not
+   registered on the table: saves the bucket for a snapshot on every try */
+static inline void
+clht_slot_publish (clht_hashtable_t *hashtable, uint64_t bin, int idx)
+{
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  clht_snapshot_all_t s;
+  do
+    {
+      s = CLHT_LOAD (&bucket->snapshot, acquire);
+      CLHT_COW_SAVE (hashtable, bin);
+    }
+  while (CLHT_CAS (&bucket->snapshot, s,
+                   snap_set_map_and_inc_version (s, idx, MAP_VALID), seq_cst) != s);
+}
+#endif
+
+#if !defined(CLHT_TWO_CHOICE)
+/* put of an entry that expires at tick expiry (CLHT_TTL_NEVER: no TTL) */
+static inline int
+clht_put_exp (clht_t *h, clht_addr_t key, clht_val_t val, uint32_t expiry)
+{
+#if !defined(CLHT_CACHE)
+  int empty_retries = 0;
+#endif
+  CLHT_STAT_INC (put);
+  CLHT_HOT_BEGIN ();
+  CLHT_PH_BEGIN ();
+retry_all:
+  CLHT_CHECK_RESIZE (h);
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+  CLHT_NC_SEEN (hashtable);
+  CLHT_PH_LOAD (hashtable->table);
+  CLHT_PH (PH_TABLE);
+  size_t bin = clht_hash (hashtable, key);
+  CLHT_PH (PH_HASH);
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+
+  int empty_index = -2;
+  clht_snapshot_all_t s, s1, cas;
+
+retry:
+  s = CLHT_LOAD (&bucket->snapshot, acquire);
+  CLHT_PH (PH_BUCKET);
+
+  clht_val_t found = clht_bucket_search (hashtable, bucket, key);
+  CLHT_PH (PH_SEARCH);
+  if (found != 0)
+    {
+      if (unlikely (empty_index >= 0))
+        {
+          CLHT_STORE (&bucket->map[empty_index], MAP_INVLD, relaxed);
+        }
+      CLHT_NO_UPDATE ();
+      CLHT_HOT_END (hashtable, bin, key);
+      return false;
+    }
+
+  if (likely (empty_index < 0))
+    {
+      int evict = 0;
+      empty_index = snap_get_empty_index (s);
+      if (empty_index < 0)
+        {
+          if (CLHT_TTL_RECLAIM (h, hashtable, bin) > 0)
+            {
+              goto retry;
+            }
+#if defined(CLHT_CACHE)
+          /* reserve the slot of the victim: the eviction is the reservation */
+          empty_index = snap_clock_victim (s, MAP_INSRT, &s1);
+          if (empty_index < 0)
+            {
+              _mm_pause ();
+              goto retry_all;
+            }
+          evict = 1;
+#else
+          CLHT_STAT_INC (empty_retries);
+          if (empty_retries++ >= CLHT_NO_EMPTY_SLOT_TRIES)
+            {
+
+              empty_retries = 0;
+              ht_status (h, 0, 2, 0);
+            }
+          goto retry_all;
+#endif
+        }
+      else
+        {
+          s1 = snap_set_map (s, empty_index, MAP_INSRT);
+        }
+      CLHT_COW_SAVE (hashtable, bin);
+      cas = CLHT_CAS (&bucket->snapshot, s, s1, acquire);
+      CLHT_PH (PH_CAS_INS);
+      if (cas != s)
+        {
+          empty_index = -2;
+          INC (num_retry_cas1);
+          CLHT_STAT_INC (cas_retries);
+          CLHT_HOT_CAS (hashtable, bin, key);
+          goto retry;
+        }
+      if (evict)
+        {
+          CLHT_STAT_INC (evictions);
+          clht_elems_add (h, -1);
+        }
+
+      CLHT_STORE (&bucket->val[empty_index], val, relaxed);
+      CLHT_KEY_STORE (&bucket->key[empty_index], key);
+      CLHT_TTL_SET (hashtable, bucket, empty_index, expiry);
+    }
+  else
+    {
+      s1 = snap_set_map (s, empty_index, MAP_INSRT);
+    }
+
+  clht_snapshot_all_t s2
+      = snap_set_map_and_inc_version (s1, empty_index, MAP_VALID);
+  CLHT_COW_SAVE (hashtable, bin);
+  cas = CLHT_CAS (&bucket->snapshot, s1, s2, seq_cst);
+  CLHT_PH (PH_CAS_VAL);
+  if (cas != s1)
+    {
+      INC (num_retry_cas2);
+      CLHT_STAT_INC (cas_retries);
+      CLHT_HOT_CAS (hashtable, bin, key);
+      goto retry;
+    }
+
+  CLHT_NO_UPDATE ();
+  CLHT_TTL_NOTE (hashtable, bin, expiry);
+  CLHT_WATCH_NOTIFY (bin);
+  CLHT_STAT_INC (put_suc);
+  CLHT_HOT_END (hashtable, bin, key);
+  clht_elems_add (h, 1);
+  return true;
+}
+
+#if !defined(CLHT_DELEGATE)
+/* Insert a key-value entry into a hash table. */
+int
+clht_put (clht_t *h, clht_addr_t key, clht_val_t val)
+{
+  return clht_put_exp (h, key, val, CLHT_TTL_NEVER);
+}
+
+/* Remove a key-value entry from a hash table. */
+clht_val_t
+clht_remove (clht_t *h, clht_addr_t key)
+{
+  CLHT_STAT_INC (remove);
+  CLHT_HOT_BEGIN ();
+  CLHT_PH_BEGIN ();
+  CLHT_CHECK_RESIZE (h);
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+  CLHT_NC_SEEN (hashtable);
+  CLHT_PH_LOAD (hashtable->table);
+  CLHT_PH (PH_TABLE);
+  size_t bin = clht_hash (hashtable, key);
+  CLHT_PH (PH_HASH);
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+
+  clht_snapshot_t s;
+
+  int i;
+retry:
+  s.snapshot = CLHT_LOAD (&bucket->snapshot, acquire);
+  CLHT_PH (PH_BUCKET);
+
+  for (i = 0; i < KEY_BUCKT; i++)
+    {
+      if (CLHT_KEY_LOAD (&bucket->key[i]) == key && s.map[i] == MAP_VALID
+          && !CLHT_TTL_EXPIRED (hashtable, bucket, i))
+        {
+          clht_val_t removed = CLHT_LOAD (&bucket->val[i], relaxed);
+          clht_snapshot_all_t s1 = snap_set_map (s.snapshot, i, MAP_INVLD);
+          CLHT_PH (PH_SEARCH);
+          CLHT_COW_SAVE (hashtable, bin);
+          clht_snapshot_all_t cas = CLHT_CAS (&bucket->snapshot, s.snapshot, s1, seq_cst);
+          CLHT_PH (PH_CAS_REM);
+          if (cas == s.snapshot)
+            {
+              CLHT_NO_UPDATE ();
+              CLHT_WATCH_NOTIFY (bin);
+              CLHT_STAT_INC (remove_suc);
+              CLHT_HOT_END (hashtable, bin, key);
+              clht_elems_add (h, -1);
+              return removed;
+            }
+          else
+            {
+              INC (num_retry_cas3);
+              CLHT_STAT_INC (cas_retries);
+              CLHT_HOT_CAS (hashtable, bin, key);
+              goto retry;
+            }
+        }
+      if (unlikely (s.map[i] == MAP_MULTI)
+          && CLHT_KEY_LOAD (&bucket->key[i]) == key)
+        {
+          /* a multi-key remove may still give it back */
+          _mm_pause ();
+          goto retry;
+        }
+    }
+  CLHT_PH (PH_SEARCH);
+
+  CLHT_NO_UPDATE ();
+  CLHT_HOT_END (hashtable, bin, key);
+  return false;
+}
+#endif  /* !CLHT_DELEGATE */
+
+/*
+ * Versioned reads and conditional writes. The version of a key is the
+ * version of its bucket snapshot, which every put increments when it
+ * publishes, and the version of the table, which every resize changes.
+ */
+static inline uint64_t
+clht_version_of (clht_hashtable_t *hashtable, clht_snapshot_all_t s)
+{
+  clht_snapshot_t st = { .snapshot = s };
+  return ((uint64_t)(uint32_t)hashtable->version << 32) | st.version;
+}
+
+clht_val_t
+clht_get_versioned (clht_t *h, clht_addr_t key, uint64_t *version)
+{
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+  CLHT_NC_SEEN (hashtable);
+  CLHT_GC_HT_VERSION_USED (hashtable);
+  size_t bin = clht_hash (hashtable, key);
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  clht_snapshot_t s, s1;
+  clht_val_t val;
+
+  /* seqlock reader: no put was published while the value was read */
+  do
+    {
+      s.snapshot = CLHT_LOAD (&bucket->snapshot, acquire);
+      val = clht_bucket_search (hashtable, bucket, key);
+      CLHT_FENCE (acquire);
+      CLHT_NC_INVAL (bucket);
+      s1.snapshot = CLHT_LOAD (&bucket->snapshot, relaxed);
+    }
+  while (s.version != s1.version);
+
+  *version = clht_version_of (hashtable, s.snapshot);
+  CLHT_STAT_INC (get);
+  if (val != 0)
+    {
+      CLHT_STAT_INC (get_hit);
+    }
+  return val;
+}
+
+#if !defined(CLHT_DELEGATE)
+/*
+ * Insert (replace 0) or replace (replace 1) key if its version is still
+ * version. The new value goes to a free slot, and one snapshot CAS both
+ * publishes it and invalidates the old one, so a get sees either value.
+ */
+static int
+clht_put_cond (clht_t *h, clht_addr_t key, clht_val_t val, uint64_t version,
+               int replace)
+{
+#if !defined(CLHT_CACHE)
+  int empty_retries = 0;
+#endif
+  CLHT_STAT_INC (put);
+retry_all:;
+  clht_hashtable_t *hashtable = clht_table_enter (h);
+  size_t bin = clht_hash (hashtable, key);
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  clht_snapshot_t s;
+  clht_snapshot_all_t s1, s2;
+  uint32_t expiry;
+  int i, old, idx, evict;
+
+retry:
+  s.snapshot = CLHT_LOAD (&bucket->snapshot, acquire);
+  if (clht_version_of (hashtable, s.snapshot) != version)
+    {
+      CLHT_NO_UPDATE ();
+      return false;
+    }
+
+  old = -1;
+  for (i = 0; i < KEY_BUCKT; i++)
+    {
+      if (CLHT_KEY_LOAD (&bucket->key[i]) != key)
+        {
+          continue;
+        }
+      if (s.map[i] == MAP_VALID && !CLHT_TTL_EXPIRED (hashtable, bucket, i))
+        {
+          old = i;
+        }
+      else if (unlikely (s.map[i] == MAP_MULTI))
+        {
+          _mm_pause ();
+          goto retry;
+        }
+    }
+  if ((old >= 0) != replace)
+    {
+      CLHT_NO_UPDATE ();
+      return false;
+    }
+  /* a replaced entry keeps its expiry; the commit CAS fails if it changed */
+  expiry = old >= 0 ? CLHT_TTL_GET (hashtable, bucket, old) : CLHT_TTL_NEVER;
+
+  evict = 0;
+  idx = snap_get_empty_index (s.snapshot);
+  if (idx < 0)
+    {
+      if (CLHT_TTL_RECLAIM (h, hashtable, bin) > 0)
+        {
+          goto retry;
+        }
+#if defined(CLHT_CACHE)
+      /* the victim may be the old entry: then it is evicted and put again */
+      idx = snap_clock_victim (s.snapshot, MAP_INSRT, &s1);
+      if (idx < 0)
+        {
+          _mm_pause ();
+          goto retry_all;
+        }
+      evict = idx != old;
+#else
+      CLHT_NO_UPDATE ();
+      CLHT_STAT_INC (empty_retries);
+      if (empty_retries++ >= CLHT_NO_EMPTY_SLOT_TRIES)
+        {
+          empty_retries = 0;
+          ht_status (h, 0, 2, 0);
+        }
+      goto retry_all;
+#endif
+    }
+  else
+    {
+      s1 = snap_set_map (s.snapshot, idx, MAP_INSRT);
+    }
+
+  CLHT_COW_SAVE (hashtable, bin);
+  if (CLHT_CAS (&bucket->snapshot, s.snapshot, s1, acquire) != s.snapshot)
+    {
+      CLHT_STAT_INC (cas_retries);
+      goto retry;
+    }
+  if (evict)
+    {
+      CLHT_STAT_INC (evictions);
+      clht_elems_add (h, -1);
+    }
+
+  CLHT_STORE (&bucket->val[idx], val, relaxed);
+  CLHT_KEY_STORE (&bucket->key[idx], key);
+  CLHT_TTL_SET (hashtable, bucket, idx, expiry);
+
+  s2 = snap_set_map_and_inc_version (s1, idx, MAP_VALID);
+  if (old >= 0 && old != idx)
+    {
+      s2 = snap_set_map (s2, old, MAP_INVLD);
+    }
+  if (CLHT_CAS (&bucket->snapshot, s1, s2, seq_cst) != s1)
+    {
+      /* the bucket changed: the version decides again */
+      clht_slot_set (bucket, idx, MAP_INVLD, 0);
+      CLHT_STAT_INC (cas_retries);
+      goto retry;
+    }
+
+  CLHT_NO_UPDATE ();
+  CLHT_WATCH_NOTIFY (bin);
+  CLHT_STAT_INC (put_suc);
+  if (!replace)
+    {
+      clht_elems_add (h, 1);
+    }
+  return true;
+}
+
+int
+clht_put_if_version (clht_t *h, clht_addr_t key, clht_val_t val,
+                     uint64_t version)
+{
+  return clht_put_cond (h, key, val, version, 0);
+}
+
+int
+clht_replace_if_version (clht_t *h, clht_addr_t key, clht_val_t val,
+                         uint64_t version)
+{
+  return clht_put_cond (h, key, val, version, 1);
+}
+#endif  /* !CLHT_DELEGATE */
+
+static uint32_t
+clht_put_seq (clht_hashtable_t *hashtable, clht_addr_t key, clht_val_t val,
+              uint64_t bin, uint32_t expiry)
+{
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  uint32_t j;
+  for (j = 0; j < KEY_BUCKT; j++)
+    {
+      if (bucket->key[j] == 0)
+        {
+          bucket->val[j] = val;
+          bucket->key[j] = key;
+          bucket->map[j] = MAP_VALID;
+          CLHT_TTL_SET (hashtable, bucket, j, expiry);
+          CLHT_TTL_NOTE (hashtable, bin, expiry);
+          return true;
+        }
+    }
+
+  clht_event_log (CLHT_EV_NO_SPACE, bin, hashtable->num_buckets, 0, 0, 0);
+  return false;
+}
+#else  /* CLHT_TWO_CHOICE */
+
+/*
+ * Makes room in the full bucket bin by moving one of its keys to the
+ * other candidate bucket of that key (one step, no cuckoo chains): the
+ * copy is reserved and written first, the original is invalidated with a
+ * CAS on the unchanged snapshot, and only then the copy is published.
+ * Returns 0 if none of the keys has room in its other bucket.
+ */
+static int
+clht_2c_displace (clht_hashtable_t *hashtable, bucket_t *table, uint64_t bin)
+{
+  bucket_t *bucket = table + bin;
+  clht_snapshot_t s = { .snapshot = CLHT_LOAD (&bucket->snapshot, acquire) };
+
+  int i;
+  for (i = 0; i < KEY_BUCKT; i++)
+    {
+      if (s.map[i] != MAP_VALID)
+        {
+          continue;
+        }
+
+      clht_addr_t key = CLHT_KEY_LOAD (&bucket->key[i]);
+      clht_val_t val = CLHT_LOAD (&bucket->val[i], relaxed);
+      uint32_t expiry = CLHT_TTL_GET (hashtable, bucket, i);
+      uint64_t bin_alt = clht_hash_alt (hashtable, key, bin);
+      bucket_t *alt = table + bin_alt;
+      clht_snapshot_all_t a = CLHT_LOAD (&alt->snapshot, acquire);
+      int j = snap_get_empty_index (a);
+      if (j < 0)
+        {
+          continue;
+        }
+
+      CLHT_COW_SAVE (hashtable, bin_alt);
+      if (CLHT_CAS (&alt->snapshot, a, snap_set_map (a, j, MAP_INSRT), acquire) != a)
+        {
+          return 1;
+        }
+      CLHT_STORE (&alt->val[j], val, relaxed);
+      CLHT_KEY_STORE (&alt->key[j], key);
+      CLHT_TTL_SET (hashtable, alt, j, expiry);
+
+      clht_snapshot_all_t s1
+          = snap_set_map_and_inc_version (s.snapshot, i, MAP_INVLD);
+      CLHT_COW_SAVE (hashtable, bin);
+      if (CLHT_CAS (&bucket->snapshot, s.snapshot, s1, seq_cst) != s.snapshot)
+        {
+          clht_slot_set (alt, j, MAP_INVLD, 0);
+          return 1;
+        }
+      clht_slot_publish (hashtable, bin_alt, j);
+      CLHT_TTL_NOTE (hashtable, bin_alt, expiry);
+      CLHT_WATCH_NOTIFY (bin);
+      CLHT_WATCH_NOTIFY (bin_alt);
+      return 1;
+    }
+  return 0;
+}
+
+/* put of an entry that expires at tick expiry (CLHT_TTL_NEVER: no TTL) */
+static inline int
+clht_put_exp (clht_t *h, clht_addr_t key, clht_val_t val, uint32_t expiry)
+{
+#if !defined(CLHT_CACHE)
+  int empty_retries = 0;
+#endif
+  CLHT_STAT_INC (put);
+  CLHT_HOT_BEGIN ();
+retry_all:
+  CLHT_CHECK_RESIZE (h);
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+  CLHT_NC_SEEN (hashtable);
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  size_t bin = clht_hash (hashtable, key);
+  size_t bin2 = clht_hash2 (hashtable, key, bin);
+  bucket_t *bucket = table + bin, *bucket2 = table + bin2;
+  __builtin_prefetch ((void *)bucket2, 1, 3);
+
+  clht_snapshot_all_t s, s2, s1;
+  bucket_t *found;
+  clht_val_t v;
+  int idx, r;
+
+retry:
+  r = clht_2c_lookup (hashtable, bucket, bucket2, key, &s, &s2, &found, &idx, &v);
+  if (r == CLHT_2C_FOUND)
+    {
+      CLHT_NO_UPDATE ();
+      CLHT_HOT_END (hashtable, bin, key);
+      return false;
+    }
+  if (r == CLHT_2C_PENDING)
+    {
+      _mm_pause ();
+      goto retry;
+    }
+
+  int empty1 = snap_num_empty (s), empty2 = snap_num_empty (s2);
+  int evict = 0;
+  if (empty1 == 0 && empty2 == 0)
+    {
+      if (CLHT_TTL_RECLAIM (h, hashtable, bin) + CLHT_TTL_RECLAIM (h, hashtable, bin2) > 0
+          || clht_2c_displace (hashtable, table, bin)
+          || clht_2c_displace (hashtable, table, bin2))
+        {
+          goto retry;
+        }
+
+#if defined(CLHT_CACHE)
+      /* evict from the primary bucket, reserving the victim's slot */
+      idx = snap_clock_victim (s, MAP_INSRT, &s1);
+      if (idx < 0)
+        {
+          _mm_pause ();
+          goto retry_all;
+        }
+      evict = 1;
+#else
+      CLHT_STAT_INC (empty_retries);
+      if (empty_retries++ >= CLHT_NO_EMPTY_SLOT_TRIES)
+        {
+          empty_retries = 0;
+          ht_status (h, 0, 2, 0);
+        }
+      goto retry_all;
+#endif
+    }
+
+  if (evict || empty1 >= empty2)
+    {
+      /* primary bucket: reserve and publish, as in CLHT-LF */
+      if (!evict)
+        {
+          idx = snap_get_empty_index (s);
+          s1 = snap_set_map (s, idx, MAP_INSRT);
+        }
+      CLHT_COW_SAVE (hashtable, bin);
+      if (CLHT_CAS (&bucket->snapshot, s, s1, acquire) != s)
+        {
+          CLHT_STAT_INC (cas_retries);
+          CLHT_HOT_CAS (hashtable, bin, key);
+          goto retry;
+        }
+      if (evict)
+        {
+          CLHT_STAT_INC (evictions);
+          clht_elems_add (h, -1);
+        }
+
+      CLHT_STORE (&bucket->val[idx], val, relaxed);
+      CLHT_KEY_STORE (&bucket->key[idx], key);
+      CLHT_TTL_SET (hashtable, bucket, idx, expiry);
+
+      CLHT_COW_SAVE (hashtable, bin);
+      if (CLHT_CAS (&bucket->snapshot, s1,
+                    snap_set_map_and_inc_version (s1, idx, MAP_VALID), seq_cst) != s1)
+        {
+          /* never wait for others while holding a reservation */
+          clht_slot_set (bucket, idx, MAP_INVLD, 0);
+          CLHT_STAT_INC (cas_retries);
+          CLHT_HOT_CAS (hashtable, bin, key);
+          goto retry;
+        }
+    }
+  else
+    {
+      /* secondary bucket: reserve there, commit on the primary snapshot */
+      idx = snap_get_empty_index (s2);
+      s1 = snap_set_map (s2, idx, MAP_INSRT);
+      CLHT_COW_SAVE (hashtable, bin2);
+      if (CLHT_CAS (&bucket2->snapshot, s2, s1, acquire) != s2)
+        {
+          CLHT_STAT_INC (cas_retries);
+          CLHT_HOT_CAS (hashtable, bin2, key);
+          goto retry;
+        }
+
+      CLHT_STORE (&bucket2->val[idx], val, relaxed);
+      CLHT_KEY_STORE (&bucket2->key[idx], key);
+      CLHT_TTL_SET (hashtable, bucket2, idx, expiry);
+
+      if (CLHT_CAS (&bucket->snapshot, s, snap_inc_version (s), seq_cst) != s)
+        {
+          clht_slot_set (bucket2, idx, MAP_INVLD, 0);
+          CLHT_STAT_INC (cas_retries);
+          CLHT_HOT_CAS (hashtable, bin, key);
+          goto retry;
+        }
+      clht_slot_publish (hashtable, bin2, idx);
+    }
+
+  CLHT_NO_UPDATE ();
+  CLHT_TTL_NOTE (hashtable, (evict || empty1 >= empty2) ? bin : bin2, expiry);
+  CLHT_WATCH_NOTIFY (bin);
+  if (!(evict || empty1 >= empty2))
+    {
+      CLHT_WATCH_NOTIFY (bin2);
+    }
+  CLHT_STAT_INC (put_suc);
+  CLHT_HOT_END (hashtable, bin, key);
+  clht_elems_add (h, 1);
+  return true;
+}
+
+/* Insert a key-value entry into a hash table. */
+int
+clht_put (clht_t *h, clht_addr_t key, clht_val_t val)
+{
+  return clht_put_exp (h, key, val, CLHT_TTL_NEVER);
+}
+
+/* Remove a key-value entry from a hash table. */
+clht_val_t
+clht_remove (clht_t *h, clht_addr_t key)
+{
+  CLHT_STAT_INC (remove);
+  CLHT_HOT_BEGIN ();
+  CLHT_CHECK_RESIZE (h);
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+  CLHT_NC_SEEN (hashtable);
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  size_t bin = clht_hash (hashtable, key);
+  size_t bin2 = clht_hash2 (hashtable, key, bin);
+  __builtin_prefetch ((void *)(table + bin2), 1, 3);
+
+  clht_snapshot_all_t s1, s2;
+  bucket_t *bucket;
+  clht_val_t removed;
+  int idx, r;
+
+retry:
+  r = clht_2c_lookup (hashtable, table + bin, table + bin2, key, &s1, &s2,
+                      &bucket, &idx, &removed);
+  if (r == CLHT_2C_PENDING)
+    {
+      _mm_pause ();
+      goto retry;
+    }
+  if (r == CLHT_2C_MISS)
+    {
+      CLHT_NO_UPDATE ();
+      CLHT_HOT_END (hashtable, bin, key);
+      return false;
+    }
+
+  clht_snapshot_all_t s = (bucket == table + bin) ? s1 : s2;
+  CLHT_COW_SAVE (hashtable, bucket - table);
+  clht_snapshot_all_t cas
+      = CLHT_CAS (&bucket->snapshot, s, snap_set_map (s, idx, MAP_INVLD), seq_cst);
+  if (cas != s)
+    {
+      CLHT_STAT_INC (cas_retries);
+      CLHT_HOT_CAS (hashtable, bucket - table, key);
+      goto retry;
+    }
+
+  CLHT_NO_UPDATE ();
+  CLHT_WATCH_NOTIFY (bucket - table);
+  CLHT_STAT_INC (remove_suc);
+  CLHT_HOT_END (hashtable, bin, key);
+  clht_elems_add (h, -1);
+  return removed;
+}
+
+static int
+clht_bucket_put_seq (clht_hashtable_t *hashtable, uint64_t bin,
+                     clht_addr_t key, clht_val_t val, uint32_t expiry)
+{
+  bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+  uint32_t j;
+  for (j = 0; j < KEY_BUCKT; j++)
+    {
+      if (bucket->key[j] == 0)
+        {
+          bucket->val[j] = val;
+          bucket->key[j] = key;
+          bucket->map[j] = MAP_VALID;
+          CLHT_TTL_SET (hashtable, bucket, j, expiry);
+          CLHT_TTL_NOTE (hashtable, bin, expiry);
+          return true;
+        }
+    }
+  return false;
+}
+
+static uint32_t
+clht_put_seq (clht_hashtable_t *hashtable, clht_addr_t key, clht_val_t val,
+              uint64_t bin, uint32_t expiry)
+{
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  uint64_t bins[2] = { bin, clht_hash2 (hashtable, key, bin) };
+  if (clht_bucket_put_seq (hashtable, bins[0], key, val, expiry)
+      || clht_bucket_put_seq (hashtable, bins[1], key, val, expiry))
+    {
+      return true;
+    }
+
+  /* both full: move one of their keys to its other bucket */
+  int b;
+  uint32_t j;
+  for (b = 0; b < 2; b++)
+    {
+      bucket_t *bucket = table + bins[b];
+      for (j = 0; j < KEY_BUCKT; j++)
+        {
+          clht_addr_t k = bucket->key[j];
+          uint64_t alt = clht_hash_alt (hashtable, k, bins[b]);
+          if (clht_bucket_put_seq (hashtable, alt, k, bucket->val[j],
+                                   CLHT_TTL_GET (hashtable, bucket, j)))
+            {
+              bucket->val[j] = val;
+              bucket->key[j] = key;
+              CLHT_TTL_SET (hashtable, bucket, j, expiry);
+              CLHT_TTL_NOTE (hashtable, bins[b], expiry);
+              return true;
+            }
+        }
+    }
+
+  clht_event_log (CLHT_EV_NO_SPACE, bin, hashtable->num_buckets, 0, 0, 0);
+  return false;
+}
+#endif  /* CLHT_TWO_CHOICE */
+
+/* ******************************************************************************** */
+/* multi-key operations */
+/* ******************************************************************************** */
+
+/*
+ * clht_multi_put and clht_multi_remove first take a MAP_MULTI slot for
+ * each of their keys and only then change any of them visibly, so that
+ * they can still give all slots back. A put reserves an empty slot per
+ * key and writes it. Once all keys are written, it seals the primary
+ * bucket of each key: it checks that the key is still absent and bumps
+ * the version with a CAS. Every put of a key ends with a CAS on that
+ * snapshot, so after the seal no other put of the key can succeed and
+ * publishing the slots cannot fail. A remove claims the MAP_VALID slot
+ * of each key, which keeps the key in place, and clears the slots at the
+ * end. Single-key operations and clht_multi_get wait for a MAP_MULTI
+ * slot with their key to be resolved. A multi-key operation never waits
+ * while it owns slots: it gives them back and retries after a backoff.
+ */
+#define CLHT_MULTI_MISS    0
+#define CLHT_MULTI_FOUND   1
+#define CLHT_MULTI_PENDING 2	/* another operation has the key in flight */
+#define CLHT_MULTI_RETRY   3	/* a bucket changed during the search */
+#define CLHT_MULTI_FULL    4
+
+#if defined(CLHT_TWO_CHOICE)
+#  define CLHT_MULTI_CANDS 2
+#  define MAP_IS_PENDING(m) ((m) == MAP_INSRT || (m) == MAP_MULTI)
+#else
+#  define CLHT_MULTI_CANDS 1
+#  define MAP_IS_PENDING(m) ((m) == MAP_MULTI)
+#endif
+
+typedef struct clht_multi_slot
+{
+  bucket_t *bucket;
+  int idx;
+} clht_multi_slot_t;
+
+/* the candidate buckets of a key, primary first */
+static inline void
+clht_multi_cands (clht_hashtable_t *hashtable, clht_addr_t key, uint64_t *bins)
+{
+  bins[0] = clht_hash (hashtable, key);
+#if defined(CLHT_TWO_CHOICE)
+  bins[1] = clht_hash2 (hashtable, key, bins[0]);
+#endif
+}
+
+static inline int
+clht_multi_owned (clht_multi_slot_t *own, size_t num_own, bucket_t *b, int idx)
+{
+  size_t i;
+  for (i = 0; i < num_own; i++)
+    {
+      if (own[i].bucket == b && own[i].idx == idx)
+        {
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/*
+ * Looks for key in its candidate buckets, skipping the slots in own. A
+ * miss is only reported if none of the snapshots (stored in snaps)
+ * changed during the search.
+ */
+static int
+clht_multi_lookup (clht_hashtable_t *hashtable, bucket_t *table,
+                   uint64_t *bins, clht_addr_t key,
+                   clht_multi_slot_t *own, size_t num_own,
+                   clht_snapshot_all_t *snaps, clht_multi_slot_t *found,
+                   clht_val_t *val)
+{
+  int c, i, res = CLHT_MULTI_MISS;
+  for (c = 0; c < CLHT_MULTI_CANDS; c++)
+    {
+      snaps[c] = CLHT_LOAD (&table[bins[c]].snapshot, acquire);
+    }
+
+  for (c = 0; c < CLHT_MULTI_CANDS; c++)
+    {
+      bucket_t *b = table + bins[c];
+      for (i = 0; i < KEY_BUCKT; i++)
+        {
+          clht_val_t v = CLHT_LOAD (&b->val[i], relaxed);
+          uint8_t map = CLHT_LOAD (&b->map[i], seq_cst);
+          if (CLHT_KEY_LOAD (&b->key[i]) != key
+              || clht_multi_owned (own, num_own, b, i))
+            {
+              continue;
+            }
+
+          if (map == MAP_VALID && CLHT_TTL_EXPIRED (hashtable, b, i))
+            {
+              continue;
+            }
+          if (map == MAP_VALID && likely (CLHT_LOAD (&b->val[i], relaxed) == v))
+            {
+              if (unlikely (CLHT_KEY_TORN (b, snaps[c])))
+                {
+                  return CLHT_MULTI_RETRY;
+                }
+              found->bucket = b;
+              found->idx = i;
+              *val = v;
+              return CLHT_MULTI_FOUND;
+            }
+          if (MAP_IS_PENDING (map))
+            {
+              res = CLHT_MULTI_PENDING;
+            }
+        }
+    }
+  if (res != CLHT_MULTI_MISS)
+    {
+      return res;
+    }
+
+  CLHT_FENCE (acquire);
+  for (c = 0; c < CLHT_MULTI_CANDS; c++)
+    {
+      CLHT_NC_INVAL (&table[bins[c]]);
+      if (CLHT_LOAD (&table[bins[c]].snapshot, relaxed) != snaps[c])
+        {
+          return CLHT_MULTI_RETRY;
+        }
+    }
+  return CLHT_MULTI_MISS;
+}
+
+/*
+ * Returns the table to work on, with the thread registered on its
+ * version, so that a resize waits for the operation to finish.
+ */
+static clht_hashtable_t *
+clht_table_enter (clht_t *h)
+{
+  while (1)
+    {
+      CLHT_CHECK_RESIZE (h);
+      SHM_off ht_off = CLHT_LOAD (&h->ht, acquire);
+      clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (ht_off);
+      CLHT_NC_SEEN (hashtable);
+      CLHT_GC_HT_VERSION_USED (hashtable);
+      /* a resize that started before the version was visible may not wait for it */
+      CLHT_FENCE (seq_cst);
+      if (likely (CLHT_LOAD (&h->resize_lock, acquire) == CLHT_LOCK_FREE
+                  && CLHT_LOAD (&h->ht, acquire) == ht_off))
+        {
+          return hashtable;
+        }
+      CLHT_NO_UPDATE ();
+    }
+}
+
+static inline void
+clht_multi_backoff (uint64_t *backoff)
+{
+  _mm_pause_rep (*backoff + (getticks () & (*backoff - 1)));
+  if (*backoff < CLHT_MULTI_MAX_BACKOFF)
+    {
+      *backoff <<= 1;
+    }
+}
+
+static int
+clht_multi_check (const char *op, clht_addr_t *keys, size_t n)
+{
+  size_t i, j;
+  if (n > CLHT_MULTI_MAX)
+    {
+      printf ("** %s: %zu keys, at most %d are supported\n", op, n,
+              CLHT_MULTI_MAX);
+      return false;
+    }
+  for (i = 0; i < n; i++)
+    {
+      for (j = i + 1; j < n; j++)
+        {
+          if (keys[i] == keys[j])
+            {
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+size_t
+clht_multi_get (clht_t *h, clht_addr_t *keys, clht_val_t *vals, size_t n)
+{
+  if (!clht_multi_check ("clht_multi_get", keys, n))
+    {
+      return 0;
+    }
+
+  uint64_t bins[CLHT_MULTI_MAX][CLHT_MULTI_CANDS];
+  clht_snapshot_all_t snaps[CLHT_MULTI_MAX][CLHT_MULTI_CANDS];
+  clht_multi_slot_t found[CLHT_MULTI_MAX];
+  clht_hashtable_t *hashtable = clht_table_enter (h);
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  size_t i, num_found;
+  int c;
+
+  for (i = 0; i < n; i++)
+    {
+      clht_multi_cands (hashtable, keys[i], bins[i]);
+      for (c = 0; c < CLHT_MULTI_CANDS; c++)
+        {
+          __builtin_prefetch ((void *)(table + bins[i][c]), 0, 3);
+        }
+    }
+
+retry:
+  num_found = 0;
+  for (i = 0; i < n; i++)
+    {
+      int r = clht_multi_lookup (hashtable, table, bins[i], keys[i], NULL, 0,
+                                 snaps[i], &found[i], &vals[i]);
+      if (r == CLHT_MULTI_PENDING || r == CLHT_MULTI_RETRY)
+        {
+          _mm_pause ();
+          goto retry;
+        }
+      if (r == CLHT_MULTI_FOUND)
+        {
+          num_found++;
+        }
+      else
+        {
+          vals[i] = 0;
+        }
+    }
+
+  /* every bucket is unchanged since before its key was searched */
+  CLHT_FENCE (acquire);
+  for (i = 0; i < n; i++)
+    {
+      for (c = 0; c < CLHT_MULTI_CANDS; c++)
+        {
+          CLHT_NC_INVAL (&table[bins[i][c]]);
+          if (CLHT_LOAD (&table[bins[i][c]].snapshot, relaxed) != snaps[i][c])
+            {
+              goto retry;
+            }
+        }
+    }
+
+  CLHT_NO_UPDATE ();
+  for (i = 0; i < n; i++)
+    {
+      CLHT_STAT_INC (get);
+      if (vals[i] != 0)
+        {
+          /* only now: a reference bit changes the snapshots checked above */
+          CLHT_CACHE_REF (found[i].bucket, found[i].idx);
+          CLHT_STAT_INC (get_hit);
+        }
+    }
+  return num_found;
+}
+
+/* the multi-key updates write slots in the ranges of other VMs, which
+   only their servers write with CLHT_DELEGATE: not available there */
+#if !defined(CLHT_DELEGATE)
+/* gives back own slots: map is MAP_INVLD (reserved / removed) or MAP_VALID (claimed) */
+static void
+clht_multi_release (clht_multi_slot_t *own, size_t num_own, int map)
+{
+  size_t i;
+  for (i = 0; i < num_own; i++)
+    {
+      clht_slot_set (own[i].bucket, own[i].idx, map, map == MAP_VALID);
+    }
+}
+
+/* after the final clht_multi_release, whose CASes may be acq_rel */
+static void
+clht_multi_notify (bucket_t *table, clht_multi_slot_t *own, size_t num_own)
+{
+  size_t i;
+  CLHT_FENCE (seq_cst);
+  for (i = 0; i < num_own; i++)
+    {
+      CLHT_WATCH_NOTIFY (own[i].bucket - table);
+    }
+}
+
+/* takes and writes an empty slot for key, in the emptier candidate bucket */
+static int
+clht_multi_reserve (clht_t *h, clht_hashtable_t *hashtable, bucket_t *table,
+                    uint64_t *bins, clht_addr_t key, clht_val_t val,
+                    clht_multi_slot_t *own, size_t num_own)
+{
+  clht_snapshot_all_t snaps[CLHT_MULTI_CANDS];
+  clht_multi_slot_t found;
+  clht_val_t v;
+  int c, r;
+
+  while (1)
+    {
+      r = clht_multi_lookup (hashtable, table, bins, key, own, num_own, snaps,
+                             &found, &v);
+      if (r == CLHT_MULTI_RETRY)
+        {
+          continue;
+        }
+      if (r != CLHT_MULTI_MISS)
+        {
+          return r;
+        }
+
+      int best = 0;
+      for (c = 1; c < CLHT_MULTI_CANDS; c++)
+        {
+          if (snap_num_empty (snaps[c]) > snap_num_empty (snaps[best]))
+            {
+              best = c;
+            }
+        }
+
+      bucket_t *b = table + bins[best];
+      clht_snapshot_all_t s1;
+      int evict = 0;
+      int idx = snap_get_empty_index (snaps[best]);
+      if (idx < 0)
+        {
+          int reclaimed = 0;
+          for (c = 0; c < CLHT_MULTI_CANDS; c++)
+            {
+              reclaimed += CLHT_TTL_RECLAIM (h, hashtable, bins[c]);
+            }
+          if (reclaimed > 0)
+            {
+              continue;
+            }
+#if defined(CLHT_TWO_CHOICE)
+          if (clht_2c_displace (hashtable, table, bins[0])
+              || clht_2c_displace (hashtable, table, bins[1]))
+            {
+              continue;
+            }
+#endif
+#if defined(CLHT_CACHE)
+          /* evict from the primary bucket; if all its slots are in
+             flight, give the own slots back rather than wait */
+          best = 0;
+          b = table + bins[0];
+          idx = snap_clock_victim (snaps[0], MAP_MULTI, &s1);
+          if (idx < 0)
+            {
+              return CLHT_MULTI_PENDING;
+            }
+          evict = 1;
+#else
+          return CLHT_MULTI_FULL;
+#endif
+        }
+      else
+        {
+          s1 = snap_set_map (snaps[best], idx, MAP_MULTI);
+        }
+
+      CLHT_COW_SAVE (hashtable, bins[best]);
+      if (CLHT_CAS (&b->snapshot, snaps[best], s1, acquire) != snaps[best])
+        {
+          CLHT_STAT_INC (cas_retries);
+          continue;
+        }
+      if (evict)
+        {
+          CLHT_STAT_INC (evictions);
+          clht_elems_add (h, -1);
+        }
+
+      CLHT_STORE (&b->val[idx], val, relaxed);
+      CLHT_KEY_STORE (&b->key[idx], key);
+      CLHT_TTL_SET (hashtable, b, idx, CLHT_TTL_NEVER);
+      own[num_own].bucket = b;
+      own[num_own].idx = idx;
+      return CLHT_MULTI_MISS;
+    }
+}
+
+/* checks that key is still absent and bumps the version of its primary bucket */
+static int
+clht_multi_seal (clht_hashtable_t *hashtable, bucket_t *table, uint64_t *bins,
+                 clht_addr_t key, clht_multi_slot_t *own, size_t num_own)
+{
+  clht_snapshot_all_t snaps[CLHT_MULTI_CANDS];
+  clht_multi_slot_t found;
+  clht_val_t v;
+  int r;
+
+  while (1)
+    {
+      r = clht_multi_lookup (hashtable, table, bins, key, own, num_own, snaps,
+                             &found, &v);
+      if (r == CLHT_MULTI_RETRY)
+        {
+          continue;
+        }
+      if (r != CLHT_MULTI_MISS)
+        {
+          return r;
+        }
+
+      if (CLHT_CAS (&table[bins[0]].snapshot, snaps[0],
+                    snap_inc_version (snaps[0]), seq_cst) == snaps[0])
+        {
+          return CLHT_MULTI_MISS;
+        }
+      CLHT_STAT_INC (cas_retries);
+    }
+}
+
+int
+clht_multi_put (clht_t *h, clht_addr_t *keys, clht_val_t *vals, size_t n)
+{
+  if (!clht_multi_check ("clht_multi_put", keys, n))
+    {
+      return false;
+    }
+
+  uint64_t bins[CLHT_MULTI_MAX][CLHT_MULTI_CANDS];
+  clht_multi_slot_t own[CLHT_MULTI_MAX];
+  uint64_t backoff = 1;
+  int empty_retries = 0;
+  size_t i, num_own;
+  int r;
+
+retry_all:;
+  clht_hashtable_t *hashtable = clht_table_enter (h);
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  for (i = 0; i < n; i++)
+    {
+      clht_multi_cands (hashtable, keys[i], bins[i]);
+    }
+
+  r = CLHT_MULTI_MISS;
+  for (num_own = 0; num_own < n && r == CLHT_MULTI_MISS; num_own++)
+    {
+      r = clht_multi_reserve (h, hashtable, table, bins[num_own], keys[num_own],
+                              vals[num_own], own, num_own);
+    }
+  if (r != CLHT_MULTI_MISS)
+    {
+      num_own--;
+    }
+  for (i = 0; i < n && r == CLHT_MULTI_MISS; i++)
+    {
+      r = clht_multi_seal (hashtable, table, bins[i], keys[i], own, num_own);
+    }
+
+  if (r != CLHT_MULTI_MISS)
+    {
+      clht_multi_release (own, num_own, MAP_INVLD);
+      CLHT_NO_UPDATE ();
+      if (r == CLHT_MULTI_FOUND)
+        {
+          for (i = 0; i < n; i++)
+            {
+              CLHT_STAT_INC (put);
+            }
+          return false;
+        }
+      if (r == CLHT_MULTI_FULL)
+        {
+          CLHT_STAT_INC (empty_retries);
+          if (empty_retries++ >= CLHT_NO_EMPTY_SLOT_TRIES)
+            {
+              empty_retries = 0;
+              ht_status (h, 0, 2, 0);
+            }
+        }
+      clht_multi_backoff (&backoff);
+      goto retry_all;
+    }
+
+  clht_multi_release (own, num_own, MAP_VALID);
+  CLHT_NO_UPDATE ();
+  clht_multi_notify (table, own, num_own);
+  for (i = 0; i < n; i++)
+    {
+      CLHT_STAT_INC (put);
+      CLHT_STAT_INC (put_suc);
+    }
+  clht_elems_add (h, n);
+  return true;
+}
+
+/* takes the MAP_VALID slot of key over as MAP_MULTI */
+static int
+clht_multi_claim (clht_hashtable_t *hashtable, bucket_t *table,
+                  uint64_t *bins, clht_addr_t key, clht_multi_slot_t *own,
+                  size_t num_own, clht_val_t *val)
+{
+  clht_snapshot_all_t snaps[CLHT_MULTI_CANDS];
+  clht_multi_slot_t found;
+  int c, r;
+
+  while (1)
+    {
+      r = clht_multi_lookup (hashtable, table, bins, key, own, num_own, snaps,
+                             &found, val);
+      if (r == CLHT_MULTI_RETRY)
+        {
+          continue;
+        }
+      if (r != CLHT_MULTI_FOUND)
+        {
+          return r;
+        }
+
+      for (c = 0; table + bins[c] != found.bucket; c++)
+        ;
+      clht_snapshot_all_t s1 = snap_set_map (snaps[c], found.idx, MAP_MULTI);
+      CLHT_COW_SAVE (hashtable, bins[c]);
+      if (CLHT_CAS (&found.bucket->snapshot, snaps[c], s1, seq_cst) == snaps[c])
+        {
+          own[num_own] = found;
+          return CLHT_MULTI_FOUND;
+        }
+      CLHT_STAT_INC (cas_retries);
+    }
+}
+
+int
+clht_multi_remove (clht_t *h, clht_addr_t *keys, clht_val_t *vals, size_t n)
+{
+  if (!clht_multi_check ("clht_multi_remove", keys, n))
+    {
+      return false;
+    }
+
+  uint64_t bins[CLHT_MULTI_MAX][CLHT_MULTI_CANDS];
+  clht_multi_slot_t own[CLHT_MULTI_MAX];
+  clht_val_t removed[CLHT_MULTI_MAX];
+  uint64_t backoff = 1;
+  size_t i, num_own;
+  int r;
+
+retry_all:;
+  clht_hashtable_t *hashtable = clht_table_enter (h);
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  for (i = 0; i < n; i++)
+    {
+      clht_multi_cands (hashtable, keys[i], bins[i]);
+    }
+
+  r = CLHT_MULTI_FOUND;
+  for (num_own = 0; num_own < n && r == CLHT_MULTI_FOUND; num_own++)
+    {
+      r = clht_multi_claim (hashtable, table, bins[num_own], keys[num_own],
+                            own, num_own, &removed[num_own]);
+    }
+
+  if (r != CLHT_MULTI_FOUND)
+    {
+      num_own--;
+      clht_multi_release (own, num_own, MAP_VALID);
+      CLHT_NO_UPDATE ();
+      if (r == CLHT_MULTI_MISS)
+        {
+          for (i = 0; i < n; i++)
+            {
+              CLHT_STAT_INC (remove);
+            }
+          return false;
+        }
+      clht_multi_backoff (&backoff);
+      goto retry_all;
+    }
+
+  clht_multi_release (own, num_own, MAP_INVLD);
+  CLHT_NO_UPDATE ();
+  clht_multi_notify (table, own, num_own);
+  for (i = 0; i < n; i++)
+    {
+      CLHT_STAT_INC (remove);
+      CLHT_STAT_INC (remove_suc);
+      if (vals != NULL)
+        {
+          vals[i] = removed[i];
+        }
+    }
+  clht_elems_add (h, -(int64_t) n);
+  return true;
+}
+#endif  /* !CLHT_DELEGATE */
+
+/* ******************************************************************************** */
+/* watches */
+/* ******************************************************************************** */
+
+/*
+ * The stamp of key: the snapshots of its candidate buckets, without the
+ * reference bits that gets set, and the table version. Every update of
+ * the buckets and every resize changes it.
+ */
+static uint64_t
+clht_watch_stamp (clht_hashtable_t *hashtable, uint64_t *bins)
+{
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  uint64_t stamp = 0;
+  int c;
+  for (c = 0; c < CLHT_MULTI_CANDS; c++)
+    {
+      clht_snapshot_t s;
+      s.snapshot = CLHT_LOAD (&table[bins[c]].snapshot, seq_cst);
+#if KEY_BUCKT == 3
+      s.clock = 0;
+#endif
+      stamp = stamp * 0x9E3779B97F4A7C15ULL + s.snapshot;
+    }
+  return stamp ^ ((uint64_t)hashtable->version << 56);
+}
+
+uint64_t
+clht_watch_version (clht_t *h, clht_addr_t key)
+{
+  uint64_t bins[CLHT_MULTI_CANDS];
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+  CLHT_NC_SEEN (hashtable);
+  CLHT_GC_HT_VERSION_USED (hashtable);
+  clht_multi_cands (hashtable, key, bins);
+  uint64_t stamp = clht_watch_stamp (hashtable, bins);
+  CLHT_NO_UPDATE ();
+  return stamp;
+}
+
+uint64_t
+clht_watch (clht_t *h, clht_addr_t key, uint64_t last_version)
+{
+  uint64_t version = last_version;
+  clht_watch_many (h, &key, &version, 1, 0);
+  return version;
+}
+
+/*
+ * Registers the buckets of the keys in the watch filter, so that their
+ * writers bump the notification word of this VM, and sleeps on that word
+ * between checks of the stamps. The notification word is read before the
+ * stamps: a writer either changed a stamp before it was read, or saw the
+ * registration and bumps the word after that read.
+ */
+uint64_t
+clht_watch_many (clht_t *h, clht_addr_t *keys, uint64_t *versions, size_t n,
+                 uint64_t timeout_ms)
+{
+  uint64_t bins[CLHT_WATCH_MAX_KEYS][CLHT_MULTI_CANDS] = { { 0 } };
+  clht_hashtable_t *registered = NULL;
+  uint64_t deadline = timeout_ms ? clht_now_ns () + timeout_ms * 1000000ULL : 0;
+  uint64_t changed = 0;
+  size_t i;
+  int c;
+
+  if (n > CLHT_WATCH_MAX_KEYS)
+    {
+      return CLHT_WATCH_EINVAL;
+    }
+
+  while (1)
+    {
+      uint64_t seq = clht_watch_seq ();
+      clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+      CLHT_NC_SEEN (hashtable);
+      CLHT_GC_HT_VERSION_USED (hashtable);
+      if (hashtable != registered)
+        {
+          /* the keys moved to other buckets with a resize */
+          for (i = 0; registered != NULL && i < n; i++)
+            {
+              for (c = 0; c < CLHT_MULTI_CANDS; c++)
+                {
+                  clht_watch_unregister (bins[i][c]);
+                }
+            }
+          for (i = 0; i < n; i++)
+            {
+              clht_multi_cands (hashtable, keys[i], bins[i]);
+              for (c = 0; c < CLHT_MULTI_CANDS; c++)
+                {
+                  clht_watch_register (bins[i][c]);
+                }
+            }
+          registered = hashtable;
+          CLHT_FENCE (seq_cst);
+        }
+
+      for (i = 0; i < n; i++)
+        {
+          uint64_t stamp = clht_watch_stamp (hashtable, bins[i]);
+          if (stamp != versions[i])
+            {
+              versions[i] = stamp;
+              changed |= 1ULL << i;
+            }
+        }
+      /* a sleeping watch must not hold up a resize */
+      CLHT_NO_UPDATE ();
+      if (changed || !clht_watch_wait (seq, deadline))
+        {
+          break;
+        }
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      for (c = 0; c < CLHT_MULTI_CANDS; c++)
+        {
+          clht_watch_unregister (bins[i][c]);
+        }
+    }
+  return changed;
+}
+
+/* ******************************************************************************** */
+/* snapshot readers */
+/* ******************************************************************************** */
+
+struct clht_snap
+{
+  clht_hashtable_t *ht;		/* the frozen table, kept by the GC until the release */
+  uint32_t epoch;
+};
+
+/* bucket bin as it was when the snapshot was taken */
+static void
+clht_snap_bucket (clht_snap_t *snap, uint64_t bin, bucket_t *out)
+{
+  clht_hashtable_t *hashtable = snap->ht;
+  uint64_t *map = SHR_OFF_TO_PTR (hashtable->cow_map);
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+
+  while (1)
+    {
+      uint64_t m = CLHT_LOAD (&map[bin], acquire);
+      if ((uint32_t)(m >> 32) == snap->epoch)
+        {
+          bucket_t *side = SHR_OFF_TO_PTR (hashtable->cow_side);
+          /* the side buckets are reused by every snapshot */
+          CLHT_NC_INVAL (side + (uint32_t)m - 1);
+          memcpy (out, side + (uint32_t)m - 1, sizeof (bucket_t));
+          return;
+        }
+
+      /* a writer publishes the copy before it changes the bucket */
+      clht_cow_copy (hashtable, table + bin, out);
+      CLHT_FENCE (acquire);
+      CLHT_NC_INVAL (&map[bin]);
+      if (CLHT_LOAD (&map[bin], relaxed) == m)
+        {
+          return;
+        }
+    }
+}
+
+clht_snap_t *
+clht_snapshot_create (clht_t *h)
+{
+  clht_snap_t *snap = malloc (sizeof (clht_snap_t));
+  if (snap == NULL)
+    {
+      printf ("** malloc @ clht_snapshot_create\n");
+      return NULL;
+    }
+
+  /* no resize runs while the table is frozen */
+  while (!CLHT_LOCK_RESIZE (h))
+    {
+      _mm_pause ();
+    }
+  clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (h->ht);
+  CLHT_NC_INVAL_RANGE (hashtable, sizeof (clht_hashtable_t));
+  if (hashtable->cow_epoch != 0)
+    {
+      CLHT_RLS_RESIZE (h);
+      free (snap);
+      printf ("** clht_snapshot_create: the table already has a snapshot\n");
+      return NULL;
+    }
+
+  if (hashtable->cow_map == SHM_NULL)
+    {
+      hashtable->cow_map
+          = clht_table_alloc_size (hashtable->num_buckets * sizeof (uint64_t));
+      hashtable->cow_cap = hashtable->num_buckets / CLHT_COW_SIDE_DIV + 1;
+      hashtable->cow_side
+          = clht_table_alloc_size (hashtable->cow_cap * sizeof (bucket_t));
+    }
+  hashtable->cow_used = 0;
+  hashtable->cow_full = 0;
+#if defined(CLHT_TTL)
+  hashtable->cow_now = clht_clock_advance ();
+#endif
+  uint32_t epoch = ++hashtable->cow_last;
+  CLHT_NC_WB (hashtable, sizeof (clht_hashtable_t));
+
+  /* from here on every write saves its bucket first ... */
+  CLHT_STORE (&hashtable->cow_epoch, epoch, seq_cst);
+
+  /* ... and the single-key writes that loaded the epoch before expect a
+     snapshot loaded before it: bump every bucket, so that their CAS fails
+     and the retry sees the epoch ... */
+  bucket_t *table = SHR_OFF_TO_PTR (hashtable->table);
+  uint64_t bin;
+  for (bin = 0; bin < hashtable->num_buckets; bin++)
+    {
+      clht_snapshot_all_t s;
+      do
+        {
+          s = CLHT_LOAD (&table[bin].snapshot, relaxed);
+        }
+      while (CLHT_CAS (&table[bin].snapshot, s, snap_inc_version (s), seq_cst) != s);
+    }
+
+  /* ... while the others are registered on the old version: wait until
+     they are done, as a resize does, so that no bucket changes unsaved
+     after the return */
+  size_t cur_version = hashtable->version;
+  CLHT_STORE (&hashtable->version, cur_version + 1, seq_cst);
+  CLHT_GC_HT_VERSION_USED (hashtable);
+  while (clht_gc_min_version_used (h) <= cur_version)
+    {
+      _mm_pause ();
+    }
+  CLHT_NO_UPDATE ();
+  CLHT_RLS_RESIZE (h);
+
+  snap->ht = hashtable;
+  snap->epoch = epoch;
+  return snap;
+}
+
+clht_val_t
+clht_snapshot_get (clht_snap_t *snap, clht_addr_t key)
+{
+  uint64_t bins[CLHT_MULTI_CANDS];
+  bucket_t b;
+  int c, i;
+
+  clht_multi_cands (snap->ht, key, bins);
+  for (c = 0; c < CLHT_MULTI_CANDS; c++)
+    {
+      clht_snap_bucket (snap, bins[c], &b);
+      for (i = 0; i < KEY_BUCKT; i++)
+        {
+          if (b.map[i] == MAP_VALID && b.key[i] == key)
+            {
+              return b.val[i];
+            }
+        }
+    }
+  return 0;
+}
+
+size_t
+clht_snapshot_scan (clht_snap_t *snap,
+                    void (*fn) (clht_addr_t key, clht_val_t val, void *arg),
+                    void *arg)
+{
+  size_t num = 0;
+  uint64_t bin;
+  bucket_t b;
+  int i;
+
+  for (bin = 0; bin < snap->ht->num_buckets; bin++)
+    {
+      clht_snap_bucket (snap, bin, &b);
+      for (i = 0; i < KEY_BUCKT; i++)
+        {
+          if (b.map[i] == MAP_VALID)
+            {
+              fn (b.key[i], b.val[i], arg);
+              num++;
+            }
+        }
+    }
+  return num;
+}
+
+int
+clht_snapshot_valid (clht_snap_t *snap)
+{
+  return CLHT_LOAD (&snap->ht->cow_full, seq_cst) != snap->epoch;
+}
+
+void
+clht_snapshot_release (clht_snap_t *snap)
+{
+  /* the writers stop saving buckets, and the GC may free the table */
+  CLHT_STORE (&snap->ht->cow_epoch, 0, release);
+  free (snap);
+}
+
+#if defined(CLHT_TTL)
+/* ******************************************************************************** */
+/* puts with TTL and the expiry sweeper */
+/* ******************************************************************************** */
+
+int
+clht_put_ttl (clht_t *h, clht_addr_t key, clht_val_t val, uint32_t ttl_ms)
+{
+  /* + 1: the current tick is already partly over */
+  uint32_t ticks = (ttl_ms + CLHT_TTL_TICK_MS - 1) / CLHT_TTL_TICK_MS + 1;
+  return clht_put_exp (h, key, val, clht_clock_advance () + ticks);
+}
+
+/*
+ * Sweepers of all VMs share the cursor of the table, so every pass takes
+ * the next max_regions regions. A region whose earliest expiry is still
+ * ahead is skipped without touching its buckets.
+ */
+size_t
+clht_ttl_sweep (clht_t *h, size_t max_regions)
+{
+  clht_hashtable_t *hashtable = clht_table_enter (h);
+  clht_ttl_state_t *st = clht_ttl_state (hashtable);
+  size_t num_regions = clht_ttl_num_regions (hashtable->num_buckets);
+  uint32_t now = clht_clock_now ();
+  size_t reclaimed = 0, r;
+
+  if (max_regions > num_regions)
+    {
+      max_regions = num_regions;
+    }
+  uint64_t first = CLHT_FAA (&st->cursor, max_regions, relaxed);
+
+  for (r = 0; r < max_regions; r++)
+    {
+      uint64_t region = (first + r) % num_regions;
+      uint32_t *min = &st->region_min[region];
+      CLHT_NC_INVAL (min);
+      if (CLHT_LOAD (min, relaxed) > now)
+        {
+          continue;
+        }
+
+      /* the puts that publish from here on lower the minimum themselves */
+      CLHT_SWAP (min, CLHT_TTL_NONE, seq_cst);
+      uint32_t live = CLHT_TTL_NONE;
+      uint64_t bin = region * CLHT_TTL_REGION;
+      uint64_t end = bin + CLHT_TTL_REGION;
+      if (end > hashtable->num_buckets)
+        {
+          end = hashtable->num_buckets;
+        }
+      for (; bin < end; bin++)
+        {
+          reclaimed += clht_ttl_reclaim (hashtable, bin, now, &live);
+        }
+      clht_ttl_lower (min, live);
+    }
+
+  CLHT_NO_UPDATE ();
+  if (reclaimed > 0)
+    {
+      clht_elems_add (h, -(int64_t) reclaimed);
+    }
+  return reclaimed;
+}
+
+typedef struct clht_ttl_sweeper_arg
+{
+  clht_t *h;
+  int id;
+} clht_ttl_sweeper_arg_t;
+
+static int clht_ttl_sweeper_running = 0;
+static pthread_t clht_ttl_sweeper_thread;
+static clht_ttl_sweeper_arg_t clht_ttl_sweeper_arg;
+
+static void *
+clht_ttl_sweeper (void *arg)
+{
+  clht_ttl_sweeper_arg_t *a = (clht_ttl_sweeper_arg_t *)arg;
+  clht_gc_thread_init (a->h, a->id);
+
+  while (CLHT_LOAD (&clht_ttl_sweeper_running, acquire))
+    {
+      clht_clock_advance ();
+      clht_ttl_sweep (a->h, CLHT_TTL_SWEEP_REGIONS);
+      usleep (CLHT_TTL_TICK_MS * 1000);
+    }
+  return NULL;
+}
+
+int
+clht_ttl_sweeper_start (clht_t *h, int id)
+{
+  if (CLHT_SWAP (&clht_ttl_sweeper_running, 1, acq_rel))
+    {
+      printf ("** clht_ttl_sweeper_start: already running\n");
+      return 0;
+    }
+
+  clht_ttl_sweeper_arg.h = h;
+  clht_ttl_sweeper_arg.id = id;
+  if (pthread_create (&clht_ttl_sweeper_thread, NULL, clht_ttl_sweeper,
+                      &clht_ttl_sweeper_arg) != 0)
+    {
+      printf ("** pthread_create @ clht_ttl_sweeper_start\n");
+      CLHT_STORE (&clht_ttl_sweeper_running, 0, release);
+      return 0;
+    }
+  return 1;
+}
+
+void
+clht_ttl_sweeper_stop ()
+{
+  if (CLHT_SWAP (&clht_ttl_sweeper_running, 0, acq_rel))
+    {
+      pthread_join (clht_ttl_sweeper_thread, NULL);
+    }
+}
+#endif  /* CLHT_TTL */
+
+#if defined(CLHT_DELEGATE)
+/*
+ * Delegated updates (clht_deleg.h). VM v owns the buckets bin with
+ * bin * num_vms / num_buckets == v, one contiguous range per VM, which a
+ * resize recomputes for the new table. A server that gets an update for a
+ * bucket it no longer owns answers MOVED, and the client routes it again.
+ */
+static inline int
+clht_deleg_owner (clht_hashtable_t *hashtable, uint64_t bin)
+{
+  return (bin * clht_shm_num_vms ()) / hashtable->num_buckets;
+}
+
+/* producer side of the ring from this VM to VM i, shared by its threads */
+typedef struct ALIGNED (CACHE_LINE_SIZE) clht_deleg_tail
+{
+  int lock;
+  uint64_t tail;
+} clht_deleg_tail_t;
+
+static clht_deleg_tail_t clht_deleg_tails[CLHT_SHM_MAX_VMS];
+
+/* yields now and then: the other end of the ring may share the core */
+static inline void
+clht_deleg_pause (uint64_t *spins)
+{
+  if ((++*spins & (CLHT_DELEG_YIELD_SPINS - 1)) == 0)
+    {
+      sched_yield ();
+    }
+  else
+    {
+      _mm_pause ();
+    }
+}
+
+/* sends op to the owner of the bucket of key and waits for its answer */
+static uint64_t
+clht_deleg_call (clht_t *h, uint64_t op, clht_addr_t key, clht_val_t val,
+                 uint64_t version)
+{
+  int self = clht_shm_node_id ();
+  uint64_t spins = 0;
+
+  /* the owner may have to resize, which waits for the versions in use */
+  CLHT_NO_UPDATE ();
+  while (1)
+    {
+      clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire));
+      CLHT_NC_SEEN (hashtable);
+      int owner = clht_deleg_owner (hashtable, clht_hash (hashtable, key));
+      clht_deleg_ring_t *ring = clht_shm_deleg_ring (self, owner);
+      if (unlikely (ring == NULL))
+        {
+          printf ("** clht_deleg_call: no ring from VM %d to VM %d\n", self,
+                  owner);
+          return false;
+        }
+
+      clht_deleg_tail_t *t = &clht_deleg_tails[owner];
+      while (CLHT_SWAP (&t->lock, 1, acquire))
+        {
+          clht_deleg_pause (&spins);
+        }
+      clht_deleg_req_t *req = &ring->req[t->tail++ & CLHT_DELEG_RING_MASK];
+      /* the ring is full until the client of the previous round takes its answer */
+      while (CLHT_LOAD (&req->state, acquire) != CLHT_DELEG_FREE)
+        {
+          clht_deleg_pause (&spins);
+        }
+      CLHT_STORE (&req->key, key, relaxed);
+      CLHT_STORE (&req->val, val, relaxed);
+      CLHT_STORE (&req->res, version, relaxed);
+      CLHT_STORE (&req->state, op, release);
+      CLHT_STORE (&t->lock, 0, release);
+
+      uint64_t state;
+      while ((state = CLHT_LOAD (&req->state, acquire)) == op)
+        {
+          clht_deleg_pause (&spins);
+        }
+      uint64_t res = CLHT_LOAD (&req->res, relaxed);
+      CLHT_STORE (&req->state, CLHT_DELEG_FREE, release);
+      if (likely (state == CLHT_DELEG_DONE))
+        {
+          return res;
+        }
+    }
+}
+
+/* Insert a key-value entry into a hash table. */
+int
+clht_put (clht_t *h, clht_addr_t key, clht_val_t val)
+{
+  CLHT_STAT_INC (put);
+  int res = clht_deleg_call (h, CLHT_DELEG_PUT, key, val, 0);
+  if (res)
+    {
+      CLHT_STAT_INC (put_suc);
+    }
+  return res;
+}
+
+/* Remove a key-value entry from a hash table. */
+clht_val_t
+clht_remove (clht_t *h, clht_addr_t key)
+{
+  CLHT_STAT_INC (remove);
+  clht_val_t res = clht_deleg_call (h, CLHT_DELEG_REMOVE, key, 0, 0);
+  if (res)
+    {
+      CLHT_STAT_INC (remove_suc);
+    }
+  return res;
+}
+
+int
+clht_put_if_version (clht_t *h, clht_addr_t key, clht_val_t val,
+                     uint64_t version)
+{
+  CLHT_STAT_INC (put);
+  int res = clht_deleg_call (h, CLHT_DELEG_PUT_IF, key, val, version);
+  if (res)
+    {
+      CLHT_STAT_INC (put_suc);
+    }
+  return res;
+}
+
+int
+clht_replace_if_version (clht_t *h, clht_addr_t key, clht_val_t val,
+                         uint64_t version)
+{
+  CLHT_STAT_INC (put);
+  int res = clht_deleg_call (h, CLHT_DELEG_REPLACE_IF, key, val, version);
+  if (res)
+    {
+      CLHT_STAT_INC (put_suc);
+    }
+  return res;
+}
+
+/*
+ * Applies one update to *htp as the only writer of the bucket: plain
+ * stores, with the snapshot stored last (release) to publish the entry.
+ * Sets *state to MOVED if the bucket belongs to another VM.
+ */
+static uint64_t
+clht_deleg_apply (clht_t *h, clht_hashtable_t **htp, int self, uint64_t op,
+                  clht_addr_t key, clht_val_t val, uint64_t version,
+                  uint64_t *state)
+{
+  clht_hashtable_t *hashtable = *htp;
+  int i;
+
+  while (1)
+    {
+      /* an earlier update of the batch may have grown the table */
+      if (unlikely (SHR_OFF_TO_PTR (CLHT_LOAD (&h->ht, acquire)) != hashtable))
+        {
+          CLHT_NO_UPDATE ();
+          *htp = hashtable = clht_table_enter (h);
+        }
+      size_t bin = clht_hash (hashtable, key);
+      if (clht_deleg_owner (hashtable, bin) != self)
+        {
+          *state = CLHT_DELEG_MOVED;
+          return 0;
+        }
+      *state = CLHT_DELEG_DONE;
+
+      bucket_t *bucket = ((bucket_t *)SHR_OFF_TO_PTR (hashtable->table)) + bin;
+      clht_snapshot_t s;
+      CLHT_NC_INVAL (bucket);
+      s.snapshot = CLHT_LOAD (&bucket->snapshot, relaxed);
+
+      int old = -1;
+      for (i = 0; i < KEY_BUCKT; i++)
+        {
+          if (s.map[i] == MAP_VALID
+              && CLHT_KEY_LOAD (&bucket->key[i]) == key)
+            {
+              old = i;
+              break;
+            }
+        }
+
+      if (op == CLHT_DELEG_REMOVE)
+        {
+          if (old < 0)
+            {
+              return false;
+            }
+          clht_val_t removed = CLHT_LOAD (&bucket->val[old], relaxed);
+          CLHT_COW_SAVE (hashtable, bin);
+          CLHT_STORE (&bucket->snapshot,
+                      snap_set_map (s.snapshot, old, MAP_INVLD), release);
+          clht_elems_add (h, -1);
+          return removed;
+        }
+      if (op == CLHT_DELEG_PUT_IF || op == CLHT_DELEG_REPLACE_IF)
+        {
+          if (clht_version_of (hashtable, s.snapshot) != version
+              || (old >= 0) != (op == CLHT_DELEG_REPLACE_IF))
+            {
+              return false;
+            }
+        }
+      else if (old >= 0)
+        {
+          return false;
+        }
+
+      int empty_index = snap_get_empty_index (s.snapshot);
+      if (likely (empty_index >= 0))
+        {
+          CLHT_COW_SAVE (hashtable, bin);
+          CLHT_STORE (&bucket->val[empty_index], val, relaxed);
+          CLHT_KEY_STORE (&bucket->key[empty_index], key);
+          clht_snapshot_all_t s1
+              = snap_set_map_and_inc_version (s.snapshot, empty_index, MAP_VALID);
+          if (old >= 0)
+            {
+              /* a replace: the old value goes with the same store */
+              s1 = snap_set_map (s1, old, MAP_INVLD);
+            }
+          CLHT_STORE (&bucket->snapshot, s1, release);
+          if (old < 0)
+            {
+              clht_elems_add (h, 1);
+            }
+          return true;
+        }
+
+      /* nobody else removes from the bucket: grow right away */
+      CLHT_STAT_INC (empty_retries);
+      CLHT_NO_UPDATE ();
+      ht_status (h, 0, 2, 0);
+      *htp = hashtable = clht_table_enter (h);
+    }
+}
+
+/* applies the requests waiting in one ring; returns how many */
+static size_t
+clht_deleg_serve (clht_t *h, int self, clht_deleg_ring_t *ring, uint64_t *head)
+{
+  clht_hashtable_t *hashtable = NULL;
+  uint64_t res[CLHT_DELEG_RING_SIZE], state[CLHT_DELEG_RING_SIZE];
+  size_t n, i;
+
+  for (n = 0; n < CLHT_DELEG_RING_SIZE; n++)
+    {
+      clht_deleg_req_t *req = &ring->req[(*head + n) & CLHT_DELEG_RING_MASK];
+      uint64_t op = CLHT_LOAD (&req->state, acquire);
+      if (!CLHT_DELEG_IS_REQ (op))
+        {
+          break;
+        }
+      if (hashtable == NULL)
+        {
+          hashtable = clht_table_enter (h);
+        }
+      res[n] = clht_deleg_apply (h, &hashtable, self, op,
+                                 CLHT_LOAD (&req->key, relaxed),
+                                 CLHT_LOAD (&req->val, relaxed),
+                                 CLHT_LOAD (&req->res, relaxed), &state[n]);
+    }
+  if (n == 0)
+    {
+      return 0;
+    }
+
+  CLHT_NO_UPDATE ();
+  /* what the seq_cst CAS of a direct update does, once per batch */
+  CLHT_FENCE (seq_cst);
+  for (i = 0; i < n; i++)
+    {
+      clht_deleg_req_t *req = &ring->req[(*head + i) & CLHT_DELEG_RING_MASK];
+      if (state[i] == CLHT_DELEG_DONE)
+        {
+          CLHT_WATCH_NOTIFY (clht_hash (hashtable, CLHT_LOAD (&req->key, relaxed)));
+        }
+      CLHT_STORE (&req->res, res[i], relaxed);
+      CLHT_STORE (&req->state, state[i], release);
+    }
+  *head += n;
+  return n;
+}
+
+typedef struct clht_deleg_arg
+{
+  clht_t *h;
+  int id;
+} clht_deleg_arg_t;
+
+static int clht_deleg_running = 0;
+static pthread_t clht_deleg_thread;
+static clht_deleg_arg_t clht_deleg_arg;
+
+static void *
+clht_deleg_server (void *arg)
+{
+  clht_deleg_arg_t *a = (clht_deleg_arg_t *)arg;
+  int self = clht_shm_node_id ();
+  int num_vms = clht_shm_num_vms ();
+  uint64_t head[CLHT_SHM_MAX_VMS] = { 0 };
+  uint64_t spins = 0;
+  int from;
+
+  clht_gc_thread_init (a->h, a->id);
+
+  while (CLHT_LOAD (&clht_deleg_running, acquire))
+    {
+      size_t served = 0;
+      for (from = 0; from < num_vms; from++)
+        {
+          served += clht_deleg_serve (a->h, self,
+                                      clht_shm_deleg_ring (from, self),
+                                      &head[from]);
+        }
+      if (served == 0)
+        {
+          clht_deleg_pause (&spins);
+        }
+    }
+  return NULL;
+}
+
+int
+clht_deleg_start (clht_t *h, int id)
+{
+  int self = clht_shm_node_id ();
+  if (clht_shm_num_vms () > CLHT_SHM_MAX_VMS
+      || clht_shm_deleg_ring (self, self) == NULL)
+    {
+      printf ("** clht_deleg_start: no rings for VM %d of %d\n", self,
+              clht_shm_num_vms ());
+      return 0;
+    }
+  if (CLHT_SWAP (&clht_deleg_running, 1, acq_rel))
+    {
+      printf ("** clht_deleg_start: already running\n");
+      return 0;
+    }
+
+  clht_deleg_arg.h = h;
+  clht_deleg_arg.id = id;
+  if (pthread_create (&clht_deleg_thread, NULL, clht_deleg_server,
+                      &clht_deleg_arg) != 0)
+    {
+      printf ("** pthread_create @ clht_deleg_start\n");
+      CLHT_STORE (&clht_deleg_running, 0, release);
+      return 0;
+    }
+  return 1;
+}
+
+/* the other VMs must have sent their last update: they would wait forever */
+void
+clht_deleg_stop ()
+{
+  if (CLHT_SWAP (&clht_deleg_running, 0, acq_rel))
+    {
+      pthread_join (clht_deleg_thread, NULL);
+    }
+}
+#endif  /* CLHT_DELEGATE */
+
+/* returns the number of expired entries left behind, or -1 if an entry
+   did not fit in ht_new */
+static int
+bucket_cpy (clht_hashtable_t *ht_old, bucket_t *bucket, clht_hashtable_t *ht_new)
+{
+  int expired = 0;
+  uint32_t j;
+  /* the bucket as the other hosts left it, see clht_nc.h */
+  CLHT_NC_INVAL (bucket);
+  for (j = 0; j < KEY_BUCKT; j++)
+    {
+      if (bucket->map[j] == MAP_VALID)
+        {
+          if (CLHT_TTL_EXPIRED (ht_old, bucket, j))
+            {
+              expired++;
+              continue;
+            }
+          clht_addr_t key = bucket->key[j];
+          uint64_t bin = clht_hash (ht_new, key);
+          if (!clht_put_seq (ht_new, key, bucket->val[j], bin,
+                             CLHT_TTL_GET (ht_old, bucket, j)))
+            {
+              return -1;
+            }
+        }
+    }
+
+  return expired;
+}
+
+/* resizing */
+int
+ht_resize_pes (clht_t *h, int is_increase, int by)
+{
+  /* if (!is_increase) */
+  /*   { */
+  /*     return 0; */
+  /*   } */
   /* is_increase = 1; */
   /* if (by > 4) */
   /*   { */
@@ -450,9 +3187,6 @@ ht_resize_pes (clht_t *h, int is_increase, int by)
 
   /* printf("[RESPES-%02d] inc: %d / by: %d\n", clht_gc_get_id(), is_increase,
    * by); */
-  ticks s = getticks ();
-
-  SHM_off ht_old_off = h->ht;
   clht_hashtable_t *ht_old = SHR_OFF_TO_PTR (h->ht);
 
   size_t num_buckets_new;
@@ -465,14 +3199,56 @@ ht_resize_pes (clht_t *h, int is_increase, int by)
       num_buckets_new = ht_old->num_buckets / 2;
     }
 
+  return ht_resize_locked (h, num_buckets_new, NULL);
+}
+
+/* resize to num_buckets_new, unless somebody already did */
+static int
+ht_grow_to (clht_t *h, size_t num_buckets_new)
+{
+  if (!CLHT_LOCK_RESIZE (h))
+    {
+      return 0;
+    }
+
+  clht_hashtable_t *ht_old = SHR_OFF_TO_PTR (h->ht);
+  if (ht_old->num_buckets >= num_buckets_new)
+    {
+      CLHT_RLS_RESIZE (h);
+      return 0;
+    }
+
+  return ht_resize_locked (h, num_buckets_new, NULL);
+}
+
+/*
+ * The caller holds the resize lock, which is released here. With bulk,
+ * the private new table is also bulk loaded before it is published.
+ */
+static int
+ht_resize_locked (clht_t *h, size_t num_buckets_new, clht_bulk_t *bulk)
+{
+  ticks s = getticks ();
+
+  SHM_off ht_old_off = h->ht;
+  clht_hashtable_t *ht_old = SHR_OFF_TO_PTR (h->ht);
+  CLHT_NC_INVAL_RANGE (ht_old, sizeof (clht_hashtable_t));
+
+  clht_event_log (CLHT_EV_RESIZE_START, ht_old->num_buckets, num_buckets_new,
+                  ht_old->version, 0, 0);
+
   SHM_off ht_new_off = clht_hashtable_create (num_buckets_new);
   clht_hashtable_t *ht_new = SHR_OFF_TO_PTR (ht_new_off);
+  ht_new->elems_at_create = CLHT_LOAD (&h->num_elems, relaxed);
 
+  /* seq_cst: the new version must be visible before the versions in use are read */
   size_t cur_version = ht_old->version;
-  ht_old->version++;
+  CLHT_STORE (&ht_old->version, cur_version + 1, seq_cst);
 
   CLHT_GC_HT_VERSION_USED (ht_old);
 
+  /* wait until no thread is still working on the old version */
+  ticks stall = getticks ();
   size_t version_min;
   do
     {
@@ -480,31 +3256,294 @@ ht_resize_pes (clht_t *h, int is_increase, int by)
 
     }
   while (cur_version >= version_min);
+  stall = getticks () - stall;
 
 
   ht_new->version = cur_version + 2;
 
+  int64_t expired = 0;
   int32_t b;
   for (b = 0; b < ht_old->num_buckets; b++)
     {
       bucket_t *bu_cur = ((bucket_t *)SHR_OFF_TO_PTR (ht_old->table)) + b;
-      bucket_cpy (bu_cur, ht_new);
+      int e = bucket_cpy (ht_old, bu_cur, ht_new);
+      if (unlikely (e < 0))
+        {
+          /* a bucket of the new table is full (more likely with two
+             slots, CLHT_KEY128): copy again to a larger one */
+          num_buckets_new = num_buckets_new * CLHT_GROWTH_PERC / 100 + 1;
+          clht_gc_free (ht_new);
+          ht_new_off = clht_hashtable_create (num_buckets_new);
+          ht_new = SHR_OFF_TO_PTR (ht_new_off);
+          ht_new->elems_at_create = CLHT_LOAD (&h->num_elems, relaxed);
+          ht_new->version = cur_version + 2;
+          expired = 0;
+          b = -1;
+          continue;
+        }
+      expired += e;
+    }
+  if (expired > 0)
+    {
+      clht_elems_add (h, -expired);
+    }
+
+  uint64_t participants = 1;
+  if (bulk != NULL)
+    {
+      participants = clht_bulk_fill (bulk, ht_new);
     }
 
   ht_new->table_prev = ht_old_off;
+#if defined(CLHT_NONCOHERENT)
+  clht_nc_wb_table (ht_new);
+#endif
 
-  SWAP_U64 ((uint64_t *)&h->ht, (uint64_t)ht_new_off);
-  ht_old->table_new = ht_new_off;
+  CLHT_STORE (&h->ht, ht_new_off, release);
+  CLHT_STORE (&ht_old->table_new, ht_new_off, relaxed);
+  /* every watch compares stamps of the old table */
+  CLHT_FENCE (seq_cst);
+  CLHT_WATCH_NOTIFY_ALL ();
 
   CLHT_RLS_RESIZE (h);
 
   ticks e = getticks () - s;
-  printf ("[RESIZE-%02d] to #bu %7zu    | took: %13llu ti = %8.6f s\n", 0,
-          ht_new->num_buckets, (unsigned long long)e, e / 2.1e9);
+  CLHT_STAT_VM_ADD (resizes, 1);
+  CLHT_STAT_VM_ADD (resize_ticks, e);
+  CLHT_STAT_VM_SET (num_buckets, ht_new->num_buckets);
+  /* the copy is done by the lock holder alone, a bulk load in parallel */
+  clht_event_log (CLHT_EV_RESIZE_END, ht_old->num_buckets, ht_new->num_buckets,
+                  clht_ticks_to_ns (e), clht_ticks_to_ns (stall), participants);
 
   return 1;
 }
 
+/* ******************************************************************************** */
+/* bulk load */
+/* ******************************************************************************** */
+
+typedef struct clht_bulk_item
+{
+  clht_addr_t key;
+  clht_val_t val;
+  uint64_t bin;
+} clht_bulk_item_t;
+
+struct clht_bulk
+{
+  clht_addr_t *keys;
+  clht_val_t *vals;
+  size_t n;
+  int nthreads;
+  clht_t *h;
+  clht_hashtable_t *ht;		/* the private table being loaded */
+  clht_bulk_item_t *items;	/* input partitioned by owner thread */
+  size_t *offsets;		/* [src * nthreads + owner] */
+  size_t *part_start;		/* [owner], nthreads + 1 entries */
+  clht_bulk_item_t *overflow;	/* items that found their bucket full */
+  size_t num_overflow;
+  size_t num_loaded;
+  pthread_barrier_t barrier;
+};
+
+typedef struct clht_bulk_arg
+{
+  clht_bulk_t *b;
+  int id;
+} clht_bulk_arg_t;
+
+/* owners get contiguous bucket ranges, so every thread writes its own part of the table */
+static inline int
+clht_bulk_owner (clht_bulk_t *b, uint64_t bin)
+{
+  return (int)((bin * b->nthreads) / b->ht->num_buckets);
+}
+
+static int
+clht_bulk_cmp_bin (const void *a, const void *b)
+{
+  uint64_t x = ((const clht_bulk_item_t *)a)->bin;
+  uint64_t y = ((const clht_bulk_item_t *)b)->bin;
+  return x < y ? -1 : x > y;
+}
+
+static void *
+clht_bulk_worker (void *arg)
+{
+  clht_bulk_t *b = ((clht_bulk_arg_t *)arg)->b;
+  int id = ((clht_bulk_arg_t *)arg)->id;
+  int nt = b->nthreads;
+  size_t from = (b->n * id) / nt, to = (b->n * (id + 1)) / nt;
+  size_t *my_off = &b->offsets[id * nt];
+  size_t i;
+
+  /* 1. count the items of this slice per owner */
+  for (i = from; i < to; i++)
+    {
+      my_off[clht_bulk_owner (b, clht_hash (b->ht, b->keys[i]))]++;
+    }
+
+  pthread_barrier_wait (&b->barrier);
+  if (id == 0)
+    {
+      size_t pos = 0;
+      int o, src;
+      for (o = 0; o < nt; o++)
+        {
+          b->part_start[o] = pos;
+          for (src = 0; src < nt; src++)
+            {
+              size_t cnt = b->offsets[src * nt + o];
+              b->offsets[src * nt + o] = pos;
+              pos += cnt;
+            }
+        }
+      b->part_start[nt] = pos;
+    }
+  pthread_barrier_wait (&b->barrier);
+
+  /* 2. scatter the slice to the owners */
+  for (i = from; i < to; i++)
+    {
+      uint64_t bin = clht_hash (b->ht, b->keys[i]);
+      clht_bulk_item_t *it = &b->items[my_off[clht_bulk_owner (b, bin)]++];
+      it->key = b->keys[i];
+      it->val = b->vals[i];
+      it->bin = bin;
+    }
+
+  pthread_barrier_wait (&b->barrier);
+
+  /* 3. fill the owned buckets in address order with plain stores */
+  clht_bulk_item_t *part = &b->items[b->part_start[id]];
+  size_t num = b->part_start[id + 1] - b->part_start[id];
+  qsort (part, num, sizeof (clht_bulk_item_t), clht_bulk_cmp_bin);
+
+  bucket_t *table = SHR_OFF_TO_PTR (b->ht->table);
+  size_t loaded = 0;
+  for (i = 0; i < num; i++)
+    {
+      bucket_t *bucket = table + part[i].bin;
+      int j, done = 0;
+      for (j = 0; j < KEY_BUCKT && !done; j++)
+        {
+          if (bucket->key[j] == part[i].key && bucket->map[j] == MAP_VALID)
+            {
+              done = 1;		/* duplicate: the first one stays */
+            }
+          else if (bucket->key[j] == 0)
+            {
+              bucket->val[j] = part[i].val;
+              bucket->key[j] = part[i].key;
+              bucket->map[j] = MAP_VALID;
+              loaded++;
+              done = 1;
+            }
+        }
+      if (!done)
+        {
+          b->overflow[CLHT_FAA (&b->num_overflow, 1, relaxed)] = part[i];
+        }
+    }
+
+  CLHT_FAA (&b->num_loaded, loaded, relaxed);
+  return NULL;
+}
+
+/* returns the number of threads that loaded */
+static int
+clht_bulk_fill (clht_bulk_t *b, clht_hashtable_t *ht)
+{
+  int nt = b->nthreads, t;
+  b->ht = ht;
+
+  pthread_t threads[nt];
+  clht_bulk_arg_t args[nt];
+  pthread_barrier_init (&b->barrier, NULL, nt);
+
+  for (t = 1; t < nt; t++)
+    {
+      args[t].b = b;
+      args[t].id = t;
+      if (pthread_create (&threads[t], NULL, clht_bulk_worker, &args[t]) != 0)
+        {
+          printf ("** pthread_create @ clht_bulk_fill\n");
+          exit (1);
+        }
+    }
+  args[0].b = b;
+  args[0].id = 0;
+  clht_bulk_worker (&args[0]);
+
+  for (t = 1; t < nt; t++)
+    {
+      pthread_join (threads[t], NULL);
+    }
+  pthread_barrier_destroy (&b->barrier);
+  return nt;
+}
+
+size_t
+clht_bulk_load (clht_t *h, clht_addr_t *keys, clht_val_t *vals, size_t n,
+                int nthreads)
+{
+  if (n == 0)
+    {
+      return 0;
+    }
+  if (nthreads < 1)
+    {
+      nthreads = 1;
+    }
+
+  clht_bulk_t b;
+  memset (&b, 0, sizeof (b));
+  b.keys = keys;
+  b.vals = vals;
+  b.n = n;
+  b.nthreads = nthreads;
+  b.h = h;
+  b.items = malloc (n * sizeof (clht_bulk_item_t));
+  b.overflow = malloc (n * sizeof (clht_bulk_item_t));
+  b.offsets = calloc (nthreads * nthreads, sizeof (size_t));
+  b.part_start = calloc (nthreads + 1, sizeof (size_t));
+  if (b.items == NULL || b.overflow == NULL || b.offsets == NULL
+      || b.part_start == NULL)
+    {
+      printf ("** malloc @ clht_bulk_load\n");
+      exit (1);
+    }
+
+  while (!CLHT_LOCK_RESIZE (h))
+    {
+      CLHT_CHECK_RESIZE (h);
+    }
+
+  clht_hashtable_t *ht_old = SHR_OFF_TO_PTR (h->ht);
+  size_t num_buckets = clht_buckets_for (CLHT_LOAD (&h->num_elems, relaxed) + n);
+  if (num_buckets < ht_old->num_buckets)
+    {
+      num_buckets = ht_old->num_buckets;
+    }
+  ht_resize_locked (h, num_buckets, &b);
+
+  size_t loaded = b.num_loaded;
+  CLHT_FAA (&h->num_elems, (int64_t)loaded, relaxed);
+
+  /* the few keys whose bucket was full go through the regular path */
+  size_t i;
+  for (i = 0; i < b.num_overflow; i++)
+    {
+      loaded += clht_put (h, b.overflow[i].key, b.overflow[i].val);
+    }
+
+  free (b.items);
+  free (b.overflow);
+  free (b.offsets);
+  free (b.part_start);
+  return loaded;
+}
+
 size_t
 clht_size (clht_hashtable_t *hashtable)
 {
@@ -519,7 +3558,9 @@ clht_size (clht_hashtable_t *hashtable)
       int i;
       for (i = 0; i < KEY_BUCKT; i++)
         {
-          if (bucket->key[i] != 0 && bucket->map[i] == MAP_VALID)
+          if (CLHT_KEY_LOAD (&bucket->key[i]) != 0
+              && CLHT_LOAD (&bucket->map[i], relaxed) == MAP_VALID
+              && !CLHT_TTL_EXPIRED (hashtable, bucket, i))
             {
               size++;
             }
@@ -539,7 +3580,7 @@ ht_status (clht_t *h, int resize_increase, int emergency_increase,
 
   clht_hashtable_t *hashtable = SHR_OFF_TO_PTR (h->ht);
   uint64_t num_buckets = hashtable->num_buckets;
-  volatile bucket_t *bucket = NULL;
+  bucket_t *bucket = NULL;
   size_t size = 0;
 
   uint64_t bin;
@@ -550,7 +3591,8 @@ ht_status (clht_t *h, int resize_increase, int emergency_increase,
       uint32_t j;
       for (j = 0; j < ENTRIES_PER_BUCKET; j++)
         {
-          if (bucket->key[j] > 0 && bucket->map[j] == MAP_VALID)
+          if (CLHT_KEY_LOAD (&bucket->key[j]) > 0
+              && CLHT_LOAD (&bucket->map[j], relaxed) == MAP_VALID)
             {
               size++;
             }
@@ -577,16 +3619,15 @@ ht_status (clht_t *h, int resize_increase, int emergency_increase,
       else*/ if ((full_ratio > 0 && full_ratio > CLHT_PERC_FULL_DOUBLE)
                || emergency_increase || resize_increase)
         {
-          int inc_by = (full_ratio / CLHT_OCCUP_AFTER_RES);
-          int inc_by_pow2 = pow2roundup (inc_by);
-
-          printf ("[STATUS-%02d] #bu: %7zu / #elems: %7zu / full%%: %8.4f%%\n",
-                  clht_gc_get_id (), hashtable->num_buckets, size, full_ratio);
-          if (inc_by_pow2 <= 1)
+          size_t num_buckets_new = clht_buckets_for (size);
+          if (num_buckets_new < clht_buckets_grown (hashtable->num_buckets))
             {
-              inc_by_pow2 = 2;
+              num_buckets_new = clht_buckets_grown (hashtable->num_buckets);
             }
-          ht_resize_pes (h, 1, inc_by_pow2);
+
+          clht_event_log (CLHT_EV_STATUS, hashtable->num_buckets, size,
+                          (uint64_t)(full_ratio * 100), 0, 0);
+          ht_grow_to (h, num_buckets_new);
         }
     }
 
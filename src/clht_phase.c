@@ -0,0 +1,197 @@
+/*
+ *   File: clht_phase.c
+ *   Description:
+ *   perf_event setup and reporting for the phase breakdown of
+ *   clht_phase.h. Everything compiles away without -DCLHT_PHASES.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "clht_phase.h"
+
+#if defined(CLHT_PHASES)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define CLHT_PHASE_MAX_THREADS 128
+
+__thread clht_phase_thread_t* clht_ph = NULL;
+
+static clht_phase_thread_t* clht_phase_threads[CLHT_PHASE_MAX_THREADS];
+static volatile uint32_t clht_phase_num_threads = 0;
+
+static const char* clht_phase_names[PH_NUM] =
+  {
+    "table", "hash", "bucket", "search", "cas-ins", "cas-val", "cas-rem"
+  };
+
+static const char* clht_phase_ev_names[PH_EV_NUM] =
+  {
+    "llc-miss", "remote-ld", "stalled"
+  };
+
+static void
+clht_phase_event_attr(struct perf_event_attr* attr, int e)
+{
+  memset(attr, 0, sizeof(*attr));
+  attr->size = sizeof(*attr);
+  attr->exclude_kernel = 1;
+  attr->exclude_hv = 1;
+
+  switch (e)
+    {
+    case PH_EV_LLC_MISS:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case PH_EV_REMOTE_LOAD:
+      /* CXL memory shows up as a CPU-less NUMA node */
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_NODE |
+	(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case PH_EV_STALLED:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+      break;
+    }
+}
+
+/*
+ * Open the counters for the calling thread. Events the PMU does not
+ * support are reported as n/a, the cycle breakdown still works.
+ */
+void
+clht_phase_thread_init()
+{
+  clht_phase_thread_t* t = (clht_phase_thread_t*) calloc(1, sizeof(clht_phase_thread_t));
+  if (t == NULL)
+    {
+      printf("** calloc @ clht_phase_thread_init\n");
+      return;
+    }
+
+  int e;
+  for (e = 0; e < PH_EV_NUM; e++)
+    {
+      struct perf_event_attr attr;
+      clht_phase_event_attr(&attr, e);
+
+      t->fd[e] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+      if (t->fd[e] < 0)
+	{
+	  continue;
+	}
+
+      void* pg = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, t->fd[e], 0);
+      if (pg == MAP_FAILED)
+	{
+	  close(t->fd[e]);
+	  t->fd[e] = -1;
+	  continue;
+	}
+      t->pg[e] = (struct perf_event_mmap_page*) pg;
+    }
+
+  uint32_t id = __sync_fetch_and_add(&clht_phase_num_threads, 1);
+  if (id < CLHT_PHASE_MAX_THREADS)
+    {
+      clht_phase_threads[id] = t;
+    }
+  clht_ph = t;
+}
+
+void
+clht_phase_print()
+{
+  ticks tot_ticks = 0;
+  uint64_t samples[PH_NUM] = {0};
+  ticks ph_ticks[PH_NUM] = {0};
+  uint64_t ev[PH_NUM][PH_EV_NUM];
+  int ev_valid[PH_EV_NUM] = {0};
+  memset(ev, 0, sizeof(ev));
+
+  uint32_t n = clht_phase_num_threads, i;
+  if (n > CLHT_PHASE_MAX_THREADS)
+    {
+      n = CLHT_PHASE_MAX_THREADS;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      clht_phase_thread_t* t = clht_phase_threads[i];
+      int p, e;
+      for (e = 0; e < PH_EV_NUM; e++)
+	{
+	  ev_valid[e] |= (t->pg[e] != NULL);
+	}
+      for (p = 0; p < PH_NUM; p++)
+	{
+	  samples[p] += t->samples[p];
+	  ph_ticks[p] += t->ticks[p];
+	  tot_ticks += t->ticks[p];
+	  for (e = 0; e < PH_EV_NUM; e++)
+	    {
+	      ev[p][e] += t->ev[p][e];
+	    }
+	}
+    }
+
+  printf("(PHASES) >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>\n");
+  printf("%-8s %12s %6s %10s", "phase", "samples", "%", "ticks/op");
+  int p, e;
+  for (e = 0; e < PH_EV_NUM; e++)
+    {
+      printf(" %10s/op", clht_phase_ev_names[e]);
+    }
+  printf("\n");
+
+  for (p = 0; p < PH_NUM; p++)
+    {
+      if (samples[p] == 0)
+	{
+	  continue;
+	}
+      printf("%-8s %12llu %5.1f%% %10.1f", clht_phase_names[p], (unsigned long long) samples[p],
+	     tot_ticks ? 100.0 * ph_ticks[p] / tot_ticks : 0, (double) ph_ticks[p] / samples[p]);
+      for (e = 0; e < PH_EV_NUM; e++)
+	{
+	  if (ev_valid[e])
+	    {
+	      printf(" %13.3f", (double) ev[p][e] / samples[p]);
+	    }
+	  else
+	    {
+	      printf(" %13s", "n/a");
+	    }
+	}
+      printf("\n");
+    }
+  printf("<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<< (PHASES)\n");
+  fflush(stdout);
+}
+
+#endif	/* CLHT_PHASES */
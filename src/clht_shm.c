@@ -1,8 +1,12 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "clht_shm.h"
+#include "clht_hist.h"
 
 #include "shm_alloc.h"
 #include "shm_constants.h"
@@ -30,30 +34,120 @@ CXL - DAX
 
 #define CXL_DAX_SIZE_ALIGNED CXL_ALIGN_ADDR(CXL_DAX_SIZE)
 
+// offset of the table area
+#define SHM_TABLE_OFF (SHM_MAPPING_SIZE_ALIGNED + SHM_COMM_SIZE)
+
+#define CLHT_SLAB_MAP_SIZE ((CXL_DAX_SIZE + CLHT_SLAB_SIZE - 1) / CLHT_SLAB_SIZE)
+
 #include "atomic_ops.h"
+#include "clht_atomic.h"
+
+struct cxl_barrier {
+	_Atomic uint64_t crossing;
+	_Atomic uint64_t round;
+} __attribute__ ((aligned (64)));
 
 struct cxl_comm {
 	_Atomic SHM_off clht;
 	_Atomic uint8_t initialized;
 	_Atomic uint64_t table_end;
 	_Atomic uint64_t connected_vms;
+	struct cxl_barrier barrier;
+	// cumulative per-VM latency histograms, published by each VM
+	clht_lat_t lat[CLHT_SHM_MAX_VMS];
+	// per-VM statistics page, see clht_stats.h
+	clht_stats_vm_t stats[CLHT_SHM_MAX_VMS];
+	// resize / status / GC events of all VMs, see clht_events.h
+	clht_event_ring_t events;
+	// per-thread hot bucket / key sketches, see clht_hot.h
+	clht_hot_thread_t hot[CLHT_SHM_MAX_VMS][CLHT_STATS_MAX_THREADS];
+	// cluster clock for entry expiry, see clht_ttl.h
+	clht_clock_t clock;
+	// VMs the region was initialized for
+	uint64_t num_vms;
+	// update rings [from][to] in the table area, see clht_deleg.h
+	SHM_off deleg_rings; // clht_deleg_ring_t*
+	// watch filter and per-VM notification words, see clht_watch.h
+	clht_watch_region_t watch;
+	// class + 1 of every slab of the table area, 0: not a slab, see clht_slab.h
+	SHM_off slab_map; // uint8_t*
+	// cluster epoch and per-thread announcements, see clht_ebr.h
+	clht_ebr_region_t ebr;
 };
 
+_Static_assert(CLHT_WATCH_MAX_VMS >= CLHT_SHM_MAX_VMS, "a filter slot of clht_watch.h needs a bit per VM");
+_Static_assert(CLHT_EBR_MAX_VMS >= CLHT_SHM_MAX_VMS, "clht_ebr.h needs the lines of every VM");
+_Static_assert(sizeof(struct cxl_comm) <= SHM_COMM_SIZE, "struct cxl_comm does not fit in SHM_COMM_SIZE");
+
 void * shm_base = NULL;
 struct cxl_comm * comm = NULL;
 void * table_base = NULL;
 
+// Counters of threads/VMs without a slot in the comm region go here
+static clht_stats_vm_t clht_stats_dummy;
+clht_stats_vm_t * clht_stats_vm = &clht_stats_dummy;
+__thread clht_stats_thread_t * clht_stats_thr = &clht_stats_dummy.thread[0];
+__thread clht_hot_thread_t * clht_hot_thr = NULL;
+clht_clock_t * clht_clock = NULL;
+clht_watch_region_t * clht_watches = NULL;
+static clht_ebr_region_t * clht_ebrs = NULL;
+
+// Id of this VM and its getticks() rate, for the event log
+static int clht_shm_node = -1;
+static double clht_shm_ticks_per_ns = 0;
+
+#if defined(CLHT_NONCOHERENT)
+// the write-back mapping and its uncached view, see clht_nc.h
+uintptr_t clht_nc_lo = 0;
+uintptr_t clht_nc_span = 0;
+intptr_t clht_nc_uc_delta = 0;
+static void * clht_nc_uc_base = NULL;
+#endif
+
+// The slabs of this VM, see clht_slab.h
+typedef struct clht_slab_depot {
+	pthread_mutex_t lock;
+	SHM_off free;	// objects linked through their first word
+	SHM_off next;	// the part of the last slab not handed out yet
+	SHM_off end;
+} clht_slab_depot_t;
+
+typedef struct clht_slab_cache {
+	uint64_t gen;
+	uint64_t n;
+	SHM_off obj[CLHT_SLAB_CACHE];
+} clht_slab_cache_t;
+
+static clht_slab_depot_t clht_slab_depot[CLHT_SLAB_CLASSES] = {
+	[0 ... CLHT_SLAB_CLASSES - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+static uint8_t * clht_slab_map = NULL;
+// bumped at every clht_shm_init: the per-thread state of an older region is dropped
+static uint64_t clht_shm_gen = 0;
+static __thread clht_slab_cache_t clht_slab_cache[CLHT_SLAB_CLASSES];
+static pthread_key_t clht_slab_key;
+static pthread_once_t clht_slab_once = PTHREAD_ONCE_INIT;
+
+static void clht_slab_attach();
+static SHM_off clht_table_reserve(uint64_t size, uint64_t align);
+
+static uint64_t clht_realtime_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 int read_ptr(int * ptr) { return *ptr; }
 
-static void * allocate(char * path, size_t size) {
+static void * allocate(char * path, size_t size, int read_only) {
     int fd;
 
-    if ((fd = open(path, O_RDWR, 0)) < 0) {
+    if ((fd = open(path, read_only ? O_RDONLY : O_RDWR, 0)) < 0) {
         perror("open");
         return NULL;
     }
     
-    void * mmap_res = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void * mmap_res = mmap(NULL, size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if(mmap_res == MAP_FAILED) {
         perror("mmap");
         return NULL;
@@ -64,17 +158,113 @@ static void * allocate(char * path, size_t size) {
     return mmap_res;
 }
 
+#if defined(CLHT_NONCOHERENT)
+/*
+ * Maps the uncached view of the device next to the write-back mapping
+ * res. The comm region is only used through the uncached view. Without
+ * one, the atomics act on the write-back mapping and the invalidations
+ * alone keep the tables consistent, as long as the hosts' atomics are
+ * (e.g. device-side) coherent. The emulation only caches the tables.
+ */
+static void clht_nc_map(void * res) {
+#if defined(CLHT_NC_EMULATE)
+	clht_nc_lo = (uintptr_t) table_base;
+	clht_nc_span = CXL_DAX_SIZE_ALIGNED - ((char*) table_base - (char*) res);
+	clht_nc_uc_delta = 0;
+#else
+	clht_nc_lo = (uintptr_t) res;
+	clht_nc_span = CXL_DAX_SIZE_ALIGNED;
+	clht_nc_uc_base = allocate(CLHT_NC_UC_PATH, CXL_DAX_SIZE_ALIGNED, 0);
+	if(clht_nc_uc_base == NULL) {
+		printf("** no uncached view at %s: atomics go through the cache\n", CLHT_NC_UC_PATH);
+		clht_nc_uc_delta = 0;
+	} else {
+		clht_nc_uc_delta = (char*) clht_nc_uc_base - (char*) res;
+	}
+#endif
+	comm = CLHT_NC_UC(comm);
+}
+
+#if defined(CLHT_NC_EMULATE)
+// lines of the emulated cache of each thread: 16KB, direct-mapped
+#define CLHT_NC_EMU_LINES 256
+
+typedef struct clht_nc_emu_line {
+	uintptr_t tag;	// address of the line, 0: invalid
+	uint64_t w[CLHT_NC_LINE / sizeof(uint64_t)];
+} clht_nc_emu_line_t;
+
+static __thread clht_nc_emu_line_t clht_nc_emu_cache[CLHT_NC_EMU_LINES];
+__thread int clht_nc_emu_skip = 0;
+
+static void clht_nc_emu_copy(const volatile void * p, void * out, size_t n) {
+	switch(n) {
+	case 1: *(uint8_t*) out = __atomic_load_n((const volatile uint8_t*) p, __ATOMIC_RELAXED); break;
+	case 2: *(uint16_t*) out = __atomic_load_n((const volatile uint16_t*) p, __ATOMIC_RELAXED); break;
+	case 4: *(uint32_t*) out = __atomic_load_n((const volatile uint32_t*) p, __ATOMIC_RELAXED); break;
+	default: *(uint64_t*) out = __atomic_load_n((const volatile uint64_t*) p, __ATOMIC_RELAXED); break;
+	}
+}
+
+/*
+ * A miss fills the whole line, one word at a time, so the words of a line
+ * can be of different ages, as when a line is evicted and refetched while
+ * it is being written: the seqlock rechecks of CLHT-LF have to catch this.
+ */
+void clht_nc_emu_load(const volatile void * p, void * out, size_t n, int fresh) {
+	uintptr_t a = (uintptr_t) p;
+	if(a - clht_nc_lo >= clht_nc_span) {
+		clht_nc_emu_copy(p, out, n);
+		return;
+	}
+
+	uintptr_t line = a & ~(uintptr_t) (CLHT_NC_LINE - 1);
+	clht_nc_emu_line_t * l = &clht_nc_emu_cache[(line / CLHT_NC_LINE) & (CLHT_NC_EMU_LINES - 1)];
+	if(fresh && !clht_nc_emu_skip)
+		l->tag = 0;
+	if(l->tag != line) {
+		int i;
+		for(i = 0; i < CLHT_NC_LINE / sizeof(uint64_t); i++)
+			l->w[i] = __atomic_load_n(((const volatile uint64_t*) line) + i, __ATOMIC_RELAXED);
+		l->tag = line;
+	}
+	memcpy(out, ((char*) l->w) + (a - line), n);
+}
+
+void clht_nc_emu_inval(const volatile void * p) {
+	uintptr_t line = (uintptr_t) p & ~(uintptr_t) (CLHT_NC_LINE - 1);
+	clht_nc_emu_line_t * l = &clht_nc_emu_cache[(line / CLHT_NC_LINE) & (CLHT_NC_EMU_LINES - 1)];
+	if(l->tag == line && !clht_nc_emu_skip)
+		l->tag = 0;
+}
+
+void clht_nc_emu_wb(const volatile void * p, size_t n) {
+	uintptr_t a = (uintptr_t) p & ~(uintptr_t) (CLHT_NC_LINE - 1);
+	if(n / CLHT_NC_LINE >= CLHT_NC_EMU_LINES) {
+		memset(clht_nc_emu_cache, 0, sizeof(clht_nc_emu_cache));
+		return;
+	}
+	for(; a < (uintptr_t) p + n; a += CLHT_NC_LINE)
+		clht_nc_emu_inval((const volatile void*) a);
+}
+#endif	/* CLHT_NC_EMULATE */
+#endif	/* CLHT_NONCOHERENT */
+
 static void * _clht_shm_init(int leader) {
 
 
-	void * res = (void *) allocate("/dev/mewsi", CXL_DAX_SIZE_ALIGNED);
-	if(res == MAP_FAILED) {
+	void * res = (void *) allocate("/dev/mewsi", CXL_DAX_SIZE_ALIGNED, 0);
+	if(res == NULL) {
 		return NULL;
 	}
 
 	comm = (struct cxl_comm*) (((char*)res) + SHM_MAPPING_SIZE_ALIGNED);
 	table_base = ((char*)res) + SHM_MAPPING_SIZE_ALIGNED + SHM_COMM_SIZE;
 
+#if defined(CLHT_NONCOHERENT)
+	clht_nc_map(res);
+#endif
+
 	return res;
 }
 
@@ -89,29 +279,73 @@ void * clht_shm_init(int node, int force_init, int num_buckets, int num_vms) {
 		return NULL;
 	}
 	shm_init(force_init, shm_base);
+	clht_shm_gen++;
+
+	clht_shm_node = node;
+	clht_shm_ticks_per_ns = clht_ticks_per_ns();
 
 	if(force_init) {
-		comm->initialized = 0;
+		atomic_store_explicit(&comm->initialized, 0, memory_order_relaxed);
 	}
-	
-    if(CAS_U8(&comm->initialized, 0, 1) == 1) {
-    	while(comm->initialized != 2);
+
+	// 0: empty, 1: being initialized by the VM whose CAS won, 2: ready
+	uint8_t state = 0;
+    if(!atomic_compare_exchange_strong_explicit(&comm->initialized, &state, 1,
+                                                memory_order_acquire, memory_order_acquire) && state == 1) {
+    	while(atomic_load_explicit(&comm->initialized, memory_order_acquire) != 2);
     }
 
-    if(comm->initialized == 1) {
+    if(state == 0) {
     	printf("[%d] Initializing CLHT\n", node);
-
-		comm->table_end = 0;
-    	comm->clht = clht_create(num_buckets);
-
-    	comm->initialized = 2;
-    	comm->connected_vms = 1;
+    	// run_cluster.sh starts the other VMs once it sees this line, even
+    	// with stdout redirected to a file or an ssh pipe
+    	fflush(stdout);
+
+		atomic_store_explicit(&comm->table_end, 0, memory_order_relaxed);
+		atomic_store_explicit(&comm->barrier.crossing, 0, memory_order_relaxed);
+		atomic_store_explicit(&comm->barrier.round, 0, memory_order_relaxed);
+		memset(comm->lat, 0, sizeof(comm->lat));
+		memset(comm->stats, 0, sizeof(comm->stats));
+		memset(&comm->events, 0, sizeof(comm->events));
+		memset(comm->hot, 0, sizeof(comm->hot));
+		memset(&comm->watch, 0, sizeof(comm->watch));
+		memset(&comm->ebr, 0, sizeof(comm->ebr));
+		comm->clock.epoch_ns = clht_realtime_ns();
+		CLHT_STORE(&comm->clock.now, 0, relaxed);
+		comm->num_vms = num_vms;
+		comm->deleg_rings = SHM_NULL;
+		comm->slab_map = clht_table_alloc_size(CLHT_SLAB_MAP_SIZE);
+		clht_slab_attach();
+#if defined(CLHT_DELEGATE)
+		comm->deleg_rings = clht_table_alloc_size(CLHT_SHM_MAX_VMS * CLHT_SHM_MAX_VMS * sizeof(clht_deleg_ring_t));
+#endif
+    	atomic_store_explicit(&comm->clht, clht_create(num_buckets), memory_order_relaxed);
+
+    	// count ourselves before the others can see the table and join
+    	atomic_store_explicit(&comm->connected_vms, 1, memory_order_relaxed);
+    	atomic_store_explicit(&comm->initialized, 2, memory_order_release);
     } else {
     	printf("[%d] Obtaining CLHT\n", node);
-    	comm->connected_vms++;
+    	clht_slab_attach();
+    	atomic_fetch_add_explicit(&comm->connected_vms, 1, memory_order_acq_rel);
+    }
+
+    if(node >= 0 && node < CLHT_SHM_MAX_VMS) {
+    	clht_stats_vm = &comm->stats[node];
+    	memset(clht_stats_vm, 0, sizeof(clht_stats_vm_t));
+    	clht_stats_vm->ticks_per_ns = clht_shm_ticks_per_ns;
+    	clht_stats_vm->num_buckets = ((clht_hashtable_t*) SHR_OFF_TO_PTR(((clht_t*) SHR_OFF_TO_PTR(comm->clht))->ht))->num_buckets;
+    	clht_stats_vm->active = 1;
+    	memset(comm->hot[node], 0, sizeof(comm->hot[node]));
+    	// lines left active by an earlier run of this VM would stop the epoch
+    	memset(comm->ebr.slot[node], 0, sizeof(comm->ebr.slot[node]));
     }
 
-    while(comm->connected_vms != num_vms);
+    clht_clock = &comm->clock;
+    clht_watches = &comm->watch;
+    clht_ebrs = &comm->ebr;
+
+    while(atomic_load_explicit(&comm->connected_vms, memory_order_acquire) != num_vms);
 
     printf("All VMs connected\n");
 
@@ -120,31 +354,581 @@ void * clht_shm_init(int node, int force_init, int num_buckets, int num_vms) {
 }
 
 
+/*
+ * Sense-reversing spin barrier over the comm region: every VM that calls
+ * it blocks until num_vms VMs have crossed. Spins on the shared round
+ * counter, so it should only be used outside of measured regions.
+ */
+void clht_shm_barrier(uint64_t num_vms) {
+	uint64_t round = atomic_load_explicit(&comm->barrier.round, memory_order_acquire);
+
+	if(atomic_fetch_add_explicit(&comm->barrier.crossing, 1, memory_order_acq_rel) == num_vms - 1) {
+		// the reset is published together with the new round
+		atomic_store_explicit(&comm->barrier.crossing, 0, memory_order_relaxed);
+		atomic_store_explicit(&comm->barrier.round, round + 1, memory_order_release);
+		return;
+	}
+
+	while(atomic_load_explicit(&comm->barrier.round, memory_order_acquire) == round)
+		_mm_pause();
+}
+
+clht_lat_t * clht_shm_lat(int node) {
+	if(node < 0 || node >= CLHT_SHM_MAX_VMS)
+		return NULL;
+
+	return &comm->lat[node];
+}
+
+void clht_stats_thread_init(int id) {
+	if(clht_stats_vm == &clht_stats_dummy || id < 0 || id >= CLHT_STATS_MAX_THREADS)
+		return;
+
+	clht_stats_thr = &clht_stats_vm->thread[id];
+	if(clht_stats_vm->num_threads < id + 1)
+		clht_stats_vm->num_threads = id + 1;
+
+	clht_hot_thr = &comm->hot[clht_shm_node][id];
+	clht_hot_thr->countdown = 0;
+	clht_hot_thr->slow_ticks = (uint64_t) (CLHT_HOT_SLOW_NS * clht_shm_ticks_per_ns);
+}
+
+/*
+ * Read-only attach for monitoring tools: maps the device without joining
+ * the allocator, so it never perturbs the running VMs.
+ */
+int clht_shm_attach_stats() {
+#if defined(CLHT_NONCOHERENT) && !defined(CLHT_NC_EMULATE)
+	// the comm region is written through the uncached view only
+	void * res = allocate(CLHT_NC_UC_PATH, CXL_DAX_SIZE_ALIGNED, 1);
+#else
+	void * res = allocate("/dev/mewsi", CXL_DAX_SIZE_ALIGNED, 1);
+#endif
+	if(res == NULL) {
+		return 0;
+	}
+
+	comm = (struct cxl_comm*) (((char*)res) + SHM_MAPPING_SIZE_ALIGNED);
+	return 1;
+}
+
+const clht_stats_vm_t * clht_shm_stats(int node) {
+	if(comm == NULL || node < 0 || node >= CLHT_SHM_MAX_VMS)
+		return NULL;
+
+	return &comm->stats[node];
+}
+
+const clht_event_ring_t * clht_shm_events() {
+	if(comm == NULL)
+		return NULL;
+
+	return &comm->events;
+}
+
+const clht_hot_thread_t * clht_shm_hot(int node, int thread) {
+	if(comm == NULL || node < 0 || node >= CLHT_SHM_MAX_VMS || thread < 0 || thread >= CLHT_STATS_MAX_THREADS)
+		return NULL;
+
+	return &comm->hot[node][thread];
+}
+
+int clht_shm_node_id() {
+	return clht_shm_node;
+}
+
+int clht_shm_num_vms() {
+	return comm == NULL ? 0 : (int) comm->num_vms;
+}
+
+clht_deleg_ring_t * clht_shm_deleg_ring(int from, int to) {
+	if(comm == NULL || comm->deleg_rings == SHM_NULL || from < 0 || from >= CLHT_SHM_MAX_VMS || to < 0 || to >= CLHT_SHM_MAX_VMS)
+		return NULL;
+
+	return ((clht_deleg_ring_t*) SHR_OFF_TO_PTR(comm->deleg_rings)) + from * CLHT_SHM_MAX_VMS + to;
+}
+
+/*
+ * The cluster clock only moves forward: a VM whose clock is behind reads
+ * the time of the others, and one that is ahead pulls everybody along.
+ */
+uint32_t clht_clock_advance() {
+	uint64_t ns = clht_realtime_ns();
+	uint32_t local = ns > clht_clock->epoch_ns ? (ns - clht_clock->epoch_ns) / (CLHT_TTL_TICK_MS * 1000000ULL) : 0;
+	uint32_t now = CLHT_LOAD(&clht_clock->now, relaxed);
+
+	while(now < local) {
+		uint32_t found = CLHT_CAS(&clht_clock->now, now, local, acquire);
+		if(found == now)
+			return local;
+		now = found;
+	}
+	return now;
+}
+
+// watches of this VM per filter slot; the filter bit is set while > 0
+static uint32_t clht_watch_local[CLHT_WATCH_SLOTS];
+static pthread_mutex_t clht_watch_lock = PTHREAD_MUTEX_INITIALIZER;
+// the notification word of VMs without one in the comm region
+static clht_watch_word_t clht_watch_dummy;
+
+void clht_watch_notify(uint64_t bin) {
+	uint16_t vms = CLHT_LOAD(&clht_watches->filter[bin & (CLHT_WATCH_SLOTS - 1)], seq_cst);
+
+	while(vms) {
+		CLHT_FAA(&clht_watches->notify[__builtin_ctz(vms)].seq, 1, release);
+		vms &= vms - 1;
+	}
+}
+
+void clht_watch_notify_all() {
+	int vm;
+	for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+		CLHT_FAA(&clht_watches->notify[vm].seq, 1, release);
+}
+
+void clht_watch_register(uint64_t bin) {
+	uint64_t slot = bin & (CLHT_WATCH_SLOTS - 1);
+	if(clht_shm_node < 0 || clht_shm_node >= CLHT_SHM_MAX_VMS)
+		return;
+
+	pthread_mutex_lock(&clht_watch_lock);
+	if(clht_watch_local[slot]++ == 0) {
+		CLHT_FAA(&clht_watches->watchers, 1, seq_cst);
+		CLHT_OR(&clht_watches->filter[slot], 1 << clht_shm_node, seq_cst);
+	}
+	pthread_mutex_unlock(&clht_watch_lock);
+}
+
+void clht_watch_unregister(uint64_t bin) {
+	uint64_t slot = bin & (CLHT_WATCH_SLOTS - 1);
+	if(clht_shm_node < 0 || clht_shm_node >= CLHT_SHM_MAX_VMS)
+		return;
+
+	pthread_mutex_lock(&clht_watch_lock);
+	if(--clht_watch_local[slot] == 0) {
+		CLHT_AND(&clht_watches->filter[slot], ~(1 << clht_shm_node), relaxed);
+		CLHT_FAA(&clht_watches->watchers, -1, relaxed);
+	}
+	pthread_mutex_unlock(&clht_watch_lock);
+}
+
+static clht_watch_word_t * clht_watch_word() {
+	if(clht_shm_node < 0 || clht_shm_node >= CLHT_SHM_MAX_VMS)
+		return &clht_watch_dummy;
+
+	return &clht_watches->notify[clht_shm_node];
+}
+
+uint64_t clht_watch_seq() {
+	return CLHT_LOAD(&clht_watch_word()->seq, acquire);
+}
+
+/*
+ * Spins on the word first, for changes that follow shortly, then sleeps
+ * for doubling intervals. A VM without a word is never notified: it
+ * returns after one sleep of CLHT_WATCH_SLEEP_MAX_US, and the caller
+ * polls the table.
+ */
+int clht_watch_wait(uint64_t seq, uint64_t deadline_ns) {
+	clht_watch_word_t * w = clht_watch_word();
+	uint64_t sleep_us = 1;
+	int i;
+
+	if(w == &clht_watch_dummy) {
+		usleep(CLHT_WATCH_SLEEP_MAX_US);
+		return deadline_ns == 0 || clht_realtime_ns() < deadline_ns;
+	}
+
+	for(i = 0; i < CLHT_WATCH_SPINS; i++) {
+		if(CLHT_LOAD(&w->seq, acquire) != seq)
+			return 1;
+		_mm_pause();
+	}
+
+	while(CLHT_LOAD(&w->seq, acquire) == seq) {
+		if(deadline_ns != 0 && clht_realtime_ns() >= deadline_ns)
+			return 0;
+		usleep(sleep_us);
+		if(sleep_us < CLHT_WATCH_SLEEP_MAX_US)
+			sleep_us *= 2;
+	}
+	return 1;
+}
+
+// objects retired by a thread and not freed yet, see clht_ebr.h
+typedef struct clht_ebr_retired {
+	SHM_off off;
+	clht_ebr_free_fn free_fn;
+	uint64_t epoch;
+} clht_ebr_retired_t;
+
+typedef struct clht_ebr_list {
+	uint64_t gen;
+	uint64_t n;
+	uint64_t size;
+	uint64_t retires;	// since the last attempt to advance
+	clht_ebr_retired_t * obj;
+} clht_ebr_list_t;
+
+static __thread clht_ebr_slot_t * clht_ebr_slot = NULL;
+static __thread uint64_t clht_ebr_depth = 0;
+static __thread clht_ebr_list_t clht_ebr_list;
+static pthread_key_t clht_ebr_key;
+static pthread_once_t clht_ebr_once = PTHREAD_ONCE_INIT;
+// the objects of threads that exited before they could free them
+static clht_ebr_list_t clht_ebr_orphans;
+static pthread_mutex_t clht_ebr_orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void clht_ebr_thread_init(int id) {
+	clht_ebr_slot = NULL;
+	clht_ebr_depth = 0;
+	if(clht_ebrs == NULL || clht_shm_node < 0 || clht_shm_node >= CLHT_EBR_MAX_VMS || id < 0 || id >= CLHT_STATS_MAX_THREADS)
+		return;
+
+	clht_ebr_slot = &clht_ebrs->slot[clht_shm_node][id];
+	CLHT_STORE(&clht_ebr_slot->state, 0, relaxed);
+
+	uint32_t n = CLHT_LOAD(&clht_ebrs->num_threads[clht_shm_node], relaxed);
+	while(n < (uint32_t) id + 1) {
+		uint32_t found = CLHT_CAS(&clht_ebrs->num_threads[clht_shm_node], n, id + 1, seq_cst);
+		if(found == n)
+			break;
+		n = found;
+	}
+}
+
+void clht_ebr_enter() {
+	if(clht_ebr_depth++ > 0 || clht_ebr_slot == NULL)
+		return;
+
+	uint64_t e = CLHT_LOAD(&clht_ebrs->epoch, acquire);
+	CLHT_STORE(&clht_ebr_slot->state, e << 1 | 1, relaxed);
+	// the announcement is visible before the section reads the table
+	CLHT_FENCE(seq_cst);
+}
+
+void clht_ebr_exit() {
+	if(--clht_ebr_depth > 0 || clht_ebr_slot == NULL)
+		return;
+
+	CLHT_STORE(&clht_ebr_slot->state, 0, release);
+}
+
+/*
+ * Moves the epoch from e to e + 1 if every thread in a section entered it
+ * in e, scanning the lines in use of every VM. Returns the epoch after the
+ * attempt.
+ */
+static uint64_t clht_ebr_advance() {
+	uint64_t e = CLHT_LOAD(&clht_ebrs->epoch, seq_cst);
+	int vm;
+	uint32_t t;
+
+	for(vm = 0; vm < CLHT_EBR_MAX_VMS; vm++) {
+		uint32_t n = CLHT_LOAD(&clht_ebrs->num_threads[vm], acquire);
+		for(t = 0; t < n && t < CLHT_STATS_MAX_THREADS; t++) {
+			uint64_t state = CLHT_LOAD(&clht_ebrs->slot[vm][t].state, seq_cst);
+			if((state & 1) && (state >> 1) != e)
+				return e;
+		}
+	}
+
+	uint64_t found = CLHT_CAS(&clht_ebrs->epoch, e, e + 1, seq_cst);
+	return found == e ? e + 1 : found;
+}
+
+// frees the objects of l retired two epochs before e or earlier
+static void clht_ebr_free(clht_ebr_list_t * l, uint64_t e) {
+	uint64_t i, kept = 0;
+	for(i = 0; i < l->n; i++) {
+		clht_ebr_retired_t * r = &l->obj[i];
+		if(r->epoch + 2 <= e)
+			r->free_fn(r->off);
+		else
+			l->obj[kept++] = *r;
+	}
+	l->n = kept;
+}
+
+static void clht_ebr_push(clht_ebr_list_t * l, SHM_off off, clht_ebr_free_fn free_fn, uint64_t epoch) {
+	if(l->n == l->size) {
+		l->size = l->size ? 2 * l->size : 4 * CLHT_EBR_BATCH;
+		l->obj = (clht_ebr_retired_t*) realloc(l->obj, l->size * sizeof(clht_ebr_retired_t));
+	}
+	l->obj[l->n].off = off;
+	l->obj[l->n].free_fn = free_fn;
+	l->obj[l->n].epoch = epoch;
+	l->n++;
+}
+
+// at thread exit, what cannot be freed yet goes to the orphans
+static void clht_ebr_thread_exit(void * list) {
+	clht_ebr_list_t * l = (clht_ebr_list_t*) list;
+	uint64_t i;
+
+	if(clht_ebrs != NULL && l->gen == clht_shm_gen) {
+		clht_ebr_free(l, clht_ebr_advance());
+
+		pthread_mutex_lock(&clht_ebr_orphans_lock);
+		if(clht_ebr_orphans.gen != clht_shm_gen) {
+			clht_ebr_orphans.gen = clht_shm_gen;
+			clht_ebr_orphans.n = 0;
+		}
+		for(i = 0; i < l->n; i++)
+			clht_ebr_push(&clht_ebr_orphans, l->obj[i].off, l->obj[i].free_fn, l->obj[i].epoch);
+		pthread_mutex_unlock(&clht_ebr_orphans_lock);
+		// the frees may come after the slab cache of the thread was flushed
+		clht_slab_thread_flush();
+	}
+
+	free(l->obj);
+	l->obj = NULL;
+	l->n = l->size = 0;
+}
+
+static void clht_ebr_key_init() {
+	pthread_key_create(&clht_ebr_key, clht_ebr_thread_exit);
+}
+
+// the retired objects of an older region are dropped, never freed
+static clht_ebr_list_t * clht_ebr_thread_list() {
+	clht_ebr_list_t * l = &clht_ebr_list;
+	if(l->gen != clht_shm_gen) {
+		l->gen = clht_shm_gen;
+		l->n = 0;
+		l->retires = 0;
+		pthread_once(&clht_ebr_once, clht_ebr_key_init);
+		// flushed at thread exit
+		pthread_setspecific(clht_ebr_key, l);
+	}
+	return l;
+}
+
+void clht_ebr_retire(SHM_off off, clht_ebr_free_fn free_fn) {
+	if(clht_ebrs == NULL) {
+		free_fn(off);
+		return;
+	}
+
+	clht_ebr_list_t * l = clht_ebr_thread_list();
+	// off is unlinked: a section that starts from now on cannot reach it
+	clht_ebr_push(l, off, free_fn, CLHT_LOAD(&clht_ebrs->epoch, seq_cst));
+	if(++l->retires < CLHT_EBR_BATCH)
+		return;
+
+	l->retires = 0;
+	uint64_t e = clht_ebr_advance();
+	clht_ebr_free(l, e);
+	if(clht_ebr_orphans.n > 0 && pthread_mutex_trylock(&clht_ebr_orphans_lock) == 0) {
+		if(clht_ebr_orphans.gen == clht_shm_gen)
+			clht_ebr_free(&clht_ebr_orphans, e);
+		pthread_mutex_unlock(&clht_ebr_orphans_lock);
+	}
+}
+
+void clht_ebr_drain() {
+	clht_ebr_list_t * l = &clht_ebr_list;
+	if(clht_ebrs == NULL || l->gen != clht_shm_gen)
+		return;
+
+	while(1) {
+		clht_ebr_free(l, clht_ebr_advance());
+		if(l->n == 0)
+			break;
+		_mm_pause();
+	}
+}
+
+uint64_t clht_ticks_to_ns(uint64_t t) {
+	return clht_shm_ticks_per_ns > 0 ? (uint64_t) (t / clht_shm_ticks_per_ns) : 0;
+}
+
+/*
+ * Claims the next slot with one FAI and fills it in place. The record is
+ * published by writing its seq last; a reader that sees a different seq
+ * knows the slot is still being written or was already overwritten.
+ */
+void clht_event_log(uint32_t type, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4) {
+	if(shm_base == NULL)
+		return;
+
+	clht_event_ring_t * ring = &comm->events;
+	uint64_t pos = CLHT_FAA(&ring->head, 1, relaxed);
+	clht_event_t * ev = &ring->ev[pos & CLHT_EV_RING_MASK];
+
+	// seqlock writer: the zero seq is ordered before every field store
+	CLHT_STORE(&ev->seq, 0, relaxed);
+	CLHT_FENCE(release);
+
+	ev->type = type;
+	ev->vm = (uint16_t) clht_shm_node;
+	ev->thread = (uint16_t) (clht_stats_thr - &clht_stats_vm->thread[0]);
+	ev->ts_ns = clht_realtime_ns();
+	ev->arg[0] = a0;
+	ev->arg[1] = a1;
+	ev->arg[2] = a2;
+	ev->arg[3] = a3;
+	ev->arg[4] = a4;
+
+	CLHT_STORE(&ev->seq, pos + 1, release);
+}
+
 void clht_shm_term(int node) {
 	// TODO - Decide if is last node in the system. if yes destroy meta ? Should this happen?
+	clht_stats_vm->active = 0;
+	clht_stats_vm = &clht_stats_dummy;
+	clht_stats_thr = &clht_stats_dummy.thread[0];
+	clht_hot_thr = NULL;
+
+	clht_slab_map = NULL;
+	clht_ebrs = NULL;
 	shm_deinit();
 
-	comm->connected_vms--;
-	if(comm->connected_vms == 0) {
+	if(atomic_fetch_sub_explicit(&comm->connected_vms, 1, memory_order_acq_rel) == 1) {
     	printf("All VMs disconnected\n");
 	}
 
 	munmap(shm_base, CXL_DAX_SIZE_ALIGNED);
 	shm_base = NULL;
+#if defined(CLHT_NONCOHERENT)
+	if(clht_nc_uc_base != NULL)
+		munmap(clht_nc_uc_base, CXL_DAX_SIZE_ALIGNED);
+	clht_nc_uc_base = NULL;
+	clht_nc_span = 0;
+#endif
+}
+
+static void clht_slab_thread_exit(void * cache) {
+	clht_slab_thread_flush();
+}
+
+static void clht_slab_key_init() {
+	pthread_key_create(&clht_slab_key, clht_slab_thread_exit);
+}
+
+// empties the depots, which may hold objects of an older region
+static void clht_slab_attach() {
+	int c;
+	for(c = 0; c < CLHT_SLAB_CLASSES; c++) {
+		clht_slab_depot_t * d = &clht_slab_depot[c];
+		pthread_mutex_lock(&d->lock);
+		d->free = SHM_NULL;
+		d->next = d->end = SHM_NULL;
+		pthread_mutex_unlock(&d->lock);
+	}
+
+	clht_slab_map = (uint8_t*) SHR_OFF_TO_PTR(comm->slab_map);
+	pthread_once(&clht_slab_once, clht_slab_key_init);
+}
+
+// the cache of class c of this thread, empty if it is from an older region
+static clht_slab_cache_t * clht_slab_thread(int c) {
+	if(clht_slab_cache[c].gen != clht_shm_gen) {
+		int i;
+		for(i = 0; i < CLHT_SLAB_CLASSES; i++) {
+			clht_slab_cache[i].gen = clht_shm_gen;
+			clht_slab_cache[i].n = 0;
+		}
+		// flushed at thread exit
+		pthread_setspecific(clht_slab_key, clht_slab_cache);
+	}
+	return &clht_slab_cache[c];
+}
+
+// moves the objects of cache above keep to the depot of its class
+static void clht_slab_put_back(int c, clht_slab_cache_t * cache, uint64_t keep) {
+	clht_slab_depot_t * d = &clht_slab_depot[c];
+
+	pthread_mutex_lock(&d->lock);
+	while(cache->n > keep) {
+		SHM_off off = cache->obj[--cache->n];
+		*(SHM_off*) SHR_OFF_TO_PTR(off) = d->free;
+		d->free = off;
+	}
+	pthread_mutex_unlock(&d->lock);
+}
+
+/*
+ * Takes a batch from the depot: freed objects first, then the rest of the
+ * last slab, then a new slab claimed from the table area.
+ */
+static void clht_slab_refill(int c, clht_slab_cache_t * cache) {
+	clht_slab_depot_t * d = &clht_slab_depot[c];
+	uint64_t size = 1ULL << (CLHT_SLAB_MIN_SHIFT + c);
+
+	pthread_mutex_lock(&d->lock);
+	while(cache->n < CLHT_SLAB_BATCH && d->free != SHM_NULL) {
+		SHM_off off = d->free;
+		d->free = *(SHM_off*) SHR_OFF_TO_PTR(off);
+		cache->obj[cache->n++] = off;
+	}
+	while(cache->n < CLHT_SLAB_BATCH) {
+		if(d->next == d->end) {
+			d->next = clht_table_reserve(CLHT_SLAB_SIZE, CLHT_SLAB_SIZE);
+			d->end = d->next + CLHT_SLAB_SIZE;
+			// set before any object of the slab is handed out
+			CLHT_STORE(&clht_slab_map[(d->next - SHM_TABLE_OFF) / CLHT_SLAB_SIZE], c + 1, release);
+		}
+		cache->obj[cache->n++] = d->next;
+		d->next += size;
+	}
+	pthread_mutex_unlock(&d->lock);
+}
+
+static SHM_off clht_slab_alloc(uint64_t size) {
+	int c = clht_slab_class(size);
+	clht_slab_cache_t * cache = clht_slab_thread(c);
+
+	if(cache->n == 0)
+		clht_slab_refill(c, cache);
+	return cache->obj[--cache->n];
+}
+
+static void clht_slab_free(SHM_off off) {
+	uint8_t * cls = &clht_slab_map[(off - SHM_TABLE_OFF) / CLHT_SLAB_SIZE];
+	// the class of a slab is set once, a stale 0 is read again from memory
+	int c = CLHT_LOAD(cls, relaxed);
+	if(c == 0)
+		c = CLHT_LOAD(cls, acquire);
+	if(c == 0) {
+		// a table or per-table array: the table area is never freed
+		return;
+	}
+
+	clht_slab_cache_t * cache = clht_slab_thread(c - 1);
+	if(cache->n == CLHT_SLAB_CACHE)
+		clht_slab_put_back(c - 1, cache, CLHT_SLAB_CACHE - CLHT_SLAB_BATCH);
+	cache->obj[cache->n++] = off;
+}
+
+void clht_slab_thread_flush() {
+	int c;
+	if(clht_slab_map == NULL || clht_slab_cache[0].gen != clht_shm_gen)
+		return;
+
+	for(c = 0; c < CLHT_SLAB_CLASSES; c++)
+		clht_slab_put_back(c, &clht_slab_cache[c], 0);
 }
 
 SHM_off clht_shm_alloc(uint64_t size) {
-	SHM_off res = shm_malloc(size);
+	SHM_off res = clht_slab_map != NULL && size <= CLHT_SLAB_MAX ? clht_slab_alloc(size) : shm_malloc(size);
 	void * ptr = SHR_OFF_TO_PTR(res);
 	if(ptr == NULL)
 		return res;
 
 	memset(ptr, 0, size);
+	CLHT_NC_WB(ptr, size);
 	return res;
 }
 
 void clht_shm_free(SHM_off off) {
-	return shm_free(off);
+	if(off != SHM_NULL && off >= SHM_TABLE_OFF) {
+		if(clht_slab_map != NULL)
+			clht_slab_free(off);
+		return;
+	}
+	shm_free(off);
 }
 
 uint64_t clht_get_shm_base_addr() {
@@ -152,28 +936,44 @@ uint64_t clht_get_shm_base_addr() {
 }
 
 SHM_off clht_table_alloc(uint64_t num_buckets) {
+	return clht_table_alloc_size(num_buckets * sizeof(bucket_t));
+}
+
+// claims size bytes of the table area, at a multiple of align (a power of 2)
+static SHM_off clht_table_reserve(uint64_t size, uint64_t align) {
 	uint64_t new_table_end;
 	uint64_t old_table_end; 
-	uint64_t size = num_buckets * sizeof(bucket_t);
+	uint64_t start;
 
+	old_table_end = atomic_load_explicit(&comm->table_end, memory_order_relaxed);
 	do {
-		old_table_end = comm->table_end;
-		new_table_end = old_table_end + size;
+		start = (old_table_end + align - 1) & ~(align - 1);
+		new_table_end = start + size;
 
 		if(new_table_end > CXL_DAX_SIZE) {
 			puts("OUT OF MEMORY FOR HASHTABLE");
 			exit(-1);
 		}
 
-	} while(CAS_U64(&comm->table_end, old_table_end, new_table_end) != old_table_end);
+	} while(!atomic_compare_exchange_weak_explicit(&comm->table_end, &old_table_end, new_table_end,
+	                                               memory_order_relaxed, memory_order_relaxed));
+
+	return SHM_TABLE_OFF + start;
+}
+
+// any per-table array (e.g. the expiry array of CLHT-LF), cache-line aligned
+SHM_off clht_table_alloc_size(uint64_t size) {
+	size = (size + 63) & ~63ULL;
 
-	SHM_off off = (SHM_MAPPING_SIZE_ALIGNED + SHM_COMM_SIZE + old_table_end);
+	SHM_off off = clht_table_reserve(size, 64);
 
   	void * ptr = SHR_OFF_TO_PTR(off);
 	if(ptr == NULL)
 		return off;
 
 	memset(ptr, 0, size);
+	// no other host may read the zeroes from a stale line later
+	CLHT_NC_WB(ptr, size);
 
   	return off;
 }
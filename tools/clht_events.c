@@ -0,0 +1,169 @@
+/*
+ *   File: clht_events.c
+ *   Description:
+ *   Attaches read-only to the comm region of a running CLHT cluster and
+ *   prints the resize / status / GC event log, as text or as CSV.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "clht_shm.h"
+#include "clht_atomic.h"
+
+static uint64_t lost = 0;
+
+void usage() {
+    puts("Usage: ./clht_events [-n LAST_N] [-f (follow)] [-c (CSV)]");
+}
+
+static void print_event(const clht_event_t * ev, bool csv) {
+    const uint64_t * a = ev->arg;
+    const char * name = ev->type < CLHT_EV_NUM_TYPES ? clht_ev_names[ev->type] : "?";
+
+    if(csv) {
+        printf("%lu,%s,%u,%u,%lu,%lu,%lu,%lu,%lu\n", ev->ts_ns, name, ev->vm, ev->thread,
+               a[0], a[1], a[2], a[3], a[4]);
+        return;
+    }
+
+    time_t sec = ev->ts_ns / 1000000000ULL;
+    struct tm tm;
+    char when[32];
+    localtime_r(&sec, &tm);
+    strftime(when, sizeof(when), "%H:%M:%S", &tm);
+
+    printf("%s.%06lu [%-12s vm %2u thr %2u] ", when, (unsigned long) ((ev->ts_ns % 1000000000ULL) / 1000),
+           name, ev->vm, ev->thread);
+
+    switch(ev->type) {
+    case CLHT_EV_STATUS:
+        printf("#bu: %7lu / #elems: %7lu / full%%: %6.2f%% / expands: %4lu / max expands: %2lu\n",
+               a[0], a[1], a[2] / 100.0, a[3], a[4]);
+        break;
+    case CLHT_EV_RESIZE_START:
+        printf("#bu: %7lu -> %7lu / version: %lu\n", a[0], a[1], a[2]);
+        break;
+    case CLHT_EV_RESIZE_END:
+        printf("#bu: %7lu -> %7lu / MB: %8.2f / took: %10.3f ms / stall: %10.3f ms / participants: %lu\n",
+               a[0], a[1], (a[1] * sizeof(bucket_t)) / (1024.0 * 1024), a[2] / 1e6, a[3] / 1e6, a[4]);
+        break;
+    case CLHT_EV_GC:
+        printf("freed: %3lu versions / oldest kept: %lu / took: %10.3f ms\n", a[0], a[1], a[2] / 1e6);
+        break;
+    case CLHT_EV_NO_SPACE:
+        printf("bucket %lu of %lu is full in the new table\n", a[0], a[1]);
+        break;
+    default:
+        printf("%lu %lu %lu %lu %lu\n", a[0], a[1], a[2], a[3], a[4]);
+    }
+}
+
+/*
+ * Prints the complete records in [from, head) and returns the position to
+ * continue from: the first record that is still being written, or head.
+ */
+static uint64_t drain(const clht_event_ring_t * ring, uint64_t from, bool csv) {
+    uint64_t head = CLHT_LOAD(&ring->head, acquire);
+
+    if(head - from > CLHT_EV_RING_SIZE) {
+        lost += head - from - CLHT_EV_RING_SIZE;
+        from = head - CLHT_EV_RING_SIZE;
+    }
+
+    uint64_t pos;
+    for(pos = from; pos < head; pos++) {
+        const clht_event_t * slot = &ring->ev[pos & CLHT_EV_RING_MASK];
+        uint64_t seq = CLHT_LOAD(&slot->seq, acquire);
+        if(seq == 0 || seq < pos + 1)
+            break;			// not published yet
+        if(seq > pos + 1) {		// overwritten by a later lap
+            lost++;
+            continue;
+        }
+
+        clht_event_t ev;
+        memcpy(&ev, (const void *) slot, sizeof(ev));
+        CLHT_FENCE(acquire);
+        if(CLHT_LOAD(&slot->seq, relaxed) != pos + 1) {
+            lost++;
+            continue;
+        }
+        print_event(&ev, csv);
+    }
+
+    fflush(stdout);
+    return pos;
+}
+
+int main(int argc, char **argv) {
+    uint64_t last = CLHT_EV_RING_SIZE;
+    bool follow = false;
+    bool csv = false;
+    char c;
+
+    while ((c = getopt (argc, argv, "n:fc")) != -1)
+    switch (c)
+      {
+      case 'n':
+        last = atoll(optarg);
+        break;
+      case 'f':
+        follow = true;
+        break;
+      case 'c':
+        csv = true;
+        break;
+      default:
+        printf("Invalid option %c\n", c);
+        usage();
+        return 1;
+      }
+
+    if(!clht_shm_attach_stats()) {
+        perror("clht_shm_attach_stats");
+        return 1;
+    }
+
+    const clht_event_ring_t * ring = clht_shm_events();
+
+    if(csv)
+        puts("ts_ns,type,vm,thread,arg0,arg1,arg2,arg3,arg4");
+
+    uint64_t head = CLHT_LOAD(&ring->head, acquire);
+    uint64_t pos = head > last ? head - last : 0;
+    pos = drain(ring, pos, csv);
+
+    while(follow) {
+        usleep(100000);
+        pos = drain(ring, pos, csv);
+    }
+
+    if(lost > 0)
+        fprintf(stderr, "** %lu events overwritten before they were read\n", lost);
+
+    return 0;
+}
@@ -0,0 +1,384 @@
+/*
+ *   File: clht_stat.c
+ *   Description:
+ *   Attaches read-only to the comm region of a running CLHT cluster and
+ *   prints the per-VM statistics pages, either as live rates or as
+ *   OpenMetrics text, or the hottest buckets and keys (make HOT=1).
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "clht_shm.h"
+
+/* sums of the per-thread counters of one VM */
+struct vm_sample {
+    uint64_t active;
+    uint64_t num_threads;
+    double ticks_per_ns;
+    uint64_t num_buckets;
+    uint64_t get, get_hit, put, put_suc, remove, remove_suc;
+    uint64_t cas_retries, empty_retries, evictions, cow_saves;
+    uint64_t resizes, resize_ticks, gc_runs, gc_collected, gc_ticks;
+};
+
+static struct vm_sample cur[CLHT_SHM_MAX_VMS], prev[CLHT_SHM_MAX_VMS];
+
+void usage() {
+    puts("Usage: ./clht_stat [-i INTERVAL_S] [-n COUNT] [-o (OpenMetrics)] [-H (hot buckets/keys)]");
+}
+
+static void sample(struct vm_sample * smp) {
+    for(int vm = 0; vm < CLHT_SHM_MAX_VMS; vm++) {
+        const clht_stats_vm_t * s = clht_shm_stats(vm);
+        struct vm_sample * v = &smp[vm];
+        memset(v, 0, sizeof(*v));
+
+        v->active = s->active;
+        v->num_threads = s->num_threads;
+        v->ticks_per_ns = s->ticks_per_ns;
+        v->num_buckets = s->num_buckets;
+        v->resizes = s->resizes;
+        v->resize_ticks = s->resize_ticks;
+        v->gc_runs = s->gc_runs;
+        v->gc_collected = s->gc_collected;
+        v->gc_ticks = s->gc_ticks;
+
+        for(uint64_t t = 0; t < v->num_threads && t < CLHT_STATS_MAX_THREADS; t++) {
+            const clht_stats_thread_t * th = &s->thread[t];
+            v->get += th->get;
+            v->get_hit += th->get_hit;
+            v->put += th->put;
+            v->put_suc += th->put_suc;
+            v->remove += th->remove;
+            v->remove_suc += th->remove_suc;
+            v->cas_retries += th->cas_retries;
+            v->empty_retries += th->empty_retries;
+            v->evictions += th->evictions;
+            v->cow_saves += th->cow_saves;
+        }
+    }
+}
+
+static double ticks_to_s(uint64_t t, double ticks_per_ns) {
+    return ticks_per_ns > 0 ? t / ticks_per_ns / 1e9 : 0;
+}
+
+// Elements are estimated from successful puts minus removes and evictions
+static void table_occupancy(uint64_t * buckets, int64_t * elems) {
+    *buckets = 0;
+    *elems = 0;
+    for(int vm = 0; vm < CLHT_SHM_MAX_VMS; vm++) {
+        if(cur[vm].num_buckets > *buckets)
+            *buckets = cur[vm].num_buckets;
+        *elems += (int64_t) (cur[vm].put_suc - cur[vm].remove_suc - cur[vm].evictions);
+    }
+}
+
+static void print_rates(double interval) {
+    printf("%3s %4s %12s %6s %12s %6s %12s %12s %12s %12s %8s %10s %8s %8s\n",
+           "vm", "thr", "get/s", "hit%", "put/s", "suc%", "remove/s", "cas-rtry/s", "empty-rtry/s",
+           "evict/s", "resizes", "resize-ms", "gc-runs", "gc-coll");
+
+    for(int vm = 0; vm < CLHT_SHM_MAX_VMS; vm++) {
+        struct vm_sample * c = &cur[vm], * p = &prev[vm];
+        if(!c->active)
+            continue;
+
+        uint64_t get = c->get - p->get, put = c->put - p->put;
+        printf("%3d %4lu %12.0f %6.1f %12.0f %6.1f %12.0f %12.0f %12.0f %12.0f %8lu %10.2f %8lu %8lu\n",
+               vm, c->num_threads,
+               get / interval, get ? 100.0 * (c->get_hit - p->get_hit) / get : 0,
+               put / interval, put ? 100.0 * (c->put_suc - p->put_suc) / put : 0,
+               (c->remove - p->remove) / interval,
+               (c->cas_retries - p->cas_retries) / interval,
+               (c->empty_retries - p->empty_retries) / interval,
+               (c->evictions - p->evictions) / interval,
+               c->resizes, 1e3 * ticks_to_s(c->resize_ticks, c->ticks_per_ns),
+               c->gc_runs, c->gc_collected);
+    }
+
+    uint64_t buckets;
+    int64_t elems;
+    table_occupancy(&buckets, &elems);
+    printf("table: #bu: %lu / #elems: ~%ld / full%%: %.2f%%\n\n", buckets, elems,
+           buckets ? 100.0 * elems / (buckets * ENTRIES_PER_BUCKET) : 0);
+    fflush(stdout);
+}
+
+struct hot_item {
+    uint64_t id;
+    uint64_t count;
+};
+
+#define HOT_MAX_ITEMS (CLHT_SHM_MAX_VMS * CLHT_STATS_MAX_THREADS * CLHT_HOT_K)
+#define HOT_TOP 10
+
+static struct hot_item hot_buckets[HOT_MAX_ITEMS], hot_keys[HOT_MAX_ITEMS];
+
+static int hot_cmp_id(const void * a, const void * b) {
+    uint64_t x = ((const struct hot_item *) a)->id, y = ((const struct hot_item *) b)->id;
+    return x < y ? -1 : x > y;
+}
+
+static int hot_cmp_count(const void * a, const void * b) {
+    uint64_t x = ((const struct hot_item *) a)->count, y = ((const struct hot_item *) b)->count;
+    return x > y ? -1 : x < y;
+}
+
+// Sums the counts of equal ids, then sorts by count (descending)
+static int hot_merge(struct hot_item * items, int n) {
+    if(n == 0)
+        return 0;
+
+    qsort(items, n, sizeof(*items), hot_cmp_id);
+    int m = 0;
+    for(int i = 1; i < n; i++) {
+        if(items[i].id == items[m].id)
+            items[m].count += items[i].count;
+        else
+            items[++m] = items[i];
+    }
+    qsort(items, m + 1, sizeof(*items), hot_cmp_count);
+    return m + 1;
+}
+
+/*
+ * Merges the sketches of VM vm (all VMs if vm < 0). Bucket indices are only
+ * merged for sketches of the largest (current) table size.
+ */
+static void print_hot(int vm) {
+    int nb = 0, nk = 0;
+    uint64_t num_buckets = 0, samples[CLHT_HOT_NUM_CAUSES] = { 0 };
+    int from = vm < 0 ? 0 : vm, to = vm < 0 ? CLHT_SHM_MAX_VMS : vm + 1;
+
+    for(int v = from; v < to; v++)
+        for(int t = 0; t < CLHT_STATS_MAX_THREADS; t++)
+            if(CLHT_LOAD(&clht_shm_hot(v, t)->num_buckets, relaxed) > num_buckets)
+                num_buckets = CLHT_LOAD(&clht_shm_hot(v, t)->num_buckets, relaxed);
+
+    for(int v = from; v < to; v++) {
+        for(int t = 0; t < CLHT_STATS_MAX_THREADS; t++) {
+            const clht_hot_thread_t * h = clht_shm_hot(v, t);
+            for(int c = 0; c < CLHT_HOT_NUM_CAUSES; c++)
+                samples[c] += CLHT_LOAD(&h->samples[c], relaxed);
+            for(int i = 0; i < CLHT_HOT_K; i++) {
+                uint64_t count = CLHT_LOAD(&h->key[i].count, relaxed);
+                if(count > 0) {
+                    hot_keys[nk].id = CLHT_LOAD(&h->key[i].id, relaxed);
+                    hot_keys[nk++].count = count;
+                }
+                count = CLHT_LOAD(&h->bucket[i].count, relaxed);
+                if(count > 0 && CLHT_LOAD(&h->num_buckets, relaxed) == num_buckets) {
+                    hot_buckets[nb].id = CLHT_LOAD(&h->bucket[i].id, relaxed);
+                    hot_buckets[nb++].count = count;
+                }
+            }
+        }
+    }
+
+    uint64_t events = (samples[CLHT_HOT_CAS] + samples[CLHT_HOT_SLOW]) * CLHT_HOT_PERIOD;
+    if(events == 0)
+        return;
+
+    nb = hot_merge(hot_buckets, nb);
+    nk = hot_merge(hot_keys, nk);
+
+    if(vm < 0)
+        printf("all VMs");
+    else
+        printf("vm %d", vm);
+    printf(": ~%lu cas retries, ~%lu slow ops (> %d ns) / #bu: %lu\n",
+           samples[CLHT_HOT_CAS] * CLHT_HOT_PERIOD, samples[CLHT_HOT_SLOW] * CLHT_HOT_PERIOD,
+           CLHT_HOT_SLOW_NS, num_buckets);
+    printf("  %4s | %12s %10s %7s | %20s %10s %7s\n", "rank", "bucket", "events", "share%", "key", "events", "share%");
+    for(int i = 0; i < HOT_TOP && (i < nb || i < nk); i++) {
+        printf("  %4d | ", i + 1);
+        if(i < nb)
+            printf("%12lu %10lu %7.2f | ", hot_buckets[i].id, hot_buckets[i].count,
+                   100.0 * hot_buckets[i].count / events);
+        else
+            printf("%12s %10s %7s | ", "", "", "");
+        if(i < nk)
+            printf("%20lu %10lu %7.2f", hot_keys[i].id, hot_keys[i].count, 100.0 * hot_keys[i].count / events);
+        printf("\n");
+    }
+}
+
+static void print_hot_all() {
+    for(int vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            print_hot(vm);
+    print_hot(-1);
+    printf("\n");
+    fflush(stdout);
+}
+
+#define OM_COUNTER(name, help) \
+    printf("# TYPE clht_%s counter\n# HELP clht_%s %s\n", name, name, help)
+#define OM_GAUGE(name, help) \
+    printf("# TYPE clht_%s gauge\n# HELP clht_%s %s\n", name, name, help)
+
+static void print_openmetrics() {
+    int vm;
+
+    OM_COUNTER("ops", "Operations by type and outcome.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++) {
+        struct vm_sample * c = &cur[vm];
+        if(!c->active)
+            continue;
+        printf("clht_ops_total{vm=\"%d\",op=\"get\",result=\"hit\"} %lu\n", vm, c->get_hit);
+        printf("clht_ops_total{vm=\"%d\",op=\"get\",result=\"miss\"} %lu\n", vm, c->get - c->get_hit);
+        printf("clht_ops_total{vm=\"%d\",op=\"put\",result=\"success\"} %lu\n", vm, c->put_suc);
+        printf("clht_ops_total{vm=\"%d\",op=\"put\",result=\"fail\"} %lu\n", vm, c->put - c->put_suc);
+        printf("clht_ops_total{vm=\"%d\",op=\"remove\",result=\"success\"} %lu\n", vm, c->remove_suc);
+        printf("clht_ops_total{vm=\"%d\",op=\"remove\",result=\"fail\"} %lu\n", vm, c->remove - c->remove_suc);
+    }
+
+    OM_COUNTER("cas_retries", "Failed snapshot CAS that restarted an update.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_cas_retries_total{vm=\"%d\"} %lu\n", vm, cur[vm].cas_retries);
+
+    OM_COUNTER("empty_slot_retries", "Puts that found no empty slot in the bucket.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_empty_slot_retries_total{vm=\"%d\"} %lu\n", vm, cur[vm].empty_retries);
+
+    OM_COUNTER("evictions", "Entries evicted by puts into full buckets (cache mode).");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_evictions_total{vm=\"%d\"} %lu\n", vm, cur[vm].evictions);
+
+    OM_COUNTER("cow_saves", "Buckets copied aside for snapshots by their first write.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_cow_saves_total{vm=\"%d\"} %lu\n", vm, cur[vm].cow_saves);
+
+    OM_COUNTER("resizes", "Resizes performed by the VM.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_resizes_total{vm=\"%d\"} %lu\n", vm, cur[vm].resizes);
+
+    OM_COUNTER("resize_seconds", "Time spent resizing.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_resize_seconds_total{vm=\"%d\"} %.9f\n", vm, ticks_to_s(cur[vm].resize_ticks, cur[vm].ticks_per_ns));
+
+    OM_COUNTER("gc_runs", "Garbage collections of old table versions.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_gc_runs_total{vm=\"%d\"} %lu\n", vm, cur[vm].gc_runs);
+
+    OM_COUNTER("gc_collected_tables", "Old table versions freed.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_gc_collected_tables_total{vm=\"%d\"} %lu\n", vm, cur[vm].gc_collected);
+
+    OM_COUNTER("gc_seconds", "Time spent in garbage collection.");
+    for(vm = 0; vm < CLHT_SHM_MAX_VMS; vm++)
+        if(cur[vm].active)
+            printf("clht_gc_seconds_total{vm=\"%d\"} %.9f\n", vm, ticks_to_s(cur[vm].gc_ticks, cur[vm].ticks_per_ns));
+
+    uint64_t buckets;
+    int64_t elems;
+    table_occupancy(&buckets, &elems);
+
+    OM_GAUGE("buckets", "Buckets of the table in use.");
+    printf("clht_buckets %lu\n", buckets);
+    OM_GAUGE("elements", "Estimated number of elements.");
+    printf("clht_elements %ld\n", elems);
+    OM_GAUGE("occupancy_ratio", "Estimated fraction of the slots in use.");
+    printf("clht_occupancy_ratio %f\n", buckets ? (double) elems / (buckets * ENTRIES_PER_BUCKET) : 0);
+    printf("# EOF\n");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    uint64_t interval = 1;
+    int64_t count = -1;
+    bool openmetrics = false;
+    bool hot = false;
+    char c;
+
+    while ((c = getopt (argc, argv, "i:n:oH")) != -1)
+    switch (c)
+      {
+      case 'i':
+        interval = atoll(optarg);
+        break;
+      case 'n':
+        count = atoll(optarg);
+        break;
+      case 'o':
+        openmetrics = true;
+        break;
+      case 'H':
+        hot = true;
+        break;
+      default:
+        printf("Invalid option %c\n", c);
+        usage();
+        return 1;
+      }
+
+    if(interval == 0) {
+        usage();
+        return 1;
+    }
+
+    if(!clht_shm_attach_stats()) {
+        perror("clht_shm_attach_stats");
+        return 1;
+    }
+
+    sample(cur);
+
+    // OpenMetrics and the hot sketches are cumulative: one dump unless -n asks for more
+    if(openmetrics || hot) {
+        if(count < 0)
+            count = 1;
+        while(1) {
+            if(hot)
+                print_hot_all();
+            else
+                print_openmetrics();
+            if(--count == 0)
+                break;
+            sleep(interval);
+            sample(cur);
+        }
+        return 0;
+    }
+
+    while(count < 0 || count-- > 0) {
+        memcpy(prev, cur, sizeof(cur));
+        sleep(interval);
+        sample(cur);
+        print_rates(interval);
+    }
+
+    return 0;
+}